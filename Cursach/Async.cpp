@@ -0,0 +1,47 @@
+﻿#include "Async.h"
+
+namespace async {
+
+    namespace {
+        VOID CALLBACK ResumeCallback(PTP_CALLBACK_INSTANCE, PVOID context) {
+            std::coroutine_handle<>::from_address(context).resume();
+        }
+
+        DWORD WINAPI ResumeWorkItem(PVOID context) {
+            std::coroutine_handle<>::from_address(context).resume();
+            return 0;
+        }
+    }
+
+    ThreadPool::ThreadPool(DWORD minThreads, DWORD maxThreads) {
+        InitializeThreadpoolEnvironment(&env_);
+        pool_ = CreateThreadpool(NULL);
+        if (!pool_) return;
+        SetThreadpoolThreadMaximum(pool_, maxThreads);
+        SetThreadpoolThreadMinimum(pool_, minThreads);
+        cleanup_ = CreateThreadpoolCleanupGroup();
+        SetThreadpoolCallbackPool(&env_, pool_);
+        if (cleanup_) SetThreadpoolCallbackCleanupGroup(&env_, cleanup_, NULL);
+    }
+
+    ThreadPool::~ThreadPool() {
+        if (cleanup_) CloseThreadpoolCleanupGroupMembers(cleanup_, FALSE, NULL);
+        if (cleanup_) CloseThreadpoolCleanupGroup(cleanup_);
+        if (pool_) CloseThreadpool(pool_);
+        DestroyThreadpoolEnvironment(&env_);
+    }
+
+    // Без своего пула - общий пул процесса; продолжение в текущем потоке - только если отказали оба
+    void ThreadPool::Post(std::coroutine_handle<> handle) {
+        if (pool_ && TrySubmitThreadpoolCallback(ResumeCallback, handle.address(), &env_)) return;
+        if (QueueUserWorkItem(ResumeWorkItem, handle.address(), WT_EXECUTEDEFAULT)) return;
+        handle.resume();
+    }
+
+    // Не разрушается: на выходе из процесса запуски могут еще завершаться и продолжаться в пуле
+    ThreadPool& ThreadPool::Default() {
+        static ThreadPool* pool = new ThreadPool(1, kMaxThreads);
+        return *pool;
+    }
+
+} // namespace async
@@ -0,0 +1,171 @@
+﻿#pragma once
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <Windows.h>
+
+// Сопрограммы C++20 поверх пула потоков Windows. Ожидание процесса, таймера или события
+// не занимает поток: сопрограмма приостанавливается и продолжается на пуле, когда
+// объект сработал (RegisterWaitForSingleObject и т.п.).
+//
+//   async::Future<int> RunWithRetry(TaskPtr task) {
+//       int rc = co_await JobExecutor::RunTaskAsync(task);
+//       if (rc != 0) rc = co_await JobExecutor::RunTaskAsync(task);
+//       co_return rc;
+//   }
+//   async::Spawn(Report(task));   // запуск без ожидания результата
+namespace async {
+
+    // Исполнитель продолжений: небольшой частный пул потоков Windows (CreateThreadpool)
+    class ThreadPool {
+    public:
+        ThreadPool(DWORD minThreads, DWORD maxThreads);
+        ~ThreadPool();   // дожидается уже отправленных продолжений
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Продолжает сопрограмму в потоке пула; если пул недоступен - в общем пуле процесса
+        // (QueueUserWorkItem), и лишь если отказал и он - в текущем потоке. Вызывающий из обработчика
+        // ожидания должен учитывать последний случай (см. ExitAwaiter в JobExecutor.cpp).
+        void Post(std::coroutine_handle<> handle);
+
+        // co_await pool.Schedule() - дальнейший код сопрограммы выполняется в пуле
+        auto Schedule() {
+            struct Awaiter {
+                ThreadPool& pool;
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> h) { pool.Post(h); }
+                void await_resume() const noexcept {}
+            };
+            return Awaiter{ *this };
+        }
+
+        // Пул запусков задач. Ожидание процесса потока не занимает, но запуск (CreateProcess,
+        // ответ помощника) и снятие по таймауту или отмене блокируют поток на время вызова -
+        // поэтому предел не по числу процессоров: потоки создаются по мере надобности, до kMaxThreads.
+        static ThreadPool& Default();
+        static constexpr DWORD kMaxThreads = 256;
+
+    private:
+        PTP_POOL pool_ = NULL;
+        PTP_CLEANUP_GROUP cleanup_ = NULL;
+        TP_CALLBACK_ENVIRON env_;
+    };
+
+    template <class T> class Future;
+
+    namespace detail {
+
+        struct PromiseBase {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr error;
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            // По завершении управление сразу переходит к ожидающему (без рекурсии стека)
+            struct FinalAwaiter {
+                bool await_ready() const noexcept { return false; }
+                template <class P>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+                    auto next = h.promise().continuation;
+                    return next ? next : std::noop_coroutine();
+                }
+                void await_resume() const noexcept {}
+            };
+            FinalAwaiter final_suspend() noexcept { return {}; }
+
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        template <class T>
+        struct Promise : PromiseBase {
+            std::optional<T> value;
+            Future<T> get_return_object();
+            void return_value(T v) { value.emplace(std::move(v)); }
+            T Take() {
+                if (error) std::rethrow_exception(error);
+                return std::move(*value);
+            }
+        };
+
+        template <>
+        struct Promise<void> : PromiseBase {
+            Future<void> get_return_object();
+            void return_void() {}
+            void Take() {
+                if (error) std::rethrow_exception(error);
+            }
+        };
+
+        // Сопрограмма-обертка Spawn: стартует сразу и сама освобождает кадр
+        struct Detached {
+            struct promise_type {
+                Detached get_return_object() noexcept { return {}; }
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception() { std::terminate(); }
+            };
+        };
+
+    } // namespace detail
+
+    // Отложенная сопрограмма: тело начинает выполняться при co_await, результат - из co_return.
+    // Владеет кадром; ожидается не больше одного раза.
+    template <class T>
+    class [[nodiscard]] Future {
+    public:
+        using promise_type = detail::Promise<T>;
+        using Handle = std::coroutine_handle<promise_type>;
+
+        Future() = default;
+        explicit Future(Handle h) : handle_(h) {}
+        Future(Future&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+        Future& operator=(Future&& other) noexcept {
+            if (this != &other) {
+                if (handle_) handle_.destroy();
+                handle_ = std::exchange(other.handle_, {});
+            }
+            return *this;
+        }
+        Future(const Future&) = delete;
+        Future& operator=(const Future&) = delete;
+        ~Future() {
+            if (handle_) handle_.destroy();
+        }
+
+        auto operator co_await() && noexcept {
+            struct Awaiter {
+                Handle handle;
+                bool await_ready() const noexcept { return !handle || handle.done(); }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                    handle.promise().continuation = awaiting;
+                    return handle;
+                }
+                T await_resume() { return handle.promise().Take(); }
+            };
+            return Awaiter{ handle_ };
+        }
+
+    private:
+        Handle handle_;
+    };
+
+    namespace detail {
+        template <class T>
+        Future<T> Promise<T>::get_return_object() {
+            return Future<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+        }
+        inline Future<void> Promise<void>::get_return_object() {
+            return Future<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+        }
+    }
+
+    // Запуск без ожидания: сопрограмма выполняется в текущем потоке до первой приостановки,
+    // дальше - там, где ее продолжат. Исключение из нее завершает процесс.
+    inline detail::Detached Spawn(Future<void> future) {
+        co_await std::move(future);
+    }
+
+} // namespace async
@@ -0,0 +1,479 @@
+﻿#include "BulkIO.h"
+#include "TaskManager.h"
+#include "Persistence.h"
+#include "Logger.h"
+#include "Utf8File.h"
+#include "Utils.h"
+#include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cwctype>
+#include <deque>
+#include <future>
+#include <thread>
+
+namespace {
+
+    constexpr size_t kChunkBytes = 4 * 1024 * 1024;
+    constexpr size_t kMaxPrintedErrors = 1000;
+
+    enum class Format { NDJSON, CSV };
+
+    // Колонки CSV: определение задачи без состояния выполнения. Ключи - как в tasks.json:
+    // строка CSV превращается в JSON-объект и разбирается тем же ParseTaskRecord
+    struct CsvColumn {
+        const wchar_t* key;
+        bool text;                          // строковое значение (в JSON - в кавычках)
+        std::wstring (*get)(const Task& t);
+    };
+
+    std::wstring Num(long long v) { return std::to_wstring(v); }
+    std::wstring Bool(bool v) { return v ? L"true" : L"false"; }
+
+    const CsvColumn kCsvColumns[] = {
+        { L"id", true, [](const Task& t) { return std::wstring(t.id); } },
+        { L"name", true, [](const Task& t) { return std::wstring(t.name); } },
+        { L"description", true, [](const Task& t) { return std::wstring(t.description); } },
+        { L"exePath", true, [](const Task& t) { return (std::wstring)t.exePath; } },
+        { L"arguments", true, [](const Task& t) { return (std::wstring)t.arguments; } },
+        { L"workingDirectory", true, [](const Task& t) { return (std::wstring)t.workingDirectory; } },
+        { L"group", true, [](const Task& t) { return t.group; } },
+        { L"enabled", false, [](const Task& t) { return Bool(t.enabled); } },
+        { L"triggerType", false, [](const Task& t) { return Num((int)t.triggerType); } },
+        { L"runOnceTime", false, [](const Task& t) { return Num(t.runOnceTime.time_since_epoch().count()); } },
+        { L"intervalMinutes", false, [](const Task& t) { return Num(t.intervalMinutes); } },
+        { L"dailyHour", false, [](const Task& t) { return Num(t.dailyHour); } },
+        { L"dailyMinute", false, [](const Task& t) { return Num(t.dailyMinute); } },
+        { L"dailySecond", false, [](const Task& t) { return Num(t.dailySecond); } },
+        { L"weeklyDays", false, [](const Task& t) { return Num((long long)t.weeklyDays.to_ulong()); } },
+        { L"weeklyHour", false, [](const Task& t) { return Num(t.weeklyHour); } },
+        { L"weeklyMinute", false, [](const Task& t) { return Num(t.weeklyMinute); } },
+        { L"weeklySecond", false, [](const Task& t) { return Num(t.weeklySecond); } },
+        { L"watchPath", true, [](const Task& t) { return t.watchPath; } },
+        { L"watchPattern", true, [](const Task& t) { return t.watchPattern; } },
+        { L"watchEvents", false, [](const Task& t) { return Num(t.watchEvents); } },
+        { L"watchSubtree", false, [](const Task& t) { return Bool(t.watchSubtree); } },
+        { L"debounceMs", false, [](const Task& t) { return Num(t.debounceMs); } },
+        { L"runIfMissed", false, [](const Task& t) { return Bool(t.runIfMissed); } },
+        { L"hasExecutionTimeout", false, [](const Task& t) { return Bool(t.hasExecutionTimeout); } },
+        { L"executionTimeoutMinutes", false, [](const Task& t) { return Num(t.executionTimeoutMinutes); } },
+        { L"cpuTimeLimitSeconds", false, [](const Task& t) { return Num(t.cpuTimeLimitSeconds); } },
+        { L"memoryLimitMB", false, [](const Task& t) { return Num(t.memoryLimitMB); } },
+        { L"maxProcesses", false, [](const Task& t) { return Num(t.maxProcesses); } },
+        { L"overlapPolicy", false, [](const Task& t) { return Num((int)t.overlapPolicy); } },
+        { L"maxConcurrentInstances", false, [](const Task& t) { return Num(t.maxConcurrentInstances); } },
+        { L"priority", false, [](const Task& t) { return Num((int)t.priority); } },
+        { L"retryMaxAttempts", false, [](const Task& t) { return Num(t.retryMaxAttempts); } },
+        { L"retryDelaySeconds", false, [](const Task& t) { return Num(t.retryDelaySeconds); } },
+        { L"retryMaxDelaySeconds", false, [](const Task& t) { return Num(t.retryMaxDelaySeconds); } },
+        { L"retryExitCodes", true, [](const Task& t) { return t.retryExitCodes; } },
+    };
+
+    const CsvColumn* FindColumn(std::wstring_view key) {
+        for (const auto& c : kCsvColumns)
+            if (key == c.key) return &c;
+        return nullptr;
+    }
+
+    void WriteCsvCell(util::Utf8Writer& out, const std::wstring& v) {
+        if (v.find_first_of(L",\"\r\n") == std::wstring::npos) {
+            out << v;
+            return;
+        }
+        std::wstring quoted = L"\"";
+        for (wchar_t c : v) {
+            if (c == L'"') quoted += L'"';
+            quoted += c;
+        }
+        quoted += L'"';
+        out << quoted;
+    }
+
+    // Ячейки одной записи CSV (RFC 4180). pos - начало записи, на выходе - начало следующей
+    void SplitCsvRecord(std::wstring_view text, size_t& pos, std::vector<std::wstring>& cells) {
+        cells.clear();
+        std::wstring cell;
+        bool quoted = false;
+        for (; pos < text.size(); ++pos) {
+            wchar_t c = text[pos];
+            if (quoted) {
+                if (c != L'"') cell += c;
+                else if (pos + 1 < text.size() && text[pos + 1] == L'"') { cell += L'"'; ++pos; }
+                else quoted = false;
+            }
+            else if (c == L'"') quoted = true;
+            else if (c == L',') { cells.push_back(std::move(cell)); cell.clear(); }
+            else if (c == L'\n') { ++pos; break; }
+            else if (c != L'\r') cell += c;
+        }
+        cells.push_back(std::move(cell));
+    }
+
+    // Пустая строка - задача пригодна к импорту
+    std::wstring ValidateTask(const Task& t) {
+        if (t.name.empty()) return L"name is empty";
+        if (((const std::wstring&)t.exePath).empty()) return L"exePath is empty";
+        if ((int)t.triggerType < 0 || (int)t.triggerType > (int)TriggerType::FILE_WATCH) return L"unknown triggerType";
+        if (t.triggerType == TriggerType::ONCE && t.runOnceTime.time_since_epoch().count() == 0)
+            return L"runOnceTime is not set";
+        if (t.triggerType == TriggerType::INTERVAL && t.intervalMinutes == 0) return L"intervalMinutes must be > 0";
+        if (t.dailyHour > 23 || t.dailyMinute > 59 || t.dailySecond > 59) return L"daily time out of range";
+        if (t.weeklyHour > 23 || t.weeklyMinute > 59 || t.weeklySecond > 59) return L"weekly time out of range";
+        if (t.triggerType == TriggerType::WEEKLY && t.weeklyDays.none()) return L"weeklyDays is empty";
+        if (t.triggerType == TriggerType::FILE_WATCH && t.watchPath.empty()) return L"watchPath is empty";
+        return {};
+    }
+
+    struct Chunk {
+        std::string bytes;      // целые записи
+        uint64_t firstLine = 0; // номер строки файла первой записи (с 1)
+    };
+
+    struct ParsedChunk {
+        std::vector<TaskPtr> tasks;
+        std::vector<std::wstring> errors;
+    };
+
+    // Конец последней целой записи в буфере (за ним - начало следующей) или 0.
+    // NDJSON: перевод строки внутри строк экранирован. CSV: перевод строки вне кавычек;
+    // блок всегда начинается на границе записи, поэтому четность кавычек известна
+    size_t LastRecordEnd(const std::string& buf, Format format) {
+        if (format == Format::NDJSON) {
+            size_t nl = buf.rfind('\n');
+            return nl == std::string::npos ? 0 : nl + 1;
+        }
+        size_t end = 0;
+        bool quoted = false;
+        for (size_t i = 0; i < buf.size(); ++i) {
+            if (buf[i] == '"') quoted = !quoted;
+            else if (buf[i] == '\n' && !quoted) end = i + 1;
+        }
+        return end;
+    }
+
+    TaskPtr ParseJsonRecord(std::wstring_view line, std::wstring& error) {
+        size_t b = line.find_first_not_of(L" \t\r");
+        size_t e = line.find_last_not_of(L" \t\r");
+        if (b == std::wstring_view::npos) return nullptr;
+        std::wstring record(line.substr(b, e - b + 1));
+        if (record.front() != L'{' || record.back() != L'}' || !util::IsValidJsonSimple(record)) {
+            error = L"not a JSON object";
+            return nullptr;
+        }
+        auto t = std::make_shared<Task>();
+        ParseTaskRecord(record, *t);
+        return t;
+    }
+
+    TaskPtr ParseCsvRecord(const std::vector<const CsvColumn*>& columns, const std::vector<std::wstring>& cells,
+        std::wstring& error) {
+        if (cells.size() != columns.size()) {
+            error = L"expected " + std::to_wstring(columns.size()) + L" fields, got " + std::to_wstring(cells.size());
+            return nullptr;
+        }
+        std::wstring record = L"{";
+        for (size_t i = 0; i < cells.size(); ++i) {
+            const std::wstring& v = cells[i];
+            if (!columns[i]->text) {
+                if (v.empty()) continue;   // значение по умолчанию
+                bool number = v.find_first_not_of(L"0123456789", v[0] == L'-' ? 1 : 0) == std::wstring::npos &&
+                    v != L"-";
+                if (!number && v != L"true" && v != L"false") {
+                    error = std::wstring(columns[i]->key) + L": '" + v + L"' is not a number or boolean";
+                    return nullptr;
+                }
+            }
+            if (record.size() > 1) record += L',';
+            record += L'"';
+            record += columns[i]->key;
+            record += L"\":";
+            if (columns[i]->text) record += L"\"" + util::EscapeJSON(v) + L"\"";
+            else record += v;
+        }
+        record += L'}';
+        auto t = std::make_shared<Task>();
+        ParseTaskRecord(record, *t);
+        return t;
+    }
+
+    // Рабочий поток: разбор и проверка одного блока. Состояние выполнения из файла не берется -
+    // оно принадлежит другому хосту (повтор по его таймеру здесь не нужен)
+    ParsedChunk ParseChunk(const Chunk& chunk, Format format, const std::vector<const CsvColumn*>& columns) {
+        ParsedChunk out;
+        std::wstring text = util::FromUtf8(chunk.bytes);
+        std::vector<std::wstring> cells;
+        uint64_t line = chunk.firstLine;
+
+        for (size_t pos = 0; pos < text.size();) {
+            size_t start = pos;
+            std::wstring error;
+            TaskPtr t;
+            if (format == Format::NDJSON) {
+                size_t nl = text.find(L'\n', pos);
+                size_t end = nl == std::wstring::npos ? text.size() : nl;
+                pos = nl == std::wstring::npos ? text.size() : nl + 1;
+                t = ParseJsonRecord(std::wstring_view(text).substr(start, end - start), error);
+            }
+            else {
+                SplitCsvRecord(text, pos, cells);
+                if (!(cells.size() == 1 && cells[0].empty()))
+                    t = ParseCsvRecord(columns, cells, error);
+            }
+
+            if (t && error.empty()) error = ValidateTask(*t);
+            if (!error.empty()) out.errors.push_back(L"line " + std::to_wstring(line) + L": " + error);
+            else if (t) {
+                t->retryAttempt = 0;
+                t->retryAt = {};
+                t->stateSlot = UINT32_MAX;
+                out.tasks.push_back(std::move(t));
+            }
+            line += std::count(text.begin() + start, text.begin() + pos, L'\n');
+        }
+        return out;
+    }
+
+    bool ParseFormat(const std::wstring& value, Format& format) {
+        if (value == L"ndjson") format = Format::NDJSON;
+        else if (value == L"csv") format = Format::CSV;
+        else return false;
+        return true;
+    }
+
+    Format FormatFromPath(const std::wstring& path) {
+        size_t dot = path.find_last_of(L'.');
+        if (dot != std::wstring::npos && _wcsicmp(path.c_str() + dot, L".csv") == 0) return Format::CSV;
+        return Format::NDJSON;
+    }
+
+    long long ElapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // runtime.dat открывает только один процесс (RuntimeState::Open без FILE_SHARE_WRITE):
+    // отказ с ERROR_SHARING_VIOLATION - хранилище ведет запущенный экземпляр
+    bool StoreInUse() {
+        std::wstring path = util::GetAppDataDir() + L"\\runtime.dat";
+        HANDLE h = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (h != INVALID_HANDLE_VALUE) {
+            CloseHandle(h);
+            return false;
+        }
+        return GetLastError() == ERROR_SHARING_VIOLATION;
+    }
+
+    struct ImportCounts {
+        size_t imported = 0, added = 0, updated = 0, failed = 0, printed = 0;
+    };
+
+    // pending - уже прочитанное начало файла (после заголовка CSV), nextLine - его первая строка
+    void ImportStream(util::Utf8Reader& in, std::string pending, uint64_t nextLine, Format format,
+        const std::vector<const CsvColumn*>& columns, size_t batchSize, size_t threads, ImportCounts& n) {
+        TaskManager tm;   // ~TaskManager сохраняет tasks.json - один раз на весь импорт
+        bool eof = false;
+        std::vector<TaskPtr> batch;
+        std::deque<std::future<ParsedChunk>> inflight;
+
+        // Блоки разбираются параллельно, а применяются строго по порядку файла
+        auto consume = [&](ParsedChunk parsed) {
+            for (auto& e : parsed.errors) {
+                ++n.failed;
+                if (n.printed++ < kMaxPrintedErrors) util::PrintToConsole(e + L"\r\n");
+            }
+            for (auto& t : parsed.tasks) {
+                batch.push_back(std::move(t));
+                if (batch.size() >= batchSize) {
+                    tm.ImportBatch(batch, n.added, n.updated);
+                    n.imported += batch.size();
+                    batch.clear();
+                }
+            }
+        };
+
+        while (!eof || !pending.empty()) {
+            if (!eof && in.ReadChunk(pending, kChunkBytes) == 0) eof = true;
+
+            size_t end = eof ? pending.size() : LastRecordEnd(pending, format);
+            if (end == 0 && !eof) continue;   // запись длиннее блока - дочитываем
+
+            Chunk chunk;
+            chunk.bytes.assign(pending, 0, end);
+            pending.erase(0, end);
+            chunk.firstLine = nextLine;
+            nextLine += std::count(chunk.bytes.begin(), chunk.bytes.end(), '\n');
+
+            if (inflight.size() >= threads * 2) {
+                consume(inflight.front().get());
+                inflight.pop_front();
+            }
+            inflight.push_back(std::async(std::launch::async,
+                [format, &columns](Chunk c) { return ParseChunk(c, format, columns); }, std::move(chunk)));
+        }
+        while (!inflight.empty()) {
+            consume(inflight.front().get());
+            inflight.pop_front();
+        }
+        if (!batch.empty()) {
+            tm.ImportBatch(batch, n.added, n.updated);
+            n.imported += batch.size();
+        }
+    }
+
+} // namespace
+
+int RunExportCommand(int argc, wchar_t** argv) {
+    const wchar_t* usage = L"Usage: --export <file> [--format ndjson|csv]\r\n";
+    if (argc < 3) {
+        util::PrintToConsole(usage);
+        return 2;
+    }
+    std::wstring path = argv[2];
+    Format format = FormatFromPath(path);
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::wstring key = argv[i];
+        if (key != L"--format" || !ParseFormat(argv[i + 1], format)) {
+            util::PrintToConsole(L"Bad argument: " + key + L"\r\n" + usage);
+            return 2;
+        }
+    }
+
+    util::Utf8Writer out(path);
+    if (!out.IsOpen()) {
+        util::PrintToConsole(L"Cannot open for writing: " + path + L"\r\n");
+        return 1;
+    }
+
+    if (format == Format::CSV) {
+        bool first = true;
+        for (const auto& c : kCsvColumns) {
+            if (!first) out << ",";
+            out << c.key;
+            first = false;
+        }
+        out << "\r\n";
+    }
+
+    // Только чтение: без TaskManager (он пересохранил бы tasks.json) и runtime.dat.
+    // tasks.json идет запись за записью: в памяти - блок файла и одна задача
+    auto start = std::chrono::steady_clock::now();
+    size_t exported = 0, skipped = 0;
+    Persistence store;
+    bool read = ForEachTaskRecord(store.Path(), [&](std::wstring_view block) {
+        if (!util::IsValidJsonSimple(std::wstring(block))) {
+            ++skipped;
+            return;
+        }
+        Task t;
+        ParseTaskRecord(block, t);
+        if (t.id.empty()) t.id = util::GenerateGUID();
+
+        if (format == Format::NDJSON) {
+            out << "{";
+            WriteTaskJson(out, t, "");
+            out << "}\n";
+        }
+        else {
+            bool first = true;
+            for (const auto& c : kCsvColumns) {
+                if (!first) out << ",";
+                WriteCsvCell(out, c.get(t));
+                first = false;
+            }
+            out << "\r\n";
+        }
+        ++exported;
+    });
+    if (!read) util::PrintToConsole(L"No tasks file or read error: " + store.Path() + L"\r\n");
+
+    if (!out.Close()) {
+        util::PrintToConsole(L"Write failed: " + path + L"\r\n");
+        return 1;
+    }
+
+    std::wstring report = L"Exported " + std::to_wstring(exported) + L" tasks to " + path +
+        (format == Format::CSV ? L" (csv)" : L" (ndjson)") +
+        (skipped ? L", " + std::to_wstring(skipped) + L" malformed record(s) skipped" : std::wstring()) +
+        L" in " + std::to_wstring(ElapsedMs(start)) + L" ms\r\n";
+    util::PrintToConsole(report);
+    g_Logger.Log(skipped ? LogLevel::Warn : LogLevel::Info, L"BulkIO", report.substr(0, report.size() - 2));
+    return skipped ? 1 : 0;
+}
+
+int RunImportCommand(int argc, wchar_t** argv) {
+    const wchar_t* usage = L"Usage: --import <file> [--format ndjson|csv] [--batch N] [--threads N]\r\n";
+    if (argc < 3) {
+        util::PrintToConsole(usage);
+        return 2;
+    }
+    std::wstring path = argv[2];
+    Format format = FormatFromPath(path);
+    size_t batchSize = 10000;
+    size_t threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::wstring key = argv[i];
+        bool ok = true;
+        if (key == L"--format") ok = ParseFormat(argv[i + 1], format);
+        else if (key == L"--batch") batchSize = (size_t)(std::max)(_wtoi(argv[i + 1]), 1);
+        else if (key == L"--threads") threads = (size_t)(std::max)(_wtoi(argv[i + 1]), 1);
+        else ok = false;
+        if (!ok) {
+            util::PrintToConsole(L"Bad argument: " + key + L"\r\n" + usage);
+            return 2;
+        }
+    }
+
+    // Импорт идет через TaskManager: он сохраняет tasks.json и раздает слоты runtime.dat.
+    // При запущенном планировщике его следующее сохранение затерло бы импорт - отказ
+    if (StoreInUse()) {
+        util::PrintToConsole(L"Task store is in use by a running scheduler - close it before --import\r\n");
+        return 1;
+    }
+
+    util::Utf8Reader in(path);
+    if (!in.IsOpen()) {
+        util::PrintToConsole(L"Cannot open: " + path + L"\r\n");
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::string pending;
+    uint64_t nextLine = 1;
+
+    // CSV: заголовок задает колонки, до раздачи блоков
+    std::vector<const CsvColumn*> columns;
+    if (format == Format::CSV) {
+        while (pending.find('\n') == std::string::npos && in.ReadChunk(pending, 64 * 1024) != 0) {}
+        size_t nl = pending.find('\n');
+        std::wstring header = util::FromUtf8(std::string_view(pending).substr(0, nl));
+        pending.erase(0, nl == std::string::npos ? pending.size() : nl + 1);
+        nextLine = 2;
+
+        std::vector<std::wstring> names;
+        size_t pos = 0;
+        SplitCsvRecord(header, pos, names);
+        for (auto& n : names) {
+            const CsvColumn* c = FindColumn(n);
+            if (!c) {
+                util::PrintToConsole(L"line 1: unknown column '" + n + L"'\r\n");
+                return 1;
+            }
+            columns.push_back(c);
+        }
+    }
+
+    ImportCounts n;
+    ImportStream(in, std::move(pending), nextLine, format, columns, batchSize, threads, n);
+
+    if (in.Failed()) util::PrintToConsole(L"Read error: " + path + L"\r\n");
+
+    std::wstring report = L"Imported " + path + L": records=" + std::to_wstring(n.imported) +
+        L" | added=" + std::to_wstring(n.added) + L" | updated=" + std::to_wstring(n.updated) +
+        L" | unchanged=" + std::to_wstring(n.imported - n.added - n.updated) +
+        L" | errors=" + std::to_wstring(n.failed) +
+        (n.printed > kMaxPrintedErrors ? L" (first " + std::to_wstring(kMaxPrintedErrors) + L" shown)" : std::wstring()) +
+        L" | " + std::to_wstring(ElapsedMs(start)) + L" ms\r\n";
+    util::PrintToConsole(report);
+    g_Logger.Log(LogLevel::Info, L"BulkIO", report.substr(0, report.size() - 2));
+    return n.failed || in.Failed() ? 1 : 0;
+}
@@ -0,0 +1,13 @@
+﻿#pragma once
+
+// Потоковый импорт и экспорт задач в NDJSON (одна запись tasks.json на строку) и CSV
+// (заголовок - ключи tasks.json). Файл идет блоками фиксированного размера, без сборки
+// документа в памяти; блоки импорта разбираются и проверяются параллельно, а применяются
+// по порядку пачками через TaskManager::ImportBatch. Ошибки - с номером строки файла.
+//
+// Mini Task Scheduler.exe --export <файл> [--format ndjson|csv]
+// Mini Task Scheduler.exe --import <файл> [--format ndjson|csv] [--batch N] [--threads N]
+// Формат по умолчанию - по расширению (.csv - CSV, иначе NDJSON).
+// Импорт пишет в хранилище и не выполняется, пока планировщик запущен (runtime.dat занят).
+int RunExportCommand(int argc, wchar_t** argv);
+int RunImportCommand(int argc, wchar_t** argv);
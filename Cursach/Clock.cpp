@@ -0,0 +1,36 @@
+#include "Clock.h"
+
+namespace {
+
+    class SystemClock : public Clock {
+    public:
+        time_point Now() const override { return std::chrono::system_clock::now(); }
+    };
+
+} // namespace
+
+const Clock& Clock::System() {
+    static SystemClock instance;
+    return instance;
+}
+
+VirtualClock::VirtualClock(time_point start)
+    : ticks_(start.time_since_epoch().count()) {
+}
+
+Clock::time_point VirtualClock::Now() const {
+    return time_point(std::chrono::system_clock::duration(ticks_.load(std::memory_order_acquire)));
+}
+
+int64_t ToFileTime(Clock::time_point tp) {
+    using namespace std::chrono;
+    const int64_t kEpochDiff = 116444736000000000LL;  // 1601 -> 1970
+    return duration_cast<duration<int64_t, std::ratio<1, 10000000>>>(tp.time_since_epoch()).count() + kEpochDiff;
+}
+
+void VirtualClock::AdvanceTo(time_point tp) {
+    int64_t target = tp.time_since_epoch().count();
+    int64_t cur = ticks_.load(std::memory_order_relaxed);
+    while (cur < target && !ticks_.compare_exchange_weak(cur, target, std::memory_order_release)) {
+    }
+}
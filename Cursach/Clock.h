@@ -0,0 +1,36 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Источник "сейчас" для расписания. Scheduler, TaskManager и JobExecutor берут время
+// только через него: в работе это системные часы, в симуляции - VirtualClock,
+// который двигает Simulator.
+class Clock {
+public:
+    using time_point = std::chrono::system_clock::time_point;
+
+    virtual ~Clock() = default;
+    virtual time_point Now() const = 0;
+    virtual bool IsVirtual() const { return false; }
+
+    static const Clock& System();   // system_clock::now()
+};
+
+// Виртуальное время: стоит на месте, пока его не сдвинут; назад не идет
+class VirtualClock : public Clock {
+public:
+    explicit VirtualClock(time_point start);
+
+    time_point Now() const override;
+    bool IsVirtual() const override { return true; }
+
+    void AdvanceTo(time_point tp);
+
+private:
+    std::atomic<int64_t> ticks_;   // system_clock::duration от эпохи
+};
+
+// Момент в единицах FILETIME (100 нс от 1601-01-01, UTC) - абсолютный срок SetWaitableTimer.
+// Доли меньше 100 нс отбрасываются
+int64_t ToFileTime(Clock::time_point tp);
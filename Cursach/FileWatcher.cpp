@@ -0,0 +1,325 @@
+﻿#include "FileWatcher.h"
+#include "Logger.h"
+#include <Shlwapi.h>
+#include <algorithm>
+
+#pragma comment(lib, "Shlwapi.lib")
+
+// Служебные ключи порта завершения
+static const ULONG_PTR kKeyStop = 0;
+static const ULONG_PTR kKeyRebuild = ~(ULONG_PTR)0;
+
+// Пачка, растянутая непрерывными событиями, все равно выдается не позже этого множителя debounce
+static const ULONGLONG kMaxDebounceFactor = 10;
+
+// Пауза переоткрытия каталога после отказа: от секунды, вдвое за попытку, не больше минуты
+static const DWORD kMinReopenDelayMs = 1000;
+static const DWORD kMaxReopenDelayMs = 60 * 1000;
+
+FileWatcher::FileWatcher(FireFn onFire) : onFire_(std::move(onFire)) {}
+
+FileWatcher::~FileWatcher() {
+    Stop();
+}
+
+void FileWatcher::Start() {
+    if (port_) return;
+    port_ = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (!port_) {
+        g_Logger.Log(LogLevel::Error, L"FileWatcher",
+            L"CreateIoCompletionPort failed (" + std::to_wstring(GetLastError()) + L")");
+        return;
+    }
+    worker_ = std::thread(&FileWatcher::ThreadProc, this);
+}
+
+void FileWatcher::Stop() {
+    if (!port_) return;
+    PostQueuedCompletionStatus(port_, 0, kKeyStop, NULL);
+    if (worker_.joinable()) worker_.join();
+    CloseHandle(port_);
+    port_ = NULL;
+}
+
+void FileWatcher::Sync(const std::vector<TaskPtr>& tasks) {
+    std::vector<WatchSpec> specs;
+    std::wstring signature;
+
+    for (auto& t : tasks) {
+        if (!t->enabled || t->triggerType != TriggerType::FILE_WATCH || t->watchPath.empty()) continue;
+        WatchSpec s;
+        s.taskId = t->id;
+        s.dir = t->watchPath;
+        s.pattern = t->watchPattern.empty() ? L"*" : t->watchPattern;
+        s.events = t->watchEvents;
+        s.subtree = t->watchSubtree;
+        s.debounceMs = t->debounceMs;
+
+        signature += s.taskId + L"|" + s.dir + L"|" + s.pattern + L"|" + std::to_wstring(s.events) +
+            (s.subtree ? L"|1|" : L"|0|") + std::to_wstring(s.debounceMs) + L"\n";
+        specs.push_back(std::move(s));
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (signature == signature_) return;
+        signature_ = std::move(signature);
+        specs_ = std::move(specs);
+    }
+    if (port_) PostQueuedCompletionStatus(port_, 0, kKeyRebuild, NULL);
+}
+
+DWORD FileWatcher::Arm(Watch& w) {
+    DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+        FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+    w.ov = OVERLAPPED{};
+    if (!ReadDirectoryChangesW(w.dirHandle, w.buffer.data(), (DWORD)w.buffer.size(),
+        w.spec.subtree ? TRUE : FALSE, filter, NULL, &w.ov, NULL)) {
+        return GetLastError();
+    }
+    return 0;
+}
+
+ULONG_PTR FileWatcher::NewKey() {
+    ULONG_PTR key = nextKey_++;
+    if (nextKey_ == kKeyRebuild) nextKey_ = 1;
+    return key;
+}
+
+bool FileWatcher::Open(Watch& w, ULONG_PTR key) {
+    w.dirHandle = CreateFileW(w.spec.dir.c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (w.dirHandle == INVALID_HANDLE_VALUE) {
+        ScheduleReopen(w, L"Cannot open directory", GetLastError());
+        return false;
+    }
+
+    DWORD err = CreateIoCompletionPort(w.dirHandle, port_, key, 0) ? Arm(w) : GetLastError();
+    if (err != 0) {
+        CloseHandle(w.dirHandle);
+        w.dirHandle = INVALID_HANDLE_VALUE;
+        ScheduleReopen(w, L"ReadDirectoryChangesW failed", err);
+        return false;
+    }
+
+    w.reopenAtTick = 0;
+    w.reopenDelayMs = 0;
+    return true;
+}
+
+void FileWatcher::ScheduleReopen(Watch& w, const std::wstring& what, DWORD err) {
+    // Первый отказ - ошибка, дальше при каждой попытке - предупреждение (не чаще kMaxReopenDelayMs)
+    LogLevel level = w.reopenDelayMs == 0 ? LogLevel::Error : LogLevel::Warn;
+    w.reopenDelayMs = w.reopenDelayMs == 0 ? kMinReopenDelayMs : (std::min)(w.reopenDelayMs * 2, kMaxReopenDelayMs);
+    w.reopenAtTick = GetTickCount64() + w.reopenDelayMs;
+    g_Logger.Log(level, L"FileWatcher",
+        what + L" (" + std::to_wstring(err) + L") for: " + w.spec.dir +
+        L" | retry in " + std::to_wstring(w.reopenDelayMs) + L" ms");
+}
+
+void FileWatcher::ReopenDue() {
+    ULONGLONG now = GetTickCount64();
+    std::vector<ULONG_PTR> due;
+    for (auto& [key, w] : watches_) {
+        if (w->reopenAtTick && w->reopenAtTick <= now) due.push_back(key);
+    }
+
+    for (ULONG_PTR oldKey : due) {
+        // Новый ключ: пакет, который еще мог прийти от закрытого дескриптора, не спутать с новым
+        std::unique_ptr<Watch> w = std::move(watches_.extract(oldKey).mapped());
+        ULONG_PTR key = NewKey();
+        if (Open(*w, key)) {
+            g_Logger.Log(LogLevel::Info, L"FileWatcher", L"Watching again: " + w->spec.dir);
+            if (w->lost) {
+                // Что менялось, пока чтения не было, неизвестно - как при переполнении, сообщаем каталог
+                if (std::find(w->pending.begin(), w->pending.end(), w->spec.dir) == w->pending.end())
+                    w->pending.push_back(w->spec.dir);
+                Debounce(*w, now);
+                w->lost = false;
+            }
+        }
+        watches_[key] = std::move(w);
+    }
+}
+
+void FileWatcher::CloseWatch(Watch& w) {
+    if (w.dirHandle == INVALID_HANDLE_VALUE) return;
+    // Дожидаемся отмены, чтобы ядро больше не писало в буфер и OVERLAPPED
+    CancelIoEx(w.dirHandle, &w.ov);
+    DWORD n = 0;
+    GetOverlappedResult(w.dirHandle, &w.ov, &n, TRUE);
+    CloseHandle(w.dirHandle);
+    w.dirHandle = INVALID_HANDLE_VALUE;
+}
+
+void FileWatcher::Rebuild() {
+    std::vector<WatchSpec> specs;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        specs = specs_;
+    }
+
+    // Наблюдения с прежними настройками остаются как есть (вместе с паузой переоткрытия),
+    // закрываются только убранные и измененные
+    std::map<std::wstring, const WatchSpec*> wanted;
+    for (auto& spec : specs) wanted[spec.taskId] = &spec;
+
+    // Накопленные, но еще не выданные пути сохраняем для тех же задач
+    std::map<std::wstring, std::vector<std::wstring>> carried;
+    size_t kept = 0;
+    for (auto it = watches_.begin(); it != watches_.end();) {
+        Watch& w = *it->second;
+        auto want = wanted.find(w.spec.taskId);
+        if (want != wanted.end() && *want->second == w.spec) {
+            wanted.erase(want);
+            ++kept;
+            ++it;
+            continue;
+        }
+        if (!w.pending.empty()) carried[w.spec.taskId] = std::move(w.pending);
+        CloseWatch(w);
+        it = watches_.erase(it);
+    }
+
+    for (auto& [taskId, spec] : wanted) {
+        auto w = std::make_unique<Watch>();
+        w->spec = *spec;
+        w->buffer.resize(64 * 1024);
+
+        ULONG_PTR key = NewKey();
+        Open(*w, key);
+
+        auto it = carried.find(taskId);
+        if (it != carried.end()) {
+            w->pending = std::move(it->second);
+            w->firstEventTick = w->fireAtTick = GetTickCount64();
+        }
+        watches_[key] = std::move(w);
+    }
+
+    g_Logger.Log(LogLevel::Info, L"FileWatcher", L"Watching " + std::to_wstring(watches_.size()) +
+        L" folder(s) | reopened " + std::to_wstring(wanted.size()) + L", unchanged " + std::to_wstring(kept));
+}
+
+void FileWatcher::OnCompletion(Watch& w, DWORD bytes) {
+    ULONGLONG now = GetTickCount64();
+    bool matched = false;
+
+    if (bytes == 0) {
+        // Переполнение буфера: конкретные файлы неизвестны, сообщаем каталог
+        g_Logger.Log(LogLevel::Warn, L"FileWatcher", L"Change buffer overflow for: " + w.spec.dir);
+        w.pending.push_back(w.spec.dir);
+        matched = true;
+    }
+
+    for (DWORD offset = 0; bytes > 0;) {
+        auto* info = reinterpret_cast<FILE_NOTIFY_INFORMATION*>(w.buffer.data() + offset);
+        std::wstring rel(info->FileName, info->FileNameLength / sizeof(wchar_t));
+
+        uint32_t ev = 0;
+        switch (info->Action) {
+        case FILE_ACTION_ADDED:            ev = FILE_EVENT_CREATED; break;
+        case FILE_ACTION_MODIFIED:         ev = FILE_EVENT_MODIFIED; break;
+        case FILE_ACTION_REMOVED:          ev = FILE_EVENT_DELETED; break;
+        case FILE_ACTION_RENAMED_NEW_NAME: ev = FILE_EVENT_RENAMED; break;
+        default: break;
+        }
+
+        size_t slash = rel.find_last_of(L"\\/");
+        std::wstring name = (slash == std::wstring::npos) ? rel : rel.substr(slash + 1);
+
+        if ((ev & w.spec.events) && PathMatchSpecExW(name.c_str(), w.spec.pattern.c_str(), PMSF_MULTIPLE) == S_OK) {
+            std::wstring full = w.spec.dir;
+            if (!full.empty() && full.back() != L'\\') full += L'\\';
+            full += rel;
+            // Несколько MODIFIED одного файла - один путь
+            if (std::find(w.pending.begin(), w.pending.end(), full) == w.pending.end())
+                w.pending.push_back(std::move(full));
+            matched = true;
+        }
+
+        if (info->NextEntryOffset == 0) break;
+        offset += info->NextEntryOffset;
+    }
+
+    if (matched) Debounce(w, now);
+
+    if (DWORD err = Arm(w)) {
+        CloseWatch(w);
+        w.lost = true;
+        ScheduleReopen(w, L"ReadDirectoryChangesW failed", err);
+    }
+}
+
+void FileWatcher::Debounce(Watch& w, ULONGLONG now) {
+    if (w.fireAtTick == 0) w.firstEventTick = now;
+    ULONGLONG latest = w.firstEventTick + kMaxDebounceFactor * (std::max)(w.spec.debounceMs, 1u);
+    w.fireAtTick = (std::min)(now + w.spec.debounceMs, latest);
+}
+
+DWORD FileWatcher::NextTimeoutMs() const {
+    ULONGLONG now = GetTickCount64();
+    ULONGLONG next = 0;
+    for (auto& [key, w] : watches_) {
+        if (w->fireAtTick && (next == 0 || w->fireAtTick < next)) next = w->fireAtTick;
+        if (w->reopenAtTick && (next == 0 || w->reopenAtTick < next)) next = w->reopenAtTick;
+    }
+    if (next == 0) return INFINITE;
+    return next <= now ? 0 : (DWORD)(next - now);
+}
+
+void FileWatcher::FireDue() {
+    ULONGLONG now = GetTickCount64();
+    for (auto& [key, w] : watches_) {
+        if (!w->fireAtTick || w->fireAtTick > now) continue;
+        std::vector<std::wstring> paths = std::move(w->pending);
+        w->pending.clear();
+        w->fireAtTick = 0;
+        g_Logger.Log(LogLevel::Info, L"FileWatcher",
+            L"Trigger for task id=" + w->spec.taskId + L" | files=" + std::to_wstring(paths.size()));
+        if (onFire_) onFire_(w->spec.taskId, std::move(paths));
+    }
+}
+
+void FileWatcher::ThreadProc() {
+    while (true) {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        LPOVERLAPPED ov = NULL;
+        BOOL ok = GetQueuedCompletionStatus(port_, &bytes, &key, &ov, NextTimeoutMs());
+
+        if (!ok && ov == NULL) {
+            // Таймаут debounce или паузы переоткрытия
+            ReopenDue();
+            FireDue();
+            continue;
+        }
+
+        if (ov == NULL && key == kKeyStop) break;
+        if (ov == NULL && key == kKeyRebuild) {
+            Rebuild();
+            continue;
+        }
+
+        auto it = watches_.find(key);
+        if (it != watches_.end() && ok) {
+            OnCompletion(*it->second, bytes);
+        }
+        else if (it != watches_.end()) {
+            // Каталог удален, сеть отвалилась и т.п.: дескриптор больше не годится, открываем заново
+            DWORD err = GetLastError();
+            if (err != ERROR_OPERATION_ABORTED) {
+                Watch& w = *it->second;
+                CloseWatch(w);
+                w.lost = true;
+                ScheduleReopen(w, L"Watch failed", err);
+            }
+        }
+        ReopenDue();
+        FireDue();
+    }
+
+    for (auto& [key, w] : watches_) CloseWatch(*w);
+    watches_.clear();
+}
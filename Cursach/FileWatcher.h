@@ -0,0 +1,83 @@
+﻿#pragma once
+#include "Task.h"
+#include <Windows.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+/// FileWatcher.h
+/// Наблюдение за каталогами задач FILE_WATCH через ReadDirectoryChangesW и
+/// порт завершения ввода-вывода (один поток на все каталоги). Подходящие
+/// события копятся по задаче и выдаются одним вызовом onFire после debounceMs тишины.
+/// Каталог, который не открылся или чье чтение завершилось ошибкой, переоткрывается
+/// с нарастающей паузой.
+class FileWatcher {
+public:
+    using FireFn = std::function<void(const std::wstring& taskId, std::vector<std::wstring> paths)>;
+
+    explicit FileWatcher(FireFn onFire);
+    ~FileWatcher();
+
+    void Start();
+    void Stop();
+
+    // Переоткрываются только наблюдения задач, чьи настройки изменились
+    void Sync(const std::vector<TaskPtr>& tasks);
+
+private:
+    struct WatchSpec {
+        std::wstring taskId;
+        std::wstring dir;
+        std::wstring pattern;
+        uint32_t events = 0;
+        bool subtree = false;
+        uint32_t debounceMs = 0;
+
+        bool operator==(const WatchSpec& o) const {
+            return taskId == o.taskId && dir == o.dir && pattern == o.pattern && events == o.events &&
+                subtree == o.subtree && debounceMs == o.debounceMs;
+        }
+    };
+    struct Watch {
+        WatchSpec spec;
+        HANDLE dirHandle = INVALID_HANDLE_VALUE;
+        OVERLAPPED ov{};
+        std::vector<BYTE> buffer;
+        std::vector<std::wstring> pending;  // пути, накопленные до срабатывания
+        ULONGLONG firstEventTick = 0;
+        ULONGLONG fireAtTick = 0;           // 0 - ничего не ждем
+        ULONGLONG reopenAtTick = 0;         // 0 - каталог открыт (или не нужен)
+        DWORD reopenDelayMs = 0;            // пауза до следующей попытки, растет вдвое
+        bool lost = false;                  // чтение уже шло и оборвалось: события могли пропасть
+    };
+
+    void ThreadProc();
+    void Rebuild();
+    DWORD Arm(Watch& w);                    // 0 - чтение запущено, иначе код ошибки
+    bool Open(Watch& w, ULONG_PTR key);     // false - переоткрытие запланировано
+    void ScheduleReopen(Watch& w, const std::wstring& what, DWORD err);
+    void ReopenDue();
+    ULONG_PTR NewKey();
+    void OnCompletion(Watch& w, DWORD bytes);
+    void Debounce(Watch& w, ULONGLONG now);
+    void CloseWatch(Watch& w);
+    DWORD NextTimeoutMs() const;
+    void FireDue();
+
+    FireFn onFire_;
+    HANDLE port_ = NULL;
+    std::thread worker_;
+
+    std::mutex mtx_;                        // защищает specs_/signature_
+    std::vector<WatchSpec> specs_;
+    std::wstring signature_;
+
+    // Только поток наблюдателя; ключ завершения - серийный номер, пакеты
+    // от закрытых наблюдений с устаревшим номером игнорируются
+    std::map<ULONG_PTR, std::unique_ptr<Watch>> watches_;
+    ULONG_PTR nextKey_ = 1;
+};
@@ -1,8 +1,12 @@
 ﻿#include "JobExecutor.h"
+#include "Launcher.h"
+#include "Latency.h"
 #include "Logger.h"
+#include "Trace.h"
 #include "Utils.h"
 #include <Windows.h>
 #include <TlHelp32.h>
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -70,150 +74,490 @@ static bool KillProcessesByName(const std::wstring& exePath) {
     return killedCount > 0;
 }
 
-int JobExecutor::RunTask(const TaskPtr& task) {
-    if (!task) return -1;
-    
-    g_Logger.Log(LogLevel::Info, L"JobExecutor", L"Starting task: " + task->name);
+// Создает Job Object с лимитами задачи. Возвращает NULL, если создать не удалось.
+// KILL_ON_JOB_CLOSE не ставим: single-instance приложения должны переживать закрытие handle.
+static HANDLE CreateLimitedJob(const TaskPtr& task) {
+    HANDLE job = CreateJobObjectW(NULL, NULL);
+    if (!job) {
+        g_Logger.Log(LogLevel::Warn, L"JobExecutor",
+            L"CreateJobObject failed (" + std::to_wstring(GetLastError()) + L") for task: " + std::wstring(task->name));
+        return NULL;
+    }
+
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION info{};
+    DWORD flags = 0;
+
+    if (task->cpuTimeLimitSeconds > 0) {
+        // Единицы - 100 нс
+        info.BasicLimitInformation.PerJobUserTimeLimit.QuadPart =
+            (LONGLONG)task->cpuTimeLimitSeconds * 10000000LL;
+        flags |= JOB_OBJECT_LIMIT_JOB_TIME;
+    }
+    if (task->memoryLimitMB > 0) {
+        info.ProcessMemoryLimit = (SIZE_T)task->memoryLimitMB * 1024 * 1024;
+        flags |= JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+    }
+    if (task->maxProcesses > 0) {
+        info.BasicLimitInformation.ActiveProcessLimit = task->maxProcesses;
+        flags |= JOB_OBJECT_LIMIT_ACTIVE_PROCESS;
+    }
+
+    if (flags != 0) {
+        info.BasicLimitInformation.LimitFlags = flags;
+        if (!SetInformationJobObject(job, JobObjectExtendedLimitInformation, &info, sizeof(info))) {
+            g_Logger.Log(LogLevel::Warn, L"JobExecutor",
+                L"SetInformationJobObject failed (" + std::to_wstring(GetLastError()) +
+                L") for task: " + std::wstring(task->name) + L" - running without limits");
+        }
+        else {
+            g_Logger.Log(LogLevel::Info, L"JobExecutor",
+                L"Task '" + std::wstring(task->name) + L"' limits: cpuSec=" + std::to_wstring(task->cpuTimeLimitSeconds) +
+                L" memMB=" + std::to_wstring(task->memoryLimitMB) +
+                L" maxProc=" + std::to_wstring(task->maxProcesses));
+        }
+    }
+
+    return job;
+}
+
+// Снимает учет ресурсов: из Job Object, если он есть, иначе только CPU процесса.
+static void CollectRunStats(HANDLE job, HANDLE process, RunStats& stats) {
+    stats = RunStats{};
+
+    if (job) {
+        JOBOBJECT_BASIC_AND_IO_ACCOUNTING_INFORMATION acc{};
+        if (QueryInformationJobObject(job, JobObjectBasicAndIoAccountingInformation, &acc, sizeof(acc), NULL)) {
+            stats.userTimeMs = (uint64_t)acc.BasicInfo.TotalUserTime.QuadPart / 10000;
+            stats.kernelTimeMs = (uint64_t)acc.BasicInfo.TotalKernelTime.QuadPart / 10000;
+            stats.readOps = acc.IoInfo.ReadOperationCount;
+            stats.writeOps = acc.IoInfo.WriteOperationCount;
+            stats.readBytes = acc.IoInfo.ReadTransferCount;
+            stats.writeBytes = acc.IoInfo.WriteTransferCount;
+        }
+
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION ext{};
+        if (QueryInformationJobObject(job, JobObjectExtendedLimitInformation, &ext, sizeof(ext), NULL)) {
+            stats.peakMemoryKB = (uint64_t)ext.PeakProcessMemoryUsed / 1024;
+        }
+        return;
+    }
+
+    FILETIME ftCreate, ftExit, ftKernel, ftUser;
+    if (GetProcessTimes(process, &ftCreate, &ftExit, &ftKernel, &ftUser)) {
+        stats.userTimeMs = (((uint64_t)ftUser.dwHighDateTime << 32) | ftUser.dwLowDateTime) / 10000;
+        stats.kernelTimeMs = (((uint64_t)ftKernel.dwHighDateTime << 32) | ftKernel.dwLowDateTime) / 10000;
+    }
+}
+
+// Ожидание завершения процесса с учетом события отмены.
+// WAIT_OBJECT_0 - процесс завершился, WAIT_OBJECT_0 + 1 - запрошена отмена.
+static DWORD WaitForExit(HANDLE process, HANDLE cancelEvent, DWORD timeoutMs) {
+    if (!cancelEvent) return WaitForSingleObject(process, timeoutMs);
+    HANDLE handles[2] = { process, cancelEvent };
+    return WaitForMultipleObjects(2, handles, FALSE, timeoutMs);
+}
+
+static void CancelRun(const TaskPtr& task, HANDLE job, const PROCESS_INFORMATION& pi) {
+    trace::Span span("kill", "job");
+    span.Arg(task->id);
+    g_Logger.Log(LogLevel::Warn, L"JobExecutor",
+        L"Run of task '" + std::wstring(task->name) + L"' cancelled | PID=" + std::to_wstring(pi.dwProcessId));
+    if (job) TerminateJobObject(job, JobExecutor::kCancelledExitCode);
+    TerminateProcess(pi.hProcess, JobExecutor::kCancelledExitCode);
+    WaitForSingleObject(pi.hProcess, 5000);
+}
+
+// Блок окружения текущего процесса + MTS_TRIGGER_FILES (символ '|' недопустим в путях Windows)
+static std::vector<wchar_t> BuildTriggerEnvironment(const std::vector<std::wstring>& paths) {
+    static const std::wstring kVar = L"MTS_TRIGGER_FILES=";
+    std::vector<wchar_t> env;
+
+    LPWCH block = GetEnvironmentStringsW();
+    if (block) {
+        for (const wchar_t* p = block; *p; p += wcslen(p) + 1) {
+            if (_wcsnicmp(p, kVar.c_str(), kVar.size()) == 0) continue;
+            env.insert(env.end(), p, p + wcslen(p) + 1);
+        }
+        FreeEnvironmentStringsW(block);
+    }
+
+    std::wstring var = kVar;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (i) var += L'|';
+        var += paths[i];
+    }
+    env.insert(env.end(), var.begin(), var.end());
+    env.push_back(L'\0');
+    env.push_back(L'\0');
+    return env;
+}
+
+// Процесс задачи между StartRun и FinishRun
+struct StartedRun {
+    TaskPtr task;
+    HANDLE job = NULL;
+    PROCESS_INFORMATION pi{};
+    DWORD timeoutMs = INFINITE;
+};
+
+// Создает процесс задачи (с лимитами Job Object) и возобновляет его поток.
+// false - процесс не создан или не возобновлен (тогда он завершен), код результата запуска в failCode.
+static bool StartRun(const TaskPtr& task, const std::vector<std::wstring>* triggerPaths,
+    StartedRun& run, int& failCode) {
+    LogTaskScope logScope(task->id);
+
+    g_Logger.Log(LogLevel::Info, L"JobExecutor", L"Starting task: " + std::wstring(task->name));
     
     if (task->hasExecutionTimeout) {
         g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-            L"Task '" + task->name + L"' has timeout: " + 
+            L"Task '" + std::wstring(task->name) + L"' has timeout: " + 
             std::to_wstring(task->executionTimeoutMinutes) + L" minutes");
     } else {
         g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-            L"Task '" + task->name + L"' has NO timeout (will wait indefinitely)");
+            L"Task '" + std::wstring(task->name) + L"' has NO timeout (will wait indefinitely)");
     }
     
     std::wstring commandLine;
     if (!task->exePath.empty()) {
-        commandLine = L"\"" + task->exePath + L"\"";
+        commandLine = L"\"" + task->exePath.str() + L"\"";
         if (!task->arguments.empty()) {
-            commandLine += L" " + task->arguments;
+            commandLine += L" " + task->arguments.str();
         }
     }
     else {
-        g_Logger.Log(LogLevel::Error, L"JobExecutor", L"No executable specified for task: " + task->name);
-        return -1;
+        g_Logger.Log(LogLevel::Error, L"JobExecutor", L"No executable specified for task: " + std::wstring(task->name));
+        failCode = -1;
+        return false;
     }
 
     STARTUPINFOW si{};
     PROCESS_INFORMATION pi{};
     si.cb = sizeof(si);
 
-    BOOL res = CreateProcessW(
-        NULL,
-        const_cast<LPWSTR>(commandLine.c_str()),
-        NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL,
-        task->workingDirectory.empty() ? NULL : task->workingDirectory.c_str(),
-        &si, &pi
-    );
+    HANDLE job = CreateLimitedJob(task);
+
+    std::vector<wchar_t> env;
+    DWORD flags = CREATE_NO_WINDOW | CREATE_SUSPENDED;
+    if (triggerPaths) {
+        env = BuildTriggerEnvironment(*triggerPaths);
+        flags |= CREATE_UNICODE_ENVIRONMENT;
+        g_Logger.Log(LogLevel::Info, L"JobExecutor",
+            L"Task '" + std::wstring(task->name) + L"' triggered by " + std::to_wstring(triggerPaths->size()) + L" file(s)");
+    }
+
+    // Процесс создается приостановленным, чтобы лимиты действовали с первой инструкции.
+    // Через процесс-помощник, если он запущен; иначе (или если он не ответил) - напрямую.
+    const wchar_t* cwd = task->workingDirectory.empty() ? NULL : task->workingDirectory.c_str();
+    DWORD err = 0;
+    BOOL res;
+    {
+        trace::Span span("spawn", "job");
+        span.Arg(task->id);
+        if (g_Launcher.Spawn(commandLine, cwd, flags, env.empty() ? nullptr : &env, pi, err)) {
+            res = (err == 0);
+        }
+        else {
+            res = CreateProcessW(
+                NULL,
+                const_cast<LPWSTR>(commandLine.c_str()),
+                NULL, NULL, FALSE, flags, env.empty() ? NULL : env.data(),
+                cwd,
+                &si, &pi
+            );
+            if (!res) err = GetLastError();
+        }
+    }
 
     if (!res) {
-        DWORD err = GetLastError();
         g_Logger.Log(LogLevel::Error, L"JobExecutor", 
-            L"CreateProcess failed (" + std::to_wstring(err) + L") for task: " + task->name);
-        return -static_cast<int>(err);
+            L"CreateProcess failed (" + std::to_wstring(err) + L") for task: " + std::wstring(task->name));
+        if (job) CloseHandle(job);
+        failCode = -static_cast<int>(err);
+        return false;
+    }
+
+    if (job && !AssignProcessToJobObject(job, pi.hProcess)) {
+        g_Logger.Log(LogLevel::Warn, L"JobExecutor",
+            L"AssignProcessToJobObject failed (" + std::to_wstring(GetLastError()) +
+            L") for task: " + std::wstring(task->name) + L" - limits and accounting disabled");
+        CloseHandle(job);
+        job = NULL;
+    }
+
+    // Не возобновленный процесс так и висел бы приостановленным до таймаута (или вечно)
+    if (ResumeThread(pi.hThread) == (DWORD)-1) {
+        err = GetLastError();
+        g_Logger.Log(LogLevel::Error, L"JobExecutor",
+            L"ResumeThread failed (" + std::to_wstring(err) + L") for task: " + std::wstring(task->name) +
+            L" | PID=" + std::to_wstring(pi.dwProcessId) + L" - process terminated");
+        if (job) TerminateJobObject(job, 1);
+        TerminateProcess(pi.hProcess, 1);
+        CloseHandle(pi.hThread);
+        CloseHandle(pi.hProcess);
+        if (job) CloseHandle(job);
+        failCode = -static_cast<int>(err);
+        return false;
     }
 
     g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-        L"Process created successfully for task: " + task->name + 
+        L"Process created successfully for task: " + std::wstring(task->name) + 
         L" | PID=" + std::to_wstring(pi.dwProcessId));
 
-    DWORD exitCode = 0;
-    DWORD waitRes = 0;
+    run.task = task;
+    run.job = job;
+    run.pi = pi;
 
     if (task->hasExecutionTimeout && task->executionTimeoutMinutes > 0) {
-        DWORD timeoutMs = task->executionTimeoutMinutes * 60 * 1000;
+        run.timeoutMs = task->executionTimeoutMinutes * 60 * 1000;
         
         g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-            L"Waiting for task '" + task->name + L"' with timeout: " + 
+            L"Waiting for task '" + std::wstring(task->name) + L"' with timeout: " + 
             std::to_wstring(task->executionTimeoutMinutes) + L" minutes (" + 
-            std::to_wstring(timeoutMs) + L" ms)");
+            std::to_wstring(run.timeoutMs) + L" ms)");
+    }
+    else {
+        g_Logger.Log(LogLevel::Info, L"JobExecutor", 
+            L"Waiting for task '" + std::wstring(task->name) + L"' without timeout (INFINITE)");
+    }
+    return true;
+}
+
+// Разбор результата ожидания (как у WaitForExit): отмена, таймаут или код выхода;
+// учет ресурсов, закрытие handle и поля запуска в задаче
+static int FinishRun(StartedRun& run, DWORD waitRes, const Clock& clock) {
+    const TaskPtr& task = run.task;
+    const PROCESS_INFORMATION& pi = run.pi;
+    HANDLE job = run.job;
+    LogTaskScope logScope(task->id);
+
+    DWORD exitCode = 0;
+
+    if (waitRes == WAIT_OBJECT_0 + 1) {
+        CancelRun(task, job, pi);
+        exitCode = JobExecutor::kCancelledExitCode;
+    }
+    else if (waitRes == WAIT_TIMEOUT) {
+        trace::Span timeoutSpan("timeout", "job");
+        timeoutSpan.Arg(task->id);
+        g_Logger.Log(LogLevel::Warn, L"JobExecutor", 
+            L"⏱️ TIMEOUT! Task '" + std::wstring(task->name) + L"' exceeded " + 
+            std::to_wstring(task->executionTimeoutMinutes) + L" minutes");
+        
+        // ← ИЗМЕНЕНО: Сначала пытаемся убить исходный процесс (вместе с его потомками в job)
+        trace::Span killSpan("kill", "job");
+        killSpan.Arg(task->id);
+        if (job) TerminateJobObject(job, 999);
+        BOOL terminated = TerminateProcess(pi.hProcess, 999);
+        if (terminated) {
+            g_Logger.Log(LogLevel::Info, L"JobExecutor", 
+                L"✓ TerminateProcess succeeded for PID=" + std::to_wstring(pi.dwProcessId));
+        } else {
+            DWORD err = GetLastError();
+            g_Logger.Log(LogLevel::Warn, L"JobExecutor", 
+                L"✗ TerminateProcess FAILED (" + std::to_wstring(err) + 
+                L") for PID=" + std::to_wstring(pi.dwProcessId));
+        }
         
-        waitRes = WaitForSingleObject(pi.hProcess, timeoutMs);
+        // ← ДОБАВЛЕНО: Убиваем ВСЕ процессы с таким именем (для Telegram, Chrome и т.д.)
+        g_Logger.Log(LogLevel::Info, L"JobExecutor", 
+            L"Attempting to kill all processes with executable name: " + task->exePath.str());
         
-        if (waitRes == WAIT_TIMEOUT) {
+        bool killedByName = KillProcessesByName(task->exePath);
+        
+        if (killedByName) {
+            g_Logger.Log(LogLevel::Info, L"JobExecutor", 
+                L"✓ Successfully killed processes by name");
+        } else {
             g_Logger.Log(LogLevel::Warn, L"JobExecutor", 
-                L"⏱️ TIMEOUT! Task '" + task->name + L"' exceeded " + 
-                std::to_wstring(task->executionTimeoutMinutes) + L" minutes");
-            
-            // ← ИЗМЕНЕНО: Сначала пытаемся убить исходный процесс
-            BOOL terminated = TerminateProcess(pi.hProcess, 999);
-            if (terminated) {
-                g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-                    L"✓ TerminateProcess succeeded for PID=" + std::to_wstring(pi.dwProcessId));
-            } else {
-                DWORD err = GetLastError();
-                g_Logger.Log(LogLevel::Warn, L"JobExecutor", 
-                    L"✗ TerminateProcess FAILED (" + std::to_wstring(err) + 
-                    L") for PID=" + std::to_wstring(pi.dwProcessId));
-            }
-            
-            // ← ДОБАВЛЕНО: Убиваем ВСЕ процессы с таким именем (для Telegram, Chrome и т.д.)
+                L"⚠ No additional processes found to kill");
+        }
+        
+        WaitForSingleObject(pi.hProcess, 5000);
+        exitCode = 999;
+    }
+    else if (waitRes == WAIT_OBJECT_0) {
+        if (!GetExitCodeProcess(pi.hProcess, &exitCode)) {
+            g_Logger.Log(LogLevel::Warn, L"JobExecutor", 
+                L"GetExitCodeProcess failed for task: " + std::wstring(task->name));
+        }
+        else if (run.timeoutMs != INFINITE) {
             g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-                L"Attempting to kill all processes with executable name: " + task->exePath);
-            
-            bool killedByName = KillProcessesByName(task->exePath);
+                L"Task '" + std::wstring(task->name) + L"' finished normally with exitCode=" + std::to_wstring(exitCode));
             
-            if (killedByName) {
-                g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-                    L"✓ Successfully killed processes by name");
-            } else {
-                g_Logger.Log(LogLevel::Warn, L"JobExecutor", 
-                    L"⚠ No additional processes found to kill");
-            }
-            
-            WaitForSingleObject(pi.hProcess, 5000);
-            exitCode = 999;
-        }
-        else if (waitRes == WAIT_OBJECT_0) {
-            if (!GetExitCodeProcess(pi.hProcess, &exitCode)) {
+            // ← ДОБАВЛЕНО: Проверка быстрого завершения (признак "single instance" приложения)
+            if (exitCode == 0) {
+                // Процесс завершился мгновенно - возможно это single-instance приложение
                 g_Logger.Log(LogLevel::Warn, L"JobExecutor", 
-                    L"GetExitCodeProcess failed for task: " + task->name);
-            } else {
+                    L"⚠ Process exited immediately (exitCode=0) - likely a single-instance app like Telegram/Chrome");
                 g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-                    L"Task '" + task->name + L"' finished normally with exitCode=" + std::to_wstring(exitCode));
-                
-                // ← ДОБАВЛЕНО: Проверка быстрого завершения (признак "single instance" приложения)
-                DWORD elapsed = GetTickCount() - GetTickCount();  // В реальности нужен timestamp
-                if (exitCode == 0 && waitRes == WAIT_OBJECT_0) {
-                    // Процесс завершился мгновенно - возможно это single-instance приложение
-                    g_Logger.Log(LogLevel::Warn, L"JobExecutor", 
-                        L"⚠ Process exited immediately (exitCode=0) - likely a single-instance app like Telegram/Chrome");
-                    g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-                        L"Note: Timeout will still work for killing the actual running instance");
-                }
+                    L"Note: Timeout will still work for killing the actual running instance");
             }
         }
         else {
-            g_Logger.Log(LogLevel::Error, L"JobExecutor", 
-                L"WaitForSingleObject failed (result=" + std::to_wstring(waitRes) + L") for task: " + task->name);
-            exitCode = 0xFFFFFFFF;
+            g_Logger.Log(LogLevel::Info, L"JobExecutor", 
+                L"Task '" + std::wstring(task->name) + L"' finished with exitCode=" + std::to_wstring(exitCode));
         }
     }
     else {
-        g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-            L"Waiting for task '" + task->name + L"' without timeout (INFINITE)");
-        
-        waitRes = WaitForSingleObject(pi.hProcess, INFINITE);
-        
-        if (!GetExitCodeProcess(pi.hProcess, &exitCode)) {
-            g_Logger.Log(LogLevel::Warn, L"JobExecutor", 
-                L"GetExitCodeProcess failed for task: " + task->name);
-        } else {
-            g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-                L"Task '" + task->name + L"' finished with exitCode=" + std::to_wstring(exitCode));
-        }
+        g_Logger.Log(LogLevel::Error, L"JobExecutor", 
+            L"WaitForSingleObject failed (result=" + std::to_wstring(waitRes) + L") for task: " + std::wstring(task->name));
+        exitCode = 0xFFFFFFFF;
     }
 
+    RunStats stats;
+    CollectRunStats(job, pi.hProcess, stats);
+
+    if (job) CloseHandle(job);
     CloseHandle(pi.hProcess);
     CloseHandle(pi.hThread);
 
     task->lastExitCode = (int)exitCode;
-    task->lastRunTime = std::chrono::system_clock::now();
+    task->lastRunStats = stats;
+    task->lastRunTime = clock.Now();
     
     g_Logger.Log(LogLevel::Info, L"JobExecutor", 
-        L"Task '" + task->name + L"' execution completed. Final exitCode=" + std::to_wstring(exitCode));
+        L"Task '" + std::wstring(task->name) + L"' execution completed. Final exitCode=" + std::to_wstring(exitCode));
+    g_Logger.Log(LogLevel::Info, L"JobExecutor",
+        L"Task '" + std::wstring(task->name) + L"' usage: user=" + std::to_wstring(stats.userTimeMs) +
+        L"ms sys=" + std::to_wstring(stats.kernelTimeMs) +
+        L"ms peakMem=" + std::to_wstring(stats.peakMemoryKB) +
+        L"KB read=" + std::to_wstring(stats.readBytes) + L"B/" + std::to_wstring(stats.readOps) +
+        L" write=" + std::to_wstring(stats.writeBytes) + L"B/" + std::to_wstring(stats.writeOps));
     
     return (int)exitCode;
-}
\ No newline at end of file
+}
+
+int JobExecutor::RunTask(const TaskPtr& task, HANDLE cancelEvent, const std::vector<std::wstring>* triggerPaths,
+    const Clock& clock) {
+    if (!task) return -1;
+    LATENCY_SCOPE("JobExecutor::RunTask");
+
+    // Все строки запуска (включая CreateLimitedJob, CancelRun) - с полем [task=<id>]
+    LogTaskScope logScope(task->id);
+    trace::Span runSpan("RunTask", "job");
+    runSpan.Arg(task->id);
+
+    StartedRun run;
+    int failCode = 0;
+    if (!StartRun(task, triggerPaths, run, failCode)) return failCode;
+
+    DWORD waitRes;
+    {
+        trace::Span span("wait", "job");
+        span.Arg(task->id);
+        waitRes = WaitForExit(run.pi.hProcess, cancelEvent, run.timeoutMs);
+    }
+    return FinishRun(run, waitRes, clock);
+}
+
+namespace {
+
+    // Ожидание процесса без потока: RegisterWaitForSingleObject на процесс (с таймаутом
+    // задачи) и на событие отмены. Первое сработавшее дает результат в духе WaitForExit,
+    // сопрограмма продолжается в пуле. Продолжение отправляется, только когда сработало
+    // ожидание И await_suspend закончил регистрацию (pending_ = 2).
+    class ExitAwaiter {
+    public:
+        ExitAwaiter(HANDLE process, HANDLE cancelEvent, DWORD timeoutMs, async::ThreadPool& pool)
+            : process_(process), cancelEvent_(cancelEvent), timeoutMs_(timeoutMs), pool_(pool) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> h) {
+            handle_ = h;
+            if (!RegisterWaitForSingleObject(&processWait_, process_, OnProcess, this, timeoutMs_,
+                WT_EXECUTEONLYONCE)) {
+                g_Logger.Log(LogLevel::Warn, L"JobExecutor",
+                    L"RegisterWaitForSingleObject failed (" + std::to_wstring(GetLastError()) +
+                    L") - waiting on the calling thread");
+                processWait_ = NULL;
+                result_ = WaitForExit(process_, cancelEvent_, timeoutMs_);
+                return false;
+            }
+            if (cancelEvent_ && !RegisterWaitForSingleObject(&cancelWait_, cancelEvent_, OnCancel, this, INFINITE,
+                WT_EXECUTEONLYONCE)) {
+                g_Logger.Log(LogLevel::Warn, L"JobExecutor",
+                    L"RegisterWaitForSingleObject failed (" + std::to_wstring(GetLastError()) +
+                    L") for cancel event - run cannot be cancelled");
+                cancelWait_ = NULL;
+            }
+            Release();   // после этого this может быть уже продолжен в пуле
+            return true;
+        }
+
+        DWORD await_resume() {
+            // Дожидается и проигравшего обработчика: после этого к this никто не обращается.
+            // Если Post не смог отправить продолжение в пул, оно идет прямо в обработчике -
+            // его собственное ожидание снимается без ожидания (иначе UnregisterWaitEx ждет сам себя);
+            // после Release обработчик к this уже не обращается
+            const bool inCallback = firingThread_ == GetCurrentThreadId();
+            if (processWait_) UnregisterWaitEx(processWait_, inCallback && firingWait_ == &processWait_ ? NULL : INVALID_HANDLE_VALUE);
+            if (cancelWait_) UnregisterWaitEx(cancelWait_, inCallback && firingWait_ == &cancelWait_ ? NULL : INVALID_HANDLE_VALUE);
+            return result_;
+        }
+
+    private:
+        static VOID CALLBACK OnProcess(PVOID context, BOOLEAN timedOut) {
+            auto self = static_cast<ExitAwaiter*>(context);
+            self->Fire(timedOut ? WAIT_TIMEOUT : WAIT_OBJECT_0, &self->processWait_);
+        }
+        static VOID CALLBACK OnCancel(PVOID context, BOOLEAN) {
+            auto self = static_cast<ExitAwaiter*>(context);
+            self->Fire(WAIT_OBJECT_0 + 1, &self->cancelWait_);
+        }
+
+        // wait - поле с handle ожидания: к срабатыванию оно может быть еще не записано
+        // (RegisterWaitForSingleObject не вернулся), поэтому сравнивается адрес поля
+        void Fire(DWORD result, HANDLE* wait) {
+            if (fired_.exchange(true)) return;
+            result_ = result;
+            firingWait_ = wait;
+            firingThread_ = GetCurrentThreadId();
+            Release();
+        }
+
+        void Release() {
+            if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) pool_.Post(handle_);
+        }
+
+        HANDLE process_;
+        HANDLE cancelEvent_;
+        DWORD timeoutMs_;
+        async::ThreadPool& pool_;
+        std::coroutine_handle<> handle_;
+        HANDLE processWait_ = NULL;
+        HANDLE cancelWait_ = NULL;
+        std::atomic<bool> fired_{ false };
+        std::atomic<int> pending_{ 2 };
+        DWORD result_ = WAIT_FAILED;
+        HANDLE* firingWait_ = nullptr;   // ожидание, чей обработчик сработал первым,
+        DWORD firingThread_ = 0;         // и его поток
+    };
+
+} // namespace
+
+async::Future<int> JobExecutor::RunTaskAsync(TaskPtr task, HANDLE cancelEvent, std::vector<std::wstring> triggerPaths,
+    const Clock& clock, async::ThreadPool& pool) {
+    if (!task) co_return -1;
+    LATENCY_SCOPE("JobExecutor::RunTask");
+
+    // Интервалы переживают co_await - асинхронные: продолжение идет в другом потоке пула
+    trace::Span runSpan("RunTask", "job", trace::kAsync);
+    runSpan.Arg(task->id);
+
+    StartedRun run;
+    int failCode = 0;
+    {
+        // Область лога привязана к потоку - только до приостановки
+        LogTaskScope logScope(task->id);
+        if (!StartRun(task, triggerPaths.empty() ? nullptr : &triggerPaths, run, failCode)) co_return failCode;
+    }
+
+    DWORD waitRes;
+    {
+        trace::Span span("wait", "job", trace::kAsync);
+        span.Arg(task->id);
+        waitRes = co_await ExitAwaiter(run.pi.hProcess, cancelEvent, run.timeoutMs, pool);
+    }
+    co_return FinishRun(run, waitRes, clock);
+}
@@ -1,9 +1,27 @@
-#pragma once
+﻿#pragma once
+#include "Async.h"
 #include "Task.h"
+#include "Clock.h"
 #include <memory>
 #include <string>
+#include <vector>
+#include <Windows.h>
 
 class JobExecutor {
 public:
-    static int RunTask(const TaskPtr& task);
+    // Код завершения запуска, остановленного через cancelEvent (999 - таймаут)
+    static constexpr int kCancelledExitCode = 998;
+
+    // cancelEvent (необязательно): при его установке процесс и его job завершаются.
+    // triggerPaths (FILE_WATCH): передаются процессу в MTS_TRIGGER_FILES через '|'
+    // clock: часы планировщика, по ним ставится lastRunTime
+    static int RunTask(const TaskPtr& task, HANDLE cancelEvent = NULL,
+        const std::vector<std::wstring>* triggerPaths = nullptr, const Clock& clock = Clock::System());
+
+    // То же без блокировки потока: процесс создается в вызывающем потоке, завершение, таймаут
+    // или отмена ждутся через RegisterWaitForSingleObject, разбор результата - после
+    // продолжения в pool. Результат co_await - код завершения, как у RunTask.
+    static async::Future<int> RunTaskAsync(TaskPtr task, HANDLE cancelEvent = NULL,
+        std::vector<std::wstring> triggerPaths = {}, const Clock& clock = Clock::System(),
+        async::ThreadPool& pool = async::ThreadPool::Default());
 };
@@ -0,0 +1,387 @@
+﻿#include "JsonSimd.h"
+#include <atomic>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define MTS_JSON_SIMD 1
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace util {
+namespace json {
+
+    namespace {
+
+        // ====================================================================
+        // Общая семантика
+        // ====================================================================
+
+        inline bool NeedsEscape(wchar_t c) {
+            return c == L'"' || c == L'\\' || (unsigned)c < 0x20;
+        }
+
+        void AppendEscaped(std::wstring& out, wchar_t c) {
+            static const wchar_t hex[] = L"0123456789abcdef";
+            switch (c) {
+            case L'\\': out += L"\\\\"; break;
+            case L'"':  out += L"\\\""; break;
+            case L'\n': out += L"\\n"; break;
+            case L'\r': out += L"\\r"; break;
+            case L'\t': out += L"\\t"; break;
+            case L'\b': out += L"\\b"; break;
+            case L'\f': out += L"\\f"; break;
+            default: {
+                // Прочие управляющие символы - \u00XX
+                wchar_t u[6] = { L'\\', L'u', L'0', L'0', hex[(c >> 4) & 0xF], hex[c & 0xF] };
+                out.append(u, 6);
+                break;
+            }
+            }
+        }
+
+        inline int HexValue(wchar_t c) {
+            if (c >= L'0' && c <= L'9') return c - L'0';
+            if (c >= L'a' && c <= L'f') return c - L'a' + 10;
+            if (c >= L'A' && c <= L'F') return c - L'A' + 10;
+            return -1;
+        }
+
+        // p[i] == '\\'. Декодирует последовательность, возвращает индекс за ней.
+        // Висящий '\\' в конце отбрасывается, неизвестная последовательность дает сам символ.
+        size_t DecodeEscape(const wchar_t* p, size_t n, size_t i, std::wstring& out) {
+            if (i + 1 >= n) return n;
+            wchar_t c = p[i + 1];
+            switch (c) {
+            case L'n': out.push_back(L'\n'); break;
+            case L'r': out.push_back(L'\r'); break;
+            case L't': out.push_back(L'\t'); break;
+            case L'b': out.push_back(L'\b'); break;
+            case L'f': out.push_back(L'\f'); break;
+            case L'u': {
+                // \uXXXX - одна кодовая единица UTF-16; суррогатные пары приходят двумя \u подряд
+                if (i + 6 <= n) {
+                    int v = 0;
+                    bool ok = true;
+                    for (size_t k = i + 2; k < i + 6 && ok; ++k) {
+                        int h = HexValue(p[k]);
+                        ok = h >= 0;
+                        v = (v << 4) | (h & 0xF);
+                    }
+                    if (ok) {
+                        out.push_back((wchar_t)v);
+                        return i + 6;
+                    }
+                }
+                out.push_back(L'u');
+                break;
+            }
+            default: out.push_back(c); break;   // \\, \", \/ и неизвестные
+            }
+            return i + 2;
+        }
+
+        // ====================================================================
+        // Ядра поиска: индекс первого "особого" символа или n
+        // ====================================================================
+
+        size_t FindEscapeScalar(const wchar_t* p, size_t n) {
+            for (size_t i = 0; i < n; ++i)
+                if (NeedsEscape(p[i])) return i;
+            return n;
+        }
+
+        size_t FindAnyScalar(const wchar_t* p, size_t n, wchar_t a, wchar_t b, wchar_t c, wchar_t d) {
+            for (size_t i = 0; i < n; ++i) {
+                wchar_t x = p[i];
+                if (x == a || x == b || x == c || x == d) return i;
+            }
+            return n;
+        }
+
+#if MTS_JSON_SIMD
+        static_assert(sizeof(wchar_t) == 2, "SIMD kernels assume UTF-16 wchar_t");
+
+        // Две загрузки по 8 символов; movemask дает по 2 бита на символ
+        size_t FindEscapeSSE2(const wchar_t* p, size_t n) {
+            const __m128i quote = _mm_set1_epi16(L'"');
+            const __m128i bslash = _mm_set1_epi16(L'\\');
+            const __m128i ctl = _mm_set1_epi16(0x1F);
+            const __m128i zero = _mm_setzero_si128();
+            auto special = [&](__m128i v) {
+                // v <= 0x1F  <=>  насыщенное v - 0x1F == 0
+                return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, quote), _mm_cmpeq_epi16(v, bslash)),
+                    _mm_cmpeq_epi16(_mm_subs_epu16(v, ctl), zero));
+            };
+
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(p + i));
+                __m128i b = _mm_loadu_si128((const __m128i*)(p + i + 8));
+                unsigned mask = (unsigned)_mm_movemask_epi8(special(a)) |
+                    ((unsigned)_mm_movemask_epi8(special(b)) << 16);
+                if (mask) {
+                    unsigned long bit;
+                    _BitScanForward(&bit, mask);
+                    return i + bit / 2;
+                }
+            }
+            return i + FindEscapeScalar(p + i, n - i);
+        }
+
+        size_t FindAnySSE2(const wchar_t* p, size_t n, wchar_t a, wchar_t b, wchar_t c, wchar_t d) {
+            const __m128i va = _mm_set1_epi16((short)a), vb = _mm_set1_epi16((short)b);
+            const __m128i vc = _mm_set1_epi16((short)c), vd = _mm_set1_epi16((short)d);
+            auto hit = [&](__m128i v) {
+                return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, va), _mm_cmpeq_epi16(v, vb)),
+                    _mm_or_si128(_mm_cmpeq_epi16(v, vc), _mm_cmpeq_epi16(v, vd)));
+            };
+
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                __m128i x = _mm_loadu_si128((const __m128i*)(p + i));
+                __m128i y = _mm_loadu_si128((const __m128i*)(p + i + 8));
+                unsigned mask = (unsigned)_mm_movemask_epi8(hit(x)) |
+                    ((unsigned)_mm_movemask_epi8(hit(y)) << 16);
+                if (mask) {
+                    unsigned long bit;
+                    _BitScanForward(&bit, mask);
+                    return i + bit / 2;
+                }
+            }
+            return i + FindAnyScalar(p + i, n - i, a, b, c, d);
+        }
+
+        // _BitScanForward64 есть только в x64; в x86 - две 32-битные половины
+        inline unsigned long LowestBit64(uint64_t mask) {
+            unsigned long bit;
+#if defined(_M_X64)
+            _BitScanForward64(&bit, mask);
+#else
+            if (_BitScanForward(&bit, (unsigned long)(uint32_t)mask)) return bit;
+            _BitScanForward(&bit, (unsigned long)(uint32_t)(mask >> 32));
+            bit += 32;
+#endif
+            return bit;
+        }
+
+        // Две загрузки по 16 символов -> 64-битная маска
+        size_t FindEscapeAVX2(const wchar_t* p, size_t n) {
+            const __m256i quote = _mm256_set1_epi16(L'"');
+            const __m256i bslash = _mm256_set1_epi16(L'\\');
+            const __m256i ctl = _mm256_set1_epi16(0x1F);
+            const __m256i zero = _mm256_setzero_si256();
+            auto special = [&](__m256i v) {
+                return _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(v, quote), _mm256_cmpeq_epi16(v, bslash)),
+                    _mm256_cmpeq_epi16(_mm256_subs_epu16(v, ctl), zero));
+            };
+
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32) {
+                __m256i a = _mm256_loadu_si256((const __m256i*)(p + i));
+                __m256i b = _mm256_loadu_si256((const __m256i*)(p + i + 16));
+                uint64_t mask = (uint64_t)(uint32_t)_mm256_movemask_epi8(special(a)) |
+                    ((uint64_t)(uint32_t)_mm256_movemask_epi8(special(b)) << 32);
+                if (mask) return i + LowestBit64(mask) / 2;
+            }
+            return i + FindEscapeSSE2(p + i, n - i);
+        }
+
+        size_t FindAnyAVX2(const wchar_t* p, size_t n, wchar_t a, wchar_t b, wchar_t c, wchar_t d) {
+            const __m256i va = _mm256_set1_epi16((short)a), vb = _mm256_set1_epi16((short)b);
+            const __m256i vc = _mm256_set1_epi16((short)c), vd = _mm256_set1_epi16((short)d);
+            auto hit = [&](__m256i v) {
+                return _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(v, va), _mm256_cmpeq_epi16(v, vb)),
+                    _mm256_or_si256(_mm256_cmpeq_epi16(v, vc), _mm256_cmpeq_epi16(v, vd)));
+            };
+
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32) {
+                __m256i x = _mm256_loadu_si256((const __m256i*)(p + i));
+                __m256i y = _mm256_loadu_si256((const __m256i*)(p + i + 16));
+                uint64_t mask = (uint64_t)(uint32_t)_mm256_movemask_epi8(hit(x)) |
+                    ((uint64_t)(uint32_t)_mm256_movemask_epi8(hit(y)) << 32);
+                if (mask) return i + LowestBit64(mask) / 2;
+            }
+            return i + FindAnySSE2(p + i, n - i, a, b, c, d);
+        }
+#endif
+
+        struct Kernels {
+            size_t(*findEscape)(const wchar_t*, size_t);
+            size_t(*findAny)(const wchar_t*, size_t, wchar_t, wchar_t, wchar_t, wchar_t);
+        };
+
+        const Kernels kScalar = { FindEscapeScalar, FindAnyScalar };
+#if MTS_JSON_SIMD
+        const Kernels kSSE2 = { FindEscapeSSE2, FindAnySSE2 };
+        const Kernels kAVX2 = { FindEscapeAVX2, FindAnyAVX2 };
+#endif
+
+        Isa Detect() {
+#if MTS_JSON_SIMD
+            int r[4];
+            __cpuid(r, 0);
+            int maxLeaf = r[0];
+            __cpuid(r, 1);
+            bool sse2 = (r[3] & (1 << 26)) != 0;
+            bool osxsave = (r[2] & (1 << 27)) != 0;
+            bool avx = (r[2] & (1 << 28)) != 0;
+            // AVX2 требует и поддержки процессора, и сохранения YMM-регистров ОС
+            if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+                __cpuidex(r, 7, 0);
+                if (r[1] & (1 << 5)) return Isa::AVX2;
+            }
+            return sse2 ? Isa::SSE2 : Isa::Scalar;
+#else
+            return Isa::Scalar;
+#endif
+        }
+
+        Isa Detected() {
+            static const Isa isa = Detect();
+            return isa;
+        }
+
+        std::atomic<int> g_active{ -1 };
+
+        const Kernels& Active() {
+            int isa = g_active.load(std::memory_order_relaxed);
+            if (isa < 0) {
+                isa = (int)Detected();
+                g_active.store(isa, std::memory_order_relaxed);
+            }
+#if MTS_JSON_SIMD
+            if (isa == (int)Isa::AVX2) return kAVX2;
+            if (isa == (int)Isa::SSE2) return kSSE2;
+#endif
+            return kScalar;
+        }
+
+    } // namespace
+
+    Isa DetectedIsa() { return Detected(); }
+
+    Isa ActiveIsa() {
+        Active();
+        return (Isa)g_active.load(std::memory_order_relaxed);
+    }
+
+    void ForceIsa(Isa isa) {
+        if ((int)isa > (int)Detected()) isa = Detected();
+        g_active.store((int)isa, std::memory_order_relaxed);
+    }
+
+    // ========================================================================
+    // Блочные реализации
+    // ========================================================================
+
+    std::wstring Escape(std::wstring_view s) {
+        const Kernels& k = Active();
+        const wchar_t* p = s.data();
+        const size_t n = s.size();
+
+        std::wstring out;
+        out.reserve(n + n / 8);
+        size_t i = 0;
+        while (i < n) {
+            size_t run = k.findEscape(p + i, n - i);
+            out.append(p + i, run);
+            i += run;
+            if (i >= n) break;
+            AppendEscaped(out, p[i]);
+            ++i;
+        }
+        return out;
+    }
+
+    std::wstring Unescape(const std::wstring& s) {
+        std::wstring out;
+        UnescapeTo(s, out);
+        return out;
+    }
+
+    void UnescapeTo(std::wstring_view s, std::wstring& out) {
+        const Kernels& k = Active();
+        const wchar_t* p = s.data();
+        const size_t n = s.size();
+
+        out.clear();
+        out.reserve(n);
+        size_t i = 0;
+        while (i < n) {
+            size_t run = k.findAny(p + i, n - i, L'\\', L'\\', L'\\', L'\\');
+            out.append(p + i, run);
+            i += run;
+            if (i >= n) break;
+            i = DecodeEscape(p, n, i, out);
+        }
+    }
+
+    bool IsValid(const std::wstring& s) {
+        const Kernels& k = Active();
+        const wchar_t* p = s.data();
+        const size_t n = s.size();
+
+        int depth = 0;
+        bool inQuotes = false;
+        size_t i = 0;
+        while (i < n) {
+            // В строке важны только кавычка и '\\', вне строки - еще фигурные скобки
+            i += inQuotes ? k.findAny(p + i, n - i, L'"', L'\\', L'"', L'\\')
+                          : k.findAny(p + i, n - i, L'"', L'\\', L'{', L'}');
+            if (i >= n) break;
+
+            wchar_t c = p[i];
+            if (c == L'\\') { i += 2; continue; }   // экранированный символ пропускается
+            if (c == L'"') inQuotes = !inQuotes;
+            else if (c == L'{') ++depth;
+            else if (--depth < 0) return false;
+            ++i;
+        }
+        return !inQuotes && depth == 0;
+    }
+
+    // ========================================================================
+    // Эталоны
+    // ========================================================================
+
+    std::wstring EscapeReference(const std::wstring& s) {
+        std::wstring out;
+        out.reserve(s.size());
+        for (wchar_t c : s) {
+            if (NeedsEscape(c)) AppendEscaped(out, c);
+            else out.push_back(c);
+        }
+        return out;
+    }
+
+    std::wstring UnescapeReference(const std::wstring& s) {
+        std::wstring out;
+        out.reserve(s.size());
+        for (size_t i = 0; i < s.size();) {
+            if (s[i] == L'\\') i = DecodeEscape(s.data(), s.size(), i, out);
+            else out.push_back(s[i++]);
+        }
+        return out;
+    }
+
+    bool IsValidReference(const std::wstring& s) {
+        int depth = 0;
+        bool inQuotes = false;
+        bool escape = false;
+        for (wchar_t c : s) {
+            if (escape) { escape = false; continue; }
+            if (c == L'\\') { escape = true; continue; }
+            if (c == L'"') inQuotes = !inQuotes;
+            if (!inQuotes) {
+                if (c == L'{') ++depth;
+                else if (c == L'}') --depth;
+                if (depth < 0) return false;
+            }
+        }
+        return !inQuotes && depth == 0;
+    }
+
+} // namespace json
+} // namespace util
@@ -0,0 +1,30 @@
+﻿#pragma once
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// Ядра для util::EscapeJSON / UnescapeJSON / IsValidJsonSimple.
+// Сканирование идет блоками: AVX2 - 32 символа за шаг, SSE2 - 16, иначе скалярный цикл.
+// Ядро выбирается один раз по CPUID; чистые участки копируются целиком.
+// Результат не зависит от ядра и совпадает с посимвольными эталонами *Reference.
+namespace util {
+namespace json {
+
+    enum class Isa { Scalar = 0, SSE2 = 1, AVX2 = 2 };
+
+    Isa DetectedIsa();          // максимум, доступный процессору и ОС
+    Isa ActiveIsa();
+    void ForceIsa(Isa isa);     // не выше DetectedIsa(); для сравнения путей и замеров
+
+    std::wstring Escape(std::wstring_view s);
+    std::wstring Unescape(const std::wstring& s);
+    void UnescapeTo(std::wstring_view s, std::wstring& out);   // out заменяется, его емкость переиспользуется
+    bool IsValid(const std::wstring& s);
+
+    // Эталонные посимвольные реализации той же семантики
+    std::wstring EscapeReference(const std::wstring& s);
+    std::wstring UnescapeReference(const std::wstring& s);
+    bool IsValidReference(const std::wstring& s);
+
+} // namespace json
+} // namespace util
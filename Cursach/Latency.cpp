@@ -0,0 +1,99 @@
+﻿#include "Latency.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace latency {
+
+    namespace {
+
+        struct Registry {
+            std::mutex mtx;
+            std::vector<Site*> sites;
+        };
+
+        Registry& R() {
+            static Registry r;
+            return r;
+        }
+
+        // Верхняя граница корзины, нс
+        uint64_t BucketUpper(int i) {
+            if (i < (1 << Site::kSubBits)) return (uint64_t)i + 1;
+            int msb = (i >> Site::kSubBits) + Site::kSubBits - 1;
+            uint64_t sub = (uint64_t)(i & ((1 << Site::kSubBits) - 1));
+            return (((uint64_t)1 << Site::kSubBits) + sub + 1) << (msb - Site::kSubBits);
+        }
+
+        std::wstring Micros(double ns) {
+            wchar_t buf[32];
+            swprintf_s(buf, L"%.1f", ns / 1000.0);
+            return buf;
+        }
+
+        std::wstring Pad(const std::wstring& s, size_t width, bool right = true) {
+            if (s.size() >= width) return s + L" ";
+            std::wstring fill(width - s.size(), L' ');
+            return right ? fill + s : s + fill;
+        }
+
+        struct Row {
+            std::wstring name;
+            uint64_t count;
+            uint64_t sum;
+            uint64_t p99;
+            uint64_t max;
+        };
+
+    } // namespace
+
+    Site::Site(const char* name) : name_(name) {
+        std::lock_guard<std::mutex> lk(R().mtx);
+        R().sites.push_back(this);
+    }
+
+    std::wstring Report() {
+        std::vector<Site*> sites;
+        {
+            std::lock_guard<std::mutex> lk(R().mtx);
+            sites = R().sites;
+        }
+
+        // Счетчики читаются без остановки записи: строка может разойтись на пару замеров
+        std::vector<Row> rows;
+        for (Site* s : sites) {
+            uint64_t buckets[Site::kBuckets];
+            uint64_t total = 0;
+            for (int i = 0; i < Site::kBuckets; ++i) {
+                buckets[i] = s->buckets_[i].load(std::memory_order_relaxed);
+                total += buckets[i];
+            }
+            if (!total) continue;
+
+            Row row{ {}, total, s->sum_.load(std::memory_order_relaxed), 0, s->max_.load(std::memory_order_relaxed) };
+            for (const char* c = s->name_; *c; ++c) row.name.push_back((wchar_t)(unsigned char)*c);
+
+            uint64_t rank = total - total / 100, seen = 0;   // 99-й перцентиль - верхняя граница корзины
+            for (int i = 0; i < Site::kBuckets; ++i) {
+                seen += buckets[i];
+                if (seen >= rank) { row.p99 = (std::min)(BucketUpper(i), row.max); break; }
+            }
+            rows.push_back(std::move(row));
+        }
+
+        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.sum > b.sum; });
+
+        std::wstring r = L"Latency by site (us):\r\n";
+        r += L"  " + Pad(L"site", 36, false) + Pad(L"count", 12) + Pad(L"mean", 12) + Pad(L"p99", 12) +
+            Pad(L"max", 12) + Pad(L"total ms", 12) + L"\r\n";
+        for (const Row& row : rows) {
+            r += L"  " + Pad(row.name, 36, false) + Pad(std::to_wstring(row.count), 12) +
+                Pad(Micros((double)row.sum / row.count), 12) + Pad(Micros((double)row.p99), 12) +
+                Pad(Micros((double)row.max), 12) + Pad(std::to_wstring(row.sum / 1000000), 12) + L"\r\n";
+        }
+        if (rows.empty()) r += L"  (no samples)\r\n";
+        return r;
+    }
+
+} // namespace latency
@@ -0,0 +1,77 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Задержки горячих путей внутри процесса. Точка замера описывается один раз (static
+// в LATENCY_SCOPE), область кода замеряется по steady_clock (QPC), длительность попадает
+// в гистограмму точки: только атомарные инкременты, без блокировок.
+// Время точки включает вложенные (AddTask - вместе с Persistence::Save).
+//
+//   void TaskManager::AddTask(const TaskPtr& task) {
+//       LATENCY_SCOPE("TaskManager::AddTask");
+//
+// Report() - таблица count / mean / p99 / max по всем точкам (меню Help, --simulate).
+namespace latency {
+
+    class Site {
+    public:
+        // Корзины: 4 на каждую степень двойки наносекунд - погрешность квантиля не больше 25%
+        static constexpr int kSubBits = 2;
+        static constexpr int kBuckets = 64 << kSubBits;
+
+        explicit Site(const char* name);
+        Site(const Site&) = delete;
+        Site& operator=(const Site&) = delete;
+
+        void Record(uint64_t ns) {
+            count_.fetch_add(1, std::memory_order_relaxed);
+            sum_.fetch_add(ns, std::memory_order_relaxed);
+            buckets_[BucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+            uint64_t max = max_.load(std::memory_order_relaxed);
+            while (ns > max && !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+        }
+
+        static int BucketOf(uint64_t ns) {
+            if (ns < (1u << kSubBits)) return (int)ns;
+            int msb = 63;
+            while (!(ns >> msb)) --msb;
+            return ((msb - kSubBits + 1) << kSubBits) | (int)((ns >> (msb - kSubBits)) & ((1u << kSubBits) - 1));
+        }
+
+    private:
+        friend std::wstring Report();
+
+        const char* name_;
+        std::atomic<uint64_t> count_{ 0 };
+        std::atomic<uint64_t> sum_{ 0 };
+        std::atomic<uint64_t> max_{ 0 };
+        std::atomic<uint64_t> buckets_[kBuckets] = {};
+    };
+
+    class Timer {
+    public:
+        explicit Timer(Site& site) : site_(site), start_(std::chrono::steady_clock::now()) {}
+        ~Timer() {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            site_.Record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+    private:
+        Site& site_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    // Точки с замерами, по убыванию суммарного времени; строки через \r\n
+    std::wstring Report();
+
+} // namespace latency
+
+#define LATENCY_CONCAT_(a, b) a##b
+#define LATENCY_CONCAT(a, b) LATENCY_CONCAT_(a, b)
+#define LATENCY_SCOPE(name)                                                                  \
+    static ::latency::Site LATENCY_CONCAT(latencySite_, __LINE__){ name };                  \
+    ::latency::Timer LATENCY_CONCAT(latencyTimer_, __LINE__)(LATENCY_CONCAT(latencySite_, __LINE__))
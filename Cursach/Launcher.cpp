@@ -0,0 +1,585 @@
+﻿#include "Launcher.h"
+#include "Logger.h"
+#include "Utils.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <cwchar>
+#include <thread>
+#include <unordered_map>
+
+Launcher g_Launcher;
+
+namespace {
+
+    // Протокол канала: заголовок и строки UTF-16 без завершающего нуля; ответ фиксированного размера.
+    // Помощник обрабатывает запросы по порядку, ответ несет id запроса.
+    struct RequestHeader {
+        uint32_t size;        // sizeof(RequestHeader) - проверка версии протокола
+        uint32_t flags;       // dwCreationFlags
+        uint64_t id;
+        uint32_t commandChars;
+        uint32_t cwdChars;
+        uint32_t envChars;    // блок окружения целиком, с двумя завершающими нулями
+        uint32_t reserved;
+    };
+
+    struct Reply {
+        uint64_t id;
+        uint32_t error;       // GetLastError() помощника, 0 - процесс создан
+        uint32_t pid, tid;
+        uint32_t reserved;
+        uint64_t process;     // handle, уже действительные в процессе планировщика
+        uint64_t thread;
+    };
+
+    const uint32_t kMaxStringChars = 32768;
+    const uint32_t kMaxEnvChars = 1 << 20;
+    const ULONGLONG kRestartDelayMs = 60 * 1000;
+    const DWORD kRequestTimeoutMs = 5000;     // запись запроса и ожидание ответа
+    const DWORD kPipeBufferSize = 64 * 1024;
+
+    // Синхронный обмен - сторона помощника
+    bool WriteAll(HANDLE h, const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            DWORD written = 0;
+            if (!WriteFile(h, p, (DWORD)(std::min)(size, (size_t)1 << 20), &written, NULL) || written == 0) return false;
+            p += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    bool ReadAll(HANDLE h, void* data, size_t size) {
+        char* p = static_cast<char*>(data);
+        while (size > 0) {
+            DWORD read = 0;
+            if (!ReadFile(h, p, (DWORD)(std::min)(size, (size_t)1 << 20), &read, NULL) || read == 0) return false;
+            p += read;
+            size -= read;
+        }
+        return true;
+    }
+
+    // Перекрывающийся обмен - сторона планировщика. Операция отменяется по таймауту
+    // (INFINITE - без него) или по событию stop; после отмены поток данных не восстановить
+    bool TransferAll(HANDLE h, bool write, void* data, size_t size, DWORD timeoutMs, HANDLE stop) {
+        HANDLE done = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (!done) return false;
+        const ULONGLONG deadline = GetTickCount64() + timeoutMs;
+        char* p = static_cast<char*>(data);
+        bool ok = true;
+        while (ok && size > 0) {
+            OVERLAPPED ov{};
+            ov.hEvent = done;
+            ResetEvent(done);
+            DWORD chunk = (DWORD)(std::min)(size, (size_t)1 << 20), n = 0;
+            BOOL started = write ? WriteFile(h, p, chunk, NULL, &ov) : ReadFile(h, p, chunk, NULL, &ov);
+            if (!started && GetLastError() != ERROR_IO_PENDING) {
+                ok = false;
+                break;
+            }
+
+            DWORD wait = INFINITE;
+            if (timeoutMs != INFINITE) {
+                ULONGLONG now = GetTickCount64();
+                wait = now < deadline ? (DWORD)(deadline - now) : 0;
+            }
+            HANDLE handles[2] = { done, stop };
+            if (WaitForMultipleObjects(2, handles, FALSE, wait) != WAIT_OBJECT_0) {
+                CancelIoEx(h, &ov);
+                GetOverlappedResult(h, &ov, &n, TRUE);
+                ok = false;
+                break;
+            }
+            ok = GetOverlappedResult(h, &ov, &n, FALSE) && n > 0;
+            p += n;
+            size -= n;
+        }
+        CloseHandle(done);
+        return ok;
+    }
+
+    HANDLE HandleArg(const wchar_t* s) {
+        return (HANDLE)(uintptr_t)_wcstoui64(s, nullptr, 10);
+    }
+
+} // namespace
+
+// Канал к одному запущенному помощнику. Держится через shared_ptr: Spawn, начатый до Stop
+// или сбоя, дорабатывает со своим экземпляром; Shutdown прерывает его ожидания
+struct Launcher::Channel {
+    struct Pending {
+        Reply reply{};
+        bool done = false;
+        bool ok = false;
+    };
+
+    HANDLE process = NULL;
+    HANDLE pipe = NULL;                 // серверный конец, FILE_FLAG_OVERLAPPED
+    HANDLE stop = NULL;                 // ручной сброс; взводится в Shutdown
+    std::thread reader;
+    std::atomic<uint64_t>* lateReplies = nullptr;
+
+    std::mutex writeMtx;                // запрос пишется в канал целиком
+    std::mutex pendingMtx;
+    std::condition_variable replied;
+    std::unordered_map<uint64_t, std::shared_ptr<Pending>> pending;
+    bool broken = false;                // поток ответов завершился
+
+    std::once_flag shutdownOnce;
+
+    ~Channel() { Shutdown(2000); }
+
+    std::shared_ptr<Pending> Register(uint64_t id) {
+        std::lock_guard<std::mutex> lk(pendingMtx);
+        if (broken) return nullptr;
+        auto p = std::make_shared<Pending>();
+        pending.emplace(id, p);
+        return p;
+    }
+
+    bool Send(const std::vector<char>& message) {
+        std::lock_guard<std::mutex> lk(writeMtx);
+        return pipe && TransferAll(pipe, true, const_cast<char*>(message.data()), message.size(), kRequestTimeoutMs, stop);
+    }
+
+    bool WaitReply(uint64_t id, const std::shared_ptr<Pending>& p, Reply& reply) {
+        std::unique_lock<std::mutex> lk(pendingMtx);
+        replied.wait_for(lk, std::chrono::milliseconds(kRequestTimeoutMs), [&]() { return p->done; });
+        // Ответ, пришедший после таймаута, поток ответов уже не найдет и закроет процесс сам
+        pending.erase(id);
+        if (!p->ok) return false;
+        reply = p->reply;
+        return true;
+    }
+
+    void ReadReplies() {
+        Reply reply{};
+        while (TransferAll(pipe, false, &reply, sizeof(reply), INFINITE, stop)) {
+            std::shared_ptr<Pending> p;
+            {
+                std::lock_guard<std::mutex> lk(pendingMtx);
+                auto it = pending.find(reply.id);
+                if (it != pending.end()) {
+                    p = it->second;
+                    p->reply = reply;
+                    p->done = p->ok = true;
+                    pending.erase(it);
+                }
+            }
+            if (p) {
+                replied.notify_all();
+            }
+            else if (reply.error == 0) {
+                // Запрос уже запущен напрямую: второй процесс не нужен
+                TerminateProcess((HANDLE)(uintptr_t)reply.process, 1);
+                CloseHandle((HANDLE)(uintptr_t)reply.process);
+                CloseHandle((HANDLE)(uintptr_t)reply.thread);
+                if (lateReplies) lateReplies->fetch_add(1, std::memory_order_relaxed);
+                g_Logger.Log(LogLevel::Warn, L"Launcher",
+                    L"Late reply from launcher - process terminated | PID=" + std::to_wstring(reply.pid));
+            }
+        }
+
+        std::lock_guard<std::mutex> lk(pendingMtx);
+        broken = true;
+        for (auto& entry : pending) entry.second->done = true;
+        pending.clear();
+        replied.notify_all();
+    }
+
+    // Помощник не ответил вовремя: новые запросы не принимаются, ожидающие сразу получают отказ
+    // (и запускаются напрямую), а поток ответов продолжает читать - поздние ответы закрывает он
+    void Retire() {
+        std::lock_guard<std::mutex> lk(pendingMtx);
+        broken = true;
+        for (auto& entry : pending) entry.second->done = true;
+        pending.clear();
+        replied.notify_all();
+    }
+
+    // Останавливает помощника: прерывает обмен, закрывает канал (сигнал помощнику завершиться)
+    // и ждет его до exitWaitMs. Повторные вызовы - no-op
+    void Shutdown(DWORD exitWaitMs) {
+        std::call_once(shutdownOnce, [&]() {
+            if (stop) SetEvent(stop);
+            if (reader.joinable()) reader.join();
+            {
+                std::lock_guard<std::mutex> lk(writeMtx);
+                if (pipe) CloseHandle(pipe);
+                pipe = NULL;
+            }
+            if (process) {
+                if (WaitForSingleObject(process, exitWaitMs) != WAIT_OBJECT_0) TerminateProcess(process, 1);
+                CloseHandle(process);
+                process = NULL;
+            }
+            if (stop) CloseHandle(stop);
+            stop = NULL;
+        });
+    }
+};
+
+Launcher::~Launcher() {
+    Stop();
+}
+
+bool Launcher::Start() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    wanted_ = true;
+    if (!channel_) channel_ = StartLocked();
+    return channel_ != nullptr;
+}
+
+bool Launcher::StartFromConfig() {
+    std::wstring ini = util::GetAppDataDir() + L"\\scheduler.ini";
+    if (GetPrivateProfileIntW(L"Launcher", L"Enabled", 0, ini.c_str()) == 0) return false;
+    return Start();
+}
+
+void Launcher::Stop() {
+    std::shared_ptr<Channel> channel, retired;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        wanted_ = false;
+        channel.swap(channel_);
+        retired.swap(retired_);
+    }
+    if (retired) retired->Shutdown(0);
+    if (channel) channel->Shutdown(2000);
+}
+
+void Launcher::SetHelperCommand(std::wstring command) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    helperCommand_ = std::move(command);
+}
+
+bool Launcher::IsRunning() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return channel_ != nullptr;
+}
+
+std::shared_ptr<Launcher::Channel> Launcher::StartLocked() {
+    lastStartTick_ = GetTickCount64();
+
+    // Прежний, не ответивший помощник больше не нужен; за минуту его поздние ответы дочитаны
+    if (retired_) {
+        retired_->Shutdown(0);
+        retired_.reset();
+    }
+
+    // Серверный конец канала остается здесь; клиентский и handle этого процесса
+    // (для DuplicateHandle) наследуются помощником, и только они (PROC_THREAD_ATTRIBUTE_HANDLE_LIST)
+    std::wstring name = L"\\\\.\\pipe\\MiniTaskScheduler.Launcher." + std::to_wstring(GetCurrentProcessId()) +
+        L"." + std::to_wstring(lastStartTick_);
+    SECURITY_ATTRIBUTES sa{ sizeof(sa), NULL, TRUE };
+    auto channel = std::make_shared<Channel>();
+    HANDLE client = NULL, self = NULL;
+    channel->stop = CreateEventW(NULL, TRUE, FALSE, NULL);
+    channel->pipe = CreateNamedPipeW(name.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1,
+        kPipeBufferSize, kPipeBufferSize, 0, NULL);
+    if (channel->pipe == INVALID_HANDLE_VALUE) channel->pipe = NULL;
+    bool ok = channel->stop && channel->pipe &&
+        (client = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, &sa, OPEN_EXISTING, 0, NULL)) != INVALID_HANDLE_VALUE &&
+        DuplicateHandle(GetCurrentProcess(), GetCurrentProcess(), GetCurrentProcess(), &self,
+            PROCESS_DUP_HANDLE, TRUE, 0);
+    if (client == INVALID_HANDLE_VALUE) client = NULL;
+
+    auto closeOurs = [&]() {
+        for (HANDLE h : { client, self })
+            if (h) CloseHandle(h);
+    };
+    if (!ok) {
+        g_Logger.Log(LogLevel::Error, L"Launcher", L"Cannot create launcher pipe (" + std::to_wstring(GetLastError()) + L")");
+        closeOurs();
+        return nullptr;
+    }
+
+    std::wstring cmd = helperCommand_;
+    if (cmd.empty()) {
+        wchar_t exe[MAX_PATH] = {};
+        GetModuleFileNameW(NULL, exe, MAX_PATH);
+        cmd = L"\"" + std::wstring(exe) + L"\" --launcher";
+    }
+    cmd += L" " + std::to_wstring((uintptr_t)client) + L" " + std::to_wstring((uintptr_t)self);
+
+    HANDLE inherit[2] = { client, self };
+    SIZE_T attrSize = 0;
+    InitializeProcThreadAttributeList(NULL, 1, 0, &attrSize);
+    std::vector<char> attrBuf(attrSize);
+    auto attrs = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attrBuf.data());
+
+    STARTUPINFOEXW si{};
+    si.StartupInfo.cb = sizeof(si);
+    PROCESS_INFORMATION pi{};
+    ok = InitializeProcThreadAttributeList(attrs, 1, 0, &attrSize) &&
+        UpdateProcThreadAttribute(attrs, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherit, sizeof(inherit), NULL, NULL);
+    if (ok) {
+        si.lpAttributeList = attrs;
+        ok = CreateProcessW(NULL, &cmd[0], NULL, NULL, TRUE, CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT,
+            NULL, NULL, &si.StartupInfo, &pi) != FALSE;
+        DeleteProcThreadAttributeList(attrs);
+    }
+    DWORD err = ok ? 0 : GetLastError();
+
+    // Клиентский конец остается только у помощника
+    closeOurs();
+
+    if (!ok) {
+        g_Logger.Log(LogLevel::Error, L"Launcher", L"Cannot start launcher process (" + std::to_wstring(err) + L")");
+        return nullptr;
+    }
+
+    CloseHandle(pi.hThread);
+    channel->process = pi.hProcess;
+    channel->lateReplies = &lateReplies_;
+    Channel* raw = channel.get();
+    channel->reader = std::thread([raw]() { raw->ReadReplies(); });
+    g_Logger.Log(LogLevel::Info, L"Launcher", L"Launcher process started | PID=" + std::to_wstring(pi.dwProcessId));
+    return channel;
+}
+
+bool Launcher::Spawn(const std::wstring& commandLine, const wchar_t* workingDirectory, DWORD flags,
+    const std::vector<wchar_t>* environment, PROCESS_INFORMATION& pi, DWORD& error) {
+    size_t cwdChars = workingDirectory ? wcslen(workingDirectory) : 0;
+    size_t envChars = environment ? environment->size() : 0;
+    if (commandLine.size() > kMaxStringChars || cwdChars > kMaxStringChars || envChars > kMaxEnvChars) return false;
+
+    std::shared_ptr<Channel> channel;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (!channel_) {
+            // Упавший помощник перезапускается не чаще раза в минуту, до тех пор - прямой запуск
+            if (!wanted_ || GetTickCount64() - lastStartTick_ < kRestartDelayMs) return false;
+            channel_ = StartLocked();
+            if (!channel_) return false;
+        }
+        channel = channel_;
+    }
+
+    RequestHeader req{};
+    req.size = sizeof(req);
+    req.flags = flags;
+    req.id = nextId_++;
+    req.commandChars = (uint32_t)commandLine.size();
+    req.cwdChars = (uint32_t)cwdChars;
+    req.envChars = (uint32_t)envChars;
+
+    std::vector<char> message(sizeof(req) + (commandLine.size() + cwdChars + envChars) * sizeof(wchar_t));
+    char* out = message.data();
+    auto append = [&](const void* data, size_t bytes) {
+        if (bytes) memcpy(out, data, bytes);
+        out += bytes;
+    };
+    append(&req, sizeof(req));
+    append(commandLine.data(), commandLine.size() * sizeof(wchar_t));
+    append(workingDirectory, cwdChars * sizeof(wchar_t));
+    append(envChars ? environment->data() : nullptr, envChars * sizeof(wchar_t));
+
+    Reply reply{};
+    auto pending = channel->Register(req.id);
+    bool ok = pending && channel->Send(message) && channel->WaitReply(req.id, pending, reply) && reply.id == req.id;
+
+    if (!ok) {
+        g_Logger.Log(LogLevel::Warn, L"Launcher",
+            L"Launcher process is not responding - spawning directly");
+        // Помощник завис или упал. Канал не закрываем: если помощник все же ответит,
+        // поток ответов завершит лишний процесс. Завершается помощник при перезапуске или Stop
+        channel->Retire();
+        std::shared_ptr<Channel> previous;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (channel_ == channel) {
+                channel_.reset();
+                lastStartTick_ = GetTickCount64();
+                previous.swap(retired_);
+                retired_ = channel;
+            }
+        }
+        if (previous) previous->Shutdown(0);
+        return false;
+    }
+
+    error = reply.error;
+    pi = PROCESS_INFORMATION{};
+    if (error == 0) {
+        pi.hProcess = (HANDLE)(uintptr_t)reply.process;
+        pi.hThread = (HANDLE)(uintptr_t)reply.thread;
+        pi.dwProcessId = reply.pid;
+        pi.dwThreadId = reply.tid;
+    }
+    return true;
+}
+
+int RunLauncherMain(int argc, wchar_t** argv) {
+    if (argc < 4) return 2;
+    HANDLE pipe = HandleArg(argv[2]);
+    HANDLE parent = HandleArg(argv[3]);
+
+    // Журнал ведет планировщик: помощник ничего не пишет, только создает процессы
+    std::vector<wchar_t> command, cwd, env;
+    while (true) {
+        RequestHeader req{};
+        if (!ReadAll(pipe, &req, sizeof(req)) || req.size != sizeof(req)) break;
+        if (req.commandChars == 0 || req.commandChars > kMaxStringChars ||
+            req.cwdChars > kMaxStringChars || req.envChars > kMaxEnvChars) break;
+
+        command.assign(req.commandChars + 1, L'\0');
+        cwd.assign(req.cwdChars + 1, L'\0');
+        env.assign(req.envChars, L'\0');
+        if (!ReadAll(pipe, command.data(), req.commandChars * sizeof(wchar_t)) ||
+            !ReadAll(pipe, cwd.data(), req.cwdChars * sizeof(wchar_t)) ||
+            !ReadAll(pipe, env.data(), req.envChars * sizeof(wchar_t))) break;
+
+        Reply reply{};
+        reply.id = req.id;
+
+        STARTUPINFOW si{};
+        si.cb = sizeof(si);
+        PROCESS_INFORMATION pi{};
+        if (CreateProcessW(NULL, command.data(), NULL, NULL, FALSE, req.flags,
+            env.empty() ? NULL : env.data(), req.cwdChars ? cwd.data() : NULL, &si, &pi)) {
+            HANDLE process = NULL, thread = NULL;
+            if (DuplicateHandle(GetCurrentProcess(), pi.hProcess, parent, &process, 0, FALSE, DUPLICATE_SAME_ACCESS) &&
+                DuplicateHandle(GetCurrentProcess(), pi.hThread, parent, &thread, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+                reply.process = (uint64_t)(uintptr_t)process;
+                reply.thread = (uint64_t)(uintptr_t)thread;
+                reply.pid = pi.dwProcessId;
+                reply.tid = pi.dwThreadId;
+            }
+            else {
+                // Процесс без handle у планировщика никто не дождется - не оставляем его
+                reply.error = GetLastError();
+                if (process) DuplicateHandle(parent, process, NULL, NULL, 0, FALSE, DUPLICATE_CLOSE_SOURCE);
+                TerminateProcess(pi.hProcess, 1);
+            }
+            CloseHandle(pi.hThread);
+            CloseHandle(pi.hProcess);
+        }
+        else {
+            reply.error = GetLastError();
+        }
+
+        if (!WriteAll(pipe, &reply, sizeof(reply))) break;
+    }
+    return 0;
+}
+
+// ===== --bench-spawn =====
+
+namespace {
+
+    struct SpawnSeries {
+        std::vector<double> us;   // задержка каждого запуска
+        size_t failures = 0;
+    };
+
+    std::wstring FormatSeries(const wchar_t* name, SpawnSeries& s) {
+        if (s.us.empty()) return std::wstring(name) + L": no successful spawns\r\n";
+        std::sort(s.us.begin(), s.us.end());
+        double sum = 0;
+        for (double v : s.us) sum += v;
+        auto pct = [&](double p) { return s.us[(std::min)(s.us.size() - 1, (size_t)(p * s.us.size()))]; };
+
+        wchar_t buf[256];
+        swprintf_s(buf, L"%-9s n=%zu  mean=%.0f us  p50=%.0f us  p99=%.0f us  max=%.0f us  failures=%zu\r\n",
+            name, s.us.size(), sum / s.us.size(), pct(0.50), pct(0.99), s.us.back(), s.failures);
+        return buf;
+    }
+
+    // Запуск так же, как в JobExecutor (приостановлен, без окна), затем ожидание завершения;
+    // в задержку входит только создание процесса
+    void RunSeries(const std::wstring& command, size_t count, bool viaLauncher, SpawnSeries& s) {
+        LARGE_INTEGER freq, t0, t1;
+        QueryPerformanceFrequency(&freq);
+        const DWORD flags = CREATE_NO_WINDOW | CREATE_SUSPENDED;
+        STARTUPINFOW si{};
+        si.cb = sizeof(si);
+
+        for (size_t i = 0; i < count; ++i) {
+            PROCESS_INFORMATION pi{};
+            std::wstring cmd = command;
+            DWORD error = 0;
+
+            QueryPerformanceCounter(&t0);
+            bool ok;
+            if (viaLauncher) {
+                ok = g_Launcher.Spawn(cmd, NULL, flags, nullptr, pi, error) && error == 0;
+            }
+            else {
+                ok = CreateProcessW(NULL, &cmd[0], NULL, NULL, FALSE, flags, NULL, NULL, &si, &pi) != FALSE;
+            }
+            QueryPerformanceCounter(&t1);
+
+            if (!ok) {
+                ++s.failures;
+                continue;
+            }
+            s.us.push_back((double)(t1.QuadPart - t0.QuadPart) * 1e6 / (double)freq.QuadPart);
+            ResumeThread(pi.hThread);
+            WaitForSingleObject(pi.hProcess, 10000);
+            CloseHandle(pi.hThread);
+            CloseHandle(pi.hProcess);
+        }
+    }
+
+    // count запусков, поделенных между threads потоками
+    void RunParallel(const std::wstring& command, size_t count, size_t threads, bool viaLauncher, SpawnSeries& s) {
+        std::vector<SpawnSeries> parts(threads);
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            size_t n = count / threads + (t < count % threads ? 1 : 0);
+            workers.emplace_back([&, t, n]() { RunSeries(command, n, viaLauncher, parts[t]); });
+        }
+        for (auto& w : workers) w.join();
+        for (auto& part : parts) {
+            s.us.insert(s.us.end(), part.us.begin(), part.us.end());
+            s.failures += part.failures;
+        }
+    }
+
+} // namespace
+
+int RunSpawnBenchmark(int argc, wchar_t** argv) {
+    size_t count = 200, threads = 1;
+    std::wstring command = L"cmd.exe /c exit 0";
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::wstring key = argv[i];
+        if (key == L"--count") count = (size_t)(std::max)(_wtoi(argv[i + 1]), 1);
+        else if (key == L"--threads") threads = (size_t)(std::min)((std::max)(_wtoi(argv[i + 1]), 1), 64);
+        else if (key == L"--command") command = argv[i + 1];
+        else {
+            util::PrintToConsole(L"Bad argument: " + key + L"\r\n"
+                L"Usage: --bench-spawn [--count N] [--threads N] [--command \"cmd.exe /c exit 0\"]\r\n");
+            return 2;
+        }
+    }
+
+    // Прогрев: кэш загрузчика и файловой системы для исполняемого файла
+    SpawnSeries warmup;
+    RunSeries(command, 5, false, warmup);
+
+    SpawnSeries direct, launched;
+    RunParallel(command, count, threads, false, direct);
+
+    LARGE_INTEGER freq, t0, t1;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t0);
+    bool started = g_Launcher.Start();
+    QueryPerformanceCounter(&t1);
+    if (started) RunParallel(command, count, threads, true, launched);
+    g_Launcher.Stop();
+
+    wchar_t startup[128];
+    swprintf_s(startup, L"launcher startup: %.0f us\r\n", (double)(t1.QuadPart - t0.QuadPart) * 1e6 / (double)freq.QuadPart);
+
+    std::wstring report = L"Spawn latency: \"" + command + L"\", " + std::to_wstring(count) + L" runs each, " +
+        std::to_wstring(threads) + L" thread(s)\r\n" +
+        FormatSeries(L"direct", direct) +
+        (started ? FormatSeries(L"launcher", launched) + startup : std::wstring(L"launcher: failed to start\r\n"));
+    util::PrintToConsole(report);
+    return started ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+﻿#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <Windows.h>
+
+// Процесс-помощник для запуска задач: второй экземпляр "Mini Task Scheduler.exe --launcher",
+// стартующий до загрузки задач. Запрос (командная строка, каталог, окружение, флаги) идет
+// по именованному каналу; помощник создает процесс и передает handle процесса и потока
+// в планировщик через DuplicateHandle (аналог передачи дескрипторов через сокет).
+//
+// Канал на стороне планировщика - перекрывающийся ввод-вывод: запросы от нескольких потоков
+// идут друг за другом без ожидания ответов, ответы разбирает по id отдельный поток.
+// Запрос, на который помощник не ответил за kRequestTimeoutMs, считается сбоем помощника:
+// Spawn возвращает false (вызывающий запускает процесс сам), помощник перезапускается позже.
+// До перезапуска (или Stop) канал к нему дочитывается: процесс из позднего ответа уже
+// запущен напрямую и завершается, не начав работу.
+//
+// fork на Windows нет, и цена CreateProcess почти не зависит от размера родителя. Помощник
+// дает другое: процессы задач создаются не из многопоточного планировщика с тысячами handle
+// (ничего не наследуют, не ждут его загрузчика и блокировок), родитель у них - маленький процесс.
+// Включается в scheduler.ini: [Launcher] Enabled=1. Пока помощник недоступен - прямой CreateProcess.
+class Launcher {
+public:
+    Launcher() = default;
+    ~Launcher();
+    Launcher(const Launcher&) = delete;
+    Launcher& operator=(const Launcher&) = delete;
+
+    bool Start();             // повторный вызов при запущенном помощнике - no-op
+    bool StartFromConfig();   // Start, если [Launcher] Enabled=1
+    void Stop();
+    bool IsRunning() const;
+
+    // Командная строка помощника без двух последних аргументов (канал и родитель);
+    // по умолчанию "<этот exe>" --launcher. Тесты подставляют свой CHILD. До Start
+    void SetHelperCommand(std::wstring command);
+
+    uint64_t LateReplies() const { return lateReplies_.load(std::memory_order_relaxed); }
+
+    // Как CreateProcessW(NULL, commandLine, NULL, NULL, FALSE, flags, environment, workingDirectory):
+    // pi - handle в этом процессе. false - помощника нет или он не ответил (запускать самому);
+    // true и error != 0 - CreateProcess в помощнике завершился ошибкой error.
+    bool Spawn(const std::wstring& commandLine, const wchar_t* workingDirectory, DWORD flags,
+        const std::vector<wchar_t>* environment, PROCESS_INFORMATION& pi, DWORD& error);
+
+private:
+    struct Channel;                 // канал к запущенному помощнику (Launcher.cpp)
+
+    std::shared_ptr<Channel> StartLocked();
+
+    mutable std::mutex mtx_;        // состояние; на время обмена с помощником не удерживается
+    std::shared_ptr<Channel> channel_;
+    std::shared_ptr<Channel> retired_;    // не ответивший помощник: дочитывается до перезапуска или Stop
+    std::wstring helperCommand_;
+    std::atomic<uint64_t> lateReplies_{ 0 };
+    std::atomic<uint64_t> nextId_{ 1 };
+    bool wanted_ = false;           // Start вызывался - после сбоя помощник перезапускается
+    ULONGLONG lastStartTick_ = 0;   // последний запуск или сбой помощника
+};
+
+extern Launcher g_Launcher;
+
+// Сторона помощника: Mini Task Scheduler.exe --launcher <канал> <родитель>
+int RunLauncherMain(int argc, wchar_t** argv);
+
+// Mini Task Scheduler.exe --bench-spawn [--count N] [--threads N] [--command "cmd.exe /c exit 0"]
+// Задержка запуска (до получения handle процесса) напрямую и через помощника;
+// --threads - столько потоков запускают процессы одновременно (запросы к помощнику в полете)
+int RunSpawnBenchmark(int argc, wchar_t** argv);
@@ -0,0 +1,166 @@
+﻿#include "LogIndex.h"
+#include <algorithm>
+#include <cstring>
+
+namespace logidx {
+
+    namespace {
+
+        // FNV-1a по UTF-16 без учета регистра ASCII (GUID вводят как угодно) - он же хранится
+        // в списке id; splitmix64 от него - второй хеш; k позиций - двойным хешированием h1 + i*h2.
+        uint64_t IdHash(std::wstring_view id) {
+            uint64_t h = 1469598103934665603ULL;
+            for (wchar_t c : id) {
+                if (c >= L'A' && c <= L'Z') c = c - L'A' + L'a';
+                h ^= (uint64_t)(uint16_t)c;
+                h *= 1099511628211ULL;
+            }
+            return h;
+        }
+
+        uint64_t SecondHash(uint64_t h1) {
+            uint64_t x = h1 + 0x9E3779B97F4A7C15ULL;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            return (x ^ (x >> 31)) | 1;
+        }
+
+        uint32_t BloomBitsFor(size_t ids) {
+            uint64_t bits = (std::max)((uint64_t)ids * kBloomBitsPerId, (uint64_t)kMinBloomBits);
+            return (uint32_t)((bits + 63) & ~63ull);
+        }
+
+    } // namespace
+
+    void SegmentIndex::Reset(uint64_t baseBytes, bool partial) {
+        header_ = IndexHeader{};
+        header_.magic = kMagic;
+        header_.version = kVersion;
+        header_.flags = partial ? kPartial : 0;
+        header_.fileBytes = baseBytes;
+        bloom_.clear();
+        ids_.clear();
+        checkpoints_.clear();
+        nextCheckpoint_ = baseBytes;
+    }
+
+    void SegmentIndex::Add(uint64_t time, std::wstring_view taskId, uint64_t offset, uint64_t length) {
+        if (header_.lines == 0 || time < header_.firstTime) header_.firstTime = time;
+        if (time > header_.lastTime) header_.lastTime = time;
+        ++header_.lines;
+
+        if (offset >= nextCheckpoint_) {
+            checkpoints_.push_back({ offset, time });
+            nextCheckpoint_ = offset + kCheckpointStep;
+        }
+        header_.fileBytes = (std::max)(header_.fileBytes, offset + length);
+
+        if (taskId.empty()) return;
+        ++header_.taskLines;
+        ids_.insert(IdHash(taskId));
+    }
+
+    bool SegmentIndex::MayContain(std::wstring_view taskId) const {
+        if (header_.taskLines == 0) return false;
+        uint64_t h1 = IdHash(taskId);
+        if (bloom_.empty()) return ids_.count(h1) != 0;   // индекс еще пишется, фильтра нет
+        uint64_t h2 = SecondHash(h1);
+        for (uint32_t i = 0; i < kBloomHashes; ++i) {
+            uint32_t bit = (uint32_t)((h1 + i * h2) % header_.bloomBits);
+            if (!(bloom_[bit >> 3] & (1u << (bit & 7)))) return false;
+        }
+        return true;
+    }
+
+    bool SegmentIndex::Overlaps(uint64_t from, uint64_t to) const {
+        if (header_.lines == 0) return false;
+        return header_.lastTime >= from && header_.firstTime <= to;
+    }
+
+    uint64_t SegmentIndex::SeekOffset(uint64_t from) const {
+        // Последняя контрольная точка строго раньше from: строки одной секунды могут
+        // идти вперемешку из разных потоков, поэтому равные не годятся
+        uint64_t offset = 0;
+        for (const auto& c : checkpoints_) {
+            if (c.time >= from) break;
+            offset = c.offset;
+        }
+        return offset;
+    }
+
+    bool SegmentIndex::Usable(uint64_t actualBytes) const {
+        return Covers(actualBytes) && header_.fileBytes == actualBytes;
+    }
+
+    bool SegmentIndex::Covers(uint64_t actualBytes) const {
+        return header_.magic == kMagic && !(header_.flags & kPartial) && header_.fileBytes <= actualBytes;
+    }
+
+    std::string SegmentIndex::Serialize() const {
+        IndexHeader h = header_;
+        h.checkpointCount = (uint32_t)checkpoints_.size();
+        h.idCount = (uint32_t)ids_.size();
+        h.bloomBits = BloomBitsFor(ids_.size());
+
+        // Фильтр - под число различных id сегмента, а не фиксированного размера
+        std::vector<uint8_t> bloom(h.bloomBits / 8, 0);
+        std::vector<uint64_t> ids(ids_.begin(), ids_.end());
+        std::sort(ids.begin(), ids.end());
+        for (uint64_t h1 : ids) {
+            uint64_t h2 = SecondHash(h1);
+            for (uint32_t i = 0; i < kBloomHashes; ++i) {
+                uint32_t bit = (uint32_t)((h1 + i * h2) % h.bloomBits);
+                bloom[bit >> 3] |= (uint8_t)(1u << (bit & 7));
+            }
+        }
+
+        std::string out(sizeof(h) + bloom.size() + ids.size() * sizeof(uint64_t) +
+            checkpoints_.size() * sizeof(Checkpoint), '\0');
+        char* p = out.data();
+        memcpy(p, &h, sizeof(h));
+        p += sizeof(h);
+        memcpy(p, bloom.data(), bloom.size());
+        p += bloom.size();
+        if (!ids.empty()) memcpy(p, ids.data(), ids.size() * sizeof(uint64_t));
+        p += ids.size() * sizeof(uint64_t);
+        if (!checkpoints_.empty()) memcpy(p, checkpoints_.data(), checkpoints_.size() * sizeof(Checkpoint));
+        return out;
+    }
+
+    bool SegmentIndex::Parse(const std::string& data) {
+        IndexHeader h;
+        if (data.size() < sizeof(h)) return false;
+        memcpy(&h, data.data(), sizeof(h));
+        if (h.magic != kMagic || h.version != kVersion || h.bloomBits == 0 || (h.bloomBits & 7)) return false;
+
+        size_t bloomBytes = h.bloomBits / 8;
+        size_t need = sizeof(h) + bloomBytes + (size_t)h.idCount * sizeof(uint64_t) +
+            (size_t)h.checkpointCount * sizeof(Checkpoint);
+        if (data.size() != need) return false;
+
+        header_ = h;
+        const char* p = data.data() + sizeof(h);
+        bloom_.assign((const uint8_t*)p, (const uint8_t*)p + bloomBytes);
+        p += bloomBytes;
+        ids_.clear();
+        ids_.reserve(h.idCount);
+        for (uint32_t i = 0; i < h.idCount; ++i, p += sizeof(uint64_t)) {
+            uint64_t id;
+            memcpy(&id, p, sizeof(id));
+            ids_.insert(id);
+        }
+        checkpoints_.resize(h.checkpointCount);
+        if (h.checkpointCount) memcpy(checkpoints_.data(), p, h.checkpointCount * sizeof(Checkpoint));
+        nextCheckpoint_ = checkpoints_.empty() ? 0 : checkpoints_.back().offset + kCheckpointStep;
+        return true;
+    }
+
+    std::wstring IndexPathFor(const std::wstring& segmentPath, bool active) {
+        if (active) return segmentPath + L".idx";
+        size_t dot = segmentPath.find_last_of(L'.');
+        size_t slash = segmentPath.find_last_of(L"\\/");
+        if (dot == std::wstring::npos || (slash != std::wstring::npos && dot < slash)) return segmentPath + L".idx";
+        return segmentPath.substr(0, dot) + L".idx";
+    }
+
+} // namespace logidx
@@ -0,0 +1,90 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Разреженный индекс сегмента текстового журнала - общий для Logger и LogDecoder --task.
+//
+// Рядом с каждым сегментом scheduler.YYYYMMDD-HHMMSS.log лежит scheduler.YYYYMMDD-HHMMSS.idx
+// (у активного scheduler.log - scheduler.log.idx, пишется при ротации, раз в kSaveIntervalMs и при выходе):
+//   IndexHeader                     диапазон времени, размер сегмента на момент записи индекса
+//   bloom[bloomBits / 8]            фильтр Блума по task id строк сегмента, kBloomBitsPerId на id
+//   uint64_t[idCount]               хеши различных task id - по ним размер фильтра пересчитывается,
+//                                   когда Logger продолжает индекс сегмента после перезапуска
+//   Checkpoint[checkpointCount]     (смещение начала строки, время) примерно через каждые kCheckpointStep байт
+//
+// Индекс описывает первые fileBytes байт сегмента. Активный сегмент дописывается после
+// сохранения индекса - хвост за fileBytes читается целиком. С kPartial (писал другой экземпляр,
+// аварийное завершение) или fileBytes больше размера на диске сегмент читается целиком.
+// Время - UTC FILETIME, числа - little-endian.
+namespace logidx {
+
+    constexpr uint32_t kMagic = 0x5844494C;     // "LIDX"
+    constexpr uint16_t kVersion = 2;
+    constexpr uint32_t kBloomBitsPerId = 10;    // ~1% ложных срабатываний при kBloomHashes = 5
+    constexpr uint32_t kMinBloomBits = 1024;
+    constexpr uint16_t kBloomHashes = 5;
+    constexpr uint64_t kSaveIntervalMs = 30 * 1000;
+    constexpr uint64_t kCheckpointStep = 64 * 1024;
+
+    constexpr uint16_t kPartial = 1;            // часть строк сегмента не попала в индекс
+
+    struct IndexHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t flags;
+        uint64_t firstTime;
+        uint64_t lastTime;
+        uint64_t fileBytes;
+        uint32_t lines;
+        uint32_t taskLines;
+        uint32_t bloomBits;
+        uint32_t checkpointCount;
+        uint32_t idCount;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(IndexHeader) == 56, "IndexHeader layout");
+
+    struct Checkpoint {
+        uint64_t offset;
+        uint64_t time;
+    };
+
+    class SegmentIndex {
+    public:
+        SegmentIndex() { Reset(0, false); }
+
+        // Новый сегмент; baseBytes > 0 - в файле уже есть строки, не попавшие в индекс
+        void Reset(uint64_t baseBytes, bool partial);
+
+        // Строка записана по смещению offset (до записи), length байт
+        void Add(uint64_t time, std::wstring_view taskId, uint64_t offset, uint64_t length);
+
+        // По фильтру Блума - для индекса, прочитанного Parse
+        bool MayContain(std::wstring_view taskId) const;
+        bool Overlaps(uint64_t from, uint64_t to) const;
+        // Смещение, с которого можно начинать чтение строк не раньше from
+        uint64_t SeekOffset(uint64_t from) const;
+        bool Usable(uint64_t actualBytes) const;     // описывает сегмент целиком
+        bool Covers(uint64_t actualBytes) const;     // описывает начало сегмента, хвост дописан позже
+
+        std::string Serialize() const;
+        bool Parse(const std::string& data);
+
+        const IndexHeader& Header() const { return header_; }
+
+    private:
+        IndexHeader header_{};
+        std::vector<uint8_t> bloom_;
+        std::unordered_set<uint64_t> ids_;   // хеши различных task id; фильтр строится из них в Serialize
+        std::vector<Checkpoint> checkpoints_;
+        uint64_t nextCheckpoint_ = 0;
+    };
+
+    // Путь индекса для сегмента: scheduler.X.log -> scheduler.X.idx, scheduler.log -> scheduler.log.idx
+    std::wstring IndexPathFor(const std::wstring& segmentPath, bool active);
+
+} // namespace logidx
@@ -1,28 +1,359 @@
 #include "Logger.h"
+#include "Latency.h"
 #include "Utils.h"       //  GetAppDataDir/TimePointToWString
-#include <fstream>
+#include "Utf8File.h"
 #include <chrono>
+#include <vector>
+#include <algorithm>
+#include <Windows.h>
+#include <winioctl.h>
 
 Logger g_Logger;
 
-Logger::Logger() {
-    std::wstring dir = util::GetAppDataDir();
-    logFilePath_ = dir + L"\\scheduler.log";
+static thread_local const std::wstring* t_taskId = nullptr;
+
+LogTaskScope::LogTaskScope(std::wstring_view taskId) : taskId_(taskId), prev_(t_taskId) {
+    t_taskId = &taskId_;
+}
+
+LogTaskScope::~LogTaskScope() {
+    t_taskId = prev_;
+}
+
+static uint64_t NowFileTime() {
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+static uint64_t ToFileTime(std::chrono::system_clock::time_point tp) {
+    using ticks = std::chrono::duration<int64_t, std::ratio<1, 10000000>>;
+    return (uint64_t)std::chrono::duration_cast<ticks>(tp.time_since_epoch()).count() + 116444736000000000ull;
+}
+
+static bool ReadBytes(const std::wstring& path, std::string& out) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, 0, NULL);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size{};
+    bool ok = GetFileSizeEx(h, &size) && size.QuadPart < (1 << 24);
+    if (ok) {
+        out.resize((size_t)size.QuadPart);
+        DWORD read = 0;
+        ok = out.empty() || (ReadFile(h, out.data(), (DWORD)out.size(), &read, NULL) && read == out.size());
+    }
+    CloseHandle(h);
+    return ok;
+}
+
+//    scheduler.ini ():
+//   [Logging] MaxSizeMB=10, RotateHours=24, KeepFiles=10, KeepTotalMB=100, Compress=1
+void Logger::ConfigureLocked() {
+    if (configured_) return;
+    configured_ = true;
+    logDir_ = util::GetAppDataDir();
+    logFilePath_ = logDir_ + L"\\scheduler.log";
+
+    std::wstring ini = logDir_ + L"\\scheduler.ini";
+    UINT maxMB = GetPrivateProfileIntW(L"Logging", L"MaxSizeMB", 10, ini.c_str());
+    maxBytes_ = (uint64_t)(std::max)(maxMB, 1u) * 1024 * 1024;
+    rotateSeconds_ = (uint64_t)GetPrivateProfileIntW(L"Logging", L"RotateHours", 24, ini.c_str()) * 3600;
+    keepFiles_ = GetPrivateProfileIntW(L"Logging", L"KeepFiles", 10, ini.c_str());
+    keepTotalBytes_ = (uint64_t)GetPrivateProfileIntW(L"Logging", L"KeepTotalMB", 100, ini.c_str()) * 1024 * 1024;
+    compress_ = GetPrivateProfileIntW(L"Logging", L"Compress", 1, ini.c_str()) != 0;
+}
+
+void Logger::Start() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        ConfigureLocked();
+    }
+    std::lock_guard<std::mutex> lk(queueMtx_);
+    if (compressor_.joinable()) return;
+    stop_ = false;
+    //  :  ,    ,   
+    compressor_ = std::thread(&Logger::CompressorProc, this);
+}
+
+void Logger::Stop() {
+    {
+        std::lock_guard<std::mutex> lk(queueMtx_);
+        stop_ = true;
+    }
+    queueCv_.notify_all();
+    if (compressor_.joinable()) compressor_.join();
+}
+
+Logger::~Logger() {
+    Stop();
+
+    if (file_) {
+        SaveIndexLocked(logidx::IndexPathFor(logFilePath_, true));
+        CloseHandle((HANDLE)file_);
+    }
+}
+
+Logger::IndexSnapshot Logger::SnapshotIndexLocked(const std::wstring& path) {
+    lastIndexSave_ = GetTickCount64();
+    return IndexSnapshot{ path, index_.Serialize(), ++indexSeq_ };
+}
+
+void Logger::SaveIndexLocked(const std::wstring& path) {
+    WriteIndex(SnapshotIndexLocked(path));
+}
+
+//  mtx_       (,    ,
+//   ) -       
+void Logger::WriteIndex(const IndexSnapshot& snap) {
+    std::lock_guard<std::mutex> lk(indexWriteMtx_);
+    if (snap.seq <= indexWrittenSeq_) return;
+    indexWrittenSeq_ = snap.seq;
+
+    const std::wstring& path = snap.path;
+    const std::string& data = snap.data;
+    //   : LogDecoder         
+    std::wstring tmp = path + L".tmp";
+    HANDLE h = CreateFileW(tmp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE) return;
+    DWORD written = 0;
+    bool ok = WriteFile(h, data.data(), (DWORD)data.size(), &written, NULL) && written == data.size();
+    CloseHandle(h);
+    if (!ok || !MoveFileExW(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(tmp.c_str());   //    
+    }
+}
+
+void Logger::OpenLocked() {
+    ConfigureLocked();
+    // FILE_SHARE_DELETE:       
+    HANDLE h = CreateFileW(logFilePath_.c_str(), FILE_APPEND_DATA | FILE_READ_ATTRIBUTES | FILE_WRITE_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE) return;
+    bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+    file_ = h;
+
+    LARGE_INTEGER size{};
+    fileSize_ = GetFileSizeEx(h, &size) ? (uint64_t)size.QuadPart : 0;
+
+    FILETIME created{};
+    if (existed && GetFileTime(h, &created, NULL, NULL)) {
+        segmentStart_ = ((uint64_t)created.dwHighDateTime << 32) | created.dwLowDateTime;
+    }
+    else {
+        //  :  NTFS     
+        segmentStart_ = NowFileTime();
+        created.dwLowDateTime = (DWORD)segmentStart_;
+        created.dwHighDateTime = (DWORD)(segmentStart_ >> 32);
+        SetFileTime(h, &created, NULL, NULL);
+    }
+    lastIdentityCheck_ = GetTickCount64();
+
+    //       ,      
+    //  ;    fileSize_    LogDecoder   
+    index_.Reset(fileSize_, fileSize_ > 0);
+    std::string saved;
+    logidx::SegmentIndex loaded;
+    if (fileSize_ > 0 && ReadBytes(logidx::IndexPathFor(logFilePath_, true), saved) &&
+        loaded.Parse(saved) && loaded.Usable(fileSize_)) {
+        index_ = loaded;
+    }
+}
+
+bool Logger::NeedsRotationLocked(size_t incoming) {
+    if (fileSize_ > 0 && fileSize_ + incoming > maxBytes_) return true;
+    if (rotateSeconds_ && fileSize_ > 0 && NowFileTime() - segmentStart_ >= rotateSeconds_ * 10000000ull) return true;
+
+    //   :       (   )
+    uint64_t tick = GetTickCount64();
+    if (tick - lastIdentityCheck_ >= 1000) {
+        lastIdentityCheck_ = tick;
+        BY_HANDLE_FILE_INFORMATION mine{}, onDisk{};
+        HANDLE h = CreateFileW(logFilePath_.c_str(), FILE_READ_ATTRIBUTES,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+        bool same = false;
+        if (h != INVALID_HANDLE_VALUE) {
+            same = GetFileInformationByHandle((HANDLE)file_, &mine) && GetFileInformationByHandle(h, &onDisk) &&
+                mine.nFileIndexHigh == onDisk.nFileIndexHigh && mine.nFileIndexLow == onDisk.nFileIndexLow &&
+                mine.dwVolumeSerialNumber == onDisk.dwVolumeSerialNumber;
+            CloseHandle(h);
+        }
+        if (!same) {
+            CloseHandle((HANDLE)file_);
+            file_ = nullptr;
+            OpenLocked();
+        }
+    }
+    return false;
+}
+
+void Logger::RotateLocked() {
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+    wchar_t stamp[32];
+    swprintf_s(stamp, L"%04u%02u%02u-%02u%02u%02u",
+        st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+
+    CloseHandle((HANDLE)file_);
+    file_ = nullptr;
+
+    //  ;    -   ,  -  .
+    //     ;     .
+    std::wstring rotated;
+    bool renamed = false;
+    for (int n = 0; n < 100; ++n) {
+        rotated = logDir_ + L"\\scheduler." + stamp + (n ? L"-" + std::to_wstring(n) : L"") + L".log";
+        if (MoveFileExW(logFilePath_.c_str(), rotated.c_str(), MOVEFILE_WRITE_THROUGH)) {
+            SaveIndexLocked(logidx::IndexPathFor(rotated, false));
+            DeleteFileW(logidx::IndexPathFor(logFilePath_, true).c_str());
+            EnqueueSegment(rotated);
+            renamed = true;
+            break;
+        }
+        if (GetLastError() != ERROR_ALREADY_EXISTS) break;  //     
+    }
+
+    OpenLocked();
+    //       ,     
+    if (renamed && file_) SaveIndexLocked(logidx::IndexPathFor(logFilePath_, true));
+
+    //   (     FILE_SHARE_DELETE) -  
+    //   ,     
+    if (!renamed && file_) {
+        fileSize_ = 0;
+        segmentStart_ = NowFileTime();
+    }
+}
+
+void Logger::EnqueueSegment(const std::wstring& path) {
+    {
+        std::lock_guard<std::mutex> lk(queueMtx_);
+        queue_.push_back(path);
+    }
+    queueCv_.notify_one();
+}
+
+//   NTFS (FSCTL_SET_COMPRESSION):   
+//  ,   ,      .
+static bool CompressSegment(const std::wstring& path) {
+    DWORD attrs = GetFileAttributesW(path.c_str());
+    if (attrs == INVALID_FILE_ATTRIBUTES) return true;          //  
+    if (attrs & FILE_ATTRIBUTE_COMPRESSED) return true;
+
+    //  FILE_SHARE_WRITE:   ,       
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+        NULL, OPEN_EXISTING, 0, NULL);
+    if (h == INVALID_HANDLE_VALUE) return GetLastError() != ERROR_SHARING_VIOLATION;
+
+    USHORT format = COMPRESSION_FORMAT_DEFAULT;
+    DWORD ret = 0;
+    DeviceIoControl(h, FSCTL_SET_COMPRESSION, &format, sizeof(format), NULL, 0, &ret, NULL);
+    CloseHandle(h);
+    return true;   //    (FAT) -   
+}
+
+void Logger::ApplyRetention() {
+    struct Segment { std::wstring path; uint64_t bytes; };
+    std::vector<Segment> segments;
+
+    WIN32_FIND_DATAW fd;
+    HANDLE find = FindFirstFileW((logDir_ + L"\\scheduler.*.log").c_str(), &fd);
+    if (find == INVALID_HANDLE_VALUE) return;
+    do {
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        std::wstring path = logDir_ + L"\\" + fd.cFileName;
+        //     ( )
+        DWORD high = 0;
+        DWORD low = GetCompressedFileSizeW(path.c_str(), &high);
+        uint64_t bytes = (low == INVALID_FILE_SIZE && GetLastError() != NO_ERROR)
+            ? (((uint64_t)fd.nFileSizeHigh << 32) | fd.nFileSizeLow)
+            : (((uint64_t)high << 32) | low);
+        segments.push_back({ path, bytes });
+    } while (FindNextFileW(find, &fd));
+    FindClose(find);
+
+    //  -  
+    std::sort(segments.begin(), segments.end(),
+        [](const Segment& a, const Segment& b) { return a.path < b.path; });
+
+    uint64_t total = 0;
+    for (auto& s : segments) total += s.bytes;
+
+    size_t count = segments.size();
+    for (auto& s : segments) {
+        bool overCount = keepFiles_ && count > keepFiles_;
+        bool overBytes = keepTotalBytes_ && total > keepTotalBytes_;
+        if (!overCount && !overBytes) break;
+        if (DeleteFileW(s.path.c_str())) {
+            DeleteFileW(logidx::IndexPathFor(s.path, false).c_str());
+            --count;
+            total -= s.bytes;
+        }
+    }
 }
 
-Logger::~Logger() = default;
+void Logger::CompressorProc() {
+    //  :    CPU,  -
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+    //    (,    )
+    if (compress_) {
+        WIN32_FIND_DATAW fd;
+        HANDLE find = FindFirstFileW((logDir_ + L"\\scheduler.*.log").c_str(), &fd);
+        if (find != INVALID_HANDLE_VALUE) {
+            do {
+                if (!(fd.dwFileAttributes & (FILE_ATTRIBUTE_COMPRESSED | FILE_ATTRIBUTE_DIRECTORY)))
+                    EnqueueSegment(logDir_ + L"\\" + fd.cFileName);
+            } while (FindNextFileW(find, &fd));
+            FindClose(find);
+        }
+    }
+    ApplyRetention();
+
+    std::unique_lock<std::mutex> lk(queueMtx_);
+    while (true) {
+        //      5 
+        queueCv_.wait_for(lk, std::chrono::seconds(5), [this] { return stop_ || !queue_.empty(); });
+        if (stop_) break;
+        if (queue_.empty()) continue;
+
+        std::deque<std::wstring> batch;
+        batch.swap(queue_);
+        lk.unlock();
+
+        std::deque<std::wstring> busy;
+        for (auto& path : batch) {
+            if (compress_ && !CompressSegment(path)) busy.push_back(path);
+        }
+        ApplyRetention();
+
+        lk.lock();
+        for (auto& path : busy) queue_.push_back(path);
+        if (!busy.empty()) {
+            queueCv_.wait_for(lk, std::chrono::seconds(5), [this] { return stop_; });
+            if (stop_) break;
+        }
+    }
+
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+}
 
 void Logger::Log(LogLevel level, const std::wstring& tag, const std::wstring& message) {
-    std::lock_guard<std::mutex> lock(mtx_);
+    Write(level, tag, t_taskId ? std::wstring_view(*t_taskId) : std::wstring_view(), message);
+}
+
+void Logger::Log(LogLevel level, const std::wstring& tag, std::wstring_view taskId, const std::wstring& message) {
+    Write(level, tag, taskId, message);
+}
 
+void Logger::Write(LogLevel level, const std::wstring& tag, std::wstring_view taskId, const std::wstring& message) {
+    if ((int)level < minLevel_.load(std::memory_order_relaxed)) return;
+    LATENCY_SCOPE("Logger::Log");
     const wchar_t* levelNames[] = { L"DEBUG", L"INFO", L"WARN", L"ERROR" };
 
     auto now = std::chrono::system_clock::now();
+    uint64_t ft = ToFileTime(now);
     std::wstring ts = util::TimePointToWString(now);
 
-    std::wofstream ofs(logFilePath_, std::ios::app);
-    if (!ofs) return; // best-effort
-
     int idx = 0;
     switch (level) {
     case LogLevel::Debug: idx = 0; break;
@@ -32,6 +363,40 @@ void Logger::Log(LogLevel level, const std::wstring& tag, const std::wstring& me
     default: idx = 1; break;
     }
 
-    ofs << ts << L" [" << levelNames[idx] << L"] [" << tag << L"] " << message << L"\n";
-    ofs.close();
+    //    -  
+    std::wstring line = ts + L" [" + levelNames[idx] + L"] [" + tag + L"] ";
+    if (!taskId.empty()) line.append(L"[task=").append(taskId).append(L"] ");
+    line += message + L"\n";
+    std::string bytes = util::ToUtf8(line);
+
+    //   mtx_ -   ;     
+    IndexSnapshot snap;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+
+        //   ; FILE_APPEND_DATA -      
+        if (!file_) {
+            OpenLocked();
+            if (!file_) return; // best-effort
+        }
+
+        //       mtx_,   :      
+        if (NeedsRotationLocked(bytes.size())) {
+            RotateLocked();
+            if (!file_) return;
+        }
+
+        DWORD written = 0;
+        if (WriteFile((HANDLE)file_, bytes.data(), (DWORD)bytes.size(), &written, NULL)) {
+            index_.Add(ft, taskId, fileSize_, written);
+            fileSize_ += written;
+        }
+
+        //      kSaveIntervalMs : LogDecoder 
+        //          
+        if (GetTickCount64() - lastIndexSave_ >= logidx::kSaveIntervalMs) {
+            snap = SnapshotIndexLocked(logidx::IndexPathFor(logFilePath_, true));
+        }
+    }
+    if (!snap.data.empty()) WriteIndex(snap);
 }
@@ -1,6 +1,13 @@
 #pragma once
 #include <string>
 #include <mutex>
+#include <thread>
+#include <deque>
+#include <condition_variable>
+#include <cstdint>
+#include <string_view>
+#include <atomic>
+#include "LogIndex.h"
 
 /// Logger.h
 ///  enum LogLevel      WinAPI .
@@ -8,15 +15,88 @@ enum class LogLevel { Debug, Info, Warn, Error };
 
 class Logger {
 public:
-    Logger();
+    Logger() = default;
     ~Logger();
 
+    //        -  wWinMain,   
+    // .  Start    ,    
+    void Start();
+    void Stop();
+
     // thread-safe logging
     void Log(LogLevel level, const std::wstring& tag, const std::wstring& message);
+    //    [task=<id>]; id     (LogDecoder --task)
+    void Log(LogLevel level, const std::wstring& tag, std::wstring_view taskId, const std::wstring& message);
+
+    //     (    Error)
+    void SetMinLevel(LogLevel level) { minLevel_.store((int)level); }
+    LogLevel GetMinLevel() const { return (LogLevel)minLevel_.load(); }
 
 private:
+    void Write(LogLevel level, const std::wstring& tag, std::wstring_view taskId, const std::wstring& message);
+    //  :  -  mtx_,   -  mtx_ (WriteIndex);
+    // SaveIndexLocked -      (, )
+    struct IndexSnapshot {
+        std::wstring path;
+        std::string data;
+        uint64_t seq = 0;
+    };
+    IndexSnapshot SnapshotIndexLocked(const std::wstring& path);
+    void WriteIndex(const IndexSnapshot& snap);
+    void SaveIndexLocked(const std::wstring& path);
+    void ConfigureLocked();   //   [Logging] -       Start
+
+    // : scheduler.log -> scheduler.YYYYMMDD-HHMMSS.log ( MoveFileExW  mtx_),
+    //      -      .
+    void OpenLocked();
+    void RotateLocked();
+    bool NeedsRotationLocked(size_t incoming);
+    void CompressorProc();
+    void EnqueueSegment(const std::wstring& path);
+    void ApplyRetention();
+
     std::wstring logFilePath_;
+    std::wstring logDir_;
+    void* file_ = nullptr;   // HANDLE,   ;    UTF-8
     std::mutex mtx_;
+    std::atomic<int> minLevel_{ (int)LogLevel::Debug };
+
+    uint64_t fileSize_ = 0;
+    uint64_t segmentStart_ = 0;       // FILETIME   
+    uint64_t lastIdentityCheck_ = 0;  // GetTickCount64     
+    logidx::SegmentIndex index_;      //   task id   
+    uint64_t lastIndexSave_ = 0;      // GetTickCount64     
+    uint64_t indexSeq_ = 0;           //    ( mtx_)
+    std::mutex indexWriteMtx_;        //   .tmp;    
+    uint64_t indexWrittenSeq_ = 0;
+
+    // [Logging]  scheduler.ini
+    uint64_t maxBytes_ = 10ull * 1024 * 1024;
+    uint64_t rotateSeconds_ = 24 * 3600;   // 0 -    
+    uint32_t keepFiles_ = 10;
+    uint64_t keepTotalBytes_ = 100ull * 1024 * 1024;
+    bool compress_ = true;
+    bool configured_ = false;
+
+    std::thread compressor_;
+    std::mutex queueMtx_;
+    std::condition_variable queueCv_;
+    std::deque<std::wstring> queue_;
+    bool stop_ = false;
+};
+
+//     : Log   taskId   
+//  [task=<id>].  ,     .
+class LogTaskScope {
+public:
+    explicit LogTaskScope(std::wstring_view taskId);
+    ~LogTaskScope();
+    LogTaskScope(const LogTaskScope&) = delete;
+    LogTaskScope& operator=(const LogTaskScope&) = delete;
+
+private:
+    std::wstring taskId_;
+    const std::wstring* prev_;
 };
 
 //   (    )
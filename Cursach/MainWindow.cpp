@@ -6,10 +6,18 @@
 #include <string>
 #include <algorithm>
 #include "JobExecutor.h"
+#include "Latency.h"
 
 #define IDM_ABOUT 3001  // ← ID меню "About"
+#define IDM_LATENCY 3002
+#define IDM_DISPATCH 3003
+#define WM_APP_VIEW_CHANGED (WM_USER + 101)  // TaskViewModel: есть измененные строки
+#define IDT_VIEW_REFRESH 1                   // разбор очереди TaskViewModel не чаще раза в kViewRefreshMs
+static const UINT kViewRefreshMs = 100;
+#define IDT_RUN_STATS 2                      // колонка Runs: счетчики запусков меняются без событий модели
+static const UINT kRunStatsRefreshMs = 2000;
 
-MainWindow::MainWindow(TaskManager* tm, Scheduler* sched) : taskManager(tm), scheduler(sched) {}
+MainWindow::MainWindow(TaskManager* tm, Scheduler* sched) : taskManager(tm), scheduler(sched), viewModel(tm) {}
 
 MainWindow::~MainWindow() {}
 
@@ -25,6 +33,8 @@ bool MainWindow::Create(HINSTANCE hInst) {
     // ← ИЗМЕНЕНО: Добавляем меню
     HMENU hMenu = CreateMenu();
     HMENU hHelpMenu = CreatePopupMenu();
+    AppendMenuW(hHelpMenu, MF_STRING, IDM_LATENCY, L"Latency Report");
+    AppendMenuW(hHelpMenu, MF_STRING, IDM_DISPATCH, L"Dispatch Report");
     AppendMenuW(hHelpMenu, MF_STRING, IDM_ABOUT, L"About");
     AppendMenuW(hMenu, MF_POPUP, (UINT_PTR)hHelpMenu, L"Help");
 
@@ -42,7 +52,8 @@ void MainWindow::CreateControls() {
     RECT rc;
     GetClientRect(hwnd, &rc);
 
-    hList = CreateWindowExW(0, WC_LISTVIEWW, L"", WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL,
+    // LVS_OWNERDATA: ListView не хранит строки, текст запрашивается через LVN_GETDISPINFO
+    hList = CreateWindowExW(0, WC_LISTVIEWW, L"", WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL | LVS_OWNERDATA,
         10, 80, rc.right - 20, rc.bottom - 90, hwnd, (HMENU)1001, GetModuleHandle(NULL), NULL);
 
     ListView_SetExtendedListViewStyle(hList, LVS_EX_FULLROWSELECT | LVS_EX_GRIDLINES);
@@ -53,6 +64,7 @@ void MainWindow::CreateControls() {
     col.pszText = (LPWSTR)L"Trigger"; col.cx = 120; ListView_InsertColumn(hList, 2, &col);
     col.pszText = (LPWSTR)L"Next Run"; col.cx = 200; ListView_InsertColumn(hList, 3, &col);
     col.pszText = (LPWSTR)L"Executable"; col.cx = 260; ListView_InsertColumn(hList, 4, &col);
+    col.pszText = (LPWSTR)L"Runs"; col.cx = 200; ListView_InsertColumn(hList, 5, &col);
 
     CreateWindowW(L"BUTTON", L"New", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON, 10, 10, 80, 30, hwnd, (HMENU)2001, GetModuleHandle(NULL), NULL);
     CreateWindowW(L"BUTTON", L"Edit", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON, 100, 10, 80, 30, hwnd, (HMENU)2002, GetModuleHandle(NULL), NULL);
@@ -69,73 +81,118 @@ void MainWindow::CreateControls() {
         WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
         150, 45, 130, 25, hwnd, (HMENU)2008, GetModuleHandle(NULL), NULL);
 
+    hCheckSortNextRun = CreateWindowW(L"BUTTON", L"Sort by Next Run",
+        WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
+        290, 45, 140, 25, hwnd, (HMENU)2010, GetModuleHandle(NULL), NULL);
+
+    hFilterCombo = CreateWindowW(L"COMBOBOX", L"",
+        WS_CHILD | WS_VISIBLE | CBS_DROPDOWNLIST | WS_VSCROLL,
+        590, 14, 130, 100, hwnd, (HMENU)2011, GetModuleHandle(NULL), NULL);
+    SendMessageW(hFilterCombo, CB_ADDSTRING, 0, (LPARAM)L"All tasks");
+    SendMessageW(hFilterCombo, CB_ADDSTRING, 0, (LPARAM)L"Enabled only");
+    SendMessageW(hFilterCombo, CB_ADDSTRING, 0, (LPARAM)L"Disabled only");
+    SendMessageW(hFilterCombo, CB_SETCURSEL, 0, 0);
+
+    // Поиск по имени, описанию и пути к exe (TaskManager::Search, триграммный индекс)
+    hSearchEdit = CreateWindowExW(WS_EX_CLIENTEDGE, L"EDIT", L"",
+        WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
+        730, 14, 150, 24, hwnd, (HMENU)2012, GetModuleHandle(NULL), NULL);
+    SendMessageW(hSearchEdit, EM_SETCUEBANNER, FALSE, (LPARAM)L"Search...");
+
     hStatLabel = CreateWindowW(L"STATIC", L"",
         WS_CHILD | WS_VISIBLE | SS_LEFT,
-        300, 45, 550, 25, hwnd, (HMENU)2009, GetModuleHandle(NULL), NULL);
+        440, 45, 440, 25, hwnd, (HMENU)2009, GetModuleHandle(NULL), NULL);
+
+    // Изменения приходят из любого потока (планировщик, фоновые запуски) - в окно через очередь
+    HWND target = hwnd;
+    viewModel.SetOnChanged([target]() { PostMessageW(target, WM_APP_VIEW_CHANGED, 0, 0); });
 
     RefreshList();
+    SetTimer(hwnd, IDT_RUN_STATS, kRunStatsRefreshMs, NULL);
 }
 
+// Полная перерисовка: число строк + invalidate. Данные уже лежат в viewModel.
 void MainWindow::RefreshList() {
     if (!hList) return;
-    ListView_DeleteAllItems(hList);
+    viewModel.TakeChanges();
+    ListView_SetItemCountEx(hList, (int)viewModel.Count(), LVSICF_NOSCROLL);
+    InvalidateRect(hList, NULL, FALSE);
+    UpdateStatistics();
+}
 
-    auto tasks = taskManager->GetAllTasks();
+// Только то, что изменилось с прошлого раза: новое число строк и диапазон перерисовки
+void MainWindow::ApplyViewChanges() {
+    if (!hList) return;
+    TaskViewModel::Changes c = viewModel.TakeChanges();
+    if (!c.any) return;
 
-    if (sortByStatus || sortByName) {
-        std::stable_sort(tasks.begin(), tasks.end(), [this](const TaskPtr& a, const TaskPtr& b) {
-            if (sortByStatus) {
-                if (a->enabled != b->enabled) {
-                    return a->enabled > b->enabled;
-                }
-            }
+    if (c.countChanged)
+        ListView_SetItemCountEx(hList, (int)viewModel.Count(), LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
+    if (viewModel.Count() > 0)
+        ListView_RedrawItems(hList, (int)c.first, (int)c.last);
+    UpdateStatistics();
+}
 
-            if (sortByName) {
-                return a->name < b->name;
-            }
+// Только строки на экране: LVS_OWNERDATA запросит текст заново (колонка Runs)
+void MainWindow::RedrawVisibleRows() {
+    if (!hList || viewModel.Count() == 0) return;
+    int top = ListView_GetTopIndex(hList);
+    int last = (std::min)(top + ListView_GetCountPerPage(hList), (int)viewModel.Count() - 1);
+    ListView_RedrawItems(hList, top, last);
+}
 
-            return false;
-            });
+void MainWindow::ApplySort() {
+    TaskViewModel::SortKey key = sortByNextRun ? TaskViewModel::SortKey::NextRun
+        : sortByName ? TaskViewModel::SortKey::Name : TaskViewModel::SortKey::None;
+    viewModel.SetSort(key, sortByStatus);
+    ApplyViewChanges();
+}
+
+void MainWindow::OnGetDispInfo(LPARAM lParam) {
+    NMLVDISPINFOW* di = (NMLVDISPINFOW*)lParam;
+    if (!(di->item.mask & LVIF_TEXT)) return;
+
+    TaskViewModel::Row row;
+    if (!viewModel.RowAt((size_t)di->item.iItem, row)) {
+        di->item.pszText[0] = L'\0';
+        return;
     }
 
-    int idx = 0;
-    const wchar_t* triggerNames[] = { L"Once", L"Interval", L"Daily", L"Weekly" };
-    for (auto& t : tasks) {
-        LVITEMW it{};
-        it.mask = LVIF_TEXT;
-        it.iItem = idx;
-        it.pszText = const_cast<LPWSTR>(t->name.c_str());
-        ListView_InsertItem(hList, &it);
-        ListView_SetItemText(hList, idx, 1, const_cast<LPWSTR>((t->enabled ? L"Enabled" : L"Disabled")));
-        ListView_SetItemText(hList, idx, 2, const_cast<LPWSTR>(triggerNames[(int)t->triggerType]));
-        auto ns = util::TimePointToWString(t->nextRunTime);
-        ListView_SetItemText(hList, idx, 3, const_cast<LPWSTR>(ns.c_str()));
-
-        std::wstring fileName = util::GetFileName(t->exePath);
-        ListView_SetItemText(hList, idx, 4, const_cast<LPWSTR>(fileName.c_str()));
-
-        ++idx;
+    const wchar_t* triggerNames[] = { L"Once", L"Interval", L"Daily", L"Weekly", L"File event" };
+    switch (di->item.iSubItem) {
+    case 0: dispText = row.name; break;
+    case 1: dispText = row.enabled ? L"Enabled" : L"Disabled"; break;
+    case 2: dispText = triggerNames[(int)row.trigger]; break;
+    case 3: dispText = util::TimePointToWString(row.nextRunTime); break;
+    case 4: dispText = util::GetFileName(row.task->exePath); break;
+    case 5: {
+        // Перекрытие запусков (overlapPolicy): живые запуски и пропущенные/отложенные срабатывания
+        Scheduler::OverlapStats st = scheduler->GetOverlapStats(row.task);
+        dispText.clear();
+        if (st.running) dispText = std::to_wstring(st.running) + L" running";
+        if (st.skipped) dispText += (dispText.empty() ? L"" : L", ") + std::to_wstring(st.skipped) + L" skipped";
+        if (st.queued) dispText += (dispText.empty() ? L"" : L", ") + std::to_wstring(st.queued) + L" queued";
+        break;
+    }
+    default: dispText.clear(); break;
     }
+    di->item.pszText = const_cast<LPWSTR>(dispText.c_str());
+}
 
-    UpdateStatistics();
+TaskPtr MainWindow::SelectedTask() const {
+    int sel = ListView_GetNextItem(hList, -1, LVNI_SELECTED);
+    return sel < 0 ? nullptr : viewModel.TaskAt((size_t)sel);
 }
 
 void MainWindow::UpdateStatistics() {
     if (!hStatLabel) return;
 
-    auto tasks = taskManager->GetAllTasks();
-    int total = (int)tasks.size();
-    int enabled = 0;
-    int disabled = 0;
-
-    for (const auto& t : tasks) {
-        if (t->enabled) ++enabled;
-        else ++disabled;
-    }
+    // Счетчики ведет viewModel, список не пересчитывается
+    TaskViewModel::Counters c = viewModel.GetCounters();
 
-    std::wstring stat = L"📊 Total: " + std::to_wstring(total) +
-        L"  |  ✓ Enabled: " + std::to_wstring(enabled) +
-        L"  |  ✗ Disabled: " + std::to_wstring(disabled);
+    std::wstring stat = L"📊 Total: " + std::to_wstring(c.total) +
+        L"  |  ✓ Enabled: " + std::to_wstring(c.enabled) +
+        L"  |  ✗ Disabled: " + std::to_wstring(c.disabled);
 
     SetWindowTextW(hStatLabel, stat.c_str());
 }
@@ -147,107 +204,65 @@ void MainWindow::ShowAboutDialog() {
         L"Version 1.0\n\n"
         L"A lightweight task scheduling application for Windows.\n\n"
         L"Features:\n"
-        L"• Once, Interval, Daily, Weekly triggers\n"
+        L"• Once, Interval, Daily, Weekly and file event triggers\n"
         L"• Enable/Disable tasks\n"
         L"• Manual task execution\n"
         L"• Automatic background scheduling\n"
-        L"• Sorting by name and status\n\n"
+        L"• Sorting by name and status\n"
+        L"• Search by name, description and executable\n\n"
         L"© 2025 - Developed with passion";
 
     MessageBoxW(hwnd, about.c_str(), L"About Mini Task Scheduler", MB_OK | MB_ICONINFORMATION);
 }
 
+// Задержки горячих путей с начала работы процесса; копия - в лог
+void MainWindow::ShowLatencyReport() {
+    std::wstring report = latency::Report();
+    g_Logger.Log(LogLevel::Info, L"MainWindow", report);
+    MessageBoxW(hwnd, report.c_str(), L"Latency Report", MB_OK | MB_ICONINFORMATION);
+}
+
+// Ожидание в очереди исполнителя по группам (DRR) с начала работы; копия - в лог
+void MainWindow::ShowDispatchReport() {
+    std::wstring report = scheduler->GroupStatsReport();
+    g_Logger.Log(LogLevel::Info, L"MainWindow", report);
+    MessageBoxW(hwnd, report.c_str(), L"Dispatch Report", MB_OK | MB_ICONINFORMATION);
+}
+
 void MainWindow::OnNew() {
     TaskPtr t;
     if (TaskDialog::ShowDialog(hwnd, t, true)) {
         taskManager->AddTask(t);
         scheduler->Notify();
-        RefreshList();
+        ApplyViewChanges();
     }
 }
 
 void MainWindow::OnEdit() {
-    int sel = ListView_GetNextItem(hList, -1, LVNI_SELECTED);
-    if (sel < 0) return;
-
-    auto tasks = taskManager->GetAllTasks();
-
-    if (sortByStatus || sortByName) {
-        std::stable_sort(tasks.begin(), tasks.end(), [this](const TaskPtr& a, const TaskPtr& b) {
-            if (sortByStatus) {
-                if (a->enabled != b->enabled) {
-                    return a->enabled > b->enabled;
-                }
-            }
-            if (sortByName) {
-                return a->name < b->name;
-            }
-            return false;
-            });
-    }
-
-    if (sel >= (int)tasks.size()) return;
-    TaskPtr t = tasks[sel];
+    TaskPtr t = SelectedTask();
+    if (!t) return;
 
     if (TaskDialog::ShowDialog(hwnd, t, false)) {
         taskManager->UpdateTask(t);
         scheduler->Notify();
-        RefreshList();
+        ApplyViewChanges();
     }
 }
 
 void MainWindow::OnDelete() {
-    int sel = ListView_GetNextItem(hList, -1, LVNI_SELECTED);
-    if (sel < 0) return;
-
-    auto tasks = taskManager->GetAllTasks();
-
-    if (sortByStatus || sortByName) {
-        std::stable_sort(tasks.begin(), tasks.end(), [this](const TaskPtr& a, const TaskPtr& b) {
-            if (sortByStatus) {
-                if (a->enabled != b->enabled) {
-                    return a->enabled > b->enabled;
-                }
-            }
-            if (sortByName) {
-                return a->name < b->name;
-            }
-            return false;
-            });
-    }
-
-    if (sel >= (int)tasks.size()) return;
-    TaskPtr t = tasks[sel];
+    TaskPtr t = SelectedTask();
+    if (!t) return;
 
     if (MessageBoxW(hwnd, (L"Delete task: " + t->name).c_str(), L"Confirm", MB_YESNO) == IDYES) {
-        taskManager->RemoveTask(t->id);
+        taskManager->RemoveTask(std::wstring(t->id));
         scheduler->Notify();
-        RefreshList();
+        ApplyViewChanges();
     }
 }
 
 void MainWindow::OnRun() {
-    int sel = ListView_GetNextItem(hList, -1, LVNI_SELECTED);
-    if (sel < 0) return;
-
-    auto tasks = taskManager->GetAllTasks();
-
-    if (sortByStatus || sortByName) {
-        std::stable_sort(tasks.begin(), tasks.end(), [this](const TaskPtr& a, const TaskPtr& b) {
-            if (sortByStatus) {
-                if (a->enabled != b->enabled) {
-                    return a->enabled > b->enabled;
-                }
-            }
-            if (sortByName) {
-                return a->name < b->name;
-            }
-            return false;
-            });
-    }
-
-    if (sel >= (int)tasks.size()) return;
-    TaskPtr t = tasks[sel];
+    TaskPtr t = SelectedTask();
+    if (!t) return;
 
     std::thread([t, this]() {
         JobExecutor::RunTask(t);
@@ -258,37 +273,18 @@ void MainWindow::OnRun() {
 }
 
 void MainWindow::OnToggleEnabled() {
-    int sel = ListView_GetNextItem(hList, -1, LVNI_SELECTED);
-    if (sel < 0) {
+    TaskPtr t = SelectedTask();
+    if (!t) {
         MessageBoxW(hwnd, L"Please select a task first.", L"Info", MB_OK | MB_ICONINFORMATION);
         return;
     }
 
-    auto tasks = taskManager->GetAllTasks();
-
-    if (sortByStatus || sortByName) {
-        std::stable_sort(tasks.begin(), tasks.end(), [this](const TaskPtr& a, const TaskPtr& b) {
-            if (sortByStatus) {
-                if (a->enabled != b->enabled) {
-                    return a->enabled > b->enabled;
-                }
-            }
-            if (sortByName) {
-                return a->name < b->name;
-            }
-            return false;
-            });
-    }
-
-    if (sel >= (int)tasks.size()) return;
-
-    TaskPtr t = tasks[sel];
     t->enabled = !t->enabled;
 
     g_Logger.Log(
         LogLevel::Info,
         L"MainWindow",
-        L"Task '" + t->name + L"' " + (t->enabled ? L"enabled" : L"disabled")
+        L"Task '" + std::wstring(t->name) + L"' " + (t->enabled ? L"enabled" : L"disabled")
     );
 
     if (t->enabled) {
@@ -300,9 +296,9 @@ void MainWindow::OnToggleEnabled() {
 
     taskManager->UpdateTask(t);
     scheduler->Notify();
-    RefreshList();
+    ApplyViewChanges();
 
-    std::wstring msg = L"Task '" + t->name + L"' is now " + (t->enabled ? L"ENABLED" : L"DISABLED");
+    std::wstring msg = L"Task '" + std::wstring(t->name) + L"' is now " + (t->enabled ? L"ENABLED" : L"DISABLED");
     MessageBoxW(hwnd, msg.c_str(), L"Status Changed", MB_OK | MB_ICONINFORMATION);
 }
 
@@ -335,6 +331,14 @@ LRESULT CALLBACK MainWindow::WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
             wnd->ShowAboutDialog();
             break;
         }
+        if (LOWORD(wParam) == IDM_LATENCY) {
+            wnd->ShowLatencyReport();
+            break;
+        }
+        if (LOWORD(wParam) == IDM_DISPATCH) {
+            wnd->ShowDispatchReport();
+            break;
+        }
 
         switch (LOWORD(wParam)) {
         case 2001: wnd->OnNew(); break;
@@ -342,6 +346,7 @@ LRESULT CALLBACK MainWindow::WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
         case 2003: wnd->OnDelete(); break;
         case 2004: wnd->OnRun(); break;
         case 2005:
+            wnd->viewModel.Reload();
             wnd->RefreshList();
             g_Logger.Log(LogLevel::Info, L"MainWindow", L"Manual refresh triggered");
             break;
@@ -350,7 +355,11 @@ LRESULT CALLBACK MainWindow::WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
         case 2007:
             if (HIWORD(wParam) == BN_CLICKED) {
                 wnd->sortByName = (IsDlgButtonChecked(hWnd, 2007) == BST_CHECKED);
-                wnd->RefreshList();
+                if (wnd->sortByName) {   // имя и следующий запуск - взаимоисключающие ключи
+                    wnd->sortByNextRun = false;
+                    CheckDlgButton(hWnd, 2010, BST_UNCHECKED);
+                }
+                wnd->ApplySort();
                 g_Logger.Log(LogLevel::Info, L"MainWindow",
                     wnd->sortByName ? L"Sort by Name: ON" : L"Sort by Name: OFF");
             }
@@ -359,16 +368,79 @@ LRESULT CALLBACK MainWindow::WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
         case 2008:
             if (HIWORD(wParam) == BN_CLICKED) {
                 wnd->sortByStatus = (IsDlgButtonChecked(hWnd, 2008) == BST_CHECKED);
-                wnd->RefreshList();
+                wnd->ApplySort();
                 g_Logger.Log(LogLevel::Info, L"MainWindow",
                     wnd->sortByStatus ? L"Sort by Status: ON" : L"Sort by Status: OFF");
             }
             break;
+
+        case 2010:
+            if (HIWORD(wParam) == BN_CLICKED) {
+                wnd->sortByNextRun = (IsDlgButtonChecked(hWnd, 2010) == BST_CHECKED);
+                if (wnd->sortByNextRun) {
+                    wnd->sortByName = false;
+                    CheckDlgButton(hWnd, 2007, BST_UNCHECKED);
+                }
+                wnd->ApplySort();
+                g_Logger.Log(LogLevel::Info, L"MainWindow",
+                    wnd->sortByNextRun ? L"Sort by Next Run: ON" : L"Sort by Next Run: OFF");
+            }
+            break;
+
+        case 2011:
+            if (HIWORD(wParam) == CBN_SELCHANGE) {
+                int f = (int)SendMessageW(wnd->hFilterCombo, CB_GETCURSEL, 0, 0);
+                wnd->viewModel.SetFilter(f == 1 ? TaskViewModel::Filter::Enabled
+                    : f == 2 ? TaskViewModel::Filter::Disabled : TaskViewModel::Filter::All);
+                wnd->ApplyViewChanges();
+            }
+            break;
+
+        case 2012:
+            if (HIWORD(wParam) == EN_CHANGE) {
+                int len = GetWindowTextLengthW(wnd->hSearchEdit);
+                std::wstring query(len, L'\0');
+                if (len > 0) GetWindowTextW(wnd->hSearchEdit, &query[0], len + 1);
+                wnd->viewModel.SetSearch(query);
+                wnd->ApplyViewChanges();
+            }
+            break;
         }
         break;
 
+    case WM_NOTIFY: {
+        NMHDR* hdr = (NMHDR*)lParam;
+        if (hdr->hwndFrom == wnd->hList && hdr->code == LVN_GETDISPINFOW) {
+            wnd->OnGetDispInfo(lParam);
+            return 0;
+        }
+        return DefWindowProcW(hWnd, uMsg, wParam, lParam);
+    }
+
     case WM_USER + 100:
-        wnd->RefreshList();
+        wnd->ApplyViewChanges();
+        break;
+
+    // События от планировщика копятся в очереди модели и разбираются пачкой по таймеру
+    case WM_APP_VIEW_CHANGED:
+        SetTimer(hWnd, IDT_VIEW_REFRESH, kViewRefreshMs, NULL);
+        break;
+
+    case WM_TIMER:
+        if (wParam == IDT_RUN_STATS) {
+            wnd->RedrawVisibleRows();
+            break;
+        }
+        if (wParam != IDT_VIEW_REFRESH) return DefWindowProcW(hWnd, uMsg, wParam, lParam);
+        KillTimer(hWnd, IDT_VIEW_REFRESH);
+        wnd->ApplyViewChanges();
+        break;
+
+    // Смена системного времени/часового пояса - планировщик пересчитывает сроки
+    case WM_TIMECHANGE:
+        g_Logger.Log(LogLevel::Info, L"MainWindow", L"WM_TIMECHANGE received");
+        wnd->scheduler->OnClockChanged();
+        wnd->ApplyViewChanges();
         break;
 
     case WM_DESTROY:
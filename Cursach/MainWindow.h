@@ -2,6 +2,8 @@
 #include <Windows.h>
 #include "TaskManager.h"
 #include "Scheduler.h"
+#include "TaskViewModel.h"
+#include <string>
 
 class MainWindow {
 public:
@@ -14,17 +16,30 @@ private:
     HWND hList = nullptr;
     HWND hCheckSortName = nullptr;
     HWND hCheckSortStatus = nullptr;
+    HWND hCheckSortNextRun = nullptr;
+    HWND hFilterCombo = nullptr;
+    HWND hSearchEdit = nullptr;
     HWND hStatLabel = nullptr;
     TaskManager* taskManager;
     Scheduler* scheduler;
+    TaskViewModel viewModel;     // строки ListView (LVS_OWNERDATA) берутся отсюда по номеру
+    std::wstring dispText;       // буфер для LVN_GETDISPINFO
 
     bool sortByName = false;
     bool sortByStatus = false;
+    bool sortByNextRun = false;
 
     void CreateControls();
     void RefreshList();
+    void ApplyViewChanges();
+    void RedrawVisibleRows();
+    void ApplySort();
+    void OnGetDispInfo(LPARAM lParam);
+    TaskPtr SelectedTask() const;
     void UpdateStatistics();
     void ShowAboutDialog();  // ← ДОБАВЛЕНО
+    void ShowLatencyReport();
+    void ShowDispatchReport();
     void OnNew();
     void OnEdit();
     void OnDelete();
@@ -2,212 +2,650 @@
 #include "Task.h"
 #include "Utils.h"
 #include "Logger.h"
-#include <fstream>
-#include <sstream>
+#include "Latency.h"
+#include "Trace.h"
+#include "Utf8File.h"
+#include "JsonSimd.h"
+#include <algorithm>
+#include <atomic>
+#include <cwctype>
+#include <memory_resource>
 #include <Windows.h>
 
+namespace {
+
+    // Upstream арены: считает обращения к куче (одно на чанк, а не на поле/запись)
+    // и помнит чанки, чтобы отличать память арены от памяти кучи
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        size_t allocations = 0;
+        size_t bytes = 0;
+
+        bool Owns(const void* p) const {
+            for (auto& [base, n] : chunks_) {
+                if (p >= base && p < base + n) return true;
+            }
+            return false;
+        }
+
+    private:
+        void* do_allocate(size_t n, size_t align) override {
+            ++allocations;
+            bytes += n;
+            void* p = std::pmr::new_delete_resource()->allocate(n, align);
+            chunks_.emplace_back((const char*)p, n);
+            return p;
+        }
+        void do_deallocate(void* p, size_t n, size_t align) override {
+            std::pmr::new_delete_resource()->deallocate(p, n, align);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override {
+            return this == &o;
+        }
+
+        std::vector<std::pair<const char*, size_t>> chunks_;
+    };
+
+    // Ресурс строк и записей снимка. Пока идет разбор - монотонная арена (к куче - раз на чанк).
+    // После Seal - куча: задачи снимка правят диалог и другие потоки, а арена не
+    // потокобезопасна и памяти не возвращает. Освобождение памяти арены - пустая операция
+    class SnapshotResource : public std::pmr::memory_resource {
+    public:
+        explicit SnapshotResource(size_t initialBytes) : arena_(initialBytes, &upstream_) {}
+
+        void Seal() { sealed_.store(true, std::memory_order_release); }
+        const CountingResource& Upstream() const { return upstream_; }
+
+    private:
+        void* do_allocate(size_t n, size_t align) override {
+            if (!sealed_.load(std::memory_order_acquire)) return arena_.allocate(n, align);
+            return std::pmr::new_delete_resource()->allocate(n, align);
+        }
+        void do_deallocate(void* p, size_t n, size_t align) override {
+            if (!upstream_.Owns(p)) std::pmr::new_delete_resource()->deallocate(p, n, align);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override {
+            return this == &o;
+        }
+
+        CountingResource upstream_;
+        std::pmr::monotonic_buffer_resource arena_;
+        std::atomic<bool> sealed_{ false };
+    };
+
+    // Межпроцессная блокировка tasks.json на время записи и слияния: байт файла tasks.json.lock
+    // (сам tasks.json заменяется переименованием и держать блокировку не может). Не открылся
+    // файл - пишем без блокировки, как до шардирования
+    class StoreLock {
+    public:
+        explicit StoreLock(const std::wstring& path) {
+            file_ = CreateFileW((path + L".lock").c_str(), GENERIC_READ | GENERIC_WRITE,
+                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file_ == INVALID_HANDLE_VALUE) {
+                g_Logger.Log(LogLevel::Warn, L"Persistence",
+                    L"Cannot open store lock file, error=" + std::to_wstring(GetLastError()));
+                return;
+            }
+            OVERLAPPED ov{};
+            if (!LockFileEx(file_, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &ov)) {
+                CloseHandle(file_);
+                file_ = INVALID_HANDLE_VALUE;
+            }
+        }
+        ~StoreLock() {
+            if (file_ == INVALID_HANDLE_VALUE) return;
+            OVERLAPPED ov{};
+            UnlockFileEx(file_, 0, 1, 0, &ov);
+            CloseHandle(file_);
+        }
+        StoreLock(const StoreLock&) = delete;
+        StoreLock& operator=(const StoreLock&) = delete;
+
+    private:
+        HANDLE file_ = INVALID_HANDLE_VALUE;
+    };
+
+    // Снимок загрузки: записи Task и их строки id/name/description лежат подряд в арене.
+    // Все TaskPtr снимка - алиасы одного shared_ptr, арена освобождается вместе с последней
+    // задачей. Чтобы одна оставшаяся задача не держала всю арену, TaskManager копирует
+    // выживших в кучу, когда их меньше половины (см. SnapshotOf)
+    struct TaskSnapshot {
+        explicit TaskSnapshot(size_t initialBytes) : resource(initialBytes) {}
+        ~TaskSnapshot() {
+            for (Task* t : records) t->~Task();
+        }
+
+        Task* Emplace() {
+            Task* t = new (resource.allocate(sizeof(Task), alignof(Task))) Task(&resource);
+            records.push_back(t);
+            return t;
+        }
+
+        SnapshotResource resource;
+        std::pmr::vector<Task*> records{ &resource };
+    };
+
+    // По deleter'у блока управления SnapshotOf узнает снимок задачи (std::get_deleter)
+    struct SnapshotDeleter {
+        TaskSnapshot* snapshot;
+        void operator()(TaskSnapshot* s) const { delete s; }
+    };
+
+    // Разбиение массива "tasks" на блоки записей {...} (кавычки, экранирование, вложенные объекты).
+    // Состояние переносится между порциями текста: один и тот же разбор у Load (документ целиком)
+    // и у ForEachTaskRecord (файл блоками). Char - wchar_t или байты UTF-8: разметка - ASCII.
+    template <class Char>
+    class RecordSplitter {
+    public:
+        using View = std::basic_string_view<Char>;
+
+        // Просматривает еще не просмотренную часть text, на каждую запись - visit(View блока).
+        // Возвращает число байт/символов начала text, которые больше не нужны: вызывающий
+        // убирает их перед следующим вызовом (незавершенная запись остается)
+        template <class Visit>
+        size_t Feed(View text, Visit&& visit) {
+            static const Char kKey[] = { '"', 't', 'a', 's', 'k', 's', '"' };
+            const View key(kKey, sizeof(kKey) / sizeof(Char));
+            size_t i = scanned_;
+            while (i < text.size()) {
+                if (state_ == State::Key) {
+                    size_t k = text.find(key, i);
+                    if (k == View::npos) {
+                        // Ключ мог разрезаться концом порции - хвост остается
+                        i = text.size() > key.size() ? text.size() - key.size() + 1 : 0;
+                        break;
+                    }
+                    state_ = State::Array;
+                    i = k + key.size();
+                }
+                else if (state_ == State::Array) {
+                    size_t k = text.find((Char)'[', i);
+                    if (k == View::npos) { i = text.size(); break; }
+                    state_ = State::Seek;
+                    i = k + 1;
+                }
+                else if (state_ == State::Seek) {
+                    size_t k = text.find((Char)'{', i);
+                    if (k == View::npos) { i = text.size(); break; }
+                    state_ = State::Record;
+                    start_ = k;
+                    depth_ = 1;
+                    inQuotes_ = escape_ = false;
+                    i = k + 1;
+                }
+                else {
+                    for (; i < text.size(); ++i) {
+                        Char c = text[i];
+                        if (escape_) { escape_ = false; continue; }
+                        if (c == (Char)'\\') { escape_ = true; continue; }
+                        if (c == (Char)'"') inQuotes_ = !inQuotes_;
+                        if (!inQuotes_) {
+                            if (c == (Char)'{') ++depth_;
+                            else if (c == (Char)'}') --depth_;
+                            if (depth_ == 0) break;
+                        }
+                    }
+                    if (i >= text.size()) break;
+                    visit(text.substr(start_, i - start_ + 1));
+                    state_ = State::Seek;
+                    ++i;
+                }
+            }
+
+            size_t keep = state_ == State::Record ? start_ : (std::min)(i, text.size());
+            scanned_ = (std::max)(i, keep) - keep;
+            if (state_ == State::Record) start_ = 0;
+            return keep;
+        }
+
+        bool FoundArray() const { return state_ != State::Key && state_ != State::Array; }
+
+    private:
+        enum class State { Key, Array, Seek, Record };
+        State state_ = State::Key;
+        size_t scanned_ = 0;    // сколько текста уже просмотрено (после сдвига)
+        size_t start_ = 0;      // начало текущей записи
+        int depth_ = 0;
+        bool inQuotes_ = false;
+        bool escape_ = false;
+    };
+
+    // Начало значения ключа "key" (сразу за двоеточием) или npos
+    size_t FindValue(std::wstring_view block, std::wstring_view key) {
+        for (size_t p = block.find(key); p != std::wstring_view::npos; p = block.find(key, p + 1)) {
+            size_t end = p + key.size();
+            if (p == 0 || block[p - 1] != L'"' || end >= block.size() || block[end] != L'"') continue;
+            size_t colon = block.find(L':', end);
+            return colon == std::wstring_view::npos ? colon : colon + 1;
+        }
+        return std::wstring_view::npos;
+    }
+
+    // Сырое (не раскодированное) содержимое строкового значения; экранированные кавычки пропускаются
+    std::wstring_view RawString(std::wstring_view block, std::wstring_view key) {
+        size_t p = FindValue(block, key);
+        if (p == std::wstring_view::npos) return {};
+        size_t q1 = block.find(L'"', p);
+        if (q1 == std::wstring_view::npos) return {};
+        for (size_t q2 = q1 + 1; q2 < block.size(); ++q2) {
+            if (block[q2] == L'\\') { ++q2; continue; }
+            if (block[q2] == L'"') return block.substr(q1 + 1, q2 - q1 - 1);
+        }
+        return {};
+    }
+
+} // namespace
+
 Persistence::Persistence() {
     path_ = util::GetAppDataDir() + L"\\tasks.json";
 }
 
+StoreStamp Persistence::StampOf(const std::wstring& path) {
+    StoreStamp st;
+    WIN32_FILE_ATTRIBUTE_DATA data{};
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) return st;
+    st.writeTime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+    st.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    return st;
+}
+
+StoreStamp Persistence::LastStamp() const {
+    std::lock_guard<std::mutex> lk(stampMtx_);
+    return lastStamp_;
+}
+
+LoadStats Persistence::GetLastLoadStats() const {
+    std::lock_guard<std::mutex> lk(stampMtx_);
+    return lastLoad_;
+}
+
+void WriteTaskJson(util::Utf8Writer& ofs, const Task& t, std::string_view lead) {
+    ofs << lead << "\"id\": \"" << util::EscapeJSON(t.id) << "\",";
+    ofs << lead << "\"name\": \"" << util::EscapeJSON(t.name) << "\",";
+    ofs << lead << "\"description\": \"" << util::EscapeJSON(t.description) << "\",";
+    ofs << lead << "\"exePath\": \"" << util::EscapeJSON(t.exePath) << "\",";
+    ofs << lead << "\"arguments\": \"" << util::EscapeJSON(t.arguments) << "\",";
+    ofs << lead << "\"workingDirectory\": \"" << util::EscapeJSON(t.workingDirectory) << "\",";
+    ofs << lead << "\"group\": \"" << util::EscapeJSON(t.group) << "\",";
+    ofs << lead << "\"enabled\": " << (t.enabled ? "true" : "false") << ",";
+    ofs << lead << "\"triggerType\": " << (int)t.triggerType << ",";
+
+    long long onceTimestamp = t.runOnceTime.time_since_epoch().count();
+    ofs << lead << "\"runOnceTime\": " << onceTimestamp << ",";
+
+    ofs << lead << "\"intervalMinutes\": " << t.intervalMinutes << ",";
+    ofs << lead << "\"dailyHour\": " << (int)t.dailyHour << ",";
+    ofs << lead << "\"dailyMinute\": " << (int)t.dailyMinute << ",";
+    ofs << lead << "\"dailySecond\": " << (int)t.dailySecond << ",";
+
+    unsigned long days = 0;
+    for (int k = 0; k < 7; ++k)
+        if (t.weeklyDays.test(k)) days |= (1 << k);
+
+    ofs << lead << "\"weeklyDays\": " << days << ",";
+    ofs << lead << "\"weeklyHour\": " << (int)t.weeklyHour << ",";
+    ofs << lead << "\"weeklyMinute\": " << (int)t.weeklyMinute << ",";
+    ofs << lead << "\"weeklySecond\": " << (int)t.weeklySecond << ",";
+    ofs << lead << "\"watchPath\": \"" << util::EscapeJSON(t.watchPath) << "\",";
+    ofs << lead << "\"watchPattern\": \"" << util::EscapeJSON(t.watchPattern) << "\",";
+    ofs << lead << "\"watchEvents\": " << t.watchEvents << ",";
+    ofs << lead << "\"watchSubtree\": " << (t.watchSubtree ? "true" : "false") << ",";
+    ofs << lead << "\"debounceMs\": " << t.debounceMs << ",";
+    ofs << lead << "\"runIfMissed\": " << (t.runIfMissed ? "true" : "false") << ",";
+
+    // ← КРИТИЧНО: Проверяем что сохраняется правильно
+    ofs << lead << "\"hasExecutionTimeout\": " << (t.hasExecutionTimeout ? "true" : "false") << ",";
+    ofs << lead << "\"executionTimeoutMinutes\": " << t.executionTimeoutMinutes << ",";
+    ofs << lead << "\"cpuTimeLimitSeconds\": " << t.cpuTimeLimitSeconds << ",";
+    ofs << lead << "\"memoryLimitMB\": " << t.memoryLimitMB << ",";
+    ofs << lead << "\"maxProcesses\": " << t.maxProcesses << ",";
+    ofs << lead << "\"overlapPolicy\": " << (int)t.overlapPolicy << ",";
+    ofs << lead << "\"maxConcurrentInstances\": " << t.maxConcurrentInstances << ",";
+    ofs << lead << "\"priority\": " << (int)t.priority << ",";
+    ofs << lead << "\"retryMaxAttempts\": " << t.retryMaxAttempts << ",";
+    ofs << lead << "\"retryDelaySeconds\": " << t.retryDelaySeconds << ",";
+    ofs << lead << "\"retryMaxDelaySeconds\": " << t.retryMaxDelaySeconds << ",";
+    ofs << lead << "\"retryExitCodes\": \"" << util::EscapeJSON(t.retryExitCodes) << "\",";
+    ofs << lead << "\"retryAttempt\": " << t.retryAttempt << ",";
+    ofs << lead << "\"retryAt\": " << (long long)t.retryAt.time_since_epoch().count() << ",";
+    ofs << lead << "\"retryRuns\": " << t.retryRuns << ",";
+    ofs << lead << "\"retryRecovered\": " << t.retryRecovered << ",";
+    ofs << lead << "\"retryGaveUp\": " << t.retryGaveUp << ",";
+    ofs << lead << "\"stateSlot\": " << t.stateSlot;
+}
+
+void ParseTaskRecord(std::wstring_view block, Task& t) {
+    auto has = [&](std::wstring_view key) { return FindValue(block, key) != std::wstring_view::npos; };
+
+    // Значение без escape-последовательностей - прямо из блока; с ними - раскодируется в буфер
+    // потока. Его емкость переживает записи: пути с '\\' не выделяют память на каждую запись
+    static thread_local std::wstring unescaped;
+    auto getRaw = [&](std::wstring_view key)->std::wstring_view {
+        std::wstring_view raw = RawString(block, key);
+        if (raw.find(L'\\') == std::wstring_view::npos) return raw;
+        util::json::UnescapeTo(raw, unescaped);
+        return unescaped;
+        };
+
+    auto getString = [&](std::wstring_view key)->std::wstring {
+        return std::wstring(getRaw(key));
+        };
+
+    // id/name/description - сразу в ресурс строк задачи (арена снимка), без копии в куче
+    auto setString = [&](std::wstring_view key, std::pmr::wstring& out) {
+        out.assign(getRaw(key));
+        };
+
+    // Поля из пула интернируются из представления (повторное значение не выделяет память)
+    auto getInterned = [&](std::wstring_view key)->util::InternedWString {
+        return util::InternedWString(getRaw(key));
+        };
+
+    auto getInt = [&](std::wstring_view key)->long long {
+        size_t p = FindValue(block, key);
+        if (p == std::wstring_view::npos) return 0;
+        size_t s = block.find_first_of(L"-0123456789", p);
+        if (s == std::wstring_view::npos) return 0;
+        bool negative = block[s] == L'-';
+        if (negative) ++s;
+        long long v = 0;
+        for (; s < block.size() && iswdigit(block[s]); ++s) v = v * 10 + (block[s] - L'0');
+        return negative ? -v : v;
+        };
+
+    auto getBool = [&](std::wstring_view key)->bool {
+        size_t p = FindValue(block, key);
+        if (p == std::wstring_view::npos) return false;
+        size_t s = block.find_first_not_of(L" \t\r\n", p);
+        return (s != std::wstring_view::npos && block.compare(s, 4, L"true") == 0);
+        };
+
+    setString(L"id", t.id);
+    setString(L"name", t.name);
+    setString(L"description", t.description);
+    t.exePath = getInterned(L"exePath");
+    t.arguments = getInterned(L"arguments");
+    t.workingDirectory = getInterned(L"workingDirectory");
+    t.group = getString(L"group");
+
+    t.enabled = getBool(L"enabled");
+    t.triggerType = (TriggerType)getInt(L"triggerType");
+
+    long long onceTimestamp = getInt(L"runOnceTime");
+    t.runOnceTime = std::chrono::system_clock::time_point(
+        std::chrono::system_clock::duration(onceTimestamp)
+    );
+
+    t.intervalMinutes = (uint32_t)getInt(L"intervalMinutes");
+    t.dailyHour = (uint8_t)getInt(L"dailyHour");
+    t.dailyMinute = (uint8_t)getInt(L"dailyMinute");
+    t.dailySecond = (uint8_t)getInt(L"dailySecond");
+
+    unsigned long days = (unsigned long)getInt(L"weeklyDays");
+    t.weeklyDays = (uint8_t)(days & 0x7F);
+
+    t.weeklyHour = (uint8_t)getInt(L"weeklyHour");
+    t.weeklyMinute = (uint8_t)getInt(L"weeklyMinute");
+    t.weeklySecond = (uint8_t)getInt(L"weeklySecond");
+
+    t.watchPath = getString(L"watchPath");
+    t.watchPattern = getString(L"watchPattern");
+    if (t.watchPattern.empty()) t.watchPattern = L"*";
+    if (has(L"watchEvents"))
+        t.watchEvents = (uint32_t)getInt(L"watchEvents");
+    t.watchSubtree = getBool(L"watchSubtree");
+    if (has(L"debounceMs"))
+        t.debounceMs = (uint32_t)getInt(L"debounceMs");
+
+    t.runIfMissed = getBool(L"runIfMissed");
+
+    // ← КРИТИЧНО: Загружаем timeout параметры
+    t.hasExecutionTimeout = getBool(L"hasExecutionTimeout");
+    t.executionTimeoutMinutes = (uint32_t)getInt(L"executionTimeoutMinutes");
+
+    // Защита от нулевого значения
+    if (t.hasExecutionTimeout && t.executionTimeoutMinutes == 0) {
+        g_Logger.Log(LogLevel::Warn, L"Persistence",
+            L"Task '" + std::wstring(t.name) + L"' has timeout enabled but minutes=0, setting to default 5");
+        t.executionTimeoutMinutes = 5;
+    }
+
+    // Лимиты ресурсов: отсутствующий ключ = 0 = без ограничения
+    t.cpuTimeLimitSeconds = (uint32_t)getInt(L"cpuTimeLimitSeconds");
+    t.memoryLimitMB = (uint32_t)getInt(L"memoryLimitMB");
+    t.maxProcesses = (uint32_t)getInt(L"maxProcesses");
+
+    long long overlap = getInt(L"overlapPolicy");
+    if (overlap < 0 || overlap > (int)OverlapPolicy::CANCEL_PREVIOUS) overlap = 0;
+    t.overlapPolicy = (OverlapPolicy)overlap;
+    t.maxConcurrentInstances = (uint32_t)getInt(L"maxConcurrentInstances");
+
+    // Старые файлы без поля priority получают NORMAL
+    long long priority = !has(L"priority")
+        ? (long long)TaskPriority::NORMAL : getInt(L"priority");
+    if (priority < 0 || priority > (int)TaskPriority::CRITICAL) priority = (int)TaskPriority::NORMAL;
+    t.priority = (TaskPriority)priority;
+
+    // Повторы: политика и состояние серии (retryAt в прошлом - повтор сразу после старта)
+    t.retryMaxAttempts = (uint32_t)getInt(L"retryMaxAttempts");
+    if (has(L"retryDelaySeconds"))
+        t.retryDelaySeconds = (uint32_t)getInt(L"retryDelaySeconds");
+    if (has(L"retryMaxDelaySeconds"))
+        t.retryMaxDelaySeconds = (uint32_t)getInt(L"retryMaxDelaySeconds");
+    t.retryExitCodes = getString(L"retryExitCodes");
+    t.retryAttempt = (uint32_t)getInt(L"retryAttempt");
+    t.retryAt = std::chrono::system_clock::time_point(
+        std::chrono::system_clock::duration(getInt(L"retryAt")));
+    t.retryRuns = (uint64_t)getInt(L"retryRuns");
+    t.retryRecovered = (uint64_t)getInt(L"retryRecovered");
+    t.retryGaveUp = (uint64_t)getInt(L"retryGaveUp");
+
+    // Постоянный номер слота в runtime.dat; нет поля - слот выдаст TaskManager
+    if (has(L"stateSlot"))
+        t.stateSlot = (uint32_t)getInt(L"stateSlot");
+}
+
 bool Persistence::Save(const std::vector<TaskPtr>& tasks) {
-    std::wstring tmp = path_ + L".tmp";
-    std::wofstream ofs(tmp, std::ios::trunc);
-    if (!ofs) {
+    TRACE_SPAN("Persistence::Save", "persistence");
+    LATENCY_SCOPE("Persistence::Save");
+    StoreLock lock(path_);
+    return Write(tasks);
+}
+
+bool Persistence::SaveMerged(const std::vector<TaskPtr>& tasks, const std::function<bool(std::wstring_view id)>& mine,
+    const TaskIdMap<bool>& edits) {
+    TRACE_SPAN("Persistence::SaveMerged", "persistence");
+    LATENCY_SCOPE("Persistence::SaveMerged");
+    StoreLock lock(path_);
+
+    LoadStats stats;
+    StoreStamp stamp;
+    std::vector<TaskPtr> merged = Read(false, stats, stamp);
+    if (!stats.valid) {
+        // Файла нет или он испорчен - сливать не с чем, пишем свой список целиком
+        return Write(tasks);
+    }
+
+    auto edited = [&](std::wstring_view id, bool kept) {
+        auto e = edits.find(id);
+        return e != edits.end() && e->second == kept;
+    };
+    TaskIdMap<const TaskPtr*> own;
+    own.reserve(tasks.size());
+    for (auto& t : tasks) {
+        if (mine(t->id) || edited(t->id, true)) TaskIdEntry(own, t->id) = &t;
+    }
+    // Порядок и состав - из файла: свои задачи, которых там нет, удалены другим экземпляром
+    // (их уберет перечитывание), чужие записи остаются как есть. Исключение - правки этого
+    // экземпляра: удаленные им записи уходят, добавленные дописываются
+    size_t replaced = 0, removed = 0;
+    std::vector<TaskPtr> kept;
+    kept.reserve(merged.size());
+    for (auto& t : merged) {
+        if (edited(t->id, false)) { ++removed; continue; }
+        auto it = own.find(t->id);
+        if (it != own.end()) {
+            kept.push_back(*it->second);
+            own.erase(it);
+            ++replaced;
+        }
+        else kept.push_back(std::move(t));
+    }
+    size_t added = 0;
+    for (auto& t : tasks) {
+        if (!edited(t->id, true) || own.find(t->id) == own.end()) continue;
+        kept.push_back(t);
+        ++added;
+    }
+    g_Logger.Log(LogLevel::Debug, L"Persistence",
+        L"Merged save: own=" + std::to_wstring(replaced) + L" | added=" + std::to_wstring(added) +
+        L" | removed=" + std::to_wstring(removed) + L" | others=" + std::to_wstring(kept.size() - replaced - added));
+    // В файле есть чужие изменения, которых нет в памяти: наблюдатель должен перечитать его
+    return Write(kept, replaced + added == kept.size());
+}
+
+bool Persistence::Write(const std::vector<TaskPtr>& tasks, bool ownStamp) {
+    // Уникальное имя: при шардировании tasks.json сохраняют несколько процессов
+    std::wstring tmp = path_ + L"." + std::to_wstring(GetCurrentProcessId()) + L".tmp";
+    util::Utf8Writer ofs(tmp);
+    if (!ofs.IsOpen()) {
         g_Logger.Log(LogLevel::Error, L"Persistence", L"Cannot open temp file for writing: " + tmp);
         return false;
     }
 
-    ofs << L"{\n  \"tasks\": [\n";
+    ofs << "{\n  \"tasks\": [\n";
     for (size_t i = 0; i < tasks.size(); ++i) {
         auto& t = tasks[i];
-        ofs << L"    {\n";
-        ofs << L"      \"id\": \"" << util::EscapeJSON(t->id) << L"\",\n";
-        ofs << L"      \"name\": \"" << util::EscapeJSON(t->name) << L"\",\n";
-        ofs << L"      \"description\": \"" << util::EscapeJSON(t->description) << L"\",\n";
-        ofs << L"      \"exePath\": \"" << util::EscapeJSON(t->exePath) << L"\",\n";
-        ofs << L"      \"arguments\": \"" << util::EscapeJSON(t->arguments) << L"\",\n";
-        ofs << L"      \"workingDirectory\": \"" << util::EscapeJSON(t->workingDirectory) << L"\",\n";
-        ofs << L"      \"enabled\": " << (t->enabled ? L"true" : L"false") << L",\n";
-        ofs << L"      \"triggerType\": " << (int)t->triggerType << L",\n";
-
-        long long onceTimestamp = t->runOnceTime.time_since_epoch().count();
-        ofs << L"      \"runOnceTime\": " << onceTimestamp << L",\n";
-
-        ofs << L"      \"intervalMinutes\": " << t->intervalMinutes << L",\n";
-        ofs << L"      \"dailyHour\": " << (int)t->dailyHour << L",\n";
-        ofs << L"      \"dailyMinute\": " << (int)t->dailyMinute << L",\n";
-        ofs << L"      \"dailySecond\": " << (int)t->dailySecond << L",\n";
-
-        unsigned long days = 0;
-        for (int k = 0; k < 7; ++k)
-            if (t->weeklyDays.test(k)) days |= (1 << k);
-
-        ofs << L"      \"weeklyDays\": " << days << L",\n";
-        ofs << L"      \"weeklyHour\": " << (int)t->weeklyHour << L",\n";
-        ofs << L"      \"weeklyMinute\": " << (int)t->weeklyMinute << L",\n";
-        ofs << L"      \"weeklySecond\": " << (int)t->weeklySecond << L",\n";
-        ofs << L"      \"runIfMissed\": " << (t->runIfMissed ? L"true" : L"false") << L",\n";
-
-        // ← КРИТИЧНО: Проверяем что сохраняется правильно
-        ofs << L"      \"hasExecutionTimeout\": " << (t->hasExecutionTimeout ? L"true" : L"false") << L",\n";
-        ofs << L"      \"executionTimeoutMinutes\": " << t->executionTimeoutMinutes << L"\n";
-
-        // ← ДОБАВЛЕНО: Логируем каждую задачу при сохранении для дебага
-        g_Logger.Log(LogLevel::Debug, L"Persistence",
-            L"Saving task: " + t->name +
-            L" | hasTimeout=" + (t->hasExecutionTimeout ? L"true" : L"false") +
-            L" | timeoutMin=" + std::to_wstring(t->executionTimeoutMinutes));
-
-        ofs << L"    }" << (i + 1 < tasks.size() ? L"," : L"") << L"\n";
-    }
-    ofs << L"  ]\n}\n";
-    ofs.close();
+        ofs << "    {";
+        WriteTaskJson(ofs, *t, "\n      ");
+        ofs << "\n";
+        ofs << "    }" << (i + 1 < tasks.size() ? "," : "") << "\n";
+    }
+    ofs << "  ]\n}\n";
+    if (!ofs.Close()) {
+        g_Logger.Log(LogLevel::Error, L"Persistence", L"Write to temp file failed: " + tmp);
+        DeleteFileW(tmp.c_str());
+        return false;
+    }
 
     DeleteFileW(path_.c_str());
     if (!MoveFileW(tmp.c_str(), path_.c_str())) {
         g_Logger.Log(LogLevel::Error, L"Persistence", L"Failed to move temp file to final location");
         return false;
     }
+    {
+        std::lock_guard<std::mutex> lk(stampMtx_);
+        lastStamp_ = ownStamp ? StampOf(path_) : StoreStamp{};
+    }
 
     g_Logger.Log(LogLevel::Info, L"Persistence", L"Tasks saved: " + std::to_wstring(tasks.size()));
     return true;
 }
 
-std::vector<TaskPtr> Persistence::Load() {
+std::vector<TaskPtr> Persistence::Read(bool snapshotArena, LoadStats& stats, StoreStamp& stamp) {
     std::vector<TaskPtr> out;
-    std::wifstream ifs(path_);
-    if (!ifs) {
+    std::string bytes;
+    // Отпечаток - до чтения: если файл успеют сменить, наблюдатель увидит новый и перечитает
+    stamp = StampOf(path_);
+    if (!util::ReadFileUtf8(path_, bytes)) {
         g_Logger.Log(LogLevel::Info, L"Persistence", L"No tasks file found");
         return out;
     }
 
-    std::wstringstream ss;
-    ss << ifs.rdbuf();
-    std::wstring content = ss.str();
+    // Файл в UTF-8: одно перекодирование всего содержимого вместо посимвольного locale
+    std::wstring content = util::FromUtf8(bytes);
+    // Начальный чанк - в байтах, по размеру файла в UTF-8: запись Task со строками
+    // id/name/description занимает меньше своего JSON. Дальше арена растет геометрически
+    size_t initialBytes = (std::max)(size_t(64 * 1024), bytes.size());
+    std::string().swap(bytes);
+
+    std::shared_ptr<TaskSnapshot> snapshot;
+    if (snapshotArena) {
+        TaskSnapshot* raw = new TaskSnapshot(initialBytes);
+        snapshot = std::shared_ptr<TaskSnapshot>(raw, SnapshotDeleter{ raw });
+    }
 
     if (!util::IsValidJsonSimple(content)) {
         g_Logger.Log(LogLevel::Warn, L"Persistence", L"tasks.json appears invalid (simple check)");
         return out;
     }
 
-    size_t pos = content.find(L"\"tasks\"");
-    if (pos == std::wstring::npos) return out;
-    pos = content.find(L"[", pos);
-    if (pos == std::wstring::npos) return out;
-
-    size_t cur = pos + 1;
-    while (true) {
-        size_t start = content.find(L"{", cur);
-        if (start == std::wstring::npos) break;
-
-        int depth = 1;
-        bool inQuotes = false;
-        bool escape = false;
-        size_t i = start + 1;
-
-        for (; i < content.size(); ++i) {
-            wchar_t c = content[i];
-            if (escape) { escape = false; continue; }
-            if (c == L'\\') { escape = true; continue; }
-            if (c == L'"') inQuotes = !inQuotes;
-
-            if (!inQuotes) {
-                if (c == L'{') ++depth;
-                else if (c == L'}') --depth;
-                if (depth == 0) break;
-            }
+    RecordSplitter<wchar_t> splitter;
+    splitter.Feed(content, [&](std::wstring_view block) {
+        // Блок - представление поверх content: ни копии блока, ни временных ключей
+        if (!snapshot) {
+            auto t = std::make_shared<Task>();
+            ParseTaskRecord(block, *t);
+            if (t->id.empty()) t->id = util::GenerateGUID();
+            out.push_back(std::move(t));
+            return;
         }
-
-        if (i >= content.size()) break;
-
-        std::wstring block = content.substr(start, i - start + 1);
-
-        auto getString = [&](const std::wstring& key)->std::wstring {
-            size_t p = block.find(L"\"" + key + L"\"");
-            if (p == std::wstring::npos) return L"";
-            size_t colon = block.find(L":", p);
-            size_t q1 = block.find(L"\"", colon);
-            if (q1 == std::wstring::npos) return L"";
-            size_t q2 = block.find(L"\"", q1 + 1);
-            if (q2 == std::wstring::npos) return L"";
-            std::wstring raw = block.substr(q1 + 1, q2 - q1 - 1);
-            return util::UnescapeJSON(raw);
-            };
-
-        auto getInt = [&](const std::wstring& key)->long long {
-            size_t p = block.find(L"\"" + key + L"\"");
-            if (p == std::wstring::npos) return 0;
-            size_t colon = block.find(L":", p);
-            size_t s = block.find_first_of(L"-0123456789", colon);
-            if (s == std::wstring::npos) return 0;
-            size_t e = s;
-            while (e < block.size() && (iswdigit(block[e]) || block[e] == L'-')) ++e;
-            if (e == s) return 0;  // ← ДОБАВЛЕНО: защита от пустой строки
-            return std::stoll(block.substr(s, e - s));
-            };
-
-        auto getBool = [&](const std::wstring& key)->bool {
-            size_t p = block.find(L"\"" + key + L"\"");
-            if (p == std::wstring::npos) return false;
-            size_t colon = block.find(L":", p);
-            size_t s = block.find_first_not_of(L" \t\r\n", colon + 1);
-            return (s != std::wstring::npos && block.compare(s, 4, L"true") == 0);
-            };
-
-        TaskPtr t = std::make_shared<Task>();
-        t->id = getString(L"id");
-        t->name = getString(L"name");
-        t->description = getString(L"description");
-        t->exePath = getString(L"exePath");
-        t->arguments = getString(L"arguments");
-        t->workingDirectory = getString(L"workingDirectory");
-
-        t->enabled = getBool(L"enabled");
-        t->triggerType = (TriggerType)getInt(L"triggerType");
-
-        long long onceTimestamp = getInt(L"runOnceTime");
-        t->runOnceTime = std::chrono::system_clock::time_point(
-            std::chrono::system_clock::duration(onceTimestamp)
-        );
-
-        t->intervalMinutes = (uint32_t)getInt(L"intervalMinutes");
-        t->dailyHour = (uint8_t)getInt(L"dailyHour");
-        t->dailyMinute = (uint8_t)getInt(L"dailyMinute");
-        t->dailySecond = (uint8_t)getInt(L"dailySecond");
-
-        unsigned long days = (unsigned long)getInt(L"weeklyDays");
-        t->weeklyDays = (uint8_t)(days & 0x7F);
-
-        t->weeklyHour = (uint8_t)getInt(L"weeklyHour");
-        t->weeklyMinute = (uint8_t)getInt(L"weeklyMinute");
-        t->weeklySecond = (uint8_t)getInt(L"weeklySecond");
-
-        t->runIfMissed = getBool(L"runIfMissed");
-
-        // ← КРИТИЧНО: Загружаем timeout параметры
-        t->hasExecutionTimeout = getBool(L"hasExecutionTimeout");
-        t->executionTimeoutMinutes = (uint32_t)getInt(L"executionTimeoutMinutes");
-
-        // Защита от нулевого значения
-        if (t->hasExecutionTimeout && t->executionTimeoutMinutes == 0) {
-            g_Logger.Log(LogLevel::Warn, L"Persistence",
-                L"Task '" + t->name + L"' has timeout enabled but minutes=0, setting to default 5");
-            t->executionTimeoutMinutes = 5;
-        }
-
-        // ← ДОБАВЛЕНО: Логируем каждую загруженную задачу
-        g_Logger.Log(LogLevel::Debug, L"Persistence",
-            L"Loaded task: " + t->name +
-            L" | hasTimeout=" + (t->hasExecutionTimeout ? L"true" : L"false") +
-            L" | timeoutMin=" + std::to_wstring(t->executionTimeoutMinutes));
-
+        Task* t = snapshot->Emplace();
+        ParseTaskRecord(block, *t);
         if (t->id.empty()) t->id = util::GenerateGUID();
-        out.push_back(t);
+        out.push_back(TaskPtr(snapshot, t));  // алиасинг: без отдельного блока управления
+    });
+    if (snapshot) snapshot->resource.Seal();
+    if (!splitter.FoundArray()) return out;
+
+    stats.valid = true;
+    stats.records = out.size();
+    if (snapshot) {
+        stats.arenaChunks = snapshot->resource.Upstream().allocations;
+        stats.arenaBytes = snapshot->resource.Upstream().bytes;
+    }
+    return out;
+}
 
-        cur = i + 1;
+std::vector<TaskPtr> Persistence::Load(bool snapshotArena) {
+    LATENCY_SCOPE("Persistence::Load");
+    {
+        std::lock_guard<std::mutex> lk(stampMtx_);
+        lastLoad_ = {};
+    }
+    LoadStats stats;
+    StoreStamp stamp;
+    std::vector<TaskPtr> out = Read(snapshotArena, stats, stamp);
+    if (!stats.valid) return out;
+    {
+        std::lock_guard<std::mutex> lk(stampMtx_);
+        lastLoad_ = stats;
+        lastStamp_ = stamp;
     }
 
-    g_Logger.Log(LogLevel::Info, L"Persistence", L"Loaded tasks: " + std::to_wstring(out.size()));
+    g_Logger.Log(LogLevel::Info, L"Persistence", L"Loaded tasks: " + std::to_wstring(out.size()) +
+        L" | arena chunks=" + std::to_wstring(stats.arenaChunks) +
+        L" (" + std::to_wstring(stats.arenaBytes / 1024) + L" KB)");
+
+    util::StringPoolStats pool = util::GetStringPoolStats();
+    g_Logger.Log(LogLevel::Debug, L"Persistence",
+        L"String pool: " + std::to_wstring(pool.strings) + L" strings, " +
+        std::to_wstring(pool.bytes / 1024) + L" KB, lookups=" + std::to_wstring(pool.lookups) +
+        L", released=" + std::to_wstring(pool.released));
     return out;
-}
\ No newline at end of file
+}
+
+SnapshotInfo SnapshotOf(const TaskPtr& task) {
+    SnapshotInfo info;
+    if (const SnapshotDeleter* d = std::get_deleter<SnapshotDeleter>(task)) {
+        info.snapshot = d->snapshot;
+        info.records = d->snapshot->records.size();
+    }
+    return info;
+}
+
+bool ForEachTaskRecord(const std::wstring& path, const std::function<void(std::wstring_view block)>& visit) {
+    util::Utf8Reader in(path);
+    if (!in.IsOpen()) return false;
+
+    // Блок файла держится только до конца последней целой записи в нем
+    RecordSplitter<char> splitter;
+    std::string pending;
+    while (in.ReadChunk(pending, 1 << 20) != 0) {
+        size_t done = splitter.Feed(pending, [&](std::string_view record) {
+            visit(util::FromUtf8(record));
+        });
+        pending.erase(0, done);
+    }
+    return !in.Failed();
+}
@@ -1,16 +1,75 @@
-#pragma once
+﻿#pragma once
+#include "Task.h"
+#include <functional>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <mutex>
+#include <cstdint>
 
-struct Task; // forward (if Task defined elsewhere)
-using TaskPtr = std::shared_ptr<Task>;
+namespace util { class Utf8Writer; }
+
+// Поля задачи в JSON без фигурных скобок, через запятую; перед каждым - lead
+// (отступ tasks.json или пусто для строки NDJSON). Общий код tasks.json и импорта-экспорта
+void WriteTaskJson(util::Utf8Writer& ofs, const Task& t, std::string_view lead);
+// Задача из JSON-объекта block (правила те же, что при загрузке tasks.json)
+void ParseTaskRecord(std::wstring_view block, Task& t);
+// Записи tasks.json по одной, файл читается блоками (документ в памяти не собирается).
+// Разбиение на записи - как у Persistence::Load. false - файл не открылся или ошибка чтения
+bool ForEachTaskRecord(const std::wstring& path, const std::function<void(std::wstring_view block)>& visit);
+
+// Снимок Load, в арене которого лежит задача. Задачи снимка держат арену целиком,
+// пока жива хоть одна из них. records = 0 - задача размещена в куче отдельно
+struct SnapshotInfo {
+    const void* snapshot = nullptr;
+    size_t records = 0;
+};
+SnapshotInfo SnapshotOf(const TaskPtr& task);
+
+// Итоги последней загрузки: записи размещаются в арене снимка, обращений к куче - по числу чанков
+struct LoadStats {
+    size_t records = 0;
+    size_t arenaChunks = 0;   // выделений upstream-ресурса арены
+    size_t arenaBytes = 0;
+    bool valid = false;       // файл прочитан и разобран (пустой список - тоже валидный)
+};
+
+// Отпечаток tasks.json: по нему наблюдатель отличает свою запись от чужой
+struct StoreStamp {
+    uint64_t writeTime = 0;   // FILETIME последней записи, 0 - файла нет
+    uint64_t size = 0;
+    bool operator==(const StoreStamp& o) const { return writeTime == o.writeTime && size == o.size; }
+    bool operator!=(const StoreStamp& o) const { return !(*this == o); }
+};
 
 class Persistence {
 public:
     Persistence();
     bool Save(const std::vector<TaskPtr>& tasks);
-    std::vector<TaskPtr> Load();
+    // snapshotArena: задачи одного снимка делят одну арену. false - каждая задача выделяется
+    // отдельно (перечитывание: большая часть записей сразу отбрасывается и не должна держать арену)
+    std::vector<TaskPtr> Load(bool snapshotArena = true);
+    LoadStats GetLastLoadStats() const;
+
+    // Шардирование: tasks.json пишут несколько процессов. Из tasks берутся только задачи,
+    // для которых mine(id), остальные записи - из текущего файла (их сохраняет владелец шарда).
+    // Чтение, слияние и запись (как и Save) - под межпроцессной блокировкой tasks.json.lock.
+    // edits - правки этого экземпляра (диалог, удаление) по id, в том числе в чужих шардах:
+    // true - запись берется из tasks (новая дописывается в конец), false - удаляется из файла
+    bool SaveMerged(const std::vector<TaskPtr>& tasks, const std::function<bool(std::wstring_view id)>& mine,
+        const TaskIdMap<bool>& edits = {});
+
+    const std::wstring& Path() const { return path_; }
+    static StoreStamp StampOf(const std::wstring& path);
+    StoreStamp LastStamp() const;  // файл после последних Save/Load этого процесса
 private:
+    // ownStamp = false: файл содержит не только наше - свой отпечаток не запоминаем
+    bool Write(const std::vector<TaskPtr>& tasks, bool ownStamp = true);
+    std::vector<TaskPtr> Read(bool snapshotArena, LoadStats& stats, StoreStamp& stamp);
+
     std::wstring path_;
+    mutable std::mutex stampMtx_;   // lastLoad_ и lastStamp_: Load идет и на потоке наблюдателя
+    LoadStats lastLoad_;
+    StoreStamp lastStamp_;
 };
@@ -0,0 +1,297 @@
+﻿#include "RuntimeState.h"
+#include "Logger.h"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+namespace {
+    constexpr char kMagic[8] = { 'M', 'T', 'S', 'R', 'U', 'N', '0', '1' };
+    constexpr uint32_t kInitialCapacity = 256;
+    constexpr size_t kIdChars = 44;
+
+    // FNV-1a по UTF-16: стабилен между запусками
+    uint64_t HashId(std::wstring_view id) {
+        uint64_t h = 1469598103934665603ULL;
+        for (wchar_t c : id) {
+            h ^= (uint16_t)c;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    int64_t ToTicks(std::chrono::system_clock::time_point tp) {
+        return (int64_t)tp.time_since_epoch().count();
+    }
+
+    std::chrono::system_clock::time_point FromTicks(int64_t ticks) {
+        return std::chrono::system_clock::time_point(std::chrono::system_clock::duration(ticks));
+    }
+
+    struct Header {
+        char magic[8];
+        uint32_t slotSize;
+        uint32_t capacity;
+        uint8_t reserved[112];
+    };
+
+    // 128 байт - две строки кэша: соседние слоты не делят строку
+    struct Slot {
+        std::atomic<uint32_t> seq;   // нечетный - запись не завершена
+        uint32_t used;
+        int64_t lastRunTime;         // тики system_clock, 0 - не было
+        int64_t nextRunTime;
+        int32_t lastExitCode;
+        uint32_t idLength;
+        uint64_t idHash;
+        uint16_t id[kIdChars];       // начало id (GUID целиком)
+    };
+
+    static_assert(sizeof(Header) == 128, "runtime.dat header layout");
+    static_assert(sizeof(Slot) == 128, "runtime.dat slot layout");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "seq must be a plain 32-bit word in the file");
+
+    Header* HeaderOf(char* view) {
+        return reinterpret_cast<Header*>(view);
+    }
+
+    Slot* SlotOf(char* view, uint32_t slot) {
+        return reinterpret_cast<Slot*>(view + sizeof(Header) + (size_t)slot * sizeof(Slot));
+    }
+
+    void SetId(Slot* s, std::wstring_view id) {
+        s->idLength = (uint32_t)id.size();
+        s->idHash = HashId(id);
+        memset(s->id, 0, sizeof(s->id));
+        for (size_t i = 0; i < id.size() && i < kIdChars; ++i) s->id[i] = (uint16_t)id[i];
+    }
+
+    bool IdMatches(const Slot* s, std::wstring_view id) {
+        if (s->idLength != id.size() || s->idHash != HashId(id)) return false;
+        for (size_t i = 0; i < id.size() && i < kIdChars; ++i)
+            if (s->id[i] != (uint16_t)id[i]) return false;
+        return true;
+    }
+}
+
+RuntimeState::~RuntimeState() {
+    Close();
+}
+
+bool RuntimeState::Open(const std::wstring& path) {
+    std::unique_lock lock(mapMtx_);
+    if (view_) return true;
+
+    // Без FILE_SHARE_WRITE: слоты раздает этот процесс, второй экземпляр их бы перепутал
+    file_ = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_ == INVALID_HANDLE_VALUE) {
+        g_Logger.Log(LogLevel::Warn, L"RuntimeState",
+            L"Cannot open " + path + L" (error " + std::to_wstring(GetLastError()) +
+            L"), run state is kept in tasks.json only");
+        return false;
+    }
+
+    LARGE_INTEGER size{};
+    GetFileSizeEx(file_, &size);
+    uint64_t bytes = (uint64_t)size.QuadPart;
+    uint32_t capacity = bytes > sizeof(Header) ? (uint32_t)((bytes - sizeof(Header)) / sizeof(Slot)) : 0;
+
+    if (!MapLocked(capacity < kInitialCapacity ? kInitialCapacity : capacity)) {
+        g_Logger.Log(LogLevel::Error, L"RuntimeState", L"Cannot map " + path +
+            L" (error " + std::to_wstring(GetLastError()) + L")");
+        CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+        return false;
+    }
+
+    Header* h = HeaderOf(view_);
+    if (memcmp(h->magic, kMagic, sizeof(kMagic)) != 0 || h->slotSize != sizeof(Slot)) {
+        if (bytes > 0)
+            g_Logger.Log(LogLevel::Warn, L"RuntimeState", L"Unknown format, starting empty: " + path);
+        memset(view_, 0, sizeof(Header) + (size_t)capacity_ * sizeof(Slot));
+        memcpy(h->magic, kMagic, sizeof(kMagic));
+        h->slotSize = sizeof(Slot);
+    }
+    h->capacity = capacity_;
+
+    // Нечетный seq остался от процесса, упавшего посреди записи: запись могла разорваться,
+    // но каждое поле целое - принимаем как есть и закрываем seq
+    size_t torn = 0;
+    free_.clear();
+    for (uint32_t i = capacity_; i-- > 0;) {
+        Slot* s = SlotOf(view_, i);
+        uint32_t seq = s->seq.load(std::memory_order_relaxed);
+        if (seq & 1) {
+            s->seq.store(seq + 1, std::memory_order_relaxed);
+            ++torn;
+        }
+        if (!s->used) free_.push_back(i);
+    }
+
+    g_Logger.Log(LogLevel::Info, L"RuntimeState",
+        L"Opened " + path + L": slots=" + std::to_wstring(capacity_ - free_.size()) +
+        L"/" + std::to_wstring(capacity_) +
+        (torn ? L" | torn=" + std::to_wstring(torn) : std::wstring()));
+    return true;
+}
+
+void RuntimeState::Close() {
+    std::unique_lock lock(mapMtx_);
+    if (view_) FlushViewOfFile(view_, 0);
+    UnmapLocked();
+    if (file_ != INVALID_HANDLE_VALUE) {
+        CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+    }
+    free_.clear();
+}
+
+bool RuntimeState::IsOpen() const {
+    std::shared_lock lock(mapMtx_);
+    return view_ != nullptr;
+}
+
+// Отображение на capacity слотов; файл при необходимости растет (новое место - нули)
+bool RuntimeState::MapLocked(uint32_t capacity) {
+    uint64_t bytes = sizeof(Header) + (uint64_t)capacity * sizeof(Slot);
+    HANDLE mapping = CreateFileMappingW(file_, NULL, PAGE_READWRITE,
+        (DWORD)(bytes >> 32), (DWORD)bytes, NULL);
+    if (!mapping) return false;
+
+    char* view = (char*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)bytes);
+    if (!view) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    UnmapLocked();
+    mapping_ = mapping;
+    view_ = view;
+    capacity_ = capacity;
+    return true;
+}
+
+void RuntimeState::UnmapLocked() {
+    if (view_) UnmapViewOfFile(view_);
+    if (mapping_) CloseHandle(mapping_);
+    view_ = nullptr;
+    mapping_ = NULL;
+    capacity_ = 0;
+}
+
+uint32_t RuntimeState::Allocate(std::wstring_view taskId) {
+    std::unique_lock lock(mapMtx_);
+    if (!view_) return kNoSlot;
+
+    if (free_.empty()) {
+        uint32_t old = capacity_;
+        if (!MapLocked(old * 2)) {
+            g_Logger.Log(LogLevel::Error, L"RuntimeState",
+                L"Cannot grow to " + std::to_wstring(old * 2) + L" slots (error " +
+                std::to_wstring(GetLastError()) + L")");
+            return kNoSlot;
+        }
+        HeaderOf(view_)->capacity = capacity_;
+        for (uint32_t i = capacity_; i-- > old;) free_.push_back(i);
+    }
+
+    uint32_t slot = free_.back();
+    free_.pop_back();
+
+    // Под unique - писателей слота нет
+    Slot* s = SlotOf(view_, slot);
+    s->lastRunTime = 0;
+    s->nextRunTime = 0;
+    s->lastExitCode = 0;
+    SetId(s, taskId);
+    s->used = 1;
+    return slot;
+}
+
+void RuntimeState::Free(uint32_t slot) {
+    std::unique_lock lock(mapMtx_);
+    if (!view_ || slot >= capacity_) return;
+    Slot* s = SlotOf(view_, slot);
+    if (!s->used) return;
+    s->used = 0;
+    s->idLength = 0;
+    s->idHash = 0;
+    free_.push_back(slot);
+}
+
+size_t RuntimeState::FreeUnreferenced(const std::vector<uint32_t>& live) {
+    std::unique_lock lock(mapMtx_);
+    if (!view_) return 0;
+
+    std::vector<bool> keep(capacity_);
+    for (uint32_t slot : live)
+        if (slot < capacity_) keep[slot] = true;
+
+    size_t released = 0;
+    for (uint32_t i = capacity_; i-- > 0;) {
+        Slot* s = SlotOf(view_, i);
+        if (!s->used || keep[i]) continue;
+        s->used = 0;
+        s->idLength = 0;
+        s->idHash = 0;
+        free_.push_back(i);
+        ++released;
+    }
+    return released;
+}
+
+bool RuntimeState::Read(uint32_t slot, std::wstring_view taskId, Record& out) const {
+    std::shared_lock lock(mapMtx_);
+    if (!view_ || slot >= capacity_) return false;
+    const Slot* s = SlotOf(view_, slot);
+    if (!s->used || !IdMatches(s, taskId)) return false;
+
+    int64_t lastRun, nextRun;
+    int32_t exitCode;
+    for (;;) {
+        uint32_t before = s->seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            YieldProcessor();
+            continue;
+        }
+        lastRun = s->lastRunTime;
+        nextRun = s->nextRunTime;
+        exitCode = s->lastExitCode;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s->seq.load(std::memory_order_relaxed) == before) break;
+    }
+
+    out.lastRunTime = FromTicks(lastRun);
+    out.nextRunTime = FromTicks(nextRun);
+    out.lastExitCode = exitCode;
+    return true;
+}
+
+void RuntimeState::Store(uint32_t slot, const Task& task) {
+    std::shared_lock lock(mapMtx_);
+    if (!view_ || slot >= capacity_) return;
+    Slot* s = SlotOf(view_, slot);
+    // Задачу удалили, а ее запуск еще завершается - слот мог уйти другой задаче
+    if (!s->used || !IdMatches(s, task.id)) return;
+
+    uint32_t seq = s->seq.load(std::memory_order_relaxed);
+    for (;;) {
+        if (!(seq & 1) && s->seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire))
+            break;
+        YieldProcessor();
+        seq = s->seq.load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);   // нечетный seq виден раньше полей
+
+    s->lastRunTime = ToTicks(task.lastRunTime);
+    s->nextRunTime = ToTicks(task.nextRunTime);
+    s->lastExitCode = task.lastExitCode;
+
+    s->seq.store(seq + 2, std::memory_order_release);
+}
+
+void RuntimeState::Flush() {
+    std::shared_lock lock(mapMtx_);
+    if (view_) FlushViewOfFile(view_, 0);
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+#include "Task.h"
+#include <chrono>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <Windows.h>
+
+// Состояние выполнения задач (lastRunTime, lastExitCode, nextRunTime) в runtime.dat -
+// файле записей фиксированного размера, отображенном в память. У задачи постоянный номер
+// слота (Task::stateSlot, хранится в tasks.json); запуск меняет свою запись на месте:
+// одна грязная страница вместо перезаписи tasks.json.
+//
+// Запись слота - под seqlock: нечетный seq - идет запись. Писатели одного слота исключают
+// друг друга CAS по seq, читатель повторяет чтение, если seq изменился. Страницы сбрасывает
+// на диск система - падение процесса записей не теряет; Flush - при выходе.
+// Файл открывает один процесс: второй экземпляр (шардирование) работает без него.
+class RuntimeState {
+public:
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+    struct Record {
+        std::chrono::system_clock::time_point lastRunTime{};
+        std::chrono::system_clock::time_point nextRunTime{};
+        int lastExitCode = 0;
+    };
+
+    RuntimeState() = default;
+    ~RuntimeState();
+    RuntimeState(const RuntimeState&) = delete;
+    RuntimeState& operator=(const RuntimeState&) = delete;
+
+    bool Open(const std::wstring& path);
+    void Close();
+    bool IsOpen() const;
+
+    uint32_t Allocate(std::wstring_view taskId);   // kNoSlot - файл недоступен
+    void Free(uint32_t slot);
+    // Освобождает занятые слоты, которых нет в live (задачи удалены до сохранения tasks.json)
+    size_t FreeUnreferenced(const std::vector<uint32_t>& live);
+
+    // false - слот пуст или принадлежит другой задаче
+    bool Read(uint32_t slot, std::wstring_view taskId, Record& out) const;
+    // Пишет поля задачи; слот, переданный другой задаче, не трогается
+    void Store(uint32_t slot, const Task& task);
+    void Flush();
+
+private:
+    bool MapLocked(uint32_t capacity);
+    void UnmapLocked();
+
+    mutable std::shared_mutex mapMtx_;   // shared - доступ к слотам; unique - рост, выделение
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = NULL;
+    char* view_ = nullptr;
+    uint32_t capacity_ = 0;
+    std::vector<uint32_t> free_;         // свободные слоты, младшие - в конце
+};
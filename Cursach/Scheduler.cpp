@@ -1,18 +1,152 @@
 ﻿#include "Scheduler.h"
 #include "JobExecutor.h"
 #include "Logger.h"
+#include "StructuredLog.h"
+#include "Trace.h"
 #include "Utils.h"
 #include <chrono>
+#include <algorithm>
 
-Scheduler::Scheduler(TaskManager* tm) : taskManager(tm) {}
+Scheduler::Scheduler(TaskManager* tm, const Clock& clock) : taskManager(tm), clock(&clock) {
+    instances->onSlotFreed = [this]() { Notify(); };
+    instances->onRunFinished = [this](const TaskPtr& task, int exitCode, bool cancelled) {
+        OnRunFinished(task, exitCode, cancelled);
+    };
+
+    wakeEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    // Высокоточный таймер (Windows 10 1803+), иначе обычный
+    timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!timer) timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+
+    fileWatcher = std::make_unique<FileWatcher>(
+        [this](const std::wstring& id, std::vector<std::wstring> paths) { OnFileTrigger(id, std::move(paths)); });
+}
 
 Scheduler::~Scheduler() {
     Stop();
+    {
+        std::lock_guard<std::mutex> lk(instances->mtx);
+        instances->onSlotFreed = nullptr;
+        instances->onRunFinished = nullptr;
+    }
+    if (timer) CloseHandle(timer);
+    if (wakeEvent) CloseHandle(wakeEvent);
+}
+
+// Настройки диспетчеризации из scheduler.ini (необязательный файл):
+//   [Dispatch]      MaxConcurrentJobs=8, ReservedCritical=2
+//   [GroupWeights]  backup=1, reports=3
+//   [Sharding]      Shards=64, MaxInstances=16, LeaseDir=<путь> (Shards=0 - выключено)
+// sharding = false (симуляция) - секция [Sharding] не читается
+void Scheduler::LoadConfig(bool sharding) {
+    std::wstring ini = util::GetAppDataDir() + L"\\scheduler.ini";
+
+    UINT maxJobs = GetPrivateProfileIntW(L"Dispatch", L"MaxConcurrentJobs", 0, ini.c_str());
+    UINT reserved = GetPrivateProfileIntW(L"Dispatch", L"ReservedCritical", 0, ini.c_str());
+    SetCapacity(maxJobs, reserved);
+
+    std::vector<wchar_t> buf(32 * 1024);
+    DWORD len = GetPrivateProfileSectionW(L"GroupWeights", buf.data(), (DWORD)buf.size(), ini.c_str());
+    for (const wchar_t* p = buf.data(); len > 0 && *p; p += wcslen(p) + 1) {
+        std::wstring entry = p;
+        size_t eq = entry.find(L'=');
+        if (eq == std::wstring::npos) continue;
+        SetGroupWeight(entry.substr(0, eq), (uint32_t)_wtoi(entry.c_str() + eq + 1));
+    }
+
+    UINT shardCount = sharding ? GetPrivateProfileIntW(L"Sharding", L"Shards", 0, ini.c_str()) : 0;
+    if (shardCount > 0 && !shards) {
+        UINT maxInstances = GetPrivateProfileIntW(L"Sharding", L"MaxInstances", 16, ini.c_str());
+        wchar_t dir[MAX_PATH] = {};
+        GetPrivateProfileStringW(L"Sharding", L"LeaseDir", L"", dir, MAX_PATH, ini.c_str());
+        std::wstring leaseDir = dir[0] ? dir : util::GetAppDataDir() + L"\\shards";
+
+        // Без свободного слота экземпляр не владеет ни одним шардом и ничего не запускает
+        shards = std::make_shared<ShardCoordinator>(leaseDir, shardCount, maxInstances);
+        if (!shards->Start()) {
+            g_Logger.Log(LogLevel::Error, L"Scheduler",
+                L"Sharding requested but no instance slot is free - this instance will not dispatch");
+        }
+        // Любое сохранение списка (окно, перечитывание, выход) сливается с записями других
+        // экземпляров. Фильтр держит координатор: последнее сохранение идет уже после ~Scheduler
+        taskManager->SetSaveFilter([coord = shards](std::wstring_view id) { return coord->OwnsTask(id); });
+    }
+}
+
+// Ключ срабатывания для журнала шарда. Для INTERVAL - номер интервала от эпохи:
+// экземпляры по-разному помнят lastRunTime, но попадают в один и тот же интервал.
+static long long OccurrenceKey(const TaskPtr& t) {
+    using namespace std::chrono;
+    switch (t->triggerType) {
+    case TriggerType::ONCE:
+        return duration_cast<seconds>(t->runOnceTime.time_since_epoch()).count();
+    case TriggerType::INTERVAL: {
+        long long period = (long long)(std::max)(t->intervalMinutes, 1u) * 60;
+        return duration_cast<seconds>(t->nextRunTime.time_since_epoch()).count() / period;
+    }
+    case TriggerType::FILE_WATCH:
+        return duration_cast<milliseconds>(t->nextRunTime.time_since_epoch()).count();
+    default:
+        return duration_cast<seconds>(t->nextRunTime.time_since_epoch()).count();
+    }
+}
+
+void Scheduler::SetCapacity(uint32_t maxJobs, uint32_t reserved) {
+    std::lock_guard<std::mutex> lk(dispatchMtx);
+    maxConcurrentJobs = maxJobs;
+    reservedForCritical = (maxJobs == 0) ? 0 : (std::min)(reserved, maxJobs);
+    g_Logger.Log(LogLevel::Info, L"Scheduler",
+        L"Dispatch capacity: maxConcurrentJobs=" + std::to_wstring(maxConcurrentJobs) +
+        L" reservedCritical=" + std::to_wstring(reservedForCritical));
+}
+
+void Scheduler::SetGroupWeight(const std::wstring& group, uint32_t weight) {
+    std::lock_guard<std::mutex> lk(dispatchMtx);
+    groupWeights[group.empty() ? L"default" : group] = (std::max)(weight, 1u);
+}
+
+std::vector<std::pair<std::wstring, Scheduler::GroupStats>> Scheduler::GetGroupStats() {
+    std::lock_guard<std::mutex> lk(dispatchMtx);
+    return { groupStats.begin(), groupStats.end() };
+}
+
+std::wstring Scheduler::GroupStatsReport() {
+    auto pad = [](std::wstring s, size_t width) {
+        if (s.size() < width) s.append(width - s.size(), L' ');
+        return s;
+    };
+
+    uint32_t maxJobs, reserved;
+    {
+        std::lock_guard<std::mutex> lk(dispatchMtx);
+        maxJobs = maxConcurrentJobs;
+        reserved = reservedForCritical;
+    }
+    auto groups = GetGroupStats();
+    std::sort(groups.begin(), groups.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::wstring r = L"Dispatch wait by group (maxConcurrentJobs=" +
+        (maxJobs ? std::to_wstring(maxJobs) : std::wstring(L"unlimited")) +
+        L", reservedCritical=" + std::to_wstring(reserved) + L"):\r\n";
+    r += L"  " + pad(L"group", 20) + pad(L"dispatched", 12) + pad(L"waiting", 10) +
+        pad(L"avg ms", 12) + L"max ms\r\n";
+    for (auto& [name, gs] : groups) {
+        wchar_t avg[32];
+        swprintf_s(avg, L"%.1f", gs.dispatched ? (double)gs.totalWaitMs / gs.dispatched : 0.0);
+        r += L"  " + pad(name, 20) + pad(std::to_wstring(gs.dispatched), 12) + pad(std::to_wstring(gs.waiting), 10) +
+            pad(avg, 12) + std::to_wstring(gs.maxWaitMs) + L"\r\n";
+    }
+    if (groups.empty()) r += L"  (nothing dispatched yet)\r\n";
+    return r;
 }
 
 void Scheduler::Start() {
     if (running.load()) return;
+    LoadConfig();
+    RestoreRetries();
     running.store(true);
+    fileWatcher->Start();
     worker = std::thread(&Scheduler::ThreadProc, this);
     g_Logger.Log(LogLevel::Info, L"Scheduler", L"Scheduler started");
 }
@@ -20,135 +154,715 @@ void Scheduler::Start() {
 void Scheduler::Stop() {
     if (!running.load()) return;
     running.store(false);
-    {
-        std::lock_guard<std::mutex> lk(mtx);
-        needWake = true;
-    }
-    cv.notify_one();
+    SetEvent(wakeEvent);
     if (worker.joinable()) worker.join();
+    fileWatcher->Stop();
     g_Logger.Log(LogLevel::Info, L"Scheduler", L"Scheduler stopped");
 }
 
 void Scheduler::Notify() {
+    SetEvent(wakeEvent);
+}
+
+void Scheduler::OnFileTrigger(const std::wstring& taskId, std::vector<std::wstring> paths) {
     {
-        std::lock_guard<std::mutex> lk(mtx);
-        needWake = true;
+        std::lock_guard<std::mutex> lk(fileMtx);
+        auto& acc = fileTriggers[taskId];
+        acc.insert(acc.end(), paths.begin(), paths.end());
     }
-    cv.notify_one();
+    SetEvent(wakeEvent);
 }
 
-void Scheduler::ThreadProc() {
-    using namespace std::chrono;
-    while (running.load()) {
-        auto tasks = taskManager->GetAllTasks();
-        system_clock::time_point nextDeadline{};
-        TaskPtr nextTask = nullptr;
-        auto now = system_clock::now();
+void Scheduler::OnClockChanged() {
+    clockChanged.store(true);
+    SetEvent(wakeEvent);
+}
 
-        for (auto& t : tasks) {
-            if (!t->enabled) continue;
-            if (t->nextRunTime.time_since_epoch().count() == 0) continue;
+void Scheduler::WaitForDeadline(std::chrono::system_clock::time_point deadline) {
+    TRACE_SPAN("WaitForDeadline", "scheduler");
+    // Нет сроков - спим до Notify без периодических пробуждений
+    if (deadline.time_since_epoch().count() == 0 || !timer) {
+        WaitForSingleObject(wakeEvent, INFINITE);
+        return;
+    }
 
-            if (t->nextRunTime <= now) {
-                if (!nextTask || t->nextRunTime < nextTask->nextRunTime) {
-                    nextTask = t;
-                }
-            }
-            else {
-                if (!nextTask) {
-                    if (nextDeadline.time_since_epoch().count() == 0 || t->nextRunTime < nextDeadline) {
-                        nextDeadline = t->nextRunTime;
-                    }
-                }
-                else {
-                    if (t->nextRunTime < nextDeadline) nextDeadline = t->nextRunTime;
+    // Положительный срок - абсолютный (FILETIME); такие таймеры сами сдвигаются при переводе часов
+    LARGE_INTEGER due;
+    due.QuadPart = ToFileTime(deadline);
+    if (!SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+        g_Logger.Log(LogLevel::Warn, L"Scheduler",
+            L"SetWaitableTimer failed (" + std::to_wstring(GetLastError()) + L"), waiting on event only");
+        WaitForSingleObject(wakeEvent, 1000);
+        return;
+    }
+
+    HANDLE handles[2] = { wakeEvent, timer };
+    DWORD res = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+    if (res == WAIT_OBJECT_0) CancelWaitableTimer(timer);
+}
+
+Scheduler::OverlapStats Scheduler::GetOverlapStats(const TaskPtr& task) {
+    OverlapStats stats;
+    std::lock_guard<std::mutex> lk(instances->mtx);
+    auto it = instances->byId.find(task->id);
+    if (it != instances->byId.end()) stats.running = it->second.running;
+    stats.skipped = task->overlapSkipped;
+    stats.queued = task->overlapQueued;
+    return stats;
+}
+
+// Решает по overlapPolicy, запускать ли очередное срабатывание, и запускает
+// процесс в отдельном потоке (fire-and-forget). Поток после завершения
+// сам подхватывает отложенное срабатывание QUEUE_ONE.
+void Scheduler::DispatchAsync(const TaskPtr& task, const std::wstring& typeStr, std::vector<std::wstring> triggerPaths) {
+    uint32_t limit = task->maxConcurrentInstances;
+    if (limit == 0 && task->overlapPolicy != OverlapPolicy::ALLOW) limit = 1;
+
+    HANDLE cancelEvent = NULL;
+    {
+        std::lock_guard<std::mutex> lk(instances->mtx);
+        InstanceState& st = TaskIdEntry(instances->byId, task->id);
+
+        if (limit != 0 && st.running >= limit) {
+            switch (task->overlapPolicy) {
+            case OverlapPolicy::QUEUE_ONE:
+                if (!st.queuedPending) {
+                    st.queuedPending = true;
+                    st.queuedPaths = std::move(triggerPaths);
+                    ++task->overlapQueued;
+                    g_Logger.Log(LogLevel::Info, L"Scheduler", task->id,
+                        L"Task '" + std::wstring(task->name) + L"' still running (" + std::to_wstring(st.running) +
+                        L") - run queued | queued total=" + std::to_wstring(task->overlapQueued));
+                    return;
                 }
+                // Файлы пропущенного срабатывания достаются отложенному запуску
+                st.queuedPaths.insert(st.queuedPaths.end(), triggerPaths.begin(), triggerPaths.end());
+                ++task->overlapSkipped;
+                g_Logger.Log(LogLevel::Warn, L"Scheduler", task->id,
+                    L"Task '" + std::wstring(task->name) + L"' already has a queued run - skipped | skipped total=" +
+                    std::to_wstring(task->overlapSkipped));
+                return;
+
+            case OverlapPolicy::CANCEL_PREVIOUS:
+                g_Logger.Log(LogLevel::Warn, L"Scheduler", task->id,
+                    L"Task '" + std::wstring(task->name) + L"' still running - cancelling " +
+                    std::to_wstring(st.running) + L" previous run(s)");
+                if (sim) sim->Cancel(task->id);
+                for (HANDLE ev : st.cancelEvents) SetEvent(ev);
+                break;
+
+            default:  // ALLOW с лимитом, SKIP_IF_RUNNING
+                ++task->overlapSkipped;
+                g_Logger.Log(LogLevel::Warn, L"Scheduler", task->id,
+                    L"Task '" + std::wstring(task->name) + L"' still running (" + std::to_wstring(st.running) +
+                    L"/" + std::to_wstring(limit) + L") - run skipped | skipped total=" +
+                    std::to_wstring(task->overlapSkipped));
+                return;
             }
         }
 
-        if (nextTask) {
-            g_Logger.Log(LogLevel::Info, L"Scheduler",
-                L"Executing task: " + nextTask->name +
-                L" | Type=" + std::to_wstring((int)nextTask->triggerType) +
-                L" | hasTimeout=" + (nextTask->hasExecutionTimeout ? L"YES" : L"NO") +
-                L" | timeoutMin=" + std::to_wstring(nextTask->executionTimeoutMinutes));
+        if (!sim) {
+            cancelEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+            if (cancelEvent) st.cancelEvents.push_back(cancelEvent);
+        }
+        ++st.running;
+        ++instances->totalRunning;
+    }
+
+    if (sim) {
+        sim->Launch(task, false);
+        return;
+    }
 
-            TriggerType triggerType = nextTask->triggerType;
+    // Раньше - отдельный поток на каждый запуск, заблокированный в WaitForSingleObject
+    async::Spawn(RunInstance(instances, task, typeStr, cancelEvent, clock, std::move(triggerPaths)));
+}
 
-            // ← ИСПРАВЛЕНИЕ: Асинхронный запуск для INTERVAL, DAILY, WEEKLY
-            if (triggerType == TriggerType::INTERVAL ||
-                triggerType == TriggerType::DAILY ||
-                triggerType == TriggerType::WEEKLY) {
+async::Future<void> Scheduler::RunInstance(std::shared_ptr<InstanceTable> table, TaskPtr task, std::wstring typeStr,
+    HANDLE cancelEvent, const Clock* clock, std::vector<std::wstring> paths) {
+    // CreateProcess и разбор итога - в пуле, не в потоке планировщика
+    co_await async::ThreadPool::Default().Schedule();
+    trace::NameThread("Job pool");
+    g_Logger.Log(LogLevel::Info, L"Scheduler", task->id,
+        L"🔄 " + typeStr + L" task run started in background: " + std::wstring(task->name));
 
-                std::wstring typeStr = (triggerType == TriggerType::INTERVAL) ? L"INTERVAL" :
-                    (triggerType == TriggerType::DAILY) ? L"DAILY" : L"WEEKLY";
+    while (true) {
+        int exitCode = co_await JobExecutor::RunTaskAsync(task, cancelEvent, paths, *clock);
 
-                g_Logger.Log(LogLevel::Info, L"Scheduler",
-                    L"⏱️ " + typeStr + L" task - launching asynchronously: " + nextTask->name);
+        g_Logger.Log(LogLevel::Info, L"Scheduler", task->id,
+            L"✓ " + typeStr + L" task completed in background: " + std::wstring(task->name) +
+            L" | exitCode=" + std::to_wstring(exitCode));
 
-                // Обновляем lastRunTime ДО запуска процесса
-                nextTask->lastRunTime = system_clock::now();
+        // Блокировка - только до конца итерации, через co_await она не держится
+        std::lock_guard<std::mutex> lk(table->mtx);
 
-                // Пересчитываем nextRunTime сразу
-                taskManager->CalculateNextRun(nextTask);
-                taskManager->Save();
+        bool cancelled = cancelEvent && WaitForSingleObject(cancelEvent, 0) == WAIT_OBJECT_0;
+        if (table->onRunFinished) table->onRunFinished(task, exitCode, cancelled);
 
-                g_Logger.Log(LogLevel::Info, L"Scheduler",
-                    L"✓ " + typeStr + L" task scheduled. Next run: " +
-                    util::TimePointToWString(nextTask->nextRunTime));
+        // Отложенное срабатывание выполняем в этой же сопрограмме, слот остается занятым
+        if (FinishRunLocked(*table, task->id, cancelEvent, cancelled, paths)) {
+            g_Logger.Log(LogLevel::Info, L"Scheduler", task->id,
+                L"Starting queued run of task: " + std::wstring(task->name));
+            continue;
+        }
+        break;
+    }
+}
 
-                // Запускаем процесс в отдельном потоке (fire-and-forget)
-                TaskPtr taskCopy = nextTask;
-                std::thread([taskCopy, typeStr]() {
-                    g_Logger.Log(LogLevel::Info, L"Scheduler",
-                        L"🔄 " + typeStr + L" task background thread started: " + taskCopy->name);
+// Отмененный запуск очередь не подхватывает. Последний запуск без отложенного срабатывания
+// удаляет запись задачи: иначе таблица копит записи удаленных и переименованных задач
+bool Scheduler::FinishRunLocked(InstanceTable& table, std::wstring_view id, HANDLE cancelEvent,
+    bool cancelled, std::vector<std::wstring>& paths) {
+    auto it = table.byId.find(id);   // есть, пока этот запуск держит running
+    InstanceState& st = it->second;
+    if (st.queuedPending && !cancelled) {
+        st.queuedPending = false;
+        paths = std::move(st.queuedPaths);
+        st.queuedPaths.clear();
+        return true;
+    }
 
-                    int exitCode = JobExecutor::RunTask(taskCopy);
+    if (cancelEvent) {
+        auto& evs = st.cancelEvents;
+        for (size_t i = 0; i < evs.size(); ++i) {
+            if (evs[i] == cancelEvent) { evs[i] = evs.back(); evs.pop_back(); break; }
+        }
+        CloseHandle(cancelEvent);
+    }
+    --st.running;
+    --table.totalRunning;
+    if (st.running == 0 && !st.queuedPending) table.byId.erase(it);
+    if (table.onSlotFreed) table.onSlotFreed();
+    return false;
+}
 
-                    g_Logger.Log(LogLevel::Info, L"Scheduler",
-                        L"✓ " + typeStr + L" task completed in background: " + taskCopy->name +
-                        L" | exitCode=" + std::to_wstring(exitCode));
-                    }).detach();
+void Scheduler::CompleteSimulatedRun(const TaskPtr& task, int exitCode, bool cancelled) {
+    OnRunFinished(task, exitCode, cancelled);
 
-                // Продолжаем работу scheduler без ожидания завершения процесса
-                continue;
-            }
+    std::vector<std::wstring> paths;
+    bool again;
+    {
+        std::lock_guard<std::mutex> lk(instances->mtx);
+        again = FinishRunLocked(*instances, task->id, NULL, cancelled, paths);
+    }
+    if (again && sim) sim->Launch(task, true);
+}
 
-            // Для ONCE - синхронное выполнение (нужно дождаться завершения для отключения)
-            if (triggerType == TriggerType::ONCE) {
-                g_Logger.Log(LogLevel::Info, L"Scheduler",
-                    L"🎯 ONCE task - executing synchronously: " + nextTask->name);
+static const std::wstring& GroupOf(const TaskPtr& t) {
+    static const std::wstring kDefault = L"default";
+    return t->group.empty() ? kDefault : t->group;
+}
 
-                int exitCode = JobExecutor::RunTask(nextTask);
+void Scheduler::CountWaiting(const std::vector<TaskPtr>& due) {
+    std::lock_guard<std::mutex> lk(dispatchMtx);
+    for (auto& [name, gs] : groupStats) gs.waiting = 0;
+    for (auto& t : due) ++groupStats[GroupOf(t)].waiting;
+}
 
-                g_Logger.Log(LogLevel::Info, L"Scheduler",
-                    L"Task completed: " + nextTask->name + L" | exitCode=" + std::to_wstring(exitCode));
+// Порядок внутри группы: приоритет, затем срок. Кучи std::*_heap - максимум в вершине,
+// поэтому сравнения "хуже"
+static const auto DueAfter = [](const auto& a, const auto& b) {
+    if (a.priority != b.priority) return a.priority < b.priority;
+    return a.at > b.at;
+};
 
-                // ONCE всегда отключается после выполнения
-                nextTask->enabled = false;
-                nextTask->nextRunTime = {};
+static const auto DueLater = [](const auto& a, const auto& b) { return a.at > b.at; };
 
-                if (exitCode == 999) {
-                    g_Logger.Log(LogLevel::Warn, L"Scheduler",
-                        L"Task '" + nextTask->name + L"' (ONCE) killed by timeout and disabled");
-                }
-                else {
-                    g_Logger.Log(LogLevel::Info, L"Scheduler",
-                        L"Task '" + nextTask->name + L"' (ONCE) completed and disabled");
+// Проход начинается со списка по сроку (CollectDue уже упорядочил). При лимите емкости
+// он раскладывается по кучам в SplitDueLocked - только если есть свободный слот: проходы
+// при насыщенном исполнителе (новый срок, Notify) кучи не строят
+void Scheduler::BuildDueQueue(std::vector<TaskPtr> due, DueQueue& queue) {
+    std::lock_guard<std::mutex> lk(dispatchMtx);
+    queue = DueQueue{};
+    queue.remaining = due.size();
+    queue.fair = maxConcurrentJobs != 0;
+    queue.inOrder = std::move(due);
+}
+
+void Scheduler::SplitDueLocked(DueQueue& queue) {
+    for (auto& t : queue.inOrder) {
+        DueEntry e{ t->priority, t->nextRunTime, std::move(t) };
+        if (e.priority == TaskPriority::CRITICAL) queue.critical.push_back(std::move(e));
+        else queue.groups[GroupOf(e.task)].push_back(std::move(e));
+    }
+    queue.inOrder.clear();
+    queue.split = true;
+    std::make_heap(queue.critical.begin(), queue.critical.end(), DueLater);
+    for (auto& [name, heap] : queue.groups) std::make_heap(heap.begin(), heap.end(), DueAfter);
+
+    // Группа без просроченных задач теряет накопленный дефицит
+    for (auto it = drrDeficit.begin(); it != drrDeficit.end();) {
+        if (queue.groups.count(it->first)) ++it;
+        else it = drrDeficit.erase(it);
+    }
+}
+
+// Выбор следующей просроченной задачи. Без лимита емкости - самая ранняя (как раньше).
+// При лимите: CRITICAL вне очереди (могут занимать резерв), остальные - DRR по группам,
+// внутри группы - по приоритету, затем по nextRunTime. nullptr - исполнитель насыщен
+// или задач не осталось.
+TaskPtr Scheduler::PickNext(DueQueue& queue) {
+    if (queue.remaining == 0) return nullptr;
+    if (!queue.fair) {
+        --queue.remaining;
+        return queue.inOrder[queue.next++];
+    }
+
+    std::lock_guard<std::mutex> lk(dispatchMtx);
+
+    uint32_t runningNow;
+    {
+        std::lock_guard<std::mutex> ilk(instances->mtx);
+        runningNow = instances->totalRunning;
+    }
+
+    // Емкость могли снять посреди прохода (LoadConfig) - тогда не насыщен
+    bool fullForCritical = maxConcurrentJobs != 0 && runningNow >= maxConcurrentJobs;
+    bool fullForOthers = maxConcurrentJobs != 0 && runningNow + reservedForCritical >= maxConcurrentJobs;
+    // Свободен только резерв - кучи нужны, лишь если среди просроченных есть CRITICAL
+    if (!queue.split && !fullForCritical &&
+        (!fullForOthers || std::any_of(queue.inOrder.begin(), queue.inOrder.end(),
+            [](const TaskPtr& t) { return t->priority == TaskPriority::CRITICAL; }))) {
+        SplitDueLocked(queue);
+    }
+
+    TaskPtr chosen;
+    if (!queue.critical.empty() && !fullForCritical) {
+        std::pop_heap(queue.critical.begin(), queue.critical.end(), DueLater);
+        chosen = std::move(queue.critical.back().task);
+        queue.critical.pop_back();
+    }
+    else if (!fullForOthers && !queue.groups.empty()) {
+        // CRITICAL, не поместившиеся в емкость, ждут; кольцо - группы с просроченными задачами
+        auto g = queue.groups.find(drrCurrent);
+        if (g == queue.groups.end() || drrDeficit[drrCurrent] < 1) {
+            // Следующая группа по кругу получает квант, равный ее весу
+            g = queue.groups.upper_bound(drrCurrent);
+            if (g == queue.groups.end()) g = queue.groups.begin();
+            auto w = groupWeights.find(g->first);
+            drrDeficit[g->first] += (w == groupWeights.end()) ? 1 : w->second;
+            drrCurrent = g->first;
+        }
+        --drrDeficit[g->first];
+
+        auto& heap = g->second;
+        std::pop_heap(heap.begin(), heap.end(), DueAfter);
+        chosen = std::move(heap.back().task);
+        heap.pop_back();
+        if (heap.empty()) {
+            drrDeficit.erase(g->first);
+            queue.groups.erase(g);
+        }
+    }
+
+    if (!chosen) {
+        if (!saturatedLogged) {
+            g_Logger.Log(LogLevel::Warn, L"Scheduler",
+                L"Executor saturated: running=" + std::to_wstring(runningNow) +
+                L"/" + std::to_wstring(maxConcurrentJobs) +
+                L" | due tasks waiting=" + std::to_wstring(queue.remaining));
+            saturatedLogged = true;
+        }
+        return nullptr;
+    }
+    --queue.remaining;
+    saturatedLogged = false;
+    return chosen;
+}
+
+// Слот исполнителя для запуска вне очереди DRR (повтор): те же правила резерва, что в PickNext
+bool Scheduler::SlotAvailable(TaskPriority priority) {
+    std::lock_guard<std::mutex> lk(dispatchMtx);
+    if (maxConcurrentJobs == 0) return true;
+
+    uint32_t runningNow;
+    {
+        std::lock_guard<std::mutex> ilk(instances->mtx);
+        runningNow = instances->totalRunning;
+    }
+    uint32_t reserved = (priority == TaskPriority::CRITICAL) ? 0 : reservedForCritical;
+    return runningNow + reserved < maxConcurrentJobs;
+}
+
+// retryExitCodes: коды через запятую (или пробел); пусто - любой код неудачи
+static bool RetryableExitCode(const Task& t, int exitCode) {
+    if (t.retryExitCodes.empty()) return true;
+    const wchar_t* p = t.retryExitCodes.c_str();
+    while (*p) {
+        wchar_t* end = nullptr;
+        long code = wcstol(p, &end, 10);
+        if (end == p) { ++p; continue; }
+        if (code == exitCode) return true;
+        p = end;
+    }
+    return false;
+}
+
+void Scheduler::RestoreRetries() {
+    std::vector<TaskPtr> tasks = taskManager->GetAllTasks();
+    size_t restored = 0;
+    {
+        std::lock_guard<std::mutex> lk(retryMtx);
+        retryTimers.clear();
+        pendingRetries.clear();
+        for (auto& t : tasks) {
+            if (t->retryAt.time_since_epoch().count() == 0) continue;
+            retryTimers.emplace(t->retryAt, t->id);
+            TaskIdEntry(pendingRetries, t->id) = PendingRetry{ t->retryAt, t->retryAttempt };
+            ++restored;
+        }
+    }
+    if (restored > 0) {
+        g_Logger.Log(LogLevel::Info, L"Scheduler",
+            L"Pending retries restored: " + std::to_wstring(restored));
+    }
+}
+
+void Scheduler::DropRetryLocked(const TaskPtr& task) {
+    auto it = pendingRetries.find(task->id);
+    if (it != pendingRetries.end()) {
+        retryTimers.erase({ it->second.at, std::wstring(task->id) });
+        pendingRetries.erase(it);
+    }
+    task->retryAt = {};
+}
+
+// Серия - неудачный запуск и его повторы. Успех закрывает серию, неудача с подходящим кодом
+// ставит таймер следующей попытки, исчерпание попыток или другой код - отказ.
+// Остановленный запуск ничего не меняет: его сменяет новый запуск.
+void Scheduler::OnRunFinished(const TaskPtr& ran, int exitCode, bool cancelled) {
+    using namespace std::chrono;
+    taskManager->StoreRuntime(ran);   // lastExitCode/lastRunTime от JobExecutor - в runtime.dat
+    if (cancelled || exitCode == JobExecutor::kCancelledExitCode) return;
+
+    // Пока шел запуск, объект задачи могли заменить: серия продолжается на текущем объекте с тем же id
+    TaskPtr task = taskManager->GetTaskById(std::wstring(ran->id));
+    if (!task) return;   // задачу удалили
+    if (task != ran) {
+        task->lastExitCode = ran->lastExitCode;
+        task->lastRunTime = ran->lastRunTime;
+    }
+
+    std::lock_guard<std::mutex> lk(retryMtx);
+
+    if (exitCode == 0) {
+        if (task->retryAttempt == 0) return;
+        ++task->retryRecovered;
+        g_Logger.Log(LogLevel::Info, L"Scheduler", task->id,
+            L"Task '" + std::wstring(task->name) + L"' succeeded on retry " + std::to_wstring(task->retryAttempt) +
+            L"/" + std::to_wstring(task->retryMaxAttempts));
+        task->retryAttempt = 0;
+    }
+    else if (task->retryAttempt < task->retryMaxAttempts && RetryableExitCode(*task, exitCode)) {
+        uint32_t attempt = ++task->retryAttempt;
+
+        // base * 2^(attempt-1) с потолком, затем случайно в [delay/2, delay]:
+        // повторы задач, упавших одновременно, не приходят пачкой
+        uint64_t baseMs = (uint64_t)(std::max)(task->retryDelaySeconds, 1u) * 1000;
+        uint64_t capMs = (uint64_t)(std::max)(task->retryMaxDelaySeconds, task->retryDelaySeconds) * 1000;
+        uint64_t delayMs = baseMs << (std::min)(attempt - 1, 20u);
+        delayMs = (std::min)((std::max)(delayMs, baseMs), (std::max)(capMs, baseMs));
+        delayMs = delayMs / 2 + retryRng() % (delayMs / 2 + 1);
+
+        DropRetryLocked(task);
+        task->retryAt = clock->Now() + milliseconds(delayMs);
+        retryTimers.emplace(task->retryAt, task->id);
+        TaskIdEntry(pendingRetries, task->id) = PendingRetry{ task->retryAt, attempt };
+
+        g_Logger.Log(LogLevel::Warn, L"Scheduler", task->id,
+            L"Task '" + std::wstring(task->name) + L"' failed (exitCode=" + std::to_wstring(exitCode) + L") - retry " +
+            std::to_wstring(attempt) + L"/" + std::to_wstring(task->retryMaxAttempts) +
+            L" in " + std::to_wstring(delayMs / 1000) + L" s");
+    }
+    else {
+        if (task->retryMaxAttempts == 0) return;   // повторы не настроены
+        ++task->retryGaveUp;
+        g_Logger.Log(LogLevel::Error, L"Scheduler", task->id,
+            L"Task '" + std::wstring(task->name) + L"' failed (exitCode=" + std::to_wstring(exitCode) + L") - " +
+            (task->retryAttempt >= task->retryMaxAttempts
+                ? L"retries exhausted (" + std::to_wstring(task->retryAttempt) + L")"
+                : std::wstring(L"exit code is not retryable")));
+        task->retryAttempt = 0;
+    }
+
+    retryStateChanged.store(true);
+    Notify();
+}
+
+std::vector<Scheduler::RetryTimer> Scheduler::DueRetries(std::chrono::system_clock::time_point now,
+    std::chrono::system_clock::time_point& nextDeadline) {
+    std::vector<RetryTimer> due;
+    std::lock_guard<std::mutex> lk(retryMtx);
+    for (const RetryTimer& timer : retryTimers) {
+        if (timer.first > now) {
+            if (nextDeadline.time_since_epoch().count() == 0 || timer.first < nextDeadline)
+                nextDeadline = timer.first;
+            break;
+        }
+        due.push_back(timer);
+    }
+    return due;
+}
+
+bool Scheduler::ClaimRetry(const TaskPtr& task, const RetryTimer& timer) {
+    std::lock_guard<std::mutex> lk(retryMtx);
+    if (retryTimers.erase(timer) == 0) return false;
+    // Серию уже сменил запуск по расписанию или новая неудача
+    auto it = pendingRetries.find(timer.second);
+    if (it == pendingRetries.end() || it->second.at != timer.first) return false;
+    uint32_t attempt = it->second.attempt;
+    pendingRetries.erase(it);
+    if (!task) return false;   // задачу удалили
+
+    // Сверка - с записью по id, а не с retryAt объекта: объект мог смениться после неудачного запуска
+    task->retryAt = {};
+    task->retryAttempt = attempt;
+    retryStateChanged.store(true);
+
+    // ONCE отключается после первого запуска - его серия доигрывается; остальные - только включенные
+    if (!task->enabled && task->triggerType != TriggerType::ONCE) {
+        g_Logger.Log(LogLevel::Info, L"Scheduler", task->id,
+            L"Task '" + std::wstring(task->name) + L"' disabled - pending retry dropped");
+        task->retryAttempt = 0;
+        return false;
+    }
+    ++task->retryRuns;
+    return true;
+}
+
+void Scheduler::RecordWait(const TaskPtr& task, std::chrono::system_clock::time_point now) {
+    using namespace std::chrono;
+    uint64_t waitMs = now > task->nextRunTime
+        ? (uint64_t)duration_cast<milliseconds>(now - task->nextRunTime).count() : 0;
+
+    std::lock_guard<std::mutex> lk(dispatchMtx);
+    GroupStats& gs = groupStats[GroupOf(task)];
+    ++gs.dispatched;
+    gs.totalWaitMs += waitMs;
+    gs.maxWaitMs = (std::max)(gs.maxWaitMs, waitMs);
+}
+
+void Scheduler::ThreadProc() {
+    trace::NameThread("Scheduler");
+    while (running.load()) {
+        TRACE_SPAN("loop", "scheduler");
+        std::chrono::system_clock::time_point nextDeadline{};
+        if (DispatchPass(nextDeadline)) continue;
+
+        // Аренда шардов продлевается не реже nextLeaseRenew
+        if (shards && (nextDeadline.time_since_epoch().count() == 0 || nextLeaseRenew < nextDeadline)) {
+            nextDeadline = nextLeaseRenew;
+        }
+
+        WaitForDeadline(nextDeadline);
+    }
+}
+
+void Scheduler::RunSimulation(SimulationHost* host) {
+    if (!host || running.load()) return;
+
+    sim = host;
+    RestoreRetries();
+    while (true) {
+        std::chrono::system_clock::time_point nextDeadline{};
+        bool dispatched = DispatchPass(nextDeadline);
+        // После запусков проход повторяется сразу - хост только проверяет, не кончился ли период
+        if (!sim->WaitUntil(dispatched ? clock->Now() : nextDeadline)) break;
+    }
+    sim = nullptr;
+}
+
+bool Scheduler::DispatchPass(std::chrono::system_clock::time_point& nextDeadline) {
+    using namespace std::chrono;
+    TRACE_SPAN("DispatchPass", "scheduler");
+
+    // DAILY/WEEKLY/ONCE считаются в местном времени - после смены часов пересчитываем
+    if (clockChanged.exchange(false)) {
+        g_Logger.Log(LogLevel::Warn, L"Scheduler",
+            L"System clock or time zone changed - recalculating next run times");
+        taskManager->RecalculateWallClockTasks();
+    }
+
+    std::vector<TaskPtr> due;
+    auto now = clock->Now();
+
+    // Полный список (строки, пути) нужен только наблюдателю и только после изменений.
+    // В симуляции файловых событий нет - каталоги не открываются.
+    uint64_t version = taskManager->Version();
+    if (!sim && version != syncedVersion) {
+        fileWatcher->Sync(taskManager->GetAllTasks());
+        syncedVersion = version;
+    }
+
+    // Сработавшие FILE_WATCH становятся просроченными; пути ждут запуска
+    {
+        std::lock_guard<std::mutex> lk(fileMtx);
+        for (auto& [id, paths] : fileTriggers) {
+            TaskPtr t = taskManager->GetTaskById(id);
+            if (!t || !t->enabled || t->triggerType != TriggerType::FILE_WATCH) continue;
+            if (shards && !shards->OwnsTask(id)) continue;
+            if (t->nextRunTime.time_since_epoch().count() == 0) taskManager->SetNextRun(t, now);
+            auto& acc = fileTriggerPaths[id];
+            acc.insert(acc.end(), paths.begin(), paths.end());
+        }
+        fileTriggers.clear();
+    }
+
+    if (shards && now >= nextLeaseRenew) {
+        shards->Rebalance();
+        nextLeaseRenew = now + seconds(2);
+    }
+
+    // Просроченные берутся из упорядоченного по сроку индекса TaskManager, узлы Task не трогаются
+    TaskManager::OwnsFn owns;
+    if (shards) owns = [this](std::wstring_view id) { return shards->OwnsTask(id); };
+    taskManager->CollectDue(now, owns, due, nextDeadline);
+    CountWaiting(due);
+
+    // При лимите емкости ожидание по группам - в лог раз в 10 минут (без лимита очереди нет)
+    if (now >= nextGroupStatsLog) {
+        bool limited;
+        {
+            std::lock_guard<std::mutex> lk(dispatchMtx);
+            limited = maxConcurrentJobs != 0;
+        }
+        if (limited && nextGroupStatsLog.time_since_epoch().count() != 0)
+            g_Logger.Log(LogLevel::Info, L"Scheduler", GroupStatsReport());
+        nextGroupStatsLog = now + minutes(10);
+    }
+
+    DueQueue queue;
+    BuildDueQueue(std::move(due), queue);
+
+    bool dispatched = false;
+    bool disabled = false;   // ONCE отключена - поле tasks.json
+
+    // Повторы с наступившим сроком - вне очереди DRR, но в пределах емкости
+    for (const RetryTimer& timer : DueRetries(now, nextDeadline)) {
+        TaskPtr task = taskManager->GetTaskById(timer.second);
+        if (task && shards && !shards->OwnsTask(task->id)) task = nullptr;   // повторит владелец шарда
+        if (task && !SlotAvailable(task->priority)) break;   // ждут onSlotFreed
+        if (!ClaimRetry(task, timer)) continue;
+        dispatched = true;
+
+        g_Logger.Log(LogLevel::Info, L"Scheduler", task->id,
+            L"🔁 Retry " + std::to_wstring(task->retryAttempt) + L"/" + std::to_wstring(task->retryMaxAttempts) +
+            L" of task: " + std::wstring(task->name) + L" | last exitCode=" + std::to_wstring(task->lastExitCode));
+        DispatchAsync(task, L"RETRY", {});
+    }
+
+    // Все просроченные запускаются за один проход (раньше - по одной задаче на проход
+    // с повторным сбором). При насыщении остальные ждут освобождения слота (onSlotFreed -> Notify).
+    while (TaskPtr nextTask = PickNext(queue)) {
+        now = clock->Now();
+
+        // Пока шла пачка, задачу могли отключить или перепланировать из UI
+        if (!nextTask->enabled || nextTask->nextRunTime.time_since_epoch().count() == 0 ||
+            nextTask->nextRunTime > now) continue;
+
+        ShardCoordinator::Claim claim = shards
+            ? shards->ClaimOccurrence(nextTask->id, OccurrenceKey(nextTask)) : ShardCoordinator::Claim::Claimed;
+        // Шард ушел другому экземпляру между сбором и запуском - срабатывание выполнит он
+        if (claim == ShardCoordinator::Claim::NotOwned) continue;
+        // Журнал не записался: задача остается просроченной, следующая попытка через секунду
+        if (claim == ShardCoordinator::Claim::WriteFailed) {
+            g_Logger.Log(LogLevel::Warn, L"Scheduler", nextTask->id,
+                L"Task '" + std::wstring(nextTask->name) + L"' not started: shard journal unavailable, retrying in 1 s");
+            auto retryAt = now + seconds(1);
+            if (nextDeadline.time_since_epoch().count() == 0 || retryAt < nextDeadline) nextDeadline = retryAt;
+            continue;
+        }
+        dispatched = true;
+
+        // Срабатывание уже выполнено прежним владельцем шарда - только перевзводим
+        if (claim == ShardCoordinator::Claim::AlreadyFired) {
+            g_Logger.Log(LogLevel::Info, L"Scheduler", nextTask->id,
+                L"Occurrence of task '" + std::wstring(nextTask->name) + L"' already fired by another instance - skipped");
+            if (nextTask->triggerType == TriggerType::ONCE) {
+                taskManager->Disable(nextTask);
+                disabled = true;
+            }
+            else {
+                nextTask->lastRunTime = now;
+                taskManager->CalculateNextRun(nextTask);
+            }
+            continue;
+        }
+
+        RecordWait(nextTask, now);
+
+        // Срабатывание по расписанию начинает новую серию: ожидающий повтор снимается
+        {
+            std::lock_guard<std::mutex> lk(retryMtx);
+            bool pending = pendingRetries.find(nextTask->id) != pendingRetries.end();
+            if (nextTask->retryAttempt != 0 || pending) {
+                if (pending) {
+                    g_Logger.Log(LogLevel::Info, L"Scheduler", nextTask->id,
+                        L"Pending retry of task '" + std::wstring(nextTask->name) + L"' superseded by scheduled run");
                 }
+                DropRetryLocked(nextTask);
+                nextTask->retryAttempt = 0;
+                retryStateChanged.store(true);
+            }
+        }
+
+        SLOG(LogLevel::Info, L"Scheduler", L"Executing task: {} | Type={} | hasTimeout={} | timeoutMin={}",
+            nextTask->name, nextTask->triggerType, nextTask->hasExecutionTimeout,
+            nextTask->executionTimeoutMinutes);
 
-                taskManager->Save();
-                continue;
+        TriggerType triggerType = nextTask->triggerType;
+
+        // Все типы запускаются асинхронно и занимают слот емкости (totalRunning).
+        // ONCE раньше выполнялась синхронно в потоке планировщика мимо учета слотов
+        std::wstring typeStr = (triggerType == TriggerType::INTERVAL) ? L"INTERVAL" :
+            (triggerType == TriggerType::DAILY) ? L"DAILY" :
+            (triggerType == TriggerType::WEEKLY) ? L"WEEKLY" :
+            (triggerType == TriggerType::FILE_WATCH) ? L"FILE_WATCH" : L"ONCE";
+
+        std::vector<std::wstring> triggerPaths;
+        if (triggerType == TriggerType::FILE_WATCH) {
+            std::lock_guard<std::mutex> lk(fileMtx);
+            auto it = fileTriggerPaths.find(nextTask->id);
+            if (it != fileTriggerPaths.end()) {
+                triggerPaths = std::move(it->second);
+                fileTriggerPaths.erase(it);
             }
         }
 
-        std::unique_lock<std::mutex> lk(mtx);
-        if (nextDeadline.time_since_epoch().count() == 0) {
-            cv.wait_for(lk, seconds(5), [&]() { return !running.load() || needWake; });
+        g_Logger.Log(LogLevel::Info, L"Scheduler", nextTask->id,
+            L"⏱️ " + typeStr + L" task - launching asynchronously: " + std::wstring(nextTask->name));
+
+        // Обновляем lastRunTime ДО запуска процесса
+        nextTask->lastRunTime = clock->Now();
+
+        if (triggerType == TriggerType::ONCE) {
+            // ONCE отключается, как только запущена: следующий проход ее уже не соберет,
+            // а повторы серии ClaimRetry для ONCE пропускает и после отключения
+            taskManager->Disable(nextTask);
+            disabled = true;
+            g_Logger.Log(LogLevel::Info, L"Scheduler", nextTask->id,
+                L"Task '" + std::wstring(nextTask->name) + L"' (ONCE) launched and disabled");
         }
         else {
-            cv.wait_until(lk, nextDeadline, [&]() { return !running.load() || needWake; });
+            // Пересчитываем nextRunTime сразу
+            taskManager->CalculateNextRun(nextTask);
+
+            g_Logger.Log(LogLevel::Info, L"Scheduler", nextTask->id,
+                L"✓ " + typeStr + L" task scheduled. Next run: " +
+                util::TimePointToWString(nextTask->nextRunTime));
         }
-        needWake = false;
+
+        // Продолжаем работу scheduler без ожидания завершения процесса
+        DispatchAsync(nextTask, typeStr, std::move(triggerPaths));
     }
-}
\ No newline at end of file
+
+    // lastRunTime/nextRunTime/lastExitCode уже записаны на месте в runtime.dat; tasks.json
+    // переписывается только ради отключенных ONCE и состояния повторов - один снимок на проход
+    bool retryChanged = retryStateChanged.exchange(false);
+    if (disabled || retryChanged) {
+        // Несколько экземпляров пишут один tasks.json: каждый - только задачи своих шардов
+        // (фильтр задан в LoadConfig)
+        taskManager->Save();
+    }
+    return dispatched;
+}
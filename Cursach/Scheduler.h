@@ -1,23 +1,196 @@
-#pragma once
+﻿#pragma once
+#include "Async.h"
 #include "TaskManager.h"
+#include "Clock.h"
+#include "ShardLease.h"
+#include "FileWatcher.h"
 #include <thread>
 #include <atomic>
-#include <condition_variable>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <random>
+#include <set>
+#include <Windows.h>
+
+// Симуляция (Simulator): процессы заменены моделью длительности, ожидание сроков -
+// сдвигом виртуальных часов. Все вызовы идут из потока Scheduler::RunSimulation.
+class SimulationHost {
+public:
+    virtual ~SimulationHost() = default;
+    // Асинхронный запуск; о завершении хост сообщает через Scheduler::CompleteSimulatedRun
+    virtual void Launch(const TaskPtr& task, bool queuedRun) = 0;
+    // CANCEL_PREVIOUS: живые запуски задачи завершаются "сейчас" с отменой
+    virtual void Cancel(std::wstring_view taskId) = 0;
+    // Ожидание до срока ({} - сроков нет) или до ближайшего завершения; false - период окончен
+    virtual bool WaitUntil(std::chrono::system_clock::time_point deadline) = 0;
+};
 
 class Scheduler {
 public:
-    Scheduler(TaskManager* tm);
+    // clock: источник "сейчас" (VirtualClock в симуляции; должен совпадать с часами TaskManager)
+    explicit Scheduler(TaskManager* tm, const Clock& clock = Clock::System());
     ~Scheduler();
     void Start();
     void Stop();
     // notify scheduler that tasks changed (recalculate next)
     void Notify();
+    // Системное время/часовой пояс изменены (WM_TIMECHANGE): пересчитать все сроки
+    void OnClockChanged();
+
+    // Счетчики перекрытия запусков для задачи (для отчета/UI)
+    struct OverlapStats {
+        uint32_t running = 0;
+        uint64_t skipped = 0;
+        uint64_t queued = 0;
+    };
+    OverlapStats GetOverlapStats(const TaskPtr& task);
+
+    // Емкость исполнителя: maxConcurrentJobs = 0 - без ограничения (как раньше).
+    // reservedForCritical слотов доступны только задачам TaskPriority::CRITICAL.
+    void SetCapacity(uint32_t maxConcurrentJobs, uint32_t reservedForCritical);
+    void SetGroupWeight(const std::wstring& group, uint32_t weight);
+
+    // Время ожидания в очереди (от nextRunTime до фактического запуска) по группам
+    struct GroupStats {
+        uint64_t dispatched = 0;
+        uint64_t totalWaitMs = 0;
+        uint64_t maxWaitMs = 0;
+        uint32_t waiting = 0;   // просроченных задач группы на последнем проходе
+    };
+    std::vector<std::pair<std::wstring, GroupStats>> GetGroupStats();
+    // Таблица GetGroupStats по группам (меню Help, отчет симуляции, периодически - в лог)
+    std::wstring GroupStatsReport();
+
+    // Несколько процессов над одним tasks.json ([Sharding] в scheduler.ini)
+    bool IsSharded() const { return shards != nullptr; }
+
+    // Настройки из scheduler.ini; Start читает их сам. sharding = false - без [Sharding] (симуляция)
+    void LoadConfig(bool sharding = true);
+
+    // Тот же цикл диспетчеризации в текущем потоке поверх host, пока host->WaitUntil не вернет false.
+    // Без FileWatcher, шардирования и процессов; вместо Start, не одновременно с ним.
+    // Емкость - LoadConfig(false) и/или SetCapacity до вызова.
+    void RunSimulation(SimulationHost* host);
+    // Завершение запуска, начатого host->Launch: учитывает повтор, освобождает слот
+    // или стартует отложенный запуск
+    void CompleteSimulatedRun(const TaskPtr& task, int exitCode, bool cancelled);
 private:
+    // Состояние живых запусков одной задачи; все операции O(1) под mtx таблицы.
+    // Запись есть, только пока идут запуски или ждет отложенное срабатывание; накопленные
+    // счетчики пропусков - в самой задаче (overlapSkipped/overlapQueued)
+    struct InstanceState {
+        uint32_t running = 0;
+        bool queuedPending = false;        // есть отложенное срабатывание (QUEUE_ONE)
+        std::vector<HANDLE> cancelEvents;  // по одному на живой запуск
+        std::vector<std::wstring> queuedPaths;  // файлы-триггеры отложенного срабатывания
+    };
+    // Живет дольше Scheduler: на нее ссылаются сопрограммы запусков
+    struct InstanceTable {
+        std::mutex mtx;
+        TaskIdMap<InstanceState> byId;
+        uint32_t totalRunning = 0;           // все живые асинхронные запуски
+        std::function<void()> onSlotFreed;   // будит планировщик, сбрасывается в ~Scheduler
+        // Итог каждого запуска (повторы); вызывается под mtx, сбрасывается в ~Scheduler
+        std::function<void(const TaskPtr&, int exitCode, bool cancelled)> onRunFinished;
+    };
+
     void ThreadProc();
+    // Один проход: просроченные задачи запускаются пачкой. true - что-то запущено, проход
+    // повторяется сразу; иначе nextDeadline - когда проснуться ({} - только по Notify)
+    bool DispatchPass(std::chrono::system_clock::time_point& nextDeadline);
+    void DispatchAsync(const TaskPtr& task, const std::wstring& typeStr, std::vector<std::wstring> triggerPaths);
+    // Просроченные задачи прохода. Кучи строятся один раз за проход (при первом свободном слоте),
+    // PickNext снимает вершины за O(log k); ключи сняты при сборке - перепланирование из UI
+    // посреди прохода кучу не ломает
+    struct DueEntry {
+        TaskPriority priority;
+        std::chrono::system_clock::time_point at;
+        TaskPtr task;
+    };
+    struct DueQueue {
+        bool fair = false;                    // false - без лимита емкости: по сроку из inOrder
+        bool split = false;                   // inOrder разложен по кучам
+        std::vector<TaskPtr> inOrder;
+        size_t next = 0;
+        std::vector<DueEntry> critical;       // куча по сроку
+        std::map<std::wstring, std::vector<DueEntry>> groups;   // только непустые; кольцо DRR - порядок ключей
+        size_t remaining = 0;
+    };
+    void BuildDueQueue(std::vector<TaskPtr> due, DueQueue& queue);
+    void SplitDueLocked(DueQueue& queue);
+    TaskPtr PickNext(DueQueue& queue);
+    void CountWaiting(const std::vector<TaskPtr>& due);
+    void RecordWait(const TaskPtr& task, std::chrono::system_clock::time_point now);
+    bool SlotAvailable(TaskPriority priority);
+    // Итог запуска под table.mtx: true - отложенное срабатывание стартует сразу (пути - в paths),
+    // слот остается занятым; false - слот освобожден, cancelEvent закрыт
+    static bool FinishRunLocked(InstanceTable& table, std::wstring_view id, HANDLE cancelEvent,
+        bool cancelled, std::vector<std::wstring>& paths);
+    // Запуск и подхваченные им отложенные срабатывания; процесс ждется без потока
+    static async::Future<void> RunInstance(std::shared_ptr<InstanceTable> table, TaskPtr task, std::wstring typeStr,
+        HANDLE cancelEvent, const Clock* clock, std::vector<std::wstring> paths);
+    std::shared_ptr<InstanceTable> instances = std::make_shared<InstanceTable>();
     TaskManager* taskManager;
+    const Clock* clock;
+    SimulationHost* sim = nullptr;   // не nullptr - идет RunSimulation
     std::thread worker;
-    std::mutex mtx;
-    std::condition_variable cv;
     std::atomic<bool> running{ false };
-    bool needWake = false;
+
+    // Тиковое ожидание заменено таймером: поток спит ровно до ближайшего срока
+    // (абсолютный waitable timer) или до wakeEvent (Notify/Stop/смена часов)
+    void WaitForDeadline(std::chrono::system_clock::time_point deadline);
+    HANDLE wakeEvent = NULL;
+    HANDLE timer = NULL;
+    std::atomic<bool> clockChanged{ false };
+
+    // FILE_WATCH: события копятся по id задачи до запуска (под fileMtx)
+    void OnFileTrigger(const std::wstring& taskId, std::vector<std::wstring> paths);
+    std::unique_ptr<FileWatcher> fileWatcher;
+    std::mutex fileMtx;
+    TaskIdMap<std::vector<std::wstring>> fileTriggers;      // ждут перевода в due
+    TaskIdMap<std::vector<std::wstring>> fileTriggerPaths;  // ждут запуска
+    uint64_t syncedVersion = ~0ull;  // версия списка задач, переданная fileWatcher
+
+    // Диспетчеризация при насыщении: Deficit Round Robin по группам (все под dispatchMtx)
+    std::mutex dispatchMtx;
+    uint32_t maxConcurrentJobs = 0;
+    uint32_t reservedForCritical = 0;
+    std::unordered_map<std::wstring, uint32_t> groupWeights;
+    std::unordered_map<std::wstring, uint32_t> drrDeficit;
+    std::wstring drrCurrent;
+    std::unordered_map<std::wstring, GroupStats> groupStats;
+    std::chrono::system_clock::time_point nextGroupStatsLog{};   // по часам clock, только поток планировщика
+    bool saturatedLogged = false;
+
+    // Повторы неудачных запусков: таймеры (срок, id) в общем цикле ожидания, без спящих потоков.
+    // Поля retry* задач меняются под retryMtx (порядок блокировок: instances->mtx -> retryMtx).
+    void OnRunFinished(const TaskPtr& task, int exitCode, bool cancelled);
+    void RestoreRetries();   // таймеры из сохраненного retryAt
+    void DropRetryLocked(const TaskPtr& task);
+    using RetryTimer = std::pair<std::chrono::system_clock::time_point, std::wstring>;
+    // Таймеры со сроком <= now (по порядку); nextDeadline сдвигается к ближайшему будущему
+    std::vector<RetryTimer> DueRetries(std::chrono::system_clock::time_point now,
+        std::chrono::system_clock::time_point& nextDeadline);
+    // Снимает таймер; true - повтор актуален и запускается
+    bool ClaimRetry(const TaskPtr& task, const RetryTimer& timer);
+    // Ожидающий повтор - по id: между неудачным запуском и сроком объект задачи могут заменить
+    // (UpdateTask, перечитывание tasks.json). retryAt/retryAttempt задачи - копия для tasks.json и UI
+    struct PendingRetry {
+        std::chrono::system_clock::time_point at;
+        uint32_t attempt = 0;
+    };
+    std::mutex retryMtx;
+    std::set<RetryTimer> retryTimers;
+    TaskIdMap<PendingRetry> pendingRetries;
+    std::mt19937_64 retryRng{ std::random_device{}() };
+    std::atomic<bool> retryStateChanged{ false };   // состояние повторов еще не сохранено
+
+    // Шардирование между экземплярами; nullptr - единственный диспетчер
+    std::shared_ptr<ShardCoordinator> shards;   // делится с фильтром сохранения TaskManager
+    std::chrono::system_clock::time_point nextLeaseRenew{};
 };
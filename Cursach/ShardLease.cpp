@@ -0,0 +1,285 @@
+﻿#include "ShardLease.h"
+#include "Logger.h"
+#include <cstring>
+
+// Блокируется один байт далеко за концом файла: содержимое (журнал) остается
+// доступным для чтения новым владельцем, а наличие блокировки означает аренду.
+static const DWORD kLockOffsetHigh = 0x40000000;
+
+static bool TryLock(HANDLE f) {
+    OVERLAPPED ov{};
+    ov.OffsetHigh = kLockOffsetHigh;
+    return LockFileEx(f, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &ov) != FALSE;
+}
+
+static void Unlock(HANDLE f) {
+    OVERLAPPED ov{};
+    ov.OffsetHigh = kLockOffsetHigh;
+    UnlockFileEx(f, 0, 1, 0, &ov);
+}
+
+static uint64_t Mix64(uint64_t x) {
+    // splitmix64
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// FNV-1a: стабилен между процессами и запусками
+static uint64_t IdHash(std::wstring_view taskId) {
+    uint64_t h = 1469598103934665603ULL;
+    for (wchar_t c : taskId) {
+        h ^= (uint64_t)c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+uint32_t ShardCoordinator::ShardOf(std::wstring_view taskId, uint32_t shardCount) {
+    return (uint32_t)(Mix64(IdHash(taskId)) % shardCount);
+}
+
+// Журнал шарда: kJournalMagic, затем записи JournalRecord. Запись дописывается одним WriteFile;
+// недописанный хвост (смерть процесса посреди записи) при чтении отбрасывается.
+// Файлы прежнего формата (строки "<taskId> <occurrence>" в UTF-16) читаются и уплотняются в новый
+static const uint64_t kJournalMagic = 0x314C4E524A53544DULL;   // "MTSJRNL1"
+static const uint64_t kCompactMinRecords = 4096;
+
+struct JournalRecord {
+    uint64_t idHash;
+    int64_t occurrence;
+};
+
+ShardCoordinator::ShardCoordinator(const std::wstring& dir, uint32_t shardCount, uint32_t maxInstances)
+    : dir_(dir), shardCount_(shardCount ? shardCount : 1), maxInstances_(maxInstances ? maxInstances : 1) {
+    leases_.resize(shardCount_);
+}
+
+ShardCoordinator::~ShardCoordinator() {
+    for (uint32_t s = 0; s < shardCount_; ++s) ReleaseShard(s);
+    if (slotFile_ != INVALID_HANDLE_VALUE) {
+        Unlock(slotFile_);
+        CloseHandle(slotFile_);
+    }
+}
+
+HANDLE ShardCoordinator::OpenShared(const std::wstring& path) {
+    return CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+bool ShardCoordinator::Start() {
+    CreateDirectoryW(dir_.c_str(), NULL);
+
+    for (uint32_t k = 0; k < maxInstances_; ++k) {
+        HANDLE f = OpenShared(dir_ + L"\\instance-" + std::to_wstring(k) + L".lock");
+        if (f == INVALID_HANDLE_VALUE) continue;
+        if (TryLock(f)) {
+            slotFile_ = f;
+            slot_ = k;
+            g_Logger.Log(LogLevel::Info, L"Shards",
+                L"Instance slot " + std::to_wstring(k) + L" acquired | shards=" +
+                std::to_wstring(shardCount_) + L" dir=" + dir_);
+            Rebalance();
+            return true;
+        }
+        CloseHandle(f);
+    }
+
+    g_Logger.Log(LogLevel::Error, L"Shards",
+        L"No free instance slot (max " + std::to_wstring(maxInstances_) + L")");
+    return false;
+}
+
+// Слот жив, если его файл заблокирован другим процессом
+std::vector<uint32_t> ShardCoordinator::LiveInstances() {
+    std::vector<uint32_t> live;
+    for (uint32_t k = 0; k < maxInstances_; ++k) {
+        if (k == slot_) { live.push_back(k); continue; }
+        HANDLE f = OpenShared(dir_ + L"\\instance-" + std::to_wstring(k) + L".lock");
+        if (f == INVALID_HANDLE_VALUE) continue;
+        if (TryLock(f)) Unlock(f);
+        else if (GetLastError() == ERROR_LOCK_VIOLATION) live.push_back(k);
+        CloseHandle(f);
+    }
+    return live;
+}
+
+void ShardCoordinator::Rebalance() {
+    if (slot_ == UINT32_MAX) return;
+    std::vector<uint32_t> live = LiveInstances();
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    uint32_t gained = 0, released = 0;
+
+    for (uint32_t s = 0; s < shardCount_; ++s) {
+        // Rendezvous: шард принадлежит живому экземпляру с наибольшим весом,
+        // при изменении состава переезжает только ~1/N шардов
+        uint32_t owner = slot_;
+        uint64_t best = 0;
+        for (uint32_t k : live) {
+            uint64_t w = Mix64(((uint64_t)s << 32) | k);
+            if (w >= best) { best = w; owner = k; }
+        }
+
+        bool owned = leases_[s].file != INVALID_HANDLE_VALUE;
+        if (owner == slot_ && !owned) {
+            if (AcquireShard(s)) ++gained;
+        }
+        else if (owner != slot_ && owned) {
+            ReleaseShard(s);
+            ++released;
+        }
+    }
+
+    if (gained || released) {
+        uint32_t owned = 0;
+        for (auto& l : leases_) if (l.file != INVALID_HANDLE_VALUE) ++owned;
+        g_Logger.Log(LogLevel::Info, L"Shards",
+            L"Rebalanced: live instances=" + std::to_wstring(live.size()) +
+            L" | +" + std::to_wstring(gained) + L" -" + std::to_wstring(released) +
+            L" | owned=" + std::to_wstring(owned) + L"/" + std::to_wstring(shardCount_));
+    }
+}
+
+bool ShardCoordinator::AcquireShard(uint32_t shard) {
+    HANDLE f = OpenShared(dir_ + L"\\shard-" + std::to_wstring(shard) + L".lease");
+    if (f == INVALID_HANDLE_VALUE) return false;
+    if (!TryLock(f)) {
+        // Прежний владелец еще не отпустил - попробуем на следующем продлении
+        CloseHandle(f);
+        return false;
+    }
+    leases_[shard].file = f;
+    LoadJournal(leases_[shard]);
+    // Заодно переводит журнал прежнего формата в новый
+    if (!CompactJournal(leases_[shard])) {
+        g_Logger.Log(LogLevel::Warn, L"Shards",
+            L"Failed to compact journal of shard " + std::to_wstring(shard) + L", error=" + std::to_wstring(GetLastError()));
+    }
+    return true;
+}
+
+void ShardCoordinator::ReleaseShard(uint32_t shard) {
+    Lease& l = leases_[shard];
+    if (l.file == INVALID_HANDLE_VALUE) return;
+    FlushFileBuffers(l.file);   // новый владелец может быть на другой машине (общий каталог)
+    Unlock(l.file);
+    CloseHandle(l.file);
+    l.file = INVALID_HANDLE_VALUE;
+    l.fired.clear();
+}
+
+void ShardCoordinator::LoadJournal(Lease& lease) {
+    lease.fired.clear();
+    lease.records = 0;
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(lease.file, &size) || size.QuadPart == 0 || size.QuadPart > 64 * 1024 * 1024) return;
+
+    std::string bytes((size_t)size.QuadPart, '\0');
+    LARGE_INTEGER zero{};
+    SetFilePointerEx(lease.file, zero, NULL, FILE_BEGIN);
+    DWORD read = 0;
+    if (!ReadFile(lease.file, &bytes[0], (DWORD)bytes.size(), &read, NULL)) return;
+    bytes.resize(read);
+
+    uint64_t magic = 0;
+    if (bytes.size() >= sizeof(magic)) memcpy(&magic, bytes.data(), sizeof(magic));
+    if (magic == kJournalMagic) {
+        for (size_t pos = sizeof(magic); pos + sizeof(JournalRecord) <= bytes.size(); pos += sizeof(JournalRecord)) {
+            JournalRecord r;
+            memcpy(&r, bytes.data() + pos, sizeof(r));
+            long long& occ = lease.fired[r.idHash];
+            if (r.occurrence > occ) occ = r.occurrence;
+            ++lease.records;
+        }
+        return;
+    }
+
+    // Прежний формат: строки "<taskId> <occurrence>\n" в UTF-16
+    std::wstring text(bytes.size() / sizeof(wchar_t), L'\0');
+    memcpy(&text[0], bytes.data(), text.size() * sizeof(wchar_t));
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find(L'\n', pos);
+        if (eol == std::wstring::npos) eol = text.size();
+        size_t sp = text.find(L' ', pos);
+        if (sp != std::wstring::npos && sp < eol) {
+            lease.fired[IdHash(std::wstring_view(text).substr(pos, sp - pos))] = _wtoi64(text.c_str() + sp + 1);
+        }
+        pos = eol + 1;
+    }
+}
+
+bool ShardCoordinator::AppendJournal(Lease& lease, uint64_t idHash, long long occurrence) {
+    JournalRecord r{ idHash, occurrence };
+    LARGE_INTEGER zero{};
+    DWORD written = 0;
+    if (!SetFilePointerEx(lease.file, zero, NULL, FILE_END)) return false;
+    if (!WriteFile(lease.file, &r, sizeof(r), &written, NULL) || written != sizeof(r)) return false;
+    ++lease.records;
+    return true;
+}
+
+// Одна запись на задачу поверх начала файла, затем обрезка. Уплотненный журнал не длиннее
+// прежнего, а при чтении побеждает наибольшее срабатывание: если процесс умрет между записью
+// и обрезкой, в файле останутся уплотненные записи и хвост старых - журнал все равно верен
+bool ShardCoordinator::CompactJournal(Lease& lease) {
+    std::string bytes(sizeof(kJournalMagic) + lease.fired.size() * sizeof(JournalRecord), '\0');
+    memcpy(&bytes[0], &kJournalMagic, sizeof(kJournalMagic));
+    size_t pos = sizeof(kJournalMagic);
+    for (auto& [hash, occ] : lease.fired) {
+        JournalRecord r{ hash, occ };
+        memcpy(&bytes[pos], &r, sizeof(r));
+        pos += sizeof(r);
+    }
+
+    LARGE_INTEGER zero{};
+    DWORD written = 0;
+    if (!SetFilePointerEx(lease.file, zero, NULL, FILE_BEGIN)) return false;
+    if (!WriteFile(lease.file, bytes.data(), (DWORD)bytes.size(), &written, NULL)) return false;
+    if (!SetEndOfFile(lease.file)) return false;
+    lease.records = lease.fired.size();
+    return FlushFileBuffers(lease.file) != FALSE;
+}
+
+bool ShardCoordinator::OwnsTask(std::wstring_view taskId) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return leases_[ShardOf(taskId, shardCount_)].file != INVALID_HANDLE_VALUE;
+}
+
+uint32_t ShardCoordinator::OwnedShardCount() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    uint32_t owned = 0;
+    for (auto& l : leases_) if (l.file != INVALID_HANDLE_VALUE) ++owned;
+    return owned;
+}
+
+ShardCoordinator::Claim ShardCoordinator::ClaimOccurrence(std::wstring_view taskId, long long occurrence) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    Lease& l = leases_[ShardOf(taskId, shardCount_)];
+    if (l.file == INVALID_HANDLE_VALUE) return Claim::NotOwned;
+
+    const uint64_t hash = IdHash(taskId);
+    auto it = l.fired.find(hash);
+    if (it != l.fired.end() && it->second >= occurrence) return Claim::AlreadyFired;
+
+    // Одна запись фиксированного размера в конец файла; без FlushFileBuffers: при смерти
+    // процесса запись остается в кеше ОС, и ее читает следующий владелец аренды
+    if (!AppendJournal(l, hash, occurrence)) {
+        // Не смогли зафиксировать - не запускаем, чтобы не получить двойной запуск после переезда
+        DWORD err = GetLastError();
+        g_Logger.Log(LogLevel::Error, L"Shards", taskId,
+            L"Failed to write shard journal, error=" + std::to_wstring(err) + L" - occurrence not claimed");
+        return Claim::WriteFailed;
+    }
+    l.fired[hash] = occurrence;
+
+    if (l.records >= kCompactMinRecords && l.records > 2 * l.fired.size() && !CompactJournal(l)) {
+        // Запись уже в журнале; уплотнение повторится на следующем срабатывании
+        g_Logger.Log(LogLevel::Warn, L"Shards", L"Failed to compact shard journal, error=" + std::to_wstring(GetLastError()));
+    }
+    return Claim::Claimed;
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+#include <Windows.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+/// ShardLease.h
+/// Распределение задач между несколькими процессами планировщика, работающими
+/// с одним tasks.json. Id задачи хешируется в один из shardCount шардов,
+/// шард закрепляется за экземпляром rendezvous-хешированием по живым экземплярам.
+/// Владение шардом - эксклюзивная блокировка LockFileEx на файле аренды в общем
+/// каталоге; ОС снимает ее при смерти процесса, и шарды перераспределяются
+/// на следующем Rebalance() оставшихся экземпляров.
+/// Журнал срабатываний шарда - в том же файле аренды: заголовок и записи фиксированного
+/// размера (хеш id, срабатывание), по одной на ClaimOccurrence; при захвате шарда и по мере
+/// роста журнал уплотняется до последней записи на задачу.
+class ShardCoordinator {
+public:
+    ShardCoordinator(const std::wstring& dir, uint32_t shardCount, uint32_t maxInstances);
+    ~ShardCoordinator();
+
+    // Занимает свободный слот экземпляра. false - все maxInstances слотов заняты.
+    bool Start();
+
+    // Продление аренды: захват своих шардов, передача чужих
+    void Rebalance();
+
+    bool OwnsTask(std::wstring_view taskId);
+
+    // Exactly-once: отмечает срабатывание в журнале шарда
+    enum class Claim {
+        Claimed,        // запись в журнале есть - запускаем
+        AlreadyFired,   // это (или более позднее) срабатывание выполнил другой владелец
+        NotOwned,       // шард уже не наш - срабатывание выполнит новый владелец
+        WriteFailed     // журнал не записался: не запускаем, попытка позже
+    };
+    Claim ClaimOccurrence(std::wstring_view taskId, long long occurrence);
+
+    uint32_t InstanceSlot() const { return slot_; }
+    uint32_t OwnedShardCount();
+
+    static uint32_t ShardOf(std::wstring_view taskId, uint32_t shardCount);
+
+private:
+    struct Lease {
+        HANDLE file = INVALID_HANDLE_VALUE;                // != INVALID - шард наш
+        std::unordered_map<uint64_t, long long> fired;     // хеш id -> последнее срабатывание
+        uint64_t records = 0;                              // записей в файле (для уплотнения)
+    };
+
+    HANDLE OpenShared(const std::wstring& path);
+    bool AcquireShard(uint32_t shard);
+    void ReleaseShard(uint32_t shard);
+    void LoadJournal(Lease& lease);
+    bool AppendJournal(Lease& lease, uint64_t idHash, long long occurrence);
+    bool CompactJournal(Lease& lease);
+    std::vector<uint32_t> LiveInstances();
+
+    std::wstring dir_;
+    uint32_t shardCount_;
+    uint32_t maxInstances_;
+    uint32_t slot_ = UINT32_MAX;
+    HANDLE slotFile_ = INVALID_HANDLE_VALUE;
+    std::mutex mtx_;
+    std::vector<Lease> leases_;
+};
@@ -0,0 +1,432 @@
+﻿#include "Simulator.h"
+#include "JobExecutor.h"
+#include "Latency.h"
+#include "Logger.h"
+#include "Persistence.h"
+#include "Utils.h"
+#include <Windows.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+
+namespace {
+
+    using namespace std::chrono;
+
+    const wchar_t* TriggerName(TriggerType t) {
+        switch (t) {
+        case TriggerType::ONCE:       return L"ONCE";
+        case TriggerType::INTERVAL:   return L"INTERVAL";
+        case TriggerType::DAILY:      return L"DAILY";
+        case TriggerType::WEEKLY:     return L"WEEKLY";
+        case TriggerType::FILE_WATCH: return L"FILE_WATCH";
+        default:                      return L"?";
+        }
+    }
+
+    std::wstring Fixed(double v, int digits) {
+        wchar_t buf[64];
+        swprintf_s(buf, L"%.*f", digits, v);
+        return buf;
+    }
+
+    std::wstring Pad(std::wstring s, size_t width) {
+        if (s.size() < width) s.append(width - s.size(), L' ');
+        return s;
+    }
+
+    std::wstring CsvQuote(std::wstring_view s) {
+        std::wstring out = L"\"";
+        for (wchar_t c : s) {
+            if (c == L'"') out += L'"';
+            out += c;
+        }
+        return out + L"\"";
+    }
+
+    // "YYYY-MM-DD HH:MM" в местном времени
+    bool ParseStart(const wchar_t* s, Clock::time_point& out) {
+        int y = 0, mo = 0, d = 0, h = 0, mi = 0;
+        if (swscanf_s(s, L"%d-%d-%d %d:%d", &y, &mo, &d, &h, &mi) < 3) return false;
+        std::tm local{};
+        local.tm_year = y - 1900;
+        local.tm_mon = mo - 1;
+        local.tm_mday = d;
+        local.tm_hour = h;
+        local.tm_min = mi;
+        local.tm_isdst = -1;
+        time_t t = mktime(&local);
+        if (t == (time_t)-1) return false;
+        out = system_clock::from_time_t(t);
+        return true;
+    }
+
+} // namespace
+
+Simulator::Simulator(const SimulationOptions& options)
+    : options_(options),
+      start_(options.start.time_since_epoch().count() != 0 ? options.start : floor<seconds>(system_clock::now())),
+      end_(start_ + hours(24 * (std::max)(options.days, 1))),
+      clock_(start_),
+      tm_(clock_, false),
+      sched_(&tm_, clock_),
+      rng_(options.seed) {
+
+    std::vector<TaskPtr> tasks;
+    if (options_.syntheticTasks > 0) {
+        tasks = MakeSyntheticTasks(options_.syntheticTasks, options_.seed, start_, (std::max)(options_.days, 1));
+    }
+    else {
+        // Своя копия задач: tasks.json симуляция не пишет (TaskManager без Persistence)
+        Persistence persistence;
+        tasks = persistence.Load();
+        for (auto& t : tasks) {
+            if (t->id.empty()) t->id = util::GenerateGUID();
+            if (t->intervalMinutes == 0) t->intervalMinutes = 1;   // иначе срок не сдвигается
+        }
+    }
+    tm_.LoadFrom(std::move(tasks));
+
+    hours_.resize((size_t)(std::max)(options_.days, 1) * 24);
+
+    if (!options_.firesPath.empty()) {
+        firesCsv_ = std::make_unique<util::Utf8Writer>(options_.firesPath);
+        if (firesCsv_->IsOpen()) *firesCsv_ << "start,task_id,name,trigger,duration_ms,exit_code,queued\n";
+        else firesCsv_.reset();
+    }
+}
+
+Simulator::~Simulator() = default;
+
+std::vector<TaskPtr> Simulator::MakeSyntheticTasks(size_t count, uint64_t seed, Clock::time_point start, int days) {
+    static const uint32_t kIntervals[] = { 30, 60, 120, 240, 360, 720, 1440 };
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> logMean(std::log(5000.0), std::log(1200000.0));   // 5 с .. 20 мин
+
+    std::vector<TaskPtr> tasks;
+    tasks.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        auto t = std::make_shared<Task>();
+        t->id = L"sim-" + std::to_wstring(i);
+        t->name = L"Synthetic task " + std::to_wstring(i);
+        t->exePath = L"C:\\Jobs\\job" + std::to_wstring(rng() % 50) + L".exe";
+        t->group = L"group" + std::to_wstring(rng() % 8);
+
+        uint32_t kind = (uint32_t)(rng() % 100);
+        if (kind < 45) {
+            t->triggerType = TriggerType::DAILY;
+            t->dailyHour = (uint8_t)(rng() % 24);
+            t->dailyMinute = (uint8_t)(rng() % 60);
+            t->dailySecond = (uint8_t)(rng() % 60);
+        }
+        else if (kind < 65) {
+            t->triggerType = TriggerType::WEEKLY;
+            int daysPerWeek = 1 + (int)(rng() % 3);
+            for (int d = 0; d < daysPerWeek; ++d) t->weeklyDays.set(rng() % 7);
+            t->weeklyHour = (uint8_t)(rng() % 24);
+            t->weeklyMinute = (uint8_t)(rng() % 60);
+            t->weeklySecond = (uint8_t)(rng() % 60);
+        }
+        else if (kind < 98) {
+            t->triggerType = TriggerType::INTERVAL;
+            t->intervalMinutes = kIntervals[rng() % (sizeof(kIntervals) / sizeof(kIntervals[0]))];
+            // Разброс фазы: иначе все задачи одного интервала срабатывают в одну секунду
+            t->lastRunTime = start - seconds(rng() % ((uint64_t)t->intervalMinutes * 60));
+        }
+        else {
+            // ONCE - короткие разовые задачи
+            t->triggerType = TriggerType::ONCE;
+            t->runOnceTime = start + seconds(rng() % ((uint64_t)days * 86400));
+        }
+
+        uint32_t overlap = (uint32_t)(rng() % 100);
+        t->overlapPolicy = overlap < 70 ? OverlapPolicy::ALLOW
+            : overlap < 85 ? OverlapPolicy::SKIP_IF_RUNNING
+            : overlap < 95 ? OverlapPolicy::QUEUE_ONE : OverlapPolicy::CANCEL_PREVIOUS;
+
+        uint32_t prio = (uint32_t)(rng() % 100);
+        t->priority = prio < 1 ? TaskPriority::CRITICAL
+            : prio < 10 ? TaskPriority::HIGH
+            : prio < 20 ? TaskPriority::LOW : TaskPriority::NORMAL;
+
+        if (rng() % 5 == 0) {
+            t->hasExecutionTimeout = true;
+            t->executionTimeoutMinutes = 5 + (uint32_t)(rng() % 26);
+            // Половина задач с таймаутом повторяет запуск, убитый по таймауту
+            if (rng() % 2 == 0) {
+                t->retryMaxAttempts = 2;
+                t->retryDelaySeconds = 60;
+                t->retryExitCodes = L"999";
+            }
+        }
+        // Средняя длительность модели
+        t->lastRunStats.userTimeMs = t->triggerType == TriggerType::ONCE
+            ? 1000 + rng() % 20000 : (uint64_t)std::exp(logMean(rng));
+        tasks.push_back(std::move(t));
+    }
+    return tasks;
+}
+
+std::wstring Simulator::Run() {
+    auto wallStart = steady_clock::now();
+
+    sched_.LoadConfig(false);
+    if (options_.maxConcurrentJobs >= 0) {
+        sched_.SetCapacity((uint32_t)options_.maxConcurrentJobs,
+            options_.reservedCritical >= 0 ? (uint32_t)options_.reservedCritical : 0);
+    }
+
+    g_Logger.Log(LogLevel::Info, L"Simulator",
+        L"Simulation started: " + util::TimePointToWString(start_) + L" - " + util::TimePointToWString(end_) +
+        L" | tasks=" + std::to_wstring(tm_.GetAllTasks().size()));
+
+    // Строки о каждом запуске виртуальной недели в настоящий журнал не идут
+    LogLevel prevLevel = g_Logger.GetMinLevel();
+    g_Logger.SetMinLevel(LogLevel::Error);
+    sched_.RunSimulation(this);
+    g_Logger.SetMinLevel(prevLevel);
+
+    double wall = duration<double>(steady_clock::now() - wallStart).count();
+    if (firesCsv_) firesCsv_->Close();
+
+    uint64_t total = 0;
+    for (uint64_t f : fires_) total += f;
+    g_Logger.Log(LogLevel::Info, L"Simulator",
+        L"Simulation finished: fires=" + std::to_wstring(total) + L" | peak running=" + std::to_wstring(peak_) +
+        L" | " + Fixed(wall, 2) + L" s");
+
+    return BuildReport(wall);
+}
+
+Simulator::HourStats& Simulator::HourAt(Clock::time_point t) {
+    long long h = t <= start_ ? 0 : (long long)duration_cast<hours>(t - start_).count();
+    return hours_[(size_t)(std::min)(h, (long long)hours_.size() - 1)];
+}
+
+void Simulator::SetTime(Clock::time_point t) {
+    Clock::time_point now = clock_.Now();
+    if (t <= now) return;
+
+    Clock::time_point areaEnd = (std::min)(t, end_);
+    if (areaEnd > now) runningArea_ += running_ * duration<double>(areaEnd - now).count();
+
+    // Запуски, перешедшие границу часа, входят в пик следующих часов
+    if (running_ > 0) {
+        size_t h0 = &HourAt(now) - hours_.data();
+        size_t h1 = &HourAt(t) - hours_.data();
+        for (size_t h = h0 + 1; h <= h1; ++h) hours_[h].peak = (std::max)(hours_[h].peak, running_);
+    }
+    clock_.AdvanceTo(t);
+}
+
+void Simulator::AdvanceTo(Clock::time_point t) {
+    while (!completions_.empty() && completions_.top().end <= t) {
+        Completion c = completions_.top();
+        completions_.pop();
+        auto it = live_.find(c.runId);
+        if (it == live_.end() || it->second.end != c.end) continue;   // отмененный срок
+
+        SetTime(c.end);
+        LiveRun run = std::move(it->second);
+        live_.erase(it);
+        --running_;
+
+        // То, что JobExecutor пишет в задачу по завершении процесса
+        run.task->lastExitCode = run.exitCode;
+        run.task->lastRunTime = c.end;
+        sched_.CompleteSimulatedRun(run.task, run.exitCode, run.cancelled);
+    }
+    SetTime(t);
+}
+
+milliseconds Simulator::SampleDuration(const Task& task, int& exitCode) {
+    double meanMs = (double)(task.lastRunStats.userTimeMs + task.lastRunStats.kernelTimeMs);
+    if (meanMs <= 0) meanMs = options_.meanRunSeconds * 1000.0;
+    meanMs = (std::max)(meanMs, 1.0);
+
+    const double sigma = 0.6;
+    std::lognormal_distribution<double> dist(std::log(meanMs) - sigma * sigma / 2, sigma);
+    double ms = dist(rng_);
+
+    exitCode = 0;
+    if (task.hasExecutionTimeout) {
+        double limit = (double)task.executionTimeoutMinutes * 60000.0;
+        if (ms > limit) {
+            ms = limit;
+            exitCode = 999;
+        }
+    }
+    return milliseconds((long long)ms + 1);
+}
+
+void Simulator::RecordStart(const Task& task, Clock::time_point start, milliseconds duration,
+    int exitCode, bool queuedRun) {
+    ++fires_[(int)task.triggerType % 5];
+    if (queuedRun) ++queuedRuns_;
+    if (exitCode == 999) ++timeouts_;
+
+    if (running_ > peak_) {
+        peak_ = running_;
+        peakAt_ = start;
+    }
+    HourStats& h = HourAt(start);
+    ++h.fires;
+    h.peak = (std::max)(h.peak, running_);
+
+    if (firesCsv_) {
+        *firesCsv_ << util::TimePointToWString(start) << "," << task.id << "," << CsvQuote(task.name) << ","
+            << TriggerName(task.triggerType) << "," << (long long)duration.count() << "," << exitCode << ","
+            << (queuedRun ? "1" : "0") << "\n";
+    }
+}
+
+void Simulator::Launch(const TaskPtr& task, bool queuedRun) {
+    int exitCode = 0;
+    milliseconds d = SampleDuration(*task, exitCode);
+    Clock::time_point now = clock_.Now();
+
+    uint64_t id = ++nextRunId_;
+    live_[id] = LiveRun{ task, now + d, exitCode, false };
+    completions_.push({ now + d, id });
+    ++running_;
+    RecordStart(*task, now, d, exitCode, queuedRun);
+}
+
+void Simulator::Cancel(std::wstring_view taskId) {
+    Clock::time_point now = clock_.Now();
+    for (auto& [id, run] : live_) {
+        if (run.cancelled || std::wstring_view(run.task->id) != taskId) continue;
+        run.cancelled = true;
+        run.end = now;
+        run.exitCode = JobExecutor::kCancelledExitCode;
+        completions_.push({ now, id });
+        ++cancelledRuns_;
+    }
+}
+
+bool Simulator::WaitUntil(Clock::time_point deadline) {
+    Clock::time_point target = end_;
+    if (deadline.time_since_epoch().count() != 0 && deadline < target) target = deadline;
+    // Завершение раньше срока будит планировщик (onSlotFreed -> Notify)
+    if (!completions_.empty() && completions_.top().end < target) target = completions_.top().end;
+
+    if (target >= end_) {
+        AdvanceTo(end_);
+        return false;
+    }
+    AdvanceTo(target);
+    return true;
+}
+
+std::wstring Simulator::BuildReport(double wallSeconds) {
+    std::wstring r;
+    auto tasks = tm_.GetAllTasks();
+    const int days = (std::max)(options_.days, 1);
+
+    size_t byType[5] = {};
+    for (auto& t : tasks) ++byType[(int)t->triggerType % 5];
+    uint64_t total = 0;
+    for (uint64_t f : fires_) total += f;
+
+    r += L"Mini Task Scheduler - simulation report\r\n";
+    r += L"Period: " + util::TimePointToWString(start_) + L" - " + util::TimePointToWString(end_) +
+        L" (" + std::to_wstring(days) + L" days), simulated in " + Fixed(wallSeconds, 2) + L" s\r\n";
+    r += L"Tasks: " + std::to_wstring(tasks.size()) +
+        (options_.syntheticTasks ? L" synthetic, seed " + std::to_wstring(options_.seed) : std::wstring(L" from tasks.json")) +
+        L" (ONCE " + std::to_wstring(byType[0]) + L", INTERVAL " + std::to_wstring(byType[1]) +
+        L", DAILY " + std::to_wstring(byType[2]) + L", WEEKLY " + std::to_wstring(byType[3]) +
+        L", FILE_WATCH " + std::to_wstring(byType[4]) + L" - not simulated)\r\n\r\n";
+
+    r += L"Fires: " + std::to_wstring(total) + L" (ONCE " + std::to_wstring(fires_[0]) +
+        L", INTERVAL " + std::to_wstring(fires_[1]) + L", DAILY " + std::to_wstring(fires_[2]) +
+        L", WEEKLY " + std::to_wstring(fires_[3]) + L")\r\n";
+    r += L"  queued runs started: " + std::to_wstring(queuedRuns_) +
+        L" | cancelled runs: " + std::to_wstring(cancelledRuns_) +
+        L" | killed by timeout: " + std::to_wstring(timeouts_) + L"\r\n";
+
+    uint64_t retryRuns = 0, recovered = 0, gaveUp = 0;
+    for (auto& t : tasks) {
+        retryRuns += t->retryRuns;
+        recovered += t->retryRecovered;
+        gaveUp += t->retryGaveUp;
+    }
+    r += L"  retries: " + std::to_wstring(retryRuns) + L" runs | recovered " + std::to_wstring(recovered) +
+        L" | gave up " + std::to_wstring(gaveUp) + L"\r\n";
+
+    // Перекрытия - счетчики самого планировщика
+    struct Overlap { uint64_t skipped, queued; TaskPtr task; };
+    std::vector<Overlap> overlaps;
+    uint64_t skipped = 0, queued = 0;
+    for (auto& t : tasks) {
+        auto st = sched_.GetOverlapStats(t);
+        if (st.skipped == 0 && st.queued == 0) continue;
+        skipped += st.skipped;
+        queued += st.queued;
+        overlaps.push_back({ st.skipped, st.queued, t });
+    }
+    size_t top = (std::min)(overlaps.size(), (size_t)10);
+    std::partial_sort(overlaps.begin(), overlaps.begin() + top, overlaps.end(), [](const Overlap& a, const Overlap& b) {
+        return a.skipped + a.queued > b.skipped + b.queued;
+    });
+    r += L"Overlaps: " + std::to_wstring(overlaps.size()) + L" tasks | skipped=" + std::to_wstring(skipped) +
+        L" queued=" + std::to_wstring(queued) + L"\r\n";
+    for (size_t i = 0; i < top; ++i) {
+        const Overlap& o = overlaps[i];
+        r += L"  " + std::wstring(o.task->name) + L" [" + TriggerName(o.task->triggerType) + L"]: skipped=" +
+            std::to_wstring(o.skipped) + L" queued=" + std::to_wstring(o.queued) + L"\r\n";
+    }
+
+    double periodSeconds = duration<double>(end_ - start_).count();
+    r += L"Concurrency: peak=" + std::to_wstring(peak_) + L" at " + util::TimePointToWString(peakAt_) +
+        L" | average=" + Fixed(runningArea_ / periodSeconds, 2) +
+        L" | still running at end=" + std::to_wstring(live_.size()) + L"\r\n\r\n";
+
+    r += sched_.GroupStatsReport();
+    r += L"\r\nHourly:\r\n";
+    r += L"  " + Pad(L"hour", 22) + Pad(L"fires", 10) + L"peak running\r\n";
+    for (size_t h = 0; h < hours_.size(); ++h) {
+        r += L"  " + Pad(util::TimePointToWString(start_ + hours(h)), 22) + Pad(std::to_wstring(hours_[h].fires), 10) +
+            std::to_wstring(hours_[h].peak) + L"\r\n";
+    }
+    return r;
+}
+
+int RunSimulationCommand(int argc, wchar_t** argv) {
+    SimulationOptions options;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::wstring key = argv[i];
+        const wchar_t* value = argv[i + 1];
+        bool ok = true;
+        if (key == L"--days") options.days = _wtoi(value);
+        else if (key == L"--tasks") options.syntheticTasks = (size_t)_wtoi64(value);
+        else if (key == L"--seed") options.seed = (uint64_t)_wtoi64(value);
+        else if (key == L"--mean-run") options.meanRunSeconds = _wtof(value);
+        else if (key == L"--max-jobs") options.maxConcurrentJobs = _wtoi(value);
+        else if (key == L"--reserved") options.reservedCritical = _wtoi(value);
+        else if (key == L"--start") ok = ParseStart(value, options.start);
+        else if (key == L"--report") options.reportPath = value;
+        else if (key == L"--fires") options.firesPath = value;
+        else ok = false;
+
+        if (!ok) {
+            util::PrintToConsole(L"Bad argument: " + key + L" " + value + L"\r\n"
+                L"Usage: --simulate [--days N] [--tasks N] [--seed N] [--mean-run SEC] [--max-jobs N] [--reserved N]\r\n"
+                L"                  [--start \"YYYY-MM-DD HH:MM\"] [--report path] [--fires path.csv]\r\n");
+            return 2;
+        }
+    }
+    if (options.reportPath.empty()) options.reportPath = util::GetAppDataDir() + L"\\simulation.txt";
+
+    Simulator sim(options);
+    std::wstring report = sim.Run();
+    report += L"\r\n" + latency::Report();   // время TaskManager/Scheduler на синтетической нагрузке
+
+    util::Utf8Writer out(options.reportPath);
+    out << report;
+    bool saved = out.Close();
+
+    util::PrintToConsole(report + (saved ? L"\r\nReport saved to " + options.reportPath + L"\r\n"
+                                   : L"\r\nFailed to write " + options.reportPath + L"\r\n"));
+    return saved ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+﻿#pragma once
+#include "Clock.h"
+#include "Scheduler.h"
+#include "TaskManager.h"
+#include "Utf8File.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct SimulationOptions {
+    int days = 7;
+    size_t syntheticTasks = 0;        // 0 - копия задач из tasks.json
+    uint64_t seed = 1;
+    double meanRunSeconds = 60;       // для задач без статистики прошлого запуска
+    int maxConcurrentJobs = -1;       // -1 - как в scheduler.ini
+    int reservedCritical = -1;
+    Clock::time_point start{};        // {} - текущее время
+    std::wstring reportPath;          // пусто - simulation.txt в каталоге данных
+    std::wstring firesPath;           // CSV всех запусков; пусто - не писать
+};
+
+// Ускоренный прогон расписания: настоящие TaskManager и Scheduler (расчет сроков, DRR,
+// политики перекрытия, емкость) на VirtualClock, процессы заменены моделью длительности.
+// Часы прыгают от события к событию (срок задачи, завершение запуска), поэтому неделя
+// идет столько, сколько стоит обработать сами срабатывания.
+//
+// Модель: длительность - логнормальная со средним из lastRunStats (CPU user+kernel)
+// или meanRunSeconds; запуск дольше таймаута задачи завершается кодом 999.
+// FILE_WATCH в симуляции не срабатывают.
+class Simulator : public SimulationHost {
+public:
+    explicit Simulator(const SimulationOptions& options);
+    ~Simulator() override;
+
+    // Прогон и текст отчета: срабатывания по часам, перекрытия, пики параллельности, ожидание по группам
+    std::wstring Run();
+
+    // Детерминированный набор задач всех типов расписания (кроме FILE_WATCH)
+    static std::vector<TaskPtr> MakeSyntheticTasks(size_t count, uint64_t seed, Clock::time_point start, int days);
+
+    void Launch(const TaskPtr& task, bool queuedRun) override;
+    void Cancel(std::wstring_view taskId) override;
+    bool WaitUntil(Clock::time_point deadline) override;
+
+private:
+    struct LiveRun {
+        TaskPtr task;
+        Clock::time_point end;
+        int exitCode = 0;
+        bool cancelled = false;
+    };
+    // Очередь завершений; запись устарела, если срок живого запуска с тех пор изменился (отмена)
+    struct Completion {
+        Clock::time_point end;
+        uint64_t runId;
+        bool operator>(const Completion& o) const { return end != o.end ? end > o.end : runId > o.runId; }
+    };
+    struct HourStats {
+        uint64_t fires = 0;
+        uint32_t peak = 0;
+    };
+
+    void AdvanceTo(Clock::time_point t);
+    void SetTime(Clock::time_point t);
+    std::chrono::milliseconds SampleDuration(const Task& task, int& exitCode);
+    void RecordStart(const Task& task, Clock::time_point start, std::chrono::milliseconds duration,
+        int exitCode, bool queuedRun);
+    HourStats& HourAt(Clock::time_point t);
+    std::wstring BuildReport(double wallSeconds);
+
+    SimulationOptions options_;
+    Clock::time_point start_, end_;
+    VirtualClock clock_;
+    TaskManager tm_;
+    Scheduler sched_;
+    std::mt19937_64 rng_;
+
+    std::unordered_map<uint64_t, LiveRun> live_;
+    std::priority_queue<Completion, std::vector<Completion>, std::greater<Completion>> completions_;
+    uint64_t nextRunId_ = 0;
+
+    // Статистика
+    uint64_t fires_[5] = {};  // по TriggerType
+    uint64_t queuedRuns_ = 0, cancelledRuns_ = 0, timeouts_ = 0;
+    uint32_t running_ = 0, peak_ = 0;
+    Clock::time_point peakAt_{};
+    double runningArea_ = 0;  // сумма running * секунды - для средней параллельности
+    std::vector<HourStats> hours_;
+    std::unique_ptr<util::Utf8Writer> firesCsv_;
+};
+
+// Mini Task Scheduler.exe --simulate [--days N] [--tasks N] [--seed N] [--mean-run SEC]
+//     [--max-jobs N] [--reserved N] [--start "YYYY-MM-DD HH:MM"] [--report путь] [--fires путь.csv]
+int RunSimulationCommand(int argc, wchar_t** argv);
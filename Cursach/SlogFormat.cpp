@@ -0,0 +1,123 @@
+﻿#include "SlogFormat.h"
+#include <cstring>
+
+namespace slog {
+
+    namespace {
+
+        template <class T>
+        void Put(std::string& out, const T& v) {
+            out.append((const char*)&v, sizeof(T));
+        }
+
+        void PutString(std::string& out, const std::wstring& s) {
+            Put(out, (uint32_t)s.size());
+            out.append((const char*)s.data(), s.size() * sizeof(wchar_t));
+        }
+
+        // Чтение с проверкой границ; p сдвигается
+        struct Reader {
+            const uint8_t* p;
+            const uint8_t* end;
+
+            template <class T>
+            bool Get(T& v) {
+                if ((size_t)(end - p) < sizeof(T)) return false;
+                memcpy(&v, p, sizeof(T));
+                p += sizeof(T);
+                return true;
+            }
+
+            bool GetString(std::wstring& s) {
+                uint32_t len;
+                if (!Get(len) || (size_t)(end - p) / sizeof(wchar_t) < len) return false;
+                s.resize(len);
+                memcpy(&s[0], p, len * sizeof(wchar_t));
+                p += len * sizeof(wchar_t);
+                return true;
+            }
+        };
+
+    } // namespace
+
+    void EncodeSite(const SiteDesc& d, std::string& out) {
+        Put(out, d.id);
+        Put(out, d.level);
+        Put(out, d.line);
+        Put(out, (uint32_t)d.argTypes.size());
+        out.append((const char*)d.argTypes.data(), d.argTypes.size());
+        PutString(out, d.tag);
+        PutString(out, d.format);
+        PutString(out, d.file);
+    }
+
+    bool DecodeSite(const uint8_t* p, size_t n, SiteDesc& d) {
+        Reader r{ p, p + n };
+        uint32_t argc;
+        if (!r.Get(d.id) || !r.Get(d.level) || !r.Get(d.line) || !r.Get(argc)) return false;
+        if ((size_t)(r.end - r.p) < argc) return false;
+        d.argTypes.assign(r.p, r.p + argc);
+        r.p += argc;
+        return r.GetString(d.tag) && r.GetString(d.format) && r.GetString(d.file);
+    }
+
+    bool DecodeArgs(const SiteDesc& d, const uint8_t* p, size_t n, std::vector<ArgValue>& out) {
+        Reader r{ p, p + n };
+        out.clear();
+        for (uint8_t type : d.argTypes) {
+            ArgValue v;
+            v.type = type;
+            bool ok = false;
+            switch (type) {
+            case ARG_I32: { int32_t x; ok = r.Get(x); v.i = x; break; }
+            case ARG_U32: { uint32_t x; ok = r.Get(x); v.u = x; break; }
+            case ARG_I64: ok = r.Get(v.i); break;
+            case ARG_U64: ok = r.Get(v.u); break;
+            case ARG_F64: ok = r.Get(v.f); break;
+            case ARG_BOOL: { uint8_t x; ok = r.Get(x); v.u = x; break; }
+            case ARG_WSTR: ok = r.GetString(v.s); break;
+            }
+            if (!ok) return false;
+            out.push_back(std::move(v));
+        }
+        return true;
+    }
+
+    std::wstring ArgToString(const ArgValue& v) {
+        switch (v.type) {
+        case ARG_I32:
+        case ARG_I64: return std::to_wstring(v.i);
+        case ARG_U32:
+        case ARG_U64: return std::to_wstring(v.u);
+        case ARG_F64: return std::to_wstring(v.f);
+        case ARG_BOOL: return v.u ? L"true" : L"false";
+        case ARG_WSTR: return v.s;
+        }
+        return L"?";
+    }
+
+    std::wstring FormatText(const std::wstring& format, const std::vector<ArgValue>& args) {
+        std::wstring out;
+        out.reserve(format.size() + args.size() * 8);
+        size_t next = 0;
+        for (size_t i = 0; i < format.size(); ++i) {
+            wchar_t c = format[i];
+            if (c == L'{' && i + 1 < format.size() && format[i + 1] == L'{') { out.push_back(L'{'); ++i; continue; }
+            if (c == L'}' && i + 1 < format.size() && format[i + 1] == L'}') { out.push_back(L'}'); ++i; continue; }
+            if (c == L'{' && i + 1 < format.size() && format[i + 1] == L'}') {
+                out += next < args.size() ? ArgToString(args[next]) : L"{?}";
+                ++next;
+                ++i;
+                continue;
+            }
+            out.push_back(c);
+        }
+        return out;
+    }
+
+    const wchar_t* LevelName(uint32_t level) {
+        static const wchar_t* names[] = { L"DEBUG", L"INFO", L"WARN", L"ERROR" };
+        return level < 4 ? names[level] : L"?";
+    }
+
+} // namespace slog
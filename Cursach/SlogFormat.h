@@ -0,0 +1,72 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Формат бинарного журнала scheduler.slog - общий для приложения и LogDecoder.
+//
+// Файл - поток записей, выровненных на 8 байт: RecordHeader + полезная нагрузка.
+//   siteId = kSessionRecord  начало сессии процесса (SessionInfo: частота QPC, привязка QPC к FILETIME)
+//   siteId = kSiteRecord     описание точки логирования; пишется в сессии раньше ее первых записей
+//   siteId = kDroppedRecord  поток отбросил uint64 записей (его кольцо было заполнено)
+//   иначе                    запись точки siteId: аргументы подряд, в порядке вызова
+// Идентификаторы точек действуют в пределах сессии. Числа - little-endian, строки - UTF-16.
+namespace slog {
+
+    enum ArgType : uint8_t {
+        ARG_I32 = 1, ARG_U32, ARG_I64, ARG_U64, ARG_F64, ARG_BOOL,
+        ARG_WSTR    // uint32 длина в символах + символы
+    };
+
+    constexpr uint32_t kPadding = 0;   // хвост кольца до перехода; в файл не попадает
+    constexpr uint32_t kSessionRecord = 0xFFFFFFFD;
+    constexpr uint32_t kSiteRecord = 0xFFFFFFFE;
+    constexpr uint32_t kDroppedRecord = 0xFFFFFFFF;
+
+    struct RecordHeader {
+        uint32_t siteId;
+        uint32_t size;       // вместе с заголовком, кратно 8
+        uint32_t threadId;
+        uint32_t reserved;
+        int64_t qpc;         // QueryPerformanceCounter
+    };
+    static_assert(sizeof(RecordHeader) == 24, "RecordHeader layout");
+
+    struct SessionInfo {
+        int64_t qpcFrequency;
+        int64_t qpcAnchor;        // QPC в момент fileTimeAnchor
+        uint64_t fileTimeAnchor;  // UTC FILETIME
+        uint32_t processId;
+        uint32_t reserved;
+    };
+
+    struct SiteDesc {
+        uint32_t id = 0;
+        uint32_t level = 0;       // LogLevel
+        uint32_t line = 0;
+        std::wstring tag;
+        std::wstring format;      // "{}" - следующий аргумент, "{{" и "}}" - скобки
+        std::wstring file;
+        std::vector<uint8_t> argTypes;
+    };
+
+    struct ArgValue {
+        uint8_t type = 0;
+        int64_t i = 0;
+        uint64_t u = 0;
+        double f = 0;
+        std::wstring s;
+    };
+
+    inline size_t Align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+    void EncodeSite(const SiteDesc& d, std::string& out);
+    bool DecodeSite(const uint8_t* p, size_t n, SiteDesc& d);
+
+    bool DecodeArgs(const SiteDesc& d, const uint8_t* p, size_t n, std::vector<ArgValue>& out);
+    std::wstring ArgToString(const ArgValue& v);
+    std::wstring FormatText(const std::wstring& format, const std::vector<ArgValue>& args);
+    const wchar_t* LevelName(uint32_t level);
+
+} // namespace slog
@@ -0,0 +1,135 @@
+﻿#include "StoreWatcher.h"
+#include "Logger.h"
+#include <algorithm>
+
+// Запись, растянутая непрерывными событиями, все равно выдается не позже этого множителя debounce
+static const ULONGLONG kMaxDebounceFactor = 10;
+
+StoreWatcher::StoreWatcher(std::wstring path, ChangedFn onChanged, DWORD debounceMs)
+    : path_(std::move(path)), onChanged_(std::move(onChanged)), debounceMs_(debounceMs) {
+    size_t slash = path_.find_last_of(L"\\/");
+    dir_ = slash == std::wstring::npos ? L"." : path_.substr(0, slash);
+    name_ = slash == std::wstring::npos ? path_ : path_.substr(slash + 1);
+}
+
+StoreWatcher::~StoreWatcher() {
+    Stop();
+}
+
+bool StoreWatcher::Start() {
+    if (worker_.joinable()) return true;
+
+    dirHandle_ = CreateFileW(dir_.c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (dirHandle_ == INVALID_HANDLE_VALUE) {
+        g_Logger.Log(LogLevel::Error, L"StoreWatcher",
+            L"Cannot open directory (" + std::to_wstring(GetLastError()) + L"): " + dir_);
+        return false;
+    }
+
+    stopEvent_ = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ioEvent_ = CreateEventW(NULL, TRUE, FALSE, NULL);
+    buffer_.resize(16 * 1024);
+    if (!stopEvent_ || !ioEvent_ || !Arm()) {
+        Stop();
+        return false;
+    }
+
+    worker_ = std::thread(&StoreWatcher::ThreadProc, this);
+    g_Logger.Log(LogLevel::Info, L"StoreWatcher", L"Watching: " + path_);
+    return true;
+}
+
+void StoreWatcher::Stop() {
+    if (worker_.joinable()) {
+        SetEvent(stopEvent_);
+        worker_.join();
+    }
+    if (dirHandle_ != INVALID_HANDLE_VALUE) {
+        // Незавершенное чтение должно закончиться до освобождения ov_ и буфера
+        if (CancelIoEx(dirHandle_, &ov_) || GetLastError() != ERROR_NOT_FOUND) {
+            DWORD bytes = 0;
+            GetOverlappedResult(dirHandle_, &ov_, &bytes, TRUE);
+        }
+        CloseHandle(dirHandle_);
+        dirHandle_ = INVALID_HANDLE_VALUE;
+    }
+    if (ioEvent_) CloseHandle(ioEvent_);
+    if (stopEvent_) CloseHandle(stopEvent_);
+    ioEvent_ = stopEvent_ = NULL;
+}
+
+bool StoreWatcher::Arm() {
+    ov_ = OVERLAPPED{};
+    ov_.hEvent = ioEvent_;
+    // Save пишет временный файл и переименовывает его - FILE_NAME; запись на месте - LAST_WRITE/SIZE
+    DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+    if (!ReadDirectoryChangesW(dirHandle_, buffer_.data(), (DWORD)buffer_.size(), FALSE, filter,
+        NULL, &ov_, NULL)) {
+        g_Logger.Log(LogLevel::Error, L"StoreWatcher",
+            L"ReadDirectoryChangesW failed (" + std::to_wstring(GetLastError()) + L") for: " + dir_);
+        return false;
+    }
+    return true;
+}
+
+bool StoreWatcher::MentionsFile(DWORD bytes) const {
+    if (bytes == 0) return true;   // переполнение буфера: имена потеряны
+    for (DWORD offset = 0;;) {
+        auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer_.data() + offset);
+        size_t len = info->FileNameLength / sizeof(wchar_t);
+        if (len == name_.size() && _wcsnicmp(info->FileName, name_.c_str(), len) == 0) return true;
+        if (info->NextEntryOffset == 0) return false;
+        offset += info->NextEntryOffset;
+    }
+}
+
+void StoreWatcher::ThreadProc() {
+    StoreStamp seen = Persistence::StampOf(path_);
+    StoreStamp candidate;
+    ULONGLONG firstTick = 0;   // 0 - изменений не ждем
+    ULONGLONG fireAt = 0;
+    bool armed = true;
+
+    HANDLE handles[2] = { stopEvent_, ioEvent_ };
+    for (;;) {
+        DWORD timeout = INFINITE;
+        if (firstTick) {
+            ULONGLONG now = GetTickCount64();
+            timeout = fireAt <= now ? 0 : (DWORD)(fireAt - now);
+        }
+
+        DWORD w = WaitForMultipleObjects(armed ? 2 : 1, handles, FALSE, timeout);
+        if (w == WAIT_OBJECT_0) break;
+
+        if (w == WAIT_OBJECT_0 + 1) {
+            DWORD bytes = 0;
+            bool ok = GetOverlappedResult(dirHandle_, &ov_, &bytes, FALSE) != FALSE;
+            bool mentioned = ok && MentionsFile(bytes);
+            armed = Arm();
+            if (!mentioned) continue;
+
+            // Пока файл меняется - срок отодвигается (но не дальше kMaxDebounceFactor * debounce)
+            ULONGLONG now = GetTickCount64();
+            if (!firstTick) firstTick = now;
+            candidate = Persistence::StampOf(path_);
+            fireAt = (std::min)(now + debounceMs_, firstTick + kMaxDebounceFactor * (std::max<DWORD>)(debounceMs_, 1));
+            continue;
+        }
+
+        if (!firstTick) continue;
+
+        // Тишина: отпечаток не сменился - запись закончена
+        StoreStamp now = Persistence::StampOf(path_);
+        if (now != candidate && GetTickCount64() < firstTick + kMaxDebounceFactor * (std::max<DWORD>)(debounceMs_, 1)) {
+            candidate = now;
+            fireAt = GetTickCount64() + debounceMs_;
+            continue;
+        }
+        firstTick = 0;
+        if (now == seen || now.writeTime == 0) continue;   // вернули как было или файл удален
+        seen = now;
+        onChanged_(now);
+    }
+}
@@ -0,0 +1,43 @@
+﻿#pragma once
+#include "Persistence.h"
+#include <Windows.h>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// StoreWatcher.h
+/// Наблюдение за tasks.json: ReadDirectoryChangesW по каталогу данных (в нем же логи
+/// и runtime.dat - события отбираются по имени файла), выдача после debounceMs тишины.
+/// onChanged вызывается в потоке наблюдателя с отпечатком, который за это время не менялся;
+/// свою запись отличает получатель (Persistence::LastStamp). Удаление файла не сообщается.
+class StoreWatcher {
+public:
+    using ChangedFn = std::function<void(const StoreStamp& stamp)>;
+
+    StoreWatcher(std::wstring path, ChangedFn onChanged, DWORD debounceMs = 500);
+    ~StoreWatcher();
+    StoreWatcher(const StoreWatcher&) = delete;
+    StoreWatcher& operator=(const StoreWatcher&) = delete;
+
+    bool Start();
+    void Stop();
+
+private:
+    void ThreadProc();
+    bool Arm();
+    bool MentionsFile(DWORD bytes) const;
+
+    std::wstring path_;
+    std::wstring dir_;
+    std::wstring name_;
+    ChangedFn onChanged_;
+    DWORD debounceMs_;
+
+    HANDLE dirHandle_ = INVALID_HANDLE_VALUE;
+    HANDLE stopEvent_ = NULL;
+    HANDLE ioEvent_ = NULL;
+    OVERLAPPED ov_{};
+    std::vector<BYTE> buffer_;
+    std::thread worker_;
+};
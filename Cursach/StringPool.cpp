@@ -0,0 +1,110 @@
+﻿#include "StringPool.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace util {
+
+    namespace {
+
+        using Entry = InternedWString::Entry;
+
+        Entry g_empty;   // пустая строка - вне пула и без счетчика ссылок
+
+        class StringPool {
+        public:
+            Entry* Intern(std::wstring_view s) {
+                std::lock_guard<std::mutex> lk(mtx_);
+                ++lookups_;
+                // Поиск по string_view - попадание в пул ничего не выделяет
+                auto it = index_.find(s);
+                if (it != index_.end()) {
+                    it->second->refs.fetch_add(1, std::memory_order_relaxed);
+                    return it->second.get();
+                }
+
+                auto entry = std::make_unique<Entry>();
+                entry->s.assign(s);
+                entry->refs.store(1, std::memory_order_relaxed);
+                bytes_ += s.size() * sizeof(wchar_t);
+                Entry* p = entry.get();
+                index_.emplace(std::wstring_view(p->s), std::move(entry));
+                return p;
+            }
+
+            // Снять ссылку. Последняя снимается только под mtx_: Intern не найдет запись,
+            // которую в этот момент удаляют
+            void Release(Entry* e) {
+                size_t refs = e->refs.load(std::memory_order_relaxed);
+                while (refs > 1) {
+                    if (e->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_acq_rel)) return;
+                }
+
+                std::lock_guard<std::mutex> lk(mtx_);
+                if (e->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+                bytes_ -= e->s.size() * sizeof(wchar_t);
+                ++released_;
+                index_.erase(std::wstring_view(e->s));
+            }
+
+            StringPoolStats Stats() {
+                std::lock_guard<std::mutex> lk(mtx_);
+                return { index_.size(), bytes_, lookups_, released_ };
+            }
+
+        private:
+            std::mutex mtx_;
+            // Узлы map не перемещаются - ключ-представление смотрит в строку своей записи
+            std::unordered_map<std::wstring_view, std::unique_ptr<Entry>> index_;
+            size_t bytes_ = 0;
+            size_t lookups_ = 0;
+            size_t released_ = 0;
+        };
+
+        // Не разрушается: задачи в статических объектах отпускают строки и после выхода из main
+        StringPool& Pool() {
+            static StringPool* pool = new StringPool();
+            return *pool;
+        }
+
+    } // namespace
+
+    InternedWString::InternedWString() : p_(&g_empty) {}
+
+    InternedWString::InternedWString(std::wstring_view s)
+        : p_(s.empty() ? &g_empty : Pool().Intern(s)) {
+    }
+
+    InternedWString::InternedWString(const InternedWString& o) : p_(o.p_) {
+        if (p_ != &g_empty) p_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    InternedWString::InternedWString(InternedWString&& o) noexcept : p_(o.p_) {
+        o.p_ = &g_empty;
+    }
+
+    InternedWString& InternedWString::operator=(const InternedWString& o) {
+        if (p_ == o.p_) return *this;
+        if (o.p_ != &g_empty) o.p_->refs.fetch_add(1, std::memory_order_relaxed);
+        if (p_ != &g_empty) Pool().Release(p_);
+        p_ = o.p_;
+        return *this;
+    }
+
+    InternedWString& InternedWString::operator=(InternedWString&& o) noexcept {
+        if (this == &o) return *this;
+        if (p_ != &g_empty) Pool().Release(p_);
+        p_ = o.p_;
+        o.p_ = &g_empty;
+        return *this;
+    }
+
+    InternedWString::~InternedWString() {
+        if (p_ != &g_empty) Pool().Release(p_);
+    }
+
+    StringPoolStats GetStringPoolStats() {
+        return Pool().Stats();
+    }
+
+} // namespace util
@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <atomic>
+#include <string>
+#include <string_view>
+
+namespace util {
+
+    // Неизменяемая строка из общего пула. Повторяющиеся поля задач (exePath, arguments,
+    // workingDirectory) хранятся один раз на процесс; сама задача держит только указатель.
+    // Равные строки дают один и тот же указатель, поэтому сравнение - сравнение указателей.
+    // Запись пула живет, пока на нее есть ссылки: строки удаленных и измененных задач
+    // (arguments бывают почти уникальными) из пула уходят.
+    class InternedWString {
+    public:
+        struct Entry {
+            std::wstring s;
+            std::atomic<size_t> refs{ 0 };
+        };
+
+        InternedWString();
+        InternedWString(std::wstring_view s);
+        InternedWString(const std::wstring& s) : InternedWString(std::wstring_view(s)) {}
+        InternedWString(const wchar_t* s) : InternedWString(std::wstring_view(s ? s : L"")) {}
+        InternedWString(const InternedWString& o);
+        InternedWString(InternedWString&& o) noexcept;
+        InternedWString& operator=(const InternedWString& o);
+        InternedWString& operator=(InternedWString&& o) noexcept;
+        ~InternedWString();
+
+        const std::wstring& str() const { return p_->s; }
+        const wchar_t* c_str() const { return p_->s.c_str(); }
+        size_t size() const { return p_->s.size(); }
+        bool empty() const { return p_->s.empty(); }
+        operator const std::wstring&() const { return p_->s; }
+
+        bool operator==(const InternedWString& o) const { return p_ == o.p_; }
+        bool operator!=(const InternedWString& o) const { return p_ != o.p_; }
+
+    private:
+        Entry* p_;
+    };
+
+    struct StringPoolStats {
+        size_t strings = 0;   // различных строк в пуле
+        size_t bytes = 0;     // байт символов (без служебных)
+        size_t lookups = 0;   // всего обращений Intern
+        size_t released = 0;  // строк, ушедших из пула с последней ссылкой
+    };
+    StringPoolStats GetStringPoolStats();
+
+} // namespace util
@@ -0,0 +1,383 @@
+﻿#include "StructuredLog.h"
+#include "Utils.h"
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <Windows.h>
+
+namespace slog {
+
+    namespace {
+
+        // Кольцо одного потока: пишет только владелец (head), читает только поток записи (tail)
+        struct Ring {
+            static constexpr size_t kSize = 64 * 1024;    // степень двойки
+
+            alignas(64) std::atomic<uint64_t> head{ 0 };
+            uint64_t pendingHead = 0;                     // Reserve -> Commit, только владелец
+            alignas(64) std::atomic<uint64_t> tail{ 0 };
+            std::atomic<uint64_t> dropped{ 0 };
+            uint64_t droppedReported = 0;
+            std::atomic<bool> alive{ true };
+            std::atomic<bool> busy{ false };              // владелец между Reserve и Commit
+            uint32_t threadId = 0;
+            alignas(64) uint8_t data[kSize];
+        };
+
+        struct State {
+            std::atomic<bool> enabled{ false };
+            std::atomic<bool> stopping{ false };      // Stop начался: Reserve отбрасывает записи
+            std::atomic<uint64_t> stopDropped{ 0 };
+
+            std::mutex sitesMtx;
+            std::vector<Site*> sites;             // id = индекс + 1
+            std::vector<SiteDesc> pendingDescs;   // описаны, но еще не записаны в файл
+            std::vector<SiteDesc> writtenDescs;   // уже в файле; повторяются в начале нового после ротации
+
+            std::mutex ringsMtx;
+            std::vector<std::shared_ptr<Ring>> rings;
+
+            HANDLE file = INVALID_HANDLE_VALUE;
+            std::wstring path;
+            uint64_t fileBytes = 0;
+            uint64_t maxBytes = 0;
+            HANDLE stopEvent = NULL;
+            std::thread writer;
+            std::string out;
+        };
+
+        State& S() {
+            static State s;
+            return s;
+        }
+
+        // Владение кольцом потока; при выходе потока кольцо дочитывается и удаляется
+        struct RingHolder {
+            std::shared_ptr<Ring> ring;
+            ~RingHolder() {
+                if (ring) ring->alive.store(false, std::memory_order_release);
+            }
+        };
+        thread_local RingHolder tl_ring;
+
+        Ring* ThisThreadRing() {
+            if (!tl_ring.ring) {
+                auto ring = std::make_shared<Ring>();
+                ring->threadId = GetCurrentThreadId();
+                std::lock_guard<std::mutex> lk(S().ringsMtx);
+                S().rings.push_back(ring);
+                tl_ring.ring = std::move(ring);
+            }
+            return tl_ring.ring.get();
+        }
+
+        void AppendRecord(std::string& out, uint32_t siteId, uint32_t threadId, const std::string& payload) {
+            LARGE_INTEGER qpc;
+            QueryPerformanceCounter(&qpc);
+            RecordHeader h{ siteId, (uint32_t)Align8(sizeof(RecordHeader) + payload.size()), threadId, 0, qpc.QuadPart };
+            out.append((const char*)&h, sizeof(h));
+            out.append(payload);
+            out.append(h.size - sizeof(h) - payload.size(), '\0');
+        }
+
+        // Начало сессии: привязка QPC к системному времени для LogDecoder
+        void AppendSession(std::string& out) {
+            SessionInfo info{};
+            LARGE_INTEGER freq, qpc;
+            QueryPerformanceFrequency(&freq);
+            FILETIME ft;
+            GetSystemTimeAsFileTime(&ft);
+            QueryPerformanceCounter(&qpc);
+            info.qpcFrequency = freq.QuadPart;
+            info.qpcAnchor = qpc.QuadPart;
+            info.fileTimeAnchor = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+            info.processId = GetCurrentProcessId();
+            AppendRecord(out, kSessionRecord, 0, std::string((const char*)&info, sizeof(info)));
+        }
+
+        void AppendSite(std::string& out, const SiteDesc& d) {
+            std::string payload;
+            EncodeSite(d, payload);
+            AppendRecord(out, kSiteRecord, 0, payload);
+        }
+
+        HANDLE OpenLog(const std::wstring& path) {
+            return CreateFileW(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        }
+
+        void WriteOut() {
+            State& s = S();
+            if (!s.out.empty() && s.file != INVALID_HANDLE_VALUE) {
+                DWORD written = 0;
+                WriteFile(s.file, s.out.data(), (DWORD)s.out.size(), &written, NULL);
+                s.fileBytes += written;
+            }
+            s.out.clear();
+        }
+
+        // Поток записи: файл перерос StructuredMaxMB - он уходит в scheduler.slog.old (прежний
+        // .old удаляется), новый файл начинается своей сессией и описаниями всех точек,
+        // описанных раньше: каждый файл декодируется сам по себе
+        void Rotate() {
+            State& s = S();
+            CloseHandle(s.file);
+            MoveFileExW(s.path.c_str(), (s.path + L".old").c_str(), MOVEFILE_REPLACE_EXISTING);
+            s.file = OpenLog(s.path);
+            s.fileBytes = 0;
+            if (s.file == INVALID_HANDLE_VALUE) {
+                g_Logger.Log(LogLevel::Error, L"Slog", L"Cannot reopen scheduler.slog after rotation, records are lost");
+                return;
+            }
+            AppendSession(s.out);
+            for (auto& d : s.writtenDescs) AppendSite(s.out, d);
+        }
+
+        // Один проход: описания точек, затем записи колец, затем счетчики отброшенных
+        void Drain() {
+            State& s = S();
+
+            std::vector<std::shared_ptr<Ring>> rings;
+            {
+                std::lock_guard<std::mutex> lk(s.ringsMtx);
+                rings = s.rings;
+            }
+
+            // Сначала фиксируем head колец: всякая видимая запись сделана после Describe своей
+            // точки, значит ее описание уже в pendingDescs и попадет в файл раньше нее
+            std::vector<uint64_t> heads(rings.size());
+            for (size_t i = 0; i < rings.size(); ++i) heads[i] = rings[i]->head.load(std::memory_order_acquire);
+
+            std::vector<SiteDesc> descs;
+            {
+                std::lock_guard<std::mutex> lk(s.sitesMtx);
+                descs.swap(s.pendingDescs);
+            }
+            for (auto& d : descs) {
+                AppendSite(s.out, d);
+                s.writtenDescs.push_back(std::move(d));
+            }
+
+            for (size_t i = 0; i < rings.size(); ++i) {
+                Ring& r = *rings[i];
+                uint64_t tail = r.tail.load(std::memory_order_relaxed);
+                while (tail < heads[i]) {
+                    size_t pos = (size_t)(tail & (Ring::kSize - 1));
+                    uint32_t siteId;
+                    memcpy(&siteId, r.data + pos, 4);
+                    if (siteId == kPadding) { tail += Ring::kSize - pos; continue; }
+                    uint32_t size;
+                    memcpy(&size, r.data + pos + 4, 4);
+                    s.out.append((const char*)r.data + pos, size);
+                    tail += size;
+                }
+                r.tail.store(tail, std::memory_order_release);
+
+                uint64_t dropped = r.dropped.load(std::memory_order_relaxed);
+                if (dropped != r.droppedReported) {
+                    uint64_t delta = dropped - r.droppedReported;
+                    r.droppedReported = dropped;
+                    AppendRecord(s.out, kDroppedRecord, r.threadId, std::string((const char*)&delta, sizeof(delta)));
+                }
+            }
+
+            // Кольца завершившихся потоков, уже дочитанные до конца
+            {
+                std::lock_guard<std::mutex> lk(s.ringsMtx);
+                auto& v = s.rings;
+                for (size_t i = 0; i < v.size();) {
+                    Ring& r = *v[i];
+                    if (!r.alive.load(std::memory_order_acquire) &&
+                        r.tail.load(std::memory_order_relaxed) == r.head.load(std::memory_order_acquire)) {
+                        v[i] = v.back();
+                        v.pop_back();
+                    }
+                    else {
+                        ++i;
+                    }
+                }
+            }
+
+            WriteOut();
+
+            // Ротация - между проходами: записи и описания точек не разрываются между файлами
+            if (s.file != INVALID_HANDLE_VALUE && s.fileBytes > s.maxBytes) {
+                Rotate();
+                WriteOut();
+            }
+        }
+
+        void WriterProc() {
+            while (WaitForSingleObject(S().stopEvent, 20) == WAIT_TIMEOUT) Drain();
+            Drain();
+        }
+
+    } // namespace
+
+    Site::Site(LogLevel level, const wchar_t* tag, const wchar_t* format, const char* file, int line)
+        : level(level), tag(tag), format(format), file(file), line(line) {
+        std::lock_guard<std::mutex> lk(S().sitesMtx);
+        S().sites.push_back(this);
+        id = (uint32_t)S().sites.size();
+    }
+
+    bool Enabled() {
+        return S().enabled.load(std::memory_order_relaxed);
+    }
+
+    void Describe(Site& site, const uint8_t* types, size_t count) {
+        std::lock_guard<std::mutex> lk(S().sitesMtx);
+        if (site.described.load(std::memory_order_relaxed)) return;
+
+        SiteDesc d;
+        d.id = site.id;
+        d.level = (uint32_t)site.level;
+        d.line = (uint32_t)site.line;
+        d.tag = site.tag;
+        d.format = site.format;
+        for (const char* c = site.file; *c; ++c) d.file.push_back((wchar_t)(unsigned char)*c);
+        d.argTypes.assign(types, types + count);
+        S().pendingDescs.push_back(std::move(d));
+
+        site.described.store(true, std::memory_order_release);
+    }
+
+    uint8_t* Reserve(uint32_t siteId, size_t payload) {
+        Ring* r = ThisThreadRing();
+
+        // busy, затем stopping (оба seq_cst) - в паре с Stop: либо Stop дождется Commit
+        // и запись попадет в последний проход, либо запись увидит stopping и будет учтена
+        r->busy.store(true);
+        if (S().stopping.load()) {
+            r->busy.store(false, std::memory_order_release);
+            S().stopDropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        const size_t total = Align8(sizeof(RecordHeader) + payload);
+        if (total > Ring::kSize / 4) {
+            r->busy.store(false, std::memory_order_release);
+            r->dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        uint64_t head = r->head.load(std::memory_order_relaxed);
+        uint64_t tail = r->tail.load(std::memory_order_acquire);
+        size_t pos = (size_t)(head & (Ring::kSize - 1));
+        size_t pad = (pos + total > Ring::kSize) ? Ring::kSize - pos : 0;
+
+        // Не ждем поток записи: при переполнении запись отбрасывается и учитывается
+        if (head + pad + total - tail > Ring::kSize) {
+            r->busy.store(false, std::memory_order_release);
+            r->dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        if (pad) {
+            uint32_t marker = kPadding;
+            memcpy(r->data + pos, &marker, 4);
+            head += pad;
+            pos = 0;
+        }
+
+        LARGE_INTEGER qpc;
+        QueryPerformanceCounter(&qpc);
+        RecordHeader h{ siteId, (uint32_t)total, r->threadId, 0, qpc.QuadPart };
+        memcpy(r->data + pos, &h, sizeof(h));
+        r->pendingHead = head + total;
+        return r->data + pos + sizeof(h);
+    }
+
+    void Commit() {
+        Ring* r = tl_ring.ring.get();
+        r->head.store(r->pendingHead, std::memory_order_release);
+        r->busy.store(false, std::memory_order_release);
+    }
+
+    void EmitText(const Site& site, const uint8_t* types, size_t count, const uint8_t* payload, size_t size) {
+        SiteDesc d;
+        d.argTypes.assign(types, types + count);
+        std::vector<ArgValue> args;
+        DecodeArgs(d, payload, size, args);
+        g_Logger.Log(site.level, site.tag, FormatText(site.format, args));
+    }
+
+    // [Logging] Structured=1 - бинарный режим; StructuredMaxMB - предел размера файла:
+    // больший файл уходит в scheduler.slog.old при старте и по ходу записи
+    void Start() {
+        State& s = S();
+        std::wstring dir = util::GetAppDataDir();
+        std::wstring ini = dir + L"\\scheduler.ini";
+        if (!GetPrivateProfileIntW(L"Logging", L"Structured", 0, ini.c_str())) return;
+
+        s.path = dir + L"\\scheduler.slog";
+        s.maxBytes = (uint64_t)GetPrivateProfileIntW(L"Logging", L"StructuredMaxMB", 64, ini.c_str()) * 1024 * 1024;
+        s.fileBytes = 0;
+        WIN32_FILE_ATTRIBUTE_DATA fa;
+        if (GetFileAttributesExW(s.path.c_str(), GetFileExInfoStandard, &fa)) {
+            s.fileBytes = (((uint64_t)fa.nFileSizeHigh) << 32) | fa.nFileSizeLow;
+            if (s.fileBytes > s.maxBytes) {
+                MoveFileExW(s.path.c_str(), (s.path + L".old").c_str(), MOVEFILE_REPLACE_EXISTING);
+                s.fileBytes = 0;
+            }
+        }
+
+        s.file = OpenLog(s.path);
+        if (s.file == INVALID_HANDLE_VALUE) {
+            g_Logger.Log(LogLevel::Error, L"Slog", L"Cannot open scheduler.slog, structured logging disabled");
+            return;
+        }
+        AppendSession(s.out);
+
+        // Точки, уже описанные до старта, описываются в новой сессии заново
+        {
+            std::lock_guard<std::mutex> lk(s.sitesMtx);
+            for (Site* site : s.sites) site->described.store(false, std::memory_order_relaxed);
+            s.pendingDescs.clear();
+        }
+        s.writtenDescs.clear();
+
+        s.stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        s.stopping.store(false);
+        s.stopDropped.store(0);
+        s.enabled.store(true);
+        s.writer = std::thread(WriterProc);
+
+        g_Logger.Log(LogLevel::Info, L"Slog", L"Structured logging to " + s.path);
+    }
+
+    // Новые записи отбрасываются (и считаются) с начала Stop; начатые до него
+    // дописываются и попадают в последний проход. После Stop вызовы SLOG снова идут в g_Logger
+    void Stop() {
+        State& s = S();
+        if (!s.enabled.load() || s.stopping.exchange(true)) return;
+
+        std::vector<std::shared_ptr<Ring>> rings;
+        {
+            std::lock_guard<std::mutex> lk(s.ringsMtx);
+            rings = s.rings;
+        }
+        for (auto& r : rings) {
+            while (r->busy.load(std::memory_order_acquire)) std::this_thread::yield();
+        }
+
+        SetEvent(s.stopEvent);
+        if (s.writer.joinable()) s.writer.join();
+        s.enabled.store(false);
+
+        // Отброшенные при остановке - отдельной записью в конце файла
+        uint64_t dropped = s.stopDropped.exchange(0);
+        if (dropped) {
+            AppendRecord(s.out, kDroppedRecord, 0, std::string((const char*)&dropped, sizeof(dropped)));
+            WriteOut();
+            g_Logger.Log(LogLevel::Warn, L"Slog", L"Records dropped while stopping: " + std::to_wstring(dropped));
+        }
+
+        CloseHandle(s.stopEvent);
+        s.stopEvent = NULL;
+        CloseHandle(s.file);
+        s.file = INVALID_HANDLE_VALUE;
+        // stopping остается до следующего Start: запоздалый Reserve не оставит запись в кольце без читателя
+    }
+
+} // namespace slog
@@ -0,0 +1,118 @@
+﻿#pragma once
+#include "Logger.h"
+#include "SlogFormat.h"
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Структурный журнал. Точка логирования описывается один раз (static в SLOG),
+// горячий путь пишет в кольцо своего потока только id точки, QPC и сырые аргументы;
+// форматирование - в LogDecoder. Фоновый поток сливает кольца в scheduler.slog.
+//
+//   SLOG(LogLevel::Info, L"Scheduler", L"Executing task: {} | Type={}", task->name, (int)type);
+//
+// Аргументы: целые, enum, bool, double, строки (std::wstring, std::pmr::wstring, const wchar_t*, InternedWString).
+// Без [Logging] Structured=1 в scheduler.ini те же вызовы форматируются в текст для g_Logger.
+namespace slog {
+
+    struct Site {
+        Site(LogLevel level, const wchar_t* tag, const wchar_t* format, const char* file, int line);
+
+        const LogLevel level;
+        const wchar_t* const tag;
+        const wchar_t* const format;
+        const char* const file;
+        const int line;
+        uint32_t id = 0;
+        std::atomic<bool> described{ false };
+    };
+
+    void Start();      // читает [Logging] Structured, открывает файл и запускает поток записи
+    void Stop();       // сливает все кольца и закрывает файл; записи во время остановки отбрасываются и считаются
+    bool Enabled();
+
+    void Describe(Site& site, const uint8_t* types, size_t count);
+    uint8_t* Reserve(uint32_t siteId, size_t payload);   // nullptr - кольцо заполнено или идет Stop, запись отброшена
+    void Commit();
+    void EmitText(const Site& site, const uint8_t* types, size_t count, const uint8_t* payload, size_t size);
+
+    namespace detail {
+
+        inline std::wstring_view View(std::wstring_view s) { return s; }
+        inline std::wstring_view View(const wchar_t* s) { return s ? std::wstring_view(s) : std::wstring_view(); }
+        template <class T>
+        auto View(const T& v) -> decltype(std::wstring_view(v.str())) { return v.str(); }
+
+        template <class T>
+        constexpr uint8_t TypeOf() {
+            using U = std::decay_t<T>;
+            if constexpr (std::is_same_v<U, bool>) return ARG_BOOL;
+            else if constexpr (std::is_enum_v<U>) return TypeOf<std::underlying_type_t<U>>();
+            else if constexpr (std::is_integral_v<U>)
+                return sizeof(U) <= 4 ? (std::is_signed_v<U> ? ARG_I32 : ARG_U32)
+                                      : (std::is_signed_v<U> ? ARG_I64 : ARG_U64);
+            else if constexpr (std::is_floating_point_v<U>) return ARG_F64;
+            else return ARG_WSTR;
+        }
+
+        template <class T>
+        size_t SizeOf(const T& v) {
+            constexpr uint8_t t = TypeOf<T>();
+            if constexpr (t == ARG_BOOL) return 1;
+            else if constexpr (t == ARG_I32 || t == ARG_U32) return 4;
+            else if constexpr (t == ARG_WSTR) return 4 + View(v).size() * sizeof(wchar_t);
+            else return 8;
+        }
+
+        template <class T>
+        uint8_t* Write(uint8_t* p, const T& v) {
+            constexpr uint8_t t = TypeOf<T>();
+            if constexpr (t == ARG_BOOL) { *p = v ? 1 : 0; return p + 1; }
+            else if constexpr (t == ARG_I32) { int32_t x = (int32_t)v; memcpy(p, &x, 4); return p + 4; }
+            else if constexpr (t == ARG_U32) { uint32_t x = (uint32_t)v; memcpy(p, &x, 4); return p + 4; }
+            else if constexpr (t == ARG_I64) { int64_t x = (int64_t)v; memcpy(p, &x, 8); return p + 8; }
+            else if constexpr (t == ARG_U64) { uint64_t x = (uint64_t)v; memcpy(p, &x, 8); return p + 8; }
+            else if constexpr (t == ARG_F64) { double x = (double)v; memcpy(p, &x, 8); return p + 8; }
+            else {
+                std::wstring_view s = View(v);
+                uint32_t len = (uint32_t)s.size();
+                memcpy(p, &len, 4);
+                memcpy(p + 4, s.data(), s.size() * sizeof(wchar_t));
+                return p + 4 + s.size() * sizeof(wchar_t);
+            }
+        }
+
+    } // namespace detail
+
+    template <class... Args>
+    void Emit(Site& site, const Args&... args) {
+        // Порог уровня - общий с текстовым журналом (Logger::SetMinLevel)
+        if ((int)site.level < (int)g_Logger.GetMinLevel()) return;
+        static constexpr uint8_t types[] = { detail::TypeOf<Args>()..., 0 };
+        if (!site.described.load(std::memory_order_acquire)) Describe(site, types, sizeof...(Args));
+
+        const size_t size = (size_t(0) + ... + detail::SizeOf(args));
+        if (!Enabled()) {
+            std::string buf(size, '\0');
+            uint8_t* p = (uint8_t*)buf.data();
+            ((p = detail::Write(p, args)), ...);
+            EmitText(site, types, sizeof...(Args), (const uint8_t*)buf.data(), size);
+            return;
+        }
+
+        uint8_t* p = Reserve(site.id, size);
+        if (!p) return;
+        ((p = detail::Write(p, args)), ...);
+        (void)p;
+        Commit();
+    }
+
+} // namespace slog
+
+#define SLOG(level, tag, format, ...) \
+    do { \
+        static slog::Site slogSite_(level, tag, format, __FILE__, __LINE__); \
+        slog::Emit(slogSite_, ##__VA_ARGS__); \
+    } while (0)
@@ -12,6 +12,7 @@ std::wstring TriggerTypeToWString(TriggerType t) {
     case TriggerType::INTERVAL: return L"INTERVAL";
     case TriggerType::DAILY: return L"DAILY";
     case TriggerType::WEEKLY: return L"WEEKLY";
+    case TriggerType::FILE_WATCH: return L"FILE_WATCH";
     default: return L"UNKNOWN";
     }
 }
@@ -23,7 +24,7 @@ std::wstring TaskToDebugString(const TaskPtr& task) {
        << L", name=" << task->name
        << L", enabled=" << (task->enabled ? L"true" : L"false")
        << L", trigger=" << TriggerTypeToWString(task->triggerType)
-       << L", exe=" << task->exePath
+       << L", exe=" << task->exePath.str()
        << L"]";
     return ss.str();
 }
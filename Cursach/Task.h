@@ -1,23 +1,68 @@
 ﻿#pragma once
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <bitset>
 #include <chrono>
+#include <cstdint>
 #include <memory>
+#include <memory_resource>
+#include "StringPool.h"
 
 enum class TriggerType {
     ONCE = 0,
     INTERVAL = 1,
     DAILY = 2,
-    WEEKLY = 3
+    WEEKLY = 3,
+    FILE_WATCH = 4   // Запуск по событиям файловой системы (FileWatcher)
+};
+
+// Маска событий для FILE_WATCH
+enum FileWatchEvents : uint32_t {
+    FILE_EVENT_CREATED = 1,
+    FILE_EVENT_MODIFIED = 2,
+    FILE_EVENT_DELETED = 4,
+    FILE_EVENT_RENAMED = 8
+};
+
+// Что делать, если очередное срабатывание пришлось на еще не завершенный запуск
+enum class OverlapPolicy {
+    ALLOW = 0,            // Запускать параллельно (в пределах maxConcurrentInstances)
+    SKIP_IF_RUNNING = 1,  // Пропустить срабатывание
+    QUEUE_ONE = 2,        // Отложить одно срабатывание до завершения текущего запуска
+    CANCEL_PREVIOUS = 3   // Остановить текущие запуски и стартовать заново
+};
+
+// Класс приоритета. CRITICAL может занимать зарезервированные слоты исполнителя.
+enum class TaskPriority {
+    LOW = 0,
+    NORMAL = 1,
+    HIGH = 2,
+    CRITICAL = 3
+};
+
+// Статистика последнего запуска (заполняется JobExecutor по данным Job Object)
+struct RunStats {
+    uint64_t userTimeMs = 0;     // user-время CPU всех процессов задания
+    uint64_t kernelTimeMs = 0;   // kernel-время CPU
+    uint64_t peakMemoryKB = 0;   // пиковый commit одного процесса
+    uint64_t readOps = 0, writeOps = 0;
+    uint64_t readBytes = 0, writeBytes = 0;
 };
 
 struct Task {
-    std::wstring id;
-    std::wstring name;
-    std::wstring description;
-    std::wstring exePath;
-    std::wstring arguments;
-    std::wstring workingDirectory;
+    Task() = default;
+    // Строки id/name/description - из res (арена снимка Persistence::Load).
+    // Копия задачи (Task(const Task&)) всегда получает строки в куче
+    explicit Task(std::pmr::memory_resource* res) : id(res), name(res), description(res) {}
+
+    std::pmr::wstring id;
+    std::pmr::wstring name;
+    std::pmr::wstring description;
+    // Повторяются у тысяч задач - хранятся в общем пуле строк
+    util::InternedWString exePath;
+    util::InternedWString arguments;
+    util::InternedWString workingDirectory;
     bool enabled = true;
     TriggerType triggerType = TriggerType::DAILY;
 
@@ -28,15 +73,76 @@ struct Task {
     std::bitset<7> weeklyDays;
     uint8_t weeklyHour = 12, weeklyMinute = 0, weeklySecond = 0;
 
+    // FILE_WATCH: каталог, маска имен ("*.csv;*.txt") и события; пачка событий
+    // склеивается в один запуск после debounceMs тишины
+    std::wstring watchPath;
+    std::wstring watchPattern = L"*";
+    uint32_t watchEvents = FILE_EVENT_CREATED | FILE_EVENT_MODIFIED | FILE_EVENT_RENAMED;
+    bool watchSubtree = false;
+    uint32_t debounceMs = 500;
+
     bool runIfMissed = true;
 
     // ← ДОБАВЛЕНО: Ограничение времени выполнения
     bool hasExecutionTimeout = false;      // Включен ли лимит
     uint32_t executionTimeoutMinutes = 5;  // Таймаут в минутах (по умолчанию 5)
 
+    // Ограничения ресурсов (применяются через Job Object при запуске), 0 = без ограничения
+    uint32_t cpuTimeLimitSeconds = 0;      // Суммарное user-время CPU на запуск
+    uint32_t memoryLimitMB = 0;            // Лимит памяти на процесс
+    uint32_t maxProcesses = 0;             // Макс. число одновременно живых процессов
+
+    // Перекрытие запусков (для INTERVAL/DAILY/WEEKLY)
+    OverlapPolicy overlapPolicy = OverlapPolicy::ALLOW;
+    uint32_t maxConcurrentInstances = 0;   // 0 = без ограничения для ALLOW и 1 для остальных политик
+
+    // Диспетчеризация при насыщении исполнителя
+    TaskPriority priority = TaskPriority::NORMAL;
+    std::wstring group;                    // Группа для справедливого распределения (пусто = "default")
+
+    // Повтор неудачного запуска: таймер Scheduler, задержка retryDelaySeconds * 2^(попытка-1)
+    // (не больше retryMaxDelaySeconds) со случайным разбросом в пределах половины.
+    // Неудача - ненулевой код, включая 999 (таймаут) и отрицательный (ошибка CreateProcess);
+    // остановленный запуск (998) не повторяется.
+    uint32_t retryMaxAttempts = 0;         // 0 = без повторов
+    uint32_t retryDelaySeconds = 30;
+    uint32_t retryMaxDelaySeconds = 3600;
+    std::wstring retryExitCodes;           // "1,2,999"; пусто = любой код неудачи
+
     // Runtime info
     std::chrono::system_clock::time_point lastRunTime{};
     std::chrono::system_clock::time_point nextRunTime{};
     int lastExitCode = 0;
+    RunStats lastRunStats;
+    uint32_t stateSlot = UINT32_MAX;   // слот в runtime.dat (lastRunTime/nextRunTime/lastExitCode), UINT32_MAX - нет
+    uint64_t overlapSkipped = 0;       // срабатываний, пропущенных из-за перекрытия (меняется под mtx таблицы запусков)
+    uint64_t overlapQueued = 0;        // срабатываний, отложенных QUEUE_ONE
+
+    // Состояние повторов (сохраняется в tasks.json, переживает перезапуск)
+    uint32_t retryAttempt = 0;                             // повторов в текущей серии
+    std::chrono::system_clock::time_point retryAt{};       // срок ожидающего повтора, {} - нет
+    uint64_t retryRuns = 0;        // всего запусков-повторов
+    uint64_t retryRecovered = 0;   // серий, завершившихся успехом на повторе
+    uint64_t retryGaveUp = 0;      // серий, оставшихся неудачными (попытки кончились или код не из списка)
 };
-using TaskPtr = std::shared_ptr<Task>;
\ No newline at end of file
+using TaskPtr = std::shared_ptr<Task>;
+
+// Словари по id задачи: поиск по std::pmr::wstring задачи без временного std::wstring ключа
+struct TaskIdHash {
+    using is_transparent = void;
+    size_t operator()(std::wstring_view id) const noexcept { return std::hash<std::wstring_view>{}(id); }
+};
+struct TaskIdEq {
+    using is_transparent = void;
+    bool operator()(std::wstring_view a, std::wstring_view b) const noexcept { return a == b; }
+};
+template <class V>
+using TaskIdMap = std::unordered_map<std::wstring, V, TaskIdHash, TaskIdEq>;
+
+// map[id]: ключ копируется только при вставке новой записи
+template <class V>
+V& TaskIdEntry(TaskIdMap<V>& map, std::wstring_view id) {
+    auto it = map.find(id);
+    if (it == map.end()) it = map.emplace(std::wstring(id), V{}).first;
+    return it->second;
+}
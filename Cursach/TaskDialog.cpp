@@ -43,6 +43,11 @@ static void UpdateTriggerUI(HWND hDlg)
     ShowCtrl(hDlg, IDC_DAY_SAT, false);
     ShowCtrl(hDlg, IDC_DAY_SUN, false);
 
+    ShowCtrl(hDlg, IDC_WATCH_PATH, false);
+    ShowCtrl(hDlg, IDC_WATCH_PATH_LABEL, false);
+    ShowCtrl(hDlg, IDC_WATCH_PATTERN, false);
+    ShowCtrl(hDlg, IDC_WATCH_PATTERN_LABEL, false);
+
     switch (t)
     {
     case (int)TriggerType::ONCE:
@@ -71,6 +76,13 @@ static void UpdateTriggerUI(HWND hDlg)
         ShowCtrl(hDlg, IDC_DAY_SAT, true);
         ShowCtrl(hDlg, IDC_DAY_SUN, true);
         break;
+
+    case (int)TriggerType::FILE_WATCH:
+        ShowCtrl(hDlg, IDC_WATCH_PATH, true);
+        ShowCtrl(hDlg, IDC_WATCH_PATH_LABEL, true);
+        ShowCtrl(hDlg, IDC_WATCH_PATTERN, true);
+        ShowCtrl(hDlg, IDC_WATCH_PATTERN_LABEL, true);
+        break;
     }
 }
 
@@ -82,6 +94,15 @@ static void UpdateTimeoutUI(HWND hDlg)
     EnableWindow(GetDlgItem(hDlg, IDC_TIMEOUT_LABEL), checked);
 }
 
+// Без попыток задержки и коды не действуют
+static void UpdateRetryUI(HWND hDlg)
+{
+    BOOL enabled = GetDlgItemInt(hDlg, IDC_RETRY_ATTEMPTS, nullptr, FALSE) > 0;
+    EnableWindow(GetDlgItem(hDlg, IDC_RETRY_DELAY), enabled);
+    EnableWindow(GetDlgItem(hDlg, IDC_RETRY_MAX_DELAY), enabled);
+    EnableWindow(GetDlgItem(hDlg, IDC_RETRY_EXIT_CODES), enabled);
+}
+
 static void LoadOnceDateTime(HWND hDlg)
 {
     SYSTEMTIME st{};
@@ -217,6 +238,85 @@ static void SaveTimeout(HWND hDlg)
     }
 }
 
+// Повторы: число попыток, задержка первой (удваивается до max) и коды, при которых повторять
+static void LoadRetry(HWND hDlg)
+{
+    SetDlgItemInt(hDlg, IDC_RETRY_ATTEMPTS, g_task->retryMaxAttempts, FALSE);
+    SetDlgItemInt(hDlg, IDC_RETRY_DELAY, g_task->retryDelaySeconds, FALSE);
+    SetDlgItemInt(hDlg, IDC_RETRY_MAX_DELAY, g_task->retryMaxDelaySeconds, FALSE);
+    SetDlgItemTextW(hDlg, IDC_RETRY_EXIT_CODES, g_task->retryExitCodes.c_str());
+    UpdateRetryUI(hDlg);
+}
+
+static void SaveRetry(HWND hDlg)
+{
+    g_task->retryMaxAttempts = GetDlgItemInt(hDlg, IDC_RETRY_ATTEMPTS, nullptr, FALSE);
+    if (g_task->retryMaxAttempts == 0) return;   // остальное без повторов не используется
+
+    g_task->retryDelaySeconds = GetDlgItemInt(hDlg, IDC_RETRY_DELAY, nullptr, FALSE);
+    g_task->retryMaxDelaySeconds = GetDlgItemInt(hDlg, IDC_RETRY_MAX_DELAY, nullptr, FALSE);
+    wchar_t buf[256];
+    GetDlgItemTextW(hDlg, IDC_RETRY_EXIT_CODES, buf, 256);
+    g_task->retryExitCodes = buf;
+}
+
+// Лимиты Job Object (026): 0 - без ограничения
+static void LoadLimits(HWND hDlg)
+{
+    SetDlgItemInt(hDlg, IDC_LIMIT_CPU, g_task->cpuTimeLimitSeconds, FALSE);
+    SetDlgItemInt(hDlg, IDC_LIMIT_MEMORY, g_task->memoryLimitMB, FALSE);
+    SetDlgItemInt(hDlg, IDC_LIMIT_PROCESSES, g_task->maxProcesses, FALSE);
+}
+
+static void SaveLimits(HWND hDlg)
+{
+    g_task->cpuTimeLimitSeconds = GetDlgItemInt(hDlg, IDC_LIMIT_CPU, nullptr, FALSE);
+    g_task->memoryLimitMB = GetDlgItemInt(hDlg, IDC_LIMIT_MEMORY, nullptr, FALSE);
+    g_task->maxProcesses = GetDlgItemInt(hDlg, IDC_LIMIT_PROCESSES, nullptr, FALSE);
+}
+
+// Перекрытие запусков и диспетчеризация: строки списков - в порядке значений OverlapPolicy/TaskPriority
+static void LoadDispatch(HWND hDlg)
+{
+    HWND overlap = GetDlgItem(hDlg, IDC_OVERLAP_POLICY);
+    ComboBox_AddString(overlap, L"Run in parallel");
+    ComboBox_AddString(overlap, L"Skip the run");
+    ComboBox_AddString(overlap, L"Queue one run");
+    ComboBox_AddString(overlap, L"Cancel previous");
+    ComboBox_SetCurSel(overlap, (int)g_task->overlapPolicy);
+    SetDlgItemInt(hDlg, IDC_MAX_INSTANCES, g_task->maxConcurrentInstances, FALSE);
+
+    HWND priority = GetDlgItem(hDlg, IDC_PRIORITY);
+    ComboBox_AddString(priority, L"Low");
+    ComboBox_AddString(priority, L"Normal");
+    ComboBox_AddString(priority, L"High");
+    ComboBox_AddString(priority, L"Critical");
+    ComboBox_SetCurSel(priority, (int)g_task->priority);
+    SetDlgItemTextW(hDlg, IDC_GROUP, g_task->group.c_str());
+}
+
+static void SaveDispatch(HWND hDlg)
+{
+    g_task->overlapPolicy = (OverlapPolicy)ComboBox_GetCurSel(GetDlgItem(hDlg, IDC_OVERLAP_POLICY));
+    g_task->maxConcurrentInstances = GetDlgItemInt(hDlg, IDC_MAX_INSTANCES, nullptr, FALSE);
+    g_task->priority = (TaskPriority)ComboBox_GetCurSel(GetDlgItem(hDlg, IDC_PRIORITY));
+    wchar_t buf[256];
+    GetDlgItemTextW(hDlg, IDC_GROUP, buf, 256);
+    g_task->group = buf;
+}
+
+// Коды через запятую или пробел, допускается минус
+static bool ValidExitCodes(const wchar_t* s)
+{
+    for (; *s; ++s) {
+        if (*s >= L'0' && *s <= L'9') continue;
+        if (*s == L'-' && (s[1] >= L'0' && s[1] <= L'9')) continue;
+        if (*s == L',' || *s == L' ') continue;
+        return false;
+    }
+    return true;
+}
+
 static bool ValidateFields(HWND hDlg)
 {
     wchar_t name[256], exe[512];
@@ -241,6 +341,17 @@ static bool ValidateFields(HWND hDlg)
         return false;
     }
 
+    if (ComboBox_GetCurSel(GetDlgItem(hDlg, IDC_TASK_TRIGGER)) == (int)TriggerType::FILE_WATCH)
+    {
+        wchar_t dir[512];
+        GetDlgItemTextW(hDlg, IDC_WATCH_PATH, dir, 512);
+        if (wcslen(dir) == 0 || !filesystem::is_directory(dir))
+        {
+            MessageBoxW(hDlg, L"Folder to watch does not exist.", L"Error", MB_ICONERROR);
+            return false;
+        }
+    }
+
     // ← ДОБАВЛЕНО: Валидация timeout
     if (IsDlgButtonChecked(hDlg, IDC_TIMEOUT_CHECK) == BST_CHECKED)
     {
@@ -254,6 +365,26 @@ static bool ValidateFields(HWND hDlg)
         }
     }
 
+    if (GetDlgItemInt(hDlg, IDC_RETRY_ATTEMPTS, nullptr, FALSE) > 0)
+    {
+        BOOL okDelay = FALSE, okMax = FALSE;
+        UINT delay = GetDlgItemInt(hDlg, IDC_RETRY_DELAY, &okDelay, FALSE);
+        UINT maxDelay = GetDlgItemInt(hDlg, IDC_RETRY_MAX_DELAY, &okMax, FALSE);
+        if (!okDelay || delay == 0 || !okMax || maxDelay < delay)
+        {
+            MessageBoxW(hDlg, L"Retry delay must be positive and not exceed the max delay.", L"Error", MB_ICONERROR);
+            return false;
+        }
+
+        wchar_t codes[256];
+        GetDlgItemTextW(hDlg, IDC_RETRY_EXIT_CODES, codes, 256);
+        if (!ValidExitCodes(codes))
+        {
+            MessageBoxW(hDlg, L"Retry exit codes must be numbers separated by commas.", L"Error", MB_ICONERROR);
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -299,10 +430,14 @@ static void LoadTaskToDialog(HWND hDlg)
     ComboBox_AddString(cb, L"Interval");
     ComboBox_AddString(cb, L"Daily");
     ComboBox_AddString(cb, L"Weekly");
+    ComboBox_AddString(cb, L"File event");
 
     ComboBox_SetCurSel(cb, (int)g_task->triggerType);
 
     SetDlgItemInt(hDlg, IDC_TASK_INTERVAL, g_task->intervalMinutes, FALSE);
+
+    SetDlgItemTextW(hDlg, IDC_WATCH_PATH, g_task->watchPath.c_str());
+    SetDlgItemTextW(hDlg, IDC_WATCH_PATTERN, g_task->watchPattern.c_str());
 }
 
 static void SaveTask(HWND hDlg)
@@ -332,9 +467,18 @@ static void SaveTask(HWND hDlg)
         SaveTime(hDlg);
         SaveWeekdays(hDlg);
         break;
+    case TriggerType::FILE_WATCH:
+        GetDlgItemTextW(hDlg, IDC_WATCH_PATH, buf, 512);
+        g_task->watchPath = buf;
+        GetDlgItemTextW(hDlg, IDC_WATCH_PATTERN, buf, 512);
+        g_task->watchPattern = buf[0] ? buf : L"*";
+        break;
     }
 
     SaveTimeout(hDlg);  // ← ДОБАВЛЕНО
+    SaveRetry(hDlg);
+    SaveLimits(hDlg);
+    SaveDispatch(hDlg);
 }
 
 static HBRUSH hGreen = CreateSolidBrush(RGB(210, 255, 210));
@@ -353,6 +497,9 @@ static INT_PTR CALLBACK DlgProc(HWND hDlg, UINT msg, WPARAM w, LPARAM l)
         LoadWeekdays(hDlg);
         LoadOnceDateTime(hDlg);
         LoadTimeout(hDlg);  // ← ДОБАВЛЕНО
+        LoadRetry(hDlg);
+        LoadLimits(hDlg);
+        LoadDispatch(hDlg);
         UpdateTriggerUI(hDlg);
         return TRUE;
 
@@ -384,6 +531,12 @@ static INT_PTR CALLBACK DlgProc(HWND hDlg, UINT msg, WPARAM w, LPARAM l)
             return TRUE;
         }
 
+        if (LOWORD(w) == IDC_RETRY_ATTEMPTS && HIWORD(w) == EN_CHANGE)
+        {
+            UpdateRetryUI(hDlg);
+            return TRUE;
+        }
+
         if (LOWORD(w) == IDOK)
         {
             if (!ValidateFields(hDlg))
@@ -1,20 +1,77 @@
 ﻿#include "TaskManager.h"
 #include "Persistence.h"
+#include "RuntimeState.h"
+#include "StoreWatcher.h"
 #include "Logger.h"
+#include "Latency.h"
+#include "StructuredLog.h"
+#include "Trace.h"
 #include "Utils.h"
 
 #include <algorithm>
 #include <chrono>
 #include <shared_mutex>
 #include <string>
+#include <thread>
+
+namespace {
+    // Поля, задаваемые пользователем; состояние выполнения не сравнивается
+    bool SameDefinition(const Task& a, const Task& b) {
+        return a.name == b.name && a.description == b.description &&
+            a.exePath == b.exePath && a.arguments == b.arguments && a.workingDirectory == b.workingDirectory &&
+            a.enabled == b.enabled && a.triggerType == b.triggerType &&
+            a.runOnceTime == b.runOnceTime && a.intervalMinutes == b.intervalMinutes &&
+            a.dailyHour == b.dailyHour && a.dailyMinute == b.dailyMinute && a.dailySecond == b.dailySecond &&
+            a.weeklyDays == b.weeklyDays && a.weeklyHour == b.weeklyHour &&
+            a.weeklyMinute == b.weeklyMinute && a.weeklySecond == b.weeklySecond &&
+            a.watchPath == b.watchPath && a.watchPattern == b.watchPattern && a.watchEvents == b.watchEvents &&
+            a.watchSubtree == b.watchSubtree && a.debounceMs == b.debounceMs &&
+            a.runIfMissed == b.runIfMissed &&
+            a.hasExecutionTimeout == b.hasExecutionTimeout && a.executionTimeoutMinutes == b.executionTimeoutMinutes &&
+            a.cpuTimeLimitSeconds == b.cpuTimeLimitSeconds && a.memoryLimitMB == b.memoryLimitMB &&
+            a.maxProcesses == b.maxProcesses &&
+            a.overlapPolicy == b.overlapPolicy && a.maxConcurrentInstances == b.maxConcurrentInstances &&
+            a.priority == b.priority && a.group == b.group &&
+            a.retryMaxAttempts == b.retryMaxAttempts && a.retryDelaySeconds == b.retryDelaySeconds &&
+            a.retryMaxDelaySeconds == b.retryMaxDelaySeconds && a.retryExitCodes == b.retryExitCodes;
+    }
+
+    // Измененная задача продолжает историю прежней: слот runtime.dat, последний запуск, серия повторов
+    void CopyRuntimeState(const Task& from, Task& to) {
+        to.lastRunTime = from.lastRunTime;
+        to.lastExitCode = from.lastExitCode;
+        to.lastRunStats = from.lastRunStats;
+        to.stateSlot = from.stateSlot;
+        to.overlapSkipped = from.overlapSkipped;
+        to.overlapQueued = from.overlapQueued;
+        to.retryAttempt = from.retryAttempt;
+        to.retryAt = from.retryAt;
+        to.retryRuns = from.retryRuns;
+        to.retryRecovered = from.retryRecovered;
+        to.retryGaveUp = from.retryGaveUp;
+    }
+}
 
-TaskManager::TaskManager() {
-    persistence = new Persistence();
+TaskManager::TaskManager(const Clock& clock, bool persistent)
+    : clock(&clock), persistence(persistent ? new Persistence() : nullptr),
+      runtime(persistent ? new RuntimeState() : nullptr) {
+    // runtime.dat держит другой экземпляр (шарды, --import) или он не открылся: слоты не выдаются
+    // и не освобождаются, stateSlot из tasks.json остается как есть - владелец файла его найдет
+    if (runtime && !runtime->Open(util::GetAppDataDir() + L"\\runtime.dat")) {
+        delete runtime;
+        runtime = nullptr;
+    }
     Load();
 }
 
 TaskManager::~TaskManager() {
+    StopStoreWatch();
+    {
+        std::lock_guard start(searchBuildMtx);
+        if (searchBuilder.joinable()) searchBuilder.join();
+    }
     Save();
+    delete runtime;   // Close: сброс страниц на диск
     delete persistence;
 }
 
@@ -24,77 +81,115 @@ std::vector<TaskPtr> TaskManager::GetAllTasks() {
 }
 
 void TaskManager::AddTask(const TaskPtr& task) {
+    LATENCY_SCOPE("TaskManager::AddTask");
     std::unique_lock lock(mutex);
+    if (runtime) task->stateSlot = runtime->Allocate(task->id);
     tasks.push_back(task);
-    CalculateNextRun(task);
+    HotAppendLocked(task);
+    SearchAddLocked(task);
+    CalculateNextRunLocked(task);
+    TaskIdEntry(unsavedEdits, task->id) = true;
+    ++version;
     lock.unlock();
 
     Save();
+    Emit(TaskEvent::Kind::Added, task, task->id);
     if (onChange) onChange();
 
     g_Logger.Log(
         LogLevel::Info,
         L"TaskManager",
-        std::wstring(L"Added task: ") + task->name
+        std::wstring(L"Added task: ") + std::wstring(task->name)
     );
 }
 
 void TaskManager::RemoveTask(const std::wstring& id) {
+    LATENCY_SCOPE("TaskManager::RemoveTask");
     std::unique_lock<std::shared_mutex> lock(mutex);
 
     auto it = std::find_if(tasks.begin(), tasks.end(),
-        [&](const TaskPtr& t) { return t && t->id == id; });
+        [&](const TaskPtr& t) { return t && t->id == std::wstring_view(id); });
 
     if (it == tasks.end()) {
         g_Logger.Log(LogLevel::Info, L"TaskManager", L"RemoveTask: not found id=" + id);
         return;
     }
 
-    std::wstring name = (*it)->name;
+    std::wstring name((*it)->name);
+    if (runtime) runtime->Free((*it)->stateSlot);
     tasks.erase(it);
+    HotRemoveLocked(id);
+    SearchRemoveLocked(id);
+    TaskIdEntry(unsavedEdits, id) = false;
+    bool compacted = CompactSnapshotsLocked();
+    ++version;
     lock.unlock();
 
     Save();
+    Emit(TaskEvent::Kind::Removed, nullptr, id);
+    if (compacted) Emit(TaskEvent::Kind::Reset, nullptr, std::wstring());
     if (onChange) onChange();
 
     g_Logger.Log(LogLevel::Info, L"TaskManager", L"Removed task: " + name);
 }
 
 void TaskManager::UpdateTask(const TaskPtr& task) {
+    LATENCY_SCOPE("TaskManager::UpdateTask");
     std::unique_lock lock(mutex);
+    bool found = false;
     for (auto& t : tasks) {
         if (t->id == task->id) {
+            // Слот, последний запуск и серия повторов - за id: пока был открыт диалог, объект
+            // могли заменить перечитыванием tasks.json, и копия в руках диалога устарела
+            if (t != task) CopyRuntimeState(*t, *task);
             t = task;
-            CalculateNextRun(t);
+            auto slot = hot.slotById.find(task->id);
+            if (slot != hot.slotById.end()) hot.owner[slot->second] = task;
+            CalculateNextRunLocked(t);
+            SearchAddLocked(task);
+            TaskIdEntry(unsavedEdits, task->id) = true;
+            found = true;
             break;
         }
     }
+    bool compacted = found && CompactSnapshotsLocked();
+    ++version;
     lock.unlock();
 
     Save();
+    if (found) Emit(TaskEvent::Kind::Updated, task, task->id);
+    if (compacted) Emit(TaskEvent::Kind::Reset, nullptr, std::wstring());
     if (onChange) onChange();
 
     g_Logger.Log(
         LogLevel::Info,
         L"TaskManager",
-        std::wstring(L"Updated task: ") + task->name
+        std::wstring(L"Updated task: ") + std::wstring(task->name)
     );
 }
 
 TaskPtr TaskManager::GetTaskById(const std::wstring& id) {
     std::shared_lock lock(mutex);
-    for (auto& t : tasks)
-        if (t->id == id)
-            return t;
-    return nullptr;
+    auto it = hot.slotById.find(id);
+    return it == hot.slotById.end() ? nullptr : hot.owner[it->second];
 }
 
 void TaskManager::CalculateNextRun(const TaskPtr& task) {
-    if (!task) return;
+    std::unique_lock lock(mutex);
+    bool owned = CalculateNextRunLocked(task);
+    lock.unlock();
+
+    if (owned) Emit(TaskEvent::Kind::Updated, task, task->id);
+}
+
+bool TaskManager::CalculateNextRunLocked(const TaskPtr& task) {
+    if (!task) return false;
+    TRACE_SPAN("CalculateNextRun", "tasks");
+    LATENCY_SCOPE("TaskManager::CalculateNextRun");
 
     using namespace std::chrono;
 
-    auto now = system_clock::now();
+    auto now = clock->Now();
     switch (task->triggerType) {
 
     case TriggerType::ONCE:
@@ -148,11 +243,8 @@ void TaskManager::CalculateNextRun(const TaskPtr& task) {
         int today = local.tm_wday;  // 0=Sunday, 1=Monday, ..., 6=Saturday
         bool found = false;
 
-        g_Logger.Log(LogLevel::Debug, L"TaskManager",
-            L"WEEKLY: Calculating next run for task: " + task->name +
-            L" | Today: " + std::to_wstring(today) +
-            L" | Target time: " + std::to_wstring(task->weeklyHour) + L":" +
-            std::to_wstring(task->weeklyMinute));
+        SLOG(LogLevel::Debug, L"TaskManager", L"WEEKLY: Calculating next run for task: {} | Today: {} | Target time: {}:{}",
+            task->name, today, task->weeklyHour, task->weeklyMinute);
 
         // Проверяем следующие 7 дней (эта неделя)
         for (int offset = 0; offset < 7; ++offset) {
@@ -173,10 +265,8 @@ void TaskManager::CalculateNextRun(const TaskPtr& task) {
             time_t ct = mktime(&cand);  // mktime нормализует дату
             auto tp = system_clock::from_time_t(ct);
 
-            g_Logger.Log(LogLevel::Debug, L"TaskManager",
-                L"  Checking offset=" + std::to_wstring(offset) +
-                L" | day=" + std::to_wstring(d) +
-                L" | time in future: " + (tp > now ? L"YES" : L"NO"));
+            SLOG(LogLevel::Debug, L"TaskManager", L"  Checking offset={} | day={} | time in future: {}",
+                offset, d, tp > now);
 
             // Берем только если время строго в будущем
             if (tp > now) {
@@ -191,8 +281,7 @@ void TaskManager::CalculateNextRun(const TaskPtr& task) {
 
         // Если не нашли на этой неделе, ищем на следующей
         if (!found) {
-            g_Logger.Log(LogLevel::Debug, L"TaskManager",
-                L"WEEKLY: No suitable time this week, checking NEXT week");
+            SLOG(LogLevel::Debug, L"TaskManager", L"WEEKLY: No suitable time this week, checking NEXT week");
 
             for (int offset = 7; offset < 14; ++offset) {
                 int d = (today + offset) % 7;
@@ -223,39 +312,552 @@ void TaskManager::CalculateNextRun(const TaskPtr& task) {
         if (!found) {
             task->nextRunTime = {};
             g_Logger.Log(LogLevel::Warn, L"TaskManager",
-                L"⚠ WEEKLY: No days selected for task: " + task->name);
+                L"⚠ WEEKLY: No days selected for task: " + std::wstring(task->name));
         }
 
         break;
     }
 
+    case TriggerType::FILE_WATCH:
+        // Срок назначает планировщик по событию FileWatcher
+        task->nextRunTime = {};
+        break;
+
     default:
         task->nextRunTime = {};
     }
+
+    return HotSyncLocked(task);
+}
+
+// ============================================================================
+// Горячий срез (SoA)
+// ============================================================================
+
+static int64_t ToEpochMs(std::chrono::system_clock::time_point tp) {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(tp.time_since_epoch()).count();
+}
+
+void TaskManager::HotAppendLocked(const TaskPtr& task) {
+    uint32_t slot = (uint32_t)hot.owner.size();
+    if ((slot & 63) == 0) hot.enabledBits.push_back(0);
+    hot.trigger.push_back(0);
+    hot.nextRunMs.push_back(0);
+    hot.owner.push_back(task);
+    TaskIdEntry(hot.slotById, task->id) = slot;
+    HotSyncLocked(task);
+}
+
+bool TaskManager::ScheduledLocked(uint32_t slot) const {
+    return ((hot.enabledBits[slot >> 6] >> (slot & 63)) & 1) && hot.nextRunMs[slot] != 0;
+}
+
+void TaskManager::HotRemoveLocked(std::wstring_view id) {
+    auto it = hot.slotById.find(id);
+    if (it == hot.slotById.end()) return;
+
+    uint32_t slot = it->second;
+    uint32_t last = (uint32_t)hot.owner.size() - 1;
+    hot.slotById.erase(it);
+    if (ScheduledLocked(slot)) hot.schedule.erase({ hot.nextRunMs[slot], slot });
+
+    // Последняя строка переезжает на место удаленной
+    if (slot != last) {
+        if (ScheduledLocked(last)) {
+            hot.schedule.erase({ hot.nextRunMs[last], last });
+            hot.schedule.insert({ hot.nextRunMs[last], slot });
+        }
+        hot.trigger[slot] = hot.trigger[last];
+        hot.nextRunMs[slot] = hot.nextRunMs[last];
+        hot.owner[slot] = std::move(hot.owner[last]);
+        uint64_t bit = (hot.enabledBits[last >> 6] >> (last & 63)) & 1;
+        hot.enabledBits[slot >> 6] = (hot.enabledBits[slot >> 6] & ~(1ull << (slot & 63))) | (bit << (slot & 63));
+        hot.slotById.find(hot.owner[slot]->id)->second = slot;
+    }
+
+    hot.enabledBits[last >> 6] &= ~(1ull << (last & 63));
+    hot.trigger.pop_back();
+    hot.nextRunMs.pop_back();
+    hot.owner.pop_back();
+    if ((last & 63) == 0) hot.enabledBits.pop_back();
+}
+
+// Копия задачи из диалога и т.п. - в срез не пишем и событий не порождаем (false)
+bool TaskManager::HotSyncLocked(const TaskPtr& task) {
+    auto it = hot.slotById.find(task->id);
+    if (it == hot.slotById.end() || hot.owner[it->second] != task) return false;
+
+    uint32_t slot = it->second;
+    if (ScheduledLocked(slot)) hot.schedule.erase({ hot.nextRunMs[slot], slot });
+
+    uint64_t mask = 1ull << (slot & 63);
+    if (task->enabled) hot.enabledBits[slot >> 6] |= mask;
+    else hot.enabledBits[slot >> 6] &= ~mask;
+    hot.trigger[slot] = (uint8_t)task->triggerType;
+    hot.nextRunMs[slot] = task->nextRunTime.time_since_epoch().count() == 0 ? 0 : ToEpochMs(task->nextRunTime);
+
+    if (ScheduledLocked(slot)) hot.schedule.insert({ hot.nextRunMs[slot], slot });
+
+    // Тот же момент, что и срез: каждое изменение nextRunTime сразу в runtime.dat
+    if (runtime) runtime->Store(task->stateSlot, *task);
+    return true;
+}
+
+// Задачи снимка Load держат всю его арену (SnapshotOf). Когда в списке осталось меньше
+// половины задач снимка (all - сразу), оставшиеся копируются в кучу, и арена уходит вместе
+// с последней внешней ссылкой (идущий запуск, строка окна). Копия - та же задача: итог
+// идущего запуска переносит StoreRuntime
+bool TaskManager::CompactSnapshotsLocked(bool all) {
+    std::unordered_map<const void*, size_t> live;
+    for (auto& t : tasks) {
+        SnapshotInfo info = SnapshotOf(t);
+        if (info.snapshot) ++live[info.snapshot];
+    }
+
+    size_t copied = 0;
+    for (auto& t : tasks) {
+        SnapshotInfo info = SnapshotOf(t);
+        if (!info.snapshot || (!all && live[info.snapshot] * 2 >= info.records)) continue;
+        TaskPtr copy = std::make_shared<Task>(*t);
+        auto row = hot.slotById.find(copy->id);
+        if (row != hot.slotById.end()) hot.owner[row->second] = copy;
+        SearchAddLocked(copy);
+        t = std::move(copy);
+        ++copied;
+    }
+    if (copied) {
+        g_Logger.Log(LogLevel::Debug, L"TaskManager",
+            L"Load snapshot compacted: " + std::to_wstring(copied) + L" task(s) copied to the heap");
+    }
+    return copied != 0;
+}
+
+void TaskManager::Emit(TaskEvent::Kind kind, const TaskPtr& task, std::wstring_view id) {
+    std::lock_guard<std::mutex> lk(eventMtx);
+    if (onTaskEvent) onTaskEvent(TaskEvent{ kind, task, std::wstring(id) });
+}
+
+void TaskManager::HotRebuildLocked() {
+    hot = HotStore{};
+    hot.enabledBits.reserve((tasks.size() + 63) / 64);
+    hot.trigger.reserve(tasks.size());
+    hot.nextRunMs.reserve(tasks.size());
+    hot.owner.reserve(tasks.size());
+    hot.slotById.reserve(tasks.size());
+    for (auto& t : tasks) HotAppendLocked(t);
+}
+
+void TaskManager::CollectDue(std::chrono::system_clock::time_point now, const OwnsFn& owns,
+    std::vector<TaskPtr>& due, std::chrono::system_clock::time_point& nextDeadline) {
+    using namespace std::chrono;
+    const int64_t nowMs = ToEpochMs(now);
+    int64_t best = 0;
+
+    std::shared_lock lock(mutex);
+
+    // Просроченные - префикс индекса; срок - первая следующая строка (своя, если есть owns).
+    // Раньше здесь был полный проход по битам enabled: на каждом проходе планировщика O(n).
+    for (const auto& [t, i] : hot.schedule) {
+        if (t <= nowMs) {
+            if (!owns || owns(hot.owner[i]->id)) due.push_back(hot.owner[i]);
+        }
+        else if (!owns || owns(hot.owner[i]->id)) {
+            best = t;
+            break;
+        }
+    }
+
+    nextDeadline = best ? system_clock::time_point(duration_cast<system_clock::duration>(milliseconds(best)))
+                        : system_clock::time_point{};
+}
+
+void TaskManager::SetNextRun(const TaskPtr& task, std::chrono::system_clock::time_point tp) {
+    LATENCY_SCOPE("TaskManager::SetNextRun");
+    std::unique_lock lock(mutex);
+    task->nextRunTime = tp;
+    bool owned = HotSyncLocked(task);
+    lock.unlock();
+
+    if (owned) Emit(TaskEvent::Kind::Updated, task, task->id);
+}
+
+void TaskManager::StoreRuntime(const TaskPtr& task) {
+    LATENCY_SCOPE("TaskManager::StoreRuntime");
+    if (!task) return;
+    {
+        // Пока шел запуск, объект задачи могли заменить (UpdateTask, перезагрузка, уплотнение
+        // снимка): итог запуска переходит к текущей задаче с тем же id
+        std::shared_lock lock(mutex);
+        auto row = hot.slotById.find(task->id);
+        if (row != hot.slotById.end() && hot.owner[row->second] != task) {
+            Task& cur = *hot.owner[row->second];
+            cur.lastRunTime = task->lastRunTime;
+            cur.lastExitCode = task->lastExitCode;
+            cur.lastRunStats = task->lastRunStats;
+        }
+    }
+    // stateSlot задачи не меняется, а слот после удаления задачи Store проверяет по id
+    if (runtime) runtime->Store(task->stateSlot, *task);
+}
+
+void TaskManager::Disable(const TaskPtr& task) {
+    LATENCY_SCOPE("TaskManager::Disable");
+    std::unique_lock lock(mutex);
+    task->enabled = false;
+    task->nextRunTime = {};
+    bool owned = HotSyncLocked(task);
+    lock.unlock();
+
+    if (owned) Emit(TaskEvent::Kind::Updated, task, task->id);
+}
+
+std::vector<TaskPtr> TaskManager::Search(const std::wstring& query, SearchMode mode, uint32_t fields, size_t limit) {
+    std::vector<TaskPtr> found;
+    {
+        std::shared_lock lock(mutex);
+        if (searchBuilt) return search.Search(query, mode, fields, limit);
+
+        // Индекс еще не готов: перебор по списку задач, UI не ждет сборки
+        for (const auto& t : tasks) {
+            if (!TaskSearchIndex::Matches(*t, query, mode, fields)) continue;
+            found.push_back(t);
+            if (limit && found.size() == limit) break;
+        }
+        if (searchBuilding) return found;
+    }
+
+    std::lock_guard start(searchBuildMtx);
+    std::vector<TaskPtr> snapshot;
+    uint64_t generation = 0;
+    {
+        std::unique_lock lock(mutex);
+        if (searchBuilt || searchBuilding) return found;
+        searchBuilding = true;
+        snapshot = tasks;
+        generation = searchGeneration;
+    }
+    if (searchBuilder.joinable()) searchBuilder.join();   // сборка до LoadFrom, ее результат отброшен
+    searchBuilder = std::thread([this, snapshot = std::move(snapshot), generation]() mutable {
+        BuildSearchIndex(std::move(snapshot), generation);
+    });
+    return found;
+}
+
+void TaskManager::BuildSearchIndex(std::vector<TaskPtr> snapshot, uint64_t generation) {
+    auto start = std::chrono::steady_clock::now();
+    TaskSearchIndex built;
+    built.Rebuild(snapshot);
+    snapshot.clear();
+
+    std::unique_lock lock(mutex);
+    if (generation != searchGeneration) return;   // список заменен целиком - соберет следующий Search
+
+    // Изменения за время сборки: по id берется текущий объект задачи
+    for (const auto& id : searchPending) {
+        auto row = hot.slotById.find(id);
+        if (row != hot.slotById.end()) built.Add(hot.owner[row->second]);
+        else built.Remove(id);
+    }
+    searchPending.clear();
+    search = std::move(built);
+    searchBuilt = true;
+    searchBuilding = false;
+    auto stats = search.GetStats();
+    lock.unlock();
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    g_Logger.Log(LogLevel::Info, L"TaskManager",
+        L"Search index built: tasks=" + std::to_wstring(stats.liveDocs) +
+        L" | trigrams=" + std::to_wstring(stats.trigrams) +
+        L" | postingKB=" + std::to_wstring(stats.postingBytes / 1024) +
+        L" | " + std::to_wstring(ms) + L" ms");
+}
+
+void TaskManager::SearchAddLocked(const TaskPtr& task) {
+    if (searchBuilt) search.Add(task);
+    else if (searchBuilding) searchPending.emplace_back(task->id);
+}
+
+void TaskManager::SearchRemoveLocked(std::wstring_view id) {
+    if (searchBuilt) search.Remove(id);
+    else if (searchBuilding) searchPending.emplace_back(id);
+}
+
+void TaskManager::RecalculateWallClockTasks() {
+    LATENCY_SCOPE("TaskManager::RecalculateWallClockTasks");
+    std::unique_lock lock(mutex);
+    const size_t rows = hot.owner.size();
+    for (size_t i = 0; i < rows; ++i) {
+        if (!((hot.enabledBits[i >> 6] >> (i & 63)) & 1)) continue;
+        auto type = (TriggerType)hot.trigger[i];
+        if (type == TriggerType::ONCE || type == TriggerType::DAILY || type == TriggerType::WEEKLY)
+            CalculateNextRunLocked(hot.owner[i]);
+    }
+    lock.unlock();
+
+    Emit(TaskEvent::Kind::Reset, nullptr, std::wstring());
 }
 
+// Правки (unsavedEdits) меняются только под unique-блокировкой, поэтому пока Save держит
+// shared-блокировку, к ним добавиться ничего не может
 void TaskManager::Save() {
+    if (!persistence) return;
     std::shared_lock lock(mutex);
-    persistence->Save(tasks);
+    std::lock_guard<std::mutex> save(saveMtx);
+    bool ok = saveOwns ? persistence->SaveMerged(tasks, saveOwns, unsavedEdits) : persistence->Save(tasks);
+    if (ok) unsavedEdits.clear();
+}
+
+void TaskManager::SetSaveFilter(OwnsFn owns) {
+    std::unique_lock lock(mutex);
+    saveOwns = std::move(owns);
 }
 
 void TaskManager::Load() {
-    auto loaded = persistence->Load();
+    if (!persistence) return;
+    LoadFrom(persistence->Load());
+}
 
+void TaskManager::LoadFrom(std::vector<TaskPtr> loaded) {
+    LATENCY_SCOPE("TaskManager::LoadFrom");
+    size_t restored = 0, assigned = 0, released = 0;
     {
         std::unique_lock lock(mutex);
-        tasks = loaded;
+        tasks = std::move(loaded);
 
         for (auto& t : tasks) {
             if (t->id.empty())
                 t->id = util::GenerateGUID();
-            CalculateNextRun(t);
+        }
+
+        // Состояние выполнения - из слотов runtime.dat. Срок из файла читаем до HotRebuild:
+        // HotSync перезапишет слот текущими полями задачи
+        std::vector<std::pair<TaskPtr, std::chrono::system_clock::time_point>> persisted;
+        if (runtime) {
+            std::vector<uint32_t> live;
+            live.reserve(tasks.size());
+            for (auto& t : tasks) {
+                RuntimeState::Record rec;
+                if (t->stateSlot != RuntimeState::kNoSlot && runtime->Read(t->stateSlot, t->id, rec)) {
+                    t->lastRunTime = rec.lastRunTime;
+                    t->lastExitCode = rec.lastExitCode;
+                    persisted.emplace_back(t, rec.nextRunTime);
+                    live.push_back(t->stateSlot);
+                    ++restored;
+                }
+                else {
+                    t->stateSlot = RuntimeState::kNoSlot;
+                }
+            }
+            // Слоты задач, удаленных без сохранения tasks.json, - до выдачи новых
+            released = runtime->FreeUnreferenced(live);
+            for (auto& t : tasks) {
+                if (t->stateSlot != RuntimeState::kNoSlot) continue;
+                t->stateSlot = runtime->Allocate(t->id);
+                if (t->stateSlot != RuntimeState::kNoSlot) ++assigned;
+            }
+        }
+
+        HotRebuildLocked();
+        for (auto& t : tasks)
+            CalculateNextRunLocked(t);
+        for (auto& [t, next] : persisted)
+            ApplyMissedRunLocked(t, next);
+        search.Clear();
+        searchBuilt = false;
+        searchBuilding = false;
+        searchPending.clear();
+        ++searchGeneration;
+        ++version;
+    }
+
+    if (runtime) {
+        g_Logger.Log(LogLevel::Info, L"TaskManager",
+            L"Runtime state: restored=" + std::to_wstring(restored) +
+            L" | assigned=" + std::to_wstring(assigned) +
+            L" | released=" + std::to_wstring(released));
+    }
+    if (assigned) Save();   // номера новых слотов - в tasks.json
+
+    Emit(TaskEvent::Kind::Reset, nullptr, std::wstring());
+    if (onChange) onChange();
+}
+
+// Срок из runtime.dat прошел, пока планировщик не работал. runIfMissed - один запуск сразу
+// (как у ONCE); иначе INTERVAL продолжает свою сетку от прошлого срока, а DAILY/WEEKLY
+// уже получили следующий срок по расписанию в CalculateNextRunLocked
+void TaskManager::ApplyMissedRunLocked(const TaskPtr& task, std::chrono::system_clock::time_point persistedNext) {
+    using namespace std::chrono;
+    if (!task->enabled || persistedNext.time_since_epoch().count() == 0) return;
+    if (task->triggerType != TriggerType::INTERVAL && task->triggerType != TriggerType::DAILY &&
+        task->triggerType != TriggerType::WEEKLY) return;
+
+    auto now = clock->Now();
+    if (persistedNext > now) {
+        if (task->triggerType != TriggerType::INTERVAL) return;
+        task->nextRunTime = persistedNext;   // сетка не сдвигается от перезапуска
+    }
+    else if (task->runIfMissed) {
+        task->nextRunTime = now;
+    }
+    else if (task->triggerType == TriggerType::INTERVAL) {
+        auto period = duration_cast<system_clock::duration>(minutes(std::max<uint32_t>(task->intervalMinutes, 1)));
+        task->nextRunTime = persistedNext + period * ((now - persistedNext) / period + 1);
+    }
+    else {
+        return;
+    }
+    HotSyncLocked(task);
+}
+
+void TaskManager::StartStoreWatch() {
+    if (!persistence || storeWatcher) return;
+    storeWatcher = new StoreWatcher(persistence->Path(), [this](const StoreStamp& stamp) {
+        if (stamp == persistence->LastStamp()) return;   // наш же Save
+        ReloadFromStore();
+    });
+    if (!storeWatcher->Start()) {
+        delete storeWatcher;
+        storeWatcher = nullptr;
+    }
+}
+
+void TaskManager::StopStoreWatch() {
+    delete storeWatcher;   // ~StoreWatcher дожидается потока
+    storeWatcher = nullptr;
+}
+
+// Новая задача дописывается (со своим слотом runtime.dat), задача с тем же id заменяется
+// и продолжает историю прежней. position - индекс tasks по id, строится при первой замене
+bool TaskManager::UpsertLocked(const TaskPtr& task, TaskIdMap<size_t>& position,
+    std::vector<TaskEvent>& events) {
+    auto row = hot.slotById.find(task->id);
+    if (row == hot.slotById.end()) {
+        if (runtime) task->stateSlot = runtime->Allocate(task->id);
+        if (!position.empty()) TaskIdEntry(position, task->id) = tasks.size();
+        tasks.push_back(task);
+        HotAppendLocked(task);
+        SearchAddLocked(task);
+        CalculateNextRunLocked(task);
+        events.push_back(TaskEvent{ TaskEvent::Kind::Added, task, std::wstring(task->id) });
+        return true;
+    }
+
+    const TaskPtr& cur = hot.owner[row->second];
+    if (cur == task || SameDefinition(*cur, *task)) return false;   // и объект, и его состояние остаются
+
+    if (position.size() != tasks.size()) {
+        position.clear();
+        position.reserve(tasks.size());
+        for (size_t i = 0; i < tasks.size(); ++i) TaskIdEntry(position, tasks[i]->id) = i;
+    }
+    CopyRuntimeState(*cur, *task);
+    tasks[position.find(task->id)->second] = task;
+    hot.owner[row->second] = task;
+    CalculateNextRunLocked(task);
+    SearchAddLocked(task);
+    events.push_back(TaskEvent{ TaskEvent::Kind::Updated, task, std::wstring(task->id) });
+    return true;
+}
+
+void TaskManager::ImportBatch(const std::vector<TaskPtr>& batch, size_t& added, size_t& updated) {
+    LATENCY_SCOPE("TaskManager::ImportBatch");
+    std::vector<TaskEvent> events;
+    {
+        std::unique_lock lock(mutex);
+        TaskIdMap<size_t> position;
+        for (auto& t : batch) {
+            if (t->id.empty()) t->id = util::GenerateGUID();
+            if (!UpsertLocked(t, position, events)) continue;
+            TaskIdEntry(unsavedEdits, t->id) = true;
+            if (events.back().kind == TaskEvent::Kind::Added) ++added;
+            else ++updated;
+        }
+        if (!events.empty()) {
+            if (CompactSnapshotsLocked()) events.push_back(TaskEvent{ TaskEvent::Kind::Reset, nullptr, std::wstring() });
+            ++version;
         }
     }
+    if (events.empty()) return;
 
+    for (auto& e : events) Emit(e.kind, e.task, e.id);
     if (onChange) onChange();
 }
 
+// Поток наблюдателя. Разбор - без блокировки списка; под блокировкой - только сравнение по id
+void TaskManager::ReloadFromStore() {
+    LATENCY_SCOPE("TaskManager::ReloadFromStore");
+    auto start = std::chrono::steady_clock::now();
+    // Без арены: неизмененные записи сразу отбрасываются, принятые не держат весь снимок
+    std::vector<TaskPtr> loaded = persistence->Load(false);
+    if (!persistence->GetLastLoadStats().valid) {
+        // Файл недописан или испорчен: список не трогаем, следующая запись придет новым событием
+        g_Logger.Log(LogLevel::Warn, L"TaskManager", L"tasks.json changed but could not be parsed - ignored");
+        return;
+    }
+
+    std::vector<TaskEvent> events;
+    size_t total = 0, added = 0, updated = 0, removed = 0;
+    bool assigned = false;
+    {
+        std::unique_lock lock(mutex);
+
+        TaskIdMap<TaskPtr> incoming;
+        incoming.reserve(loaded.size());
+        for (auto& t : loaded) TaskIdEntry(incoming, t->id) = t;   // повтор id - побеждает последний
+        total = incoming.size();
+
+        std::vector<TaskPtr> kept;
+        kept.reserve(loaded.size());
+        for (auto& cur : tasks) {
+            if (incoming.count(cur->id)) {
+                kept.push_back(cur);
+                continue;
+            }
+            if (runtime) runtime->Free(cur->stateSlot);
+            HotRemoveLocked(cur->id);
+            SearchRemoveLocked(cur->id);
+            events.push_back(TaskEvent{ TaskEvent::Kind::Removed, nullptr, std::wstring(cur->id) });
+            ++removed;
+        }
+        tasks.swap(kept);
+
+        TaskIdMap<size_t> position;
+        for (auto& t : loaded) {
+            if (incoming.find(t->id)->second != t || !UpsertLocked(t, position, events)) continue;
+            if (events.back().kind == TaskEvent::Kind::Added) ++added;
+            else ++updated;
+        }
+        assigned = added && runtime;
+
+        if (!events.empty()) {
+            // Снимок запуска после внешней правки уже с дырами и дальше только редеет:
+            // оставшиеся задачи переезжают в кучу целиком, один раз
+            if (CompactSnapshotsLocked(true)) events.push_back(TaskEvent{ TaskEvent::Kind::Reset, nullptr, std::wstring() });
+            ++version;
+        }
+    }
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    g_Logger.Log(LogLevel::Info, L"TaskManager",
+        L"tasks.json reloaded: added=" + std::to_wstring(added) +
+        L" | updated=" + std::to_wstring(updated) +
+        L" | removed=" + std::to_wstring(removed) +
+        L" | unchanged=" + std::to_wstring(total - added - updated) +
+        L" | " + std::to_wstring(ms) + L" ms");
+    if (events.empty()) return;
+
+    if (assigned) Save();   // номера слотов новых задач
+    for (auto& e : events) Emit(e.kind, e.task, e.id);
+    if (onChange) onChange();   // одно уведомление на всю пачку
+}
+
 void TaskManager::SetOnChange(OnChangeFn fn) {
     onChange = fn;
+}
+
+void TaskManager::SetOnTaskEvent(TaskEventFn fn) {
+    std::lock_guard<std::mutex> lk(eventMtx);
+    onTaskEvent = std::move(fn);
 }
\ No newline at end of file
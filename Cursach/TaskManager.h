@@ -1,12 +1,32 @@
-#pragma once
+﻿#pragma once
 #include "Task.h"
+#include "Clock.h"
+#include "TaskSearchIndex.h"
 #include <vector>
+#include <set>
+#include <utility>
 #include <shared_mutex>
 #include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// What changed in TaskManager. Reset: the whole list was reloaded or many tasks changed at once.
+struct TaskEvent {
+    enum class Kind { Added, Removed, Updated, Reset };
+    Kind kind;
+    TaskPtr task;       // Added/Updated
+    std::wstring id;    // Added/Removed/Updated
+};
 
 class TaskManager {
 public:
-    TaskManager();
+    // clock: source of "now" for next-run calculation. persistent = false keeps the list
+    // in memory only (simulation): nothing is read from or written to tasks.json.
+    explicit TaskManager(const Clock& clock = Clock::System(), bool persistent = true);
     ~TaskManager();
 
     std::vector<TaskPtr> GetAllTasks(); // copy of shared_ptrs
@@ -18,17 +38,112 @@ public:
     // Compute nextRunTime for a specific task (thread-safe call)
     void CalculateNextRun(const TaskPtr& task);
 
-    // Save/load
+    // Scheduling hot path: walks the deadline-ordered index from the front, never the Task nodes;
+    // cost is O(due + log n), not O(n). due comes out in deadline order. owns (optional) filters
+    // by id, e.g. shard ownership; nextDeadline = {} if nothing is pending.
+    using OwnsFn = std::function<bool(std::wstring_view id)>;
+    void CollectDue(std::chrono::system_clock::time_point now, const OwnsFn& owns,
+        std::vector<TaskPtr>& due, std::chrono::system_clock::time_point& nextDeadline);
+
+    // Changes to scheduling fields made outside CalculateNextRun/UpdateTask must go through here
+    void SetNextRun(const TaskPtr& task, std::chrono::system_clock::time_point tp);
+    void Disable(const TaskPtr& task);
+
+    // A run finished (lastRunTime/lastExitCode changed): rewrites the task's runtime.dat slot
+    // in place instead of the whole tasks.json
+    void StoreRuntime(const TaskPtr& task);
+
+    // Case-insensitive substring/prefix search over name, description and exePath.
+    // The trigram index is built in the background on first use, then kept in step with
+    // add/update/remove; until it is ready, queries scan the list instead of waiting.
+    std::vector<TaskPtr> Search(const std::wstring& query, SearchMode mode = SearchMode::Substring,
+        uint32_t fields = SEARCH_ALL, size_t limit = 0);
+
+    // Recalculates ONCE/DAILY/WEEKLY after a clock or time zone change
+    void RecalculateWallClockTasks();
+
+    // Grows on add/remove/update/load - lets the scheduler skip rereading the full list
+    uint64_t Version() const { return version.load(); }
+
+    // Save/load. Без фильтра tasks.json переписывается списком целиком. С фильтром (шардирование)
+    // Save сливает: пишутся задачи, для которых owns(id), и правки этого экземпляра (Add/Update/
+    // Remove/Import) с последнего сохранения; остальные записи остаются такими, какими их сохранил
+    // владелец шарда
     void Save();
+    void SetSaveFilter(OwnsFn owns);
     void Load();
+    // Replaces the whole list without touching tasks.json (simulation input)
+    void LoadFrom(std::vector<TaskPtr> loaded);
+
+    // Live reload: tasks.json changed by another writer (configuration management, another
+    // instance) is reparsed on the watcher thread and only the difference by id is applied.
+    // Unchanged tasks keep their runtime state; own saves are recognised and skipped.
+    // Stop before the onChange/onTaskEvent listeners go away.
+    void StartStoreWatch();
+    void StopStoreWatch();
+
+    // Bulk import: one lock, one version bump and one onChange per batch. A task whose id exists
+    // replaces it and keeps its runtime state; identical definitions are skipped. Counts are
+    // added to added/updated. Not saved - the caller saves once after the last batch.
+    void ImportBatch(const std::vector<TaskPtr>& batch, size_t& added, size_t& updated);
 
     // Notification callback when tasks change (scheduler listens)
     using OnChangeFn = std::function<void()>;
     void SetOnChange(OnChangeFn fn);
 
+    // Per-task change events (view model). Delivered after the change, outside the task lock,
+    // on the thread that made it; listeners must not call back into mutating methods.
+    using TaskEventFn = std::function<void(const TaskEvent&)>;
+    void SetOnTaskEvent(TaskEventFn fn);
+
 private:
+    // Hot scheduling state (structure-of-arrays). Row i describes hot.owner[i]; row order
+    // differs from tasks (removal swaps the last row in). Task nodes with strings are the cold part.
+    struct HotStore {
+        std::vector<uint64_t> enabledBits;   // 1 бит на строку
+        std::vector<uint8_t>  trigger;       // TriggerType
+        std::vector<int64_t>  nextRunMs;     // мс от эпохи system_clock, 0 - не запланирована
+        std::vector<TaskPtr>  owner;
+        TaskIdMap<uint32_t> slotById;
+        // (nextRunMs, row) включенных запланированных строк - по возрастанию срока
+        std::set<std::pair<int64_t, uint32_t>> schedule;
+    };
+
+    bool CalculateNextRunLocked(const TaskPtr& task);   // true - задача из списка (не копия)
+    void HotAppendLocked(const TaskPtr& task);
+    void HotRemoveLocked(std::wstring_view id);
+    bool HotSyncLocked(const TaskPtr& task);
+    void HotRebuildLocked();
+    void ApplyMissedRunLocked(const TaskPtr& task, std::chrono::system_clock::time_point persistedNext);
+    void ReloadFromStore();
+    bool UpsertLocked(const TaskPtr& task, TaskIdMap<size_t>& position,
+        std::vector<TaskEvent>& events);
+    bool ScheduledLocked(uint32_t slot) const;
+    bool CompactSnapshotsLocked(bool all = false);   // true - объекты задач заменены копиями
+    void BuildSearchIndex(std::vector<TaskPtr> snapshot, uint64_t generation);
+    void SearchAddLocked(const TaskPtr& task);
+    void SearchRemoveLocked(std::wstring_view id);
+    void Emit(TaskEvent::Kind kind, const TaskPtr& task, std::wstring_view id);
+
     std::vector<TaskPtr> tasks;
+    HotStore hot;
+    TaskSearchIndex search;
+    bool searchBuilt = false;     // до первого Search индекс не ведется
+    bool searchBuilding = false;  // идет фоновая сборка; изменения копятся в searchPending
+    std::vector<std::wstring> searchPending;   // id, измененные во время сборки
+    uint64_t searchGeneration = 0;             // растет при замене списка (LoadFrom)
+    std::mutex searchBuildMtx;                 // запуск и ожидание searchBuilder
+    std::thread searchBuilder;
+    std::atomic<uint64_t> version{ 0 };
     mutable std::shared_mutex mutex;
+    OwnsFn saveOwns;                  // не пусто - Save сливает (SaveMerged)
+    TaskIdMap<bool> unsavedEdits;     // правки с последнего Save: true - задача есть, false - удалена
+    std::mutex saveMtx;               // Save идет под shared-блокировкой; сериализует unsavedEdits
     OnChangeFn onChange;
-    class Persistence* persistence;
+    std::mutex eventMtx;          // сериализует доставку и смену слушателя
+    TaskEventFn onTaskEvent;
+    const Clock* clock;
+    class Persistence* persistence;   // nullptr - список только в памяти
+    class RuntimeState* runtime;      // runtime.dat; nullptr - вместе с persistence или не открылся
+    class StoreWatcher* storeWatcher = nullptr;
 };
@@ -0,0 +1,264 @@
+﻿#include "TaskSearchIndex.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+    constexpr wchar_t kFieldStart = L'\x1';   // маркер начала поля (префиксные триграммы)
+
+    // Регистр: ASCII и кириллица (включая Ё) - без зависимости от локали процесса
+    inline wchar_t Fold(wchar_t c) {
+        if (c >= L'A' && c <= L'Z') return c + (L'a' - L'A');
+        if (c >= 0x0410 && c <= 0x042F) return c + 0x20;
+        if (c == 0x0401) return 0x0451;
+        return c;
+    }
+
+    std::wstring FoldAll(std::wstring_view s) {
+        std::wstring out(s.size(), L'\0');
+        for (size_t i = 0; i < s.size(); ++i) out[i] = Fold(s[i]);
+        return out;
+    }
+
+    inline uint64_t Key(uint32_t field, wchar_t a, wchar_t b, wchar_t c) {
+        return ((uint64_t)field << 48) | ((uint64_t)(uint16_t)a << 32) | ((uint64_t)(uint16_t)b << 16) | (uint16_t)c;
+    }
+
+    std::wstring_view FieldText(const Task& t, uint32_t field) {
+        switch (field) {
+        case 0:  return t.name;
+        case 1:  return t.description;
+        default: return t.exePath.str();
+        }
+    }
+
+    bool FieldMatches(std::wstring_view text, std::wstring_view folded, SearchMode mode) {
+        if (folded.size() > text.size()) return false;
+        size_t lastStart = mode == SearchMode::Prefix ? 0 : text.size() - folded.size();
+        for (size_t start = 0; start <= lastStart; ++start) {
+            size_t i = 0;
+            while (i < folded.size() && Fold(text[start + i]) == folded[i]) ++i;
+            if (i == folded.size()) return true;
+        }
+        return false;
+    }
+
+} // namespace
+
+void TaskSearchIndex::Clear() {
+    postings_.clear();
+    docs_.clear();
+    docById_.clear();
+    live_ = 0;
+}
+
+void TaskSearchIndex::Rebuild(const std::vector<TaskPtr>& tasks) {
+    Clear();
+    docs_.reserve(tasks.size());
+    docById_.reserve(tasks.size());
+    for (const auto& t : tasks) {
+        if (t) Insert(t);
+    }
+}
+
+void TaskSearchIndex::Append(uint64_t key, uint32_t doc) {
+    Posting& p = postings_[key];
+    if (p.count && p.last == doc) return;   // триграмма повторяется в поле
+
+    uint32_t delta = doc - p.last;
+    while (delta >= 0x80) {
+        p.bytes.push_back((uint8_t)(delta | 0x80));
+        delta >>= 7;
+    }
+    p.bytes.push_back((uint8_t)delta);
+    p.last = doc;
+    ++p.count;
+}
+
+void TaskSearchIndex::Index(uint32_t doc, const Task& task) {
+    for (uint32_t field = 0; field < 3; ++field) {
+        std::wstring_view text = FieldText(task, field);
+        wchar_t a = kFieldStart, b = kFieldStart;
+        for (wchar_t ch : text) {
+            wchar_t c = Fold(ch);
+            Append(Key(field, a, b, c), doc);
+            a = b;
+            b = c;
+        }
+    }
+}
+
+void TaskSearchIndex::Insert(const TaskPtr& task) {
+    auto it = docById_.find(task->id);
+    if (it != docById_.end()) {
+        docs_[it->second] = nullptr;
+        --live_;
+    }
+
+    uint32_t doc = (uint32_t)docs_.size();
+    docs_.push_back(task);
+    docById_[std::wstring(task->id)] = doc;
+    ++live_;
+    Index(doc, *task);
+}
+
+void TaskSearchIndex::Add(const TaskPtr& task) {
+    Insert(task);
+    CompactIfSparse();   // правки одних и тех же задач копят удаленные номера так же, как удаления
+}
+
+void TaskSearchIndex::Remove(std::wstring_view id) {
+    auto it = docById_.find(id);
+    if (it == docById_.end()) return;
+    docs_[it->second] = nullptr;
+    docById_.erase(it);
+    --live_;
+    CompactIfSparse();
+}
+
+void TaskSearchIndex::CompactIfSparse() {
+    // Больше половины номеров - удаленные: списки раздуты, пересобираем
+    if (docs_.size() >= 1024 && live_ * 2 < docs_.size()) {
+        std::vector<TaskPtr> alive;
+        alive.reserve(live_);
+        for (auto& t : docs_) {
+            if (t) alive.push_back(t);
+        }
+        Rebuild(alive);
+    }
+}
+
+void TaskSearchIndex::Decode(const Posting& p, std::vector<uint32_t>& out) const {
+    out.clear();
+    out.reserve(p.count);
+    uint32_t doc = 0;
+    const uint8_t* s = p.bytes.data();
+    const uint8_t* end = s + p.bytes.size();
+    while (s < end) {
+        uint32_t delta = 0;
+        int shift = 0;
+        while (*s & 0x80) {
+            delta |= (uint32_t)(*s++ & 0x7F) << shift;
+            shift += 7;
+        }
+        delta |= (uint32_t)*s++ << shift;
+        doc += delta;
+        out.push_back(doc);
+    }
+}
+
+void TaskSearchIndex::Intersect(const Posting& p, std::vector<uint32_t>& candidates) const {
+    size_t kept = 0, i = 0;
+    uint32_t doc = 0;
+    const uint8_t* s = p.bytes.data();
+    const uint8_t* end = s + p.bytes.size();
+    while (s < end && i < candidates.size()) {
+        uint32_t delta = 0;
+        int shift = 0;
+        while (*s & 0x80) {
+            delta |= (uint32_t)(*s++ & 0x7F) << shift;
+            shift += 7;
+        }
+        delta |= (uint32_t)*s++ << shift;
+        doc += delta;
+
+        while (i < candidates.size() && candidates[i] < doc) ++i;
+        if (i < candidates.size() && candidates[i] == doc) candidates[kept++] = candidates[i++];
+    }
+    candidates.resize(kept);
+}
+
+void TaskSearchIndex::SearchOneField(std::wstring_view folded, SearchMode mode, uint32_t field,
+    size_t limit, std::vector<uint32_t>& out) const {
+    const size_t stopAt = limit ? out.size() + limit : SIZE_MAX;
+    std::vector<uint32_t> candidates;
+
+    if (mode == SearchMode::Substring && folded.size() < 3) {
+        // Короткое вхождение триграммами не выразить - перебор
+        for (uint32_t d = 0; d < docs_.size(); ++d) {
+            if (docs_[d] && FieldMatches(FieldText(*docs_[d], field), folded, mode)) {
+                out.push_back(d);
+                if (out.size() == stopAt) break;
+            }
+        }
+        return;
+    }
+
+    std::wstring padded;
+    if (mode == SearchMode::Prefix) padded.assign(2, kFieldStart);
+    padded.append(folded);
+
+    std::vector<const Posting*> lists;
+    for (size_t i = 0; i + 3 <= padded.size(); ++i) {
+        auto it = postings_.find(Key(field, padded[i], padded[i + 1], padded[i + 2]));
+        if (it == postings_.end()) return;   // триграммы нет ни у одной задачи
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](const Posting* a, const Posting* b) {
+        return a->count != b->count ? a->count < b->count : a < b;
+    });
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+    // Пересекаем, пока это дешевле проверки: распаковка длинного списка ради
+    // немногих кандидатов стоит больше, чем сравнить их поля напрямую
+    Decode(*lists[0], candidates);
+    for (size_t i = 1; i < lists.size() && candidates.size() > kVerifyThreshold; ++i) {
+        if (lists[i]->count > candidates.size() * kIntersectRatio) break;
+        Intersect(*lists[i], candidates);
+    }
+
+    for (uint32_t d : candidates) {
+        if (docs_[d] && FieldMatches(FieldText(*docs_[d], field), folded, mode)) {
+            out.push_back(d);
+            if (out.size() == stopAt) break;
+        }
+    }
+}
+
+std::vector<TaskPtr> TaskSearchIndex::Search(std::wstring_view query, SearchMode mode, uint32_t fields, size_t limit) const {
+    std::vector<TaskPtr> result;
+    std::wstring folded = FoldAll(query);
+
+    std::vector<uint32_t> docs;
+    if (folded.empty()) {
+        for (uint32_t d = 0; d < docs_.size(); ++d) {
+            if (docs_[d]) docs.push_back(d);
+        }
+    }
+    else {
+        int searched = 0;
+        for (uint32_t field = 0; field < 3; ++field) {
+            if (!(fields & (1u << field))) continue;
+            // Первые limit номеров объединения лежат среди первых limit номеров каждого поля
+            SearchOneField(folded, mode, field, limit, docs);
+            ++searched;
+        }
+        if (searched > 1) {
+            std::sort(docs.begin(), docs.end());
+            docs.erase(std::unique(docs.begin(), docs.end()), docs.end());
+        }
+    }
+
+    size_t n = limit ? (std::min)(limit, docs.size()) : docs.size();
+    result.reserve(n);
+    for (size_t i = 0; i < n; ++i) result.push_back(docs_[docs[i]]);
+    return result;
+}
+
+bool TaskSearchIndex::Matches(const Task& task, std::wstring_view query, SearchMode mode, uint32_t fields) {
+    std::wstring folded = FoldAll(query);
+    if (folded.empty()) return true;
+    for (uint32_t field = 0; field < 3; ++field) {
+        if ((fields & (1u << field)) && FieldMatches(FieldText(task, field), folded, mode)) return true;
+    }
+    return false;
+}
+
+TaskSearchIndex::Stats TaskSearchIndex::GetStats() const {
+    Stats s;
+    s.docs = docs_.size();
+    s.liveDocs = live_;
+    s.trigrams = postings_.size();
+    for (const auto& [key, p] : postings_) s.postingBytes += p.bytes.size();
+    return s;
+}
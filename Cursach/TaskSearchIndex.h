@@ -0,0 +1,82 @@
+﻿#pragma once
+#include "Task.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Поля, по которым ищет TaskSearchIndex
+enum SearchField : uint32_t {
+    SEARCH_NAME = 1,
+    SEARCH_DESCRIPTION = 2,
+    SEARCH_EXE = 4,
+    SEARCH_ALL = 7
+};
+
+enum class SearchMode {
+    Substring,   // вхождение в любом месте поля
+    Prefix       // поле начинается с запроса
+};
+
+// Триграммный инвертированный индекс по name, description и exePath (без учета регистра).
+//
+// Ключ - (поле, три символа UTF-16). Начало поля дополняется двумя маркерами, поэтому
+// префиксные запросы из 1-2 символов тоже идут через индекс. Списки документов -
+// возрастающие номера, дельты в varint; номер документа только растет, так что вставка -
+// дописывание в конец списка. Удаление и изменение задачи помечают старый номер удаленным
+// (изменение добавляет новый); при избытке удаленных индекс пересобирается.
+//
+// Запрос: пересечение списков от самого короткого, пока кандидатов больше kVerifyThreshold
+// и следующий список не слишком длинный, затем проверка кандидатов по самим полям задачи -
+// ложных совпадений в выдаче нет.
+// Вхождения короче трех символов проверяются перебором.
+//
+// Не потокобезопасен - TaskManager вызывает его под своей блокировкой.
+class TaskSearchIndex {
+public:
+    struct Stats {
+        size_t docs = 0;          // выданных номеров (вместе с удаленными)
+        size_t liveDocs = 0;
+        size_t trigrams = 0;
+        size_t postingBytes = 0;
+    };
+
+    void Clear();
+    void Rebuild(const std::vector<TaskPtr>& tasks);
+    void Add(const TaskPtr& task);            // новая задача или замена задачи с тем же id
+    void Remove(std::wstring_view id);
+
+    // Результат - в порядке добавления; limit = 0 - без ограничения
+    std::vector<TaskPtr> Search(std::wstring_view query, SearchMode mode,
+        uint32_t fields = SEARCH_ALL, size_t limit = 0) const;
+
+    // Та же проверка, что и при поиске, - для одной задачи (фильтр представления)
+    static bool Matches(const Task& task, std::wstring_view query, SearchMode mode, uint32_t fields = SEARCH_ALL);
+
+    Stats GetStats() const;
+
+private:
+    static constexpr size_t kVerifyThreshold = 64;
+    static constexpr size_t kIntersectRatio = 16;   // список длиннее кандидатов в 16 раз - уже проверка
+
+    struct Posting {
+        std::vector<uint8_t> bytes;   // дельты номеров документов, varint
+        uint32_t count = 0;
+        uint32_t last = 0;
+    };
+
+    void Insert(const TaskPtr& task);
+    void CompactIfSparse();
+    void Index(uint32_t doc, const Task& task);
+    void Append(uint64_t key, uint32_t doc);
+    void Decode(const Posting& p, std::vector<uint32_t>& out) const;
+    void Intersect(const Posting& p, std::vector<uint32_t>& candidates) const;
+    void SearchOneField(std::wstring_view folded, SearchMode mode, uint32_t field, size_t limit,
+        std::vector<uint32_t>& out) const;
+
+    std::unordered_map<uint64_t, Posting> postings_;
+    std::vector<TaskPtr> docs_;                          // номер -> задача, nullptr - удален
+    TaskIdMap<uint32_t> docById_;
+    size_t live_ = 0;
+};
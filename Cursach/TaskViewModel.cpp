@@ -0,0 +1,365 @@
+﻿#include "TaskViewModel.h"
+#include <algorithm>
+#include <climits>
+
+TaskViewModel::TaskViewModel(TaskManager* tm) : tm_(tm) {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        ResetLocked(tm_->GetAllTasks());
+    }
+    tm_->SetOnTaskEvent([this](const TaskEvent& e) { OnTaskEvent(e); });
+}
+
+TaskViewModel::~TaskViewModel() {
+    // Дожидается доставки текущего события, если оно идет в другом потоке
+    tm_->SetOnTaskEvent(nullptr);
+}
+
+void TaskViewModel::SetOnChanged(std::function<void()> fn) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    std::lock_guard<std::mutex> ql(queueMtx_);
+    onChanged_ = fn;
+    onQueued_ = std::move(fn);
+}
+
+void TaskViewModel::Snapshot(Entry& e, const TaskPtr& task) {
+    e.row.task = task;
+    e.row.name = task->name;
+    e.row.enabled = task->enabled;
+    e.row.trigger = task->triggerType;
+    e.row.nextRunTime = task->nextRunTime;
+    e.nextRunKey = task->nextRunTime.time_since_epoch().count() == 0
+        ? INT64_MAX : (int64_t)task->nextRunTime.time_since_epoch().count();
+    // Одиночные изменения проверяются напрямую - тем же сравнением, что и в индексе
+    e.matches = query_.empty() || TaskSearchIndex::Matches(*task, query_, SearchMode::Substring);
+}
+
+bool TaskViewModel::Less(int index, uint32_t a, uint32_t b) const {
+    const Entry& x = entries_[a];
+    const Entry& y = entries_[b];
+    if (index >= 3 && x.row.enabled != y.row.enabled) return x.row.enabled;   // включенные выше
+
+    switch ((SortKey)(index % 3)) {
+    case SortKey::Name:
+        if (x.row.name != y.row.name) return x.row.name < y.row.name;
+        break;
+    case SortKey::NextRun:
+        if (x.nextRunKey != y.nextRunKey) return x.nextRunKey < y.nextRunKey;
+        break;
+    default:
+        break;
+    }
+    return x.seq < y.seq;
+}
+
+bool TaskViewModel::Visible(uint32_t slot) const {
+    if (!entries_[slot].matches) return false;
+    switch (filter_) {
+    case Filter::Enabled:  return entries_[slot].row.enabled;
+    case Filter::Disabled: return !entries_[slot].row.enabled;
+    default:               return true;
+    }
+}
+
+// Индексы - отсортированные массивы номеров строк; порядок полный (seq уникален),
+// поэтому lower_bound находит строку точно. Сдвиг затрагивает видимые строки от позиции до конца.
+void TaskViewModel::InsertLocked(uint32_t slot) {
+    for (int i = 0; i < kIndexCount; ++i) {
+        auto& idx = index_[i];
+        auto pos = std::lower_bound(idx.begin(), idx.end(), slot,
+            [this, i](uint32_t a, uint32_t b) { return Less(i, a, b); });
+        idx.insert(pos, slot);
+    }
+    if (!Visible(slot)) return;
+
+    const int active = ActiveIndex();
+    auto pos = std::lower_bound(visible_.begin(), visible_.end(), slot,
+        [this, active](uint32_t a, uint32_t b) { return Less(active, a, b); });
+    size_t at = pos - visible_.begin();
+    visible_.insert(pos, slot);
+    MarkLocked(at, visible_.size() - 1, true);
+}
+
+void TaskViewModel::EraseLocked(uint32_t slot) {
+    for (int i = 0; i < kIndexCount; ++i) {
+        auto& idx = index_[i];
+        auto pos = std::lower_bound(idx.begin(), idx.end(), slot,
+            [this, i](uint32_t a, uint32_t b) { return Less(i, a, b); });
+        if (pos != idx.end() && *pos == slot) idx.erase(pos);
+    }
+    if (!Visible(slot)) return;
+
+    const int active = ActiveIndex();
+    auto pos = std::lower_bound(visible_.begin(), visible_.end(), slot,
+        [this, active](uint32_t a, uint32_t b) { return Less(active, a, b); });
+    if (pos == visible_.end() || *pos != slot) return;
+    size_t at = pos - visible_.begin();
+    size_t oldLast = visible_.size() - 1;
+    visible_.erase(pos);
+    MarkLocked(at, oldLast, true);
+}
+
+void TaskViewModel::RebuildVisibleLocked() {
+    const auto& idx = index_[ActiveIndex()];
+    visible_.clear();
+    if (filter_ == Filter::All && query_.empty()) {
+        visible_ = idx;
+    }
+    else {
+        for (uint32_t slot : idx)
+            if (Visible(slot)) visible_.push_back(slot);
+    }
+    MarkLocked(0, SIZE_MAX, true);
+}
+
+void TaskViewModel::MarkLocked(size_t first, size_t last, bool countChanged) {
+    bool wasClean = !pending_.any;
+    if (wasClean) {
+        pending_.first = first;
+        pending_.last = last;
+    }
+    else {
+        pending_.first = (std::min)(pending_.first, first);
+        pending_.last = (std::max)(pending_.last, last);
+    }
+    pending_.any = true;
+    pending_.countChanged = pending_.countChanged || countChanged;
+    if (wasClean && onChanged_ && !draining_) onChanged_();
+}
+
+void TaskViewModel::ResetLocked(const std::vector<TaskPtr>& tasks) {
+    entries_.clear();
+    freeSlots_.clear();
+    slotById_.clear();
+    counters_ = Counters{};
+    nextSeq_ = 0;
+
+    entries_.resize(tasks.size());
+    slotById_.reserve(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        Entry& e = entries_[i];
+        Snapshot(e, tasks[i]);
+        e.seq = nextSeq_++;
+        slotById_[std::wstring(tasks[i]->id)] = (uint32_t)i;
+        ++counters_.total;
+        if (e.row.enabled) ++counters_.enabled;
+    }
+    counters_.disabled = counters_.total - counters_.enabled;
+
+    // Полная сборка - один раз; дальше индексы правятся по событиям
+    SortIndexesLocked();
+    RebuildVisibleLocked();
+}
+
+void TaskViewModel::SortIndexesLocked() {
+    for (int i = 0; i < kIndexCount; ++i) {
+        auto& idx = index_[i];
+        idx.clear();
+        for (size_t s = 0; s < entries_.size(); ++s)
+            if (entries_[s].row.task) idx.push_back((uint32_t)s);   // освобожденные строки - пустые
+        std::sort(idx.begin(), idx.end(), [this, i](uint32_t a, uint32_t b) { return Less(i, a, b); });
+    }
+}
+
+// Поток, изменивший задачу (часто - планировщик): только запись в очередь
+void TaskViewModel::OnTaskEvent(const TaskEvent& e) {
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> ql(queueMtx_);
+        bool wasEmpty = queued_.empty() && !queuedReset_;
+        if (e.kind == TaskEvent::Kind::Reset) {
+            // Все, что было до Reset, перечитается из TaskManager
+            queued_.clear();
+            queuedPos_.clear();
+            queuedReset_ = true;
+        }
+        else {
+            auto pos = queuedPos_.find(e.id);
+            if (pos == queuedPos_.end()) {
+                queuedPos_.emplace(e.id, queued_.size());
+                queued_.emplace_back(e.id, Queued{ e.kind, e.task });
+            }
+            else {
+                Queued& q = queued_[pos->second].second;
+                q.kind = (q.kind == TaskEvent::Kind::Added && e.kind == TaskEvent::Kind::Updated)
+                    ? TaskEvent::Kind::Added : e.kind;
+                q.task = e.task;
+            }
+        }
+        if (wasEmpty) notify = onQueued_;
+    }
+    if (notify) notify();
+}
+
+// bulk: индексы не правятся по одной строке - после пачки они пересортировываются целиком
+void TaskViewModel::ApplyLocked(const std::wstring& id, const Queued& q, bool bulk) {
+    auto it = slotById_.find(id);
+
+    if (q.kind == TaskEvent::Kind::Removed) {
+        if (it == slotById_.end()) return;
+        uint32_t slot = it->second;
+        Entry& entry = entries_[slot];
+        if (!bulk) EraseLocked(slot);
+        --counters_.total;
+        if (entry.row.enabled) --counters_.enabled; else --counters_.disabled;
+        entry = Entry{};
+        freeSlots_.push_back(slot);
+        slotById_.erase(it);
+        return;
+    }
+
+    if (!q.task) return;
+
+    if (it == slotById_.end()) {
+        if (q.kind != TaskEvent::Kind::Added) return;
+        uint32_t slot;
+        if (!freeSlots_.empty()) {
+            slot = freeSlots_.back();
+            freeSlots_.pop_back();
+        }
+        else {
+            slot = (uint32_t)entries_.size();
+            entries_.emplace_back();
+        }
+        Entry& entry = entries_[slot];
+        Snapshot(entry, q.task);
+        entry.seq = nextSeq_++;
+        slotById_[id] = slot;
+        ++counters_.total;
+        if (entry.row.enabled) ++counters_.enabled; else ++counters_.disabled;
+        if (!bulk) InsertLocked(slot);
+        return;
+    }
+
+    // Updated: ключи сортировки не изменились - строка остается на месте
+    uint32_t slot = it->second;
+    Entry& entry = entries_[slot];
+    Entry next = entry;
+    Snapshot(next, q.task);
+
+    if (next.row.name == entry.row.name && next.row.enabled == entry.row.enabled &&
+        next.nextRunKey == entry.nextRunKey && next.matches == entry.matches) {
+        entry = std::move(next);
+        if (bulk || !Visible(slot)) return;
+        const int active = ActiveIndex();
+        auto pos = std::lower_bound(visible_.begin(), visible_.end(), slot,
+            [this, active](uint32_t a, uint32_t b) { return Less(active, a, b); });
+        size_t at = pos - visible_.begin();
+        MarkLocked(at, at, false);
+        return;
+    }
+
+    if (entry.row.enabled) --counters_.enabled; else --counters_.disabled;
+    if (!bulk) EraseLocked(slot);
+    entry = std::move(next);
+    if (entry.row.enabled) ++counters_.enabled; else ++counters_.disabled;
+    if (!bulk) InsertLocked(slot);
+}
+
+void TaskViewModel::SetSort(SortKey key, bool statusFirst) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (key == sortKey_ && statusFirst == statusFirst_) return;
+    sortKey_ = key;
+    statusFirst_ = statusFirst;
+    RebuildVisibleLocked();
+}
+
+void TaskViewModel::SetFilter(Filter filter) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (filter == filter_) return;
+    filter_ = filter;
+    RebuildVisibleLocked();
+}
+
+void TaskViewModel::SetSearch(const std::wstring& query) {
+    // Под mtx_: событие об изменении, которое уже в TaskManager, но еще не доставлено,
+    // придет после и пересчитает matches по новому запросу. TaskManager вызывает
+    // обработчик событий вне своей блокировки, поэтому обратного порядка блокировок нет.
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (query == query_) return;
+
+    // Полный набор совпадений - из триграммного индекса TaskManager, не перебором
+    std::vector<TaskPtr> found;
+    if (!query.empty()) found = tm_->Search(query);
+
+    query_ = query;
+    for (auto& e : entries_) e.matches = query_.empty();
+    for (const auto& t : found) {
+        auto it = slotById_.find(t->id);
+        if (it != slotById_.end()) entries_[it->second].matches = true;
+    }
+    RebuildVisibleLocked();
+}
+
+void TaskViewModel::Reload() {
+    {
+        std::lock_guard<std::mutex> ql(queueMtx_);
+        queued_.clear();
+        queuedPos_.clear();
+        queuedReset_ = false;
+    }
+    auto tasks = tm_->GetAllTasks();
+    std::lock_guard<std::mutex> lk(mtx_);
+    ResetLocked(tasks);
+}
+
+size_t TaskViewModel::Count() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return visible_.size();
+}
+
+bool TaskViewModel::RowAt(size_t index, Row& out) const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (index >= visible_.size()) return false;
+    out = entries_[visible_[index]].row;
+    return true;
+}
+
+TaskPtr TaskViewModel::TaskAt(size_t index) const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return index < visible_.size() ? entries_[visible_[index]].row.task : nullptr;
+}
+
+TaskViewModel::Counters TaskViewModel::GetCounters() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return counters_;
+}
+
+// Поток UI: разбор очереди событий, затем диапазон для перерисовки
+TaskViewModel::Changes TaskViewModel::TakeChanges() {
+    std::vector<std::pair<std::wstring, Queued>> batch;
+    bool reset;
+    {
+        std::lock_guard<std::mutex> ql(queueMtx_);
+        batch.swap(queued_);
+        queuedPos_.clear();
+        reset = queuedReset_;
+        queuedReset_ = false;
+    }
+    // Список - вне mtx_, как и в Reload: события приходят вне блокировки TaskManager
+    std::vector<TaskPtr> tasks;
+    if (reset) tasks = tm_->GetAllTasks();
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    draining_ = true;
+    if (reset) ResetLocked(tasks);
+    if (!batch.empty()) {
+        // Каждая строка - сдвиг в kIndexCount + 1 массивах: большой пачке дешевле пересортировка
+        const bool bulk = batch.size() * 8 > entries_.size();
+        for (auto& [id, q] : batch) ApplyLocked(id, q, bulk);
+        if (bulk) {
+            SortIndexesLocked();
+            RebuildVisibleLocked();
+        }
+    }
+    draining_ = false;
+
+    Changes c = pending_;
+    pending_ = Changes{};
+    if (c.any) {
+        size_t last = visible_.empty() ? 0 : visible_.size() - 1;
+        c.last = (std::min)(c.last, last);
+        c.first = (std::min)(c.first, c.last);
+    }
+    return c;
+}
@@ -0,0 +1,121 @@
+﻿#pragma once
+#include "TaskManager.h"
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Отсортированное и отфильтрованное представление списка задач для UI.
+//
+// Держит снимки полей, по которым идет сортировка, и упорядоченные индексы для каждого
+// порядка (вставки, имени, следующего запуска; каждый - с группировкой по статусу и без).
+// События TaskManager (приходят и с потока планировщика) только складываются в очередь по id:
+// повторные изменения одной задачи схлопываются. Очередь разбирает TakeChanges на потоке UI -
+// меняются только затронутые строки (бинарный поиск + сдвиг в индексах), а большая пачка
+// пересортировывает индексы целиком. До TakeChanges Count/RowAt отдают прежнее состояние.
+// UI (ListView с LVS_OWNERDATA) читает строки по номеру и перерисовывает диапазон из TakeChanges.
+// Платформенно-независим; все методы потокобезопасны.
+class TaskViewModel {
+public:
+    enum class SortKey { None, Name, NextRun };
+    enum class Filter { All, Enabled, Disabled };
+
+    struct Row {
+        TaskPtr task;
+        std::wstring name;
+        bool enabled = false;
+        TriggerType trigger = TriggerType::ONCE;
+        std::chrono::system_clock::time_point nextRunTime{};
+    };
+
+    struct Counters {
+        size_t total = 0;
+        size_t enabled = 0;
+        size_t disabled = 0;
+    };
+
+    // Диапазон видимых строк, изменившихся с прошлого TakeChanges
+    struct Changes {
+        bool any = false;
+        bool countChanged = false;
+        size_t first = 0, last = 0;   // включительно; при countChanged - до конца списка
+    };
+
+    explicit TaskViewModel(TaskManager* tm);
+    ~TaskViewModel();
+    TaskViewModel(const TaskViewModel&) = delete;
+    TaskViewModel& operator=(const TaskViewModel&) = delete;
+
+    // Вызывается один раз при переходе в "есть изменения" (например, PostMessage в окно);
+    // изменения применяются в TakeChanges
+    void SetOnChanged(std::function<void()> fn);
+
+    void SetSort(SortKey key, bool statusFirst);
+    void SetFilter(Filter filter);
+    void SetSearch(const std::wstring& query);   // подстрока в name/description/exePath, "" - без поиска
+    void Reload();   // полная пересборка из TaskManager (кнопка Refresh)
+
+    size_t Count() const;
+    bool RowAt(size_t index, Row& out) const;
+    TaskPtr TaskAt(size_t index) const;
+    Counters GetCounters() const;
+    Changes TakeChanges();
+
+private:
+    // Ключ снимка строки; seq - порядок в TaskManager (стабильность как у stable_sort)
+    struct Entry {
+        Row row;
+        uint64_t seq = 0;
+        int64_t nextRunKey = 0;   // INT64_MAX - не запланирована (в конец)
+        bool matches = true;      // подходит под текущий поиск
+    };
+
+    static constexpr int kIndexCount = 6;   // SortKey x statusFirst
+
+    // Последнее событие задачи в очереди; Added, за которым пришло Updated, остается Added
+    struct Queued {
+        TaskEvent::Kind kind;
+        TaskPtr task;
+    };
+
+    void OnTaskEvent(const TaskEvent& e);
+    void ApplyLocked(const std::wstring& id, const Queued& q, bool bulk);
+    void SortIndexesLocked();
+    void ResetLocked(const std::vector<TaskPtr>& tasks);
+    void Snapshot(Entry& e, const TaskPtr& task);
+    bool Less(int index, uint32_t a, uint32_t b) const;
+    bool Visible(uint32_t slot) const;
+    void InsertLocked(uint32_t slot);
+    void EraseLocked(uint32_t slot);
+    void RebuildVisibleLocked();
+    void MarkLocked(size_t first, size_t last, bool countChanged);
+    int ActiveIndex() const { return (int)sortKey_ + (statusFirst_ ? 3 : 0); }
+
+    TaskManager* tm_;
+    mutable std::mutex mtx_;
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> freeSlots_;
+    TaskIdMap<uint32_t> slotById_;
+    std::vector<uint32_t> index_[kIndexCount];
+    std::vector<uint32_t> visible_;
+    uint64_t nextSeq_ = 0;
+
+    SortKey sortKey_ = SortKey::None;
+    bool statusFirst_ = false;
+    Filter filter_ = Filter::All;
+    std::wstring query_;
+    Counters counters_;
+
+    Changes pending_;
+    bool draining_ = false;          // изменения от разбора очереди не будят окно повторно
+    std::function<void()> onChanged_;
+
+    // Очередь событий - своя блокировка: поток планировщика не ждет разбора в UI
+    std::mutex queueMtx_;
+    std::vector<std::pair<std::wstring, Queued>> queued_;   // в порядке первого события (seq новых строк)
+    TaskIdMap<size_t> queuedPos_;
+    bool queuedReset_ = false;
+    std::function<void()> onQueued_;
+};
@@ -0,0 +1,270 @@
+﻿#include "Trace.h"
+#include "Logger.h"
+#include "Utf8File.h"
+#include "Utils.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <Windows.h>
+
+namespace trace {
+
+    namespace {
+
+        struct Event {
+            const char* name;
+            const char* category;
+            int64_t start;     // QPC
+            int64_t end;
+            std::wstring arg;
+            bool async;
+        };
+
+        // Буфер одного потока. Мьютекс почти всегда свободен: его берет еще только поток сброса,
+        // а отсоединенные потоки запусков могут дописывать интервалы во время сохранения.
+        struct Buffer {
+            std::mutex mtx;
+            std::vector<Event> events;
+            uint64_t dropped = 0;
+            uint32_t threadId = 0;
+            std::string threadName;
+            bool nameWritten = false;   // метаданные thread_name уже в файле
+        };
+
+        struct State {
+            std::mutex buffersMtx;
+            std::vector<std::shared_ptr<Buffer>> buffers;   // завершившиеся потоки - до ближайшего сброса
+            std::atomic<size_t> buffered{ 0 };              // интервалов во всех буферах
+            int64_t qpcFrequency = 1;
+            int64_t qpcOrigin = 0;
+            size_t maxBuffered = 0;
+            std::wstring path;
+
+            // Файл и счетчики - только под writeMtx (поток сброса и Stop)
+            std::mutex writeMtx;
+            std::unique_ptr<util::Utf8Writer> out;
+            uint64_t asyncId = 0;
+            uint64_t written = 0;
+            uint64_t dropped = 0;
+
+            std::mutex flushMtx;
+            std::condition_variable flushCv;
+            bool stopping = false;
+            std::thread flusher;
+        };
+
+        State& S() {
+            static State s;
+            return s;
+        }
+
+        thread_local std::shared_ptr<Buffer> tl_buffer;
+
+        Buffer* ThisThreadBuffer() {
+            if (!tl_buffer) {
+                auto buffer = std::make_shared<Buffer>();
+                buffer->threadId = GetCurrentThreadId();
+                std::lock_guard<std::mutex> lk(S().buffersMtx);
+                S().buffers.push_back(buffer);
+                tl_buffer = std::move(buffer);
+            }
+            return tl_buffer.get();
+        }
+
+        int64_t Now() {
+            LARGE_INTEGER qpc;
+            QueryPerformanceCounter(&qpc);
+            return qpc.QuadPart;
+        }
+
+        // Микросекунды от начала трассировки с тремя знаками после точки
+        void WriteMicros(util::Utf8Writer& out, int64_t ticks) {
+            const State& s = S();
+            int64_t ns = ticks / s.qpcFrequency * 1000000000 + ticks % s.qpcFrequency * 1000000000 / s.qpcFrequency;
+            if (ns < 0) ns = 0;
+            char frac[4] = { (char)('0' + ns / 100 % 10), (char)('0' + ns / 10 % 10), (char)('0' + ns % 10), 0 };
+            out << ns / 1000 << "." << frac;
+        }
+
+        void WriteEventHead(util::Utf8Writer& out, const char* ph, uint32_t pid, uint32_t tid, const Event& e) {
+            out << ",\n{\"ph\":\"" << ph << "\",\"pid\":" << pid << ",\"tid\":" << tid
+                << ",\"cat\":\"" << e.category << "\",\"name\":\"" << e.name << "\",\"ts\":";
+        }
+
+        void WriteArgs(util::Utf8Writer& out, const Event& e) {
+            if (!e.arg.empty()) out << ",\"args\":{\"id\":\"" << util::EscapeJSON(e.arg) << "\"}";
+        }
+
+        // Асинхронный интервал - пара b/e с общим id, синхронный - одно событие X
+        void WriteEvent(util::Utf8Writer& out, uint32_t pid, uint32_t tid, const Event& e, uint64_t& asyncId) {
+            if (e.async) {
+                const uint64_t id = ++asyncId;
+                WriteEventHead(out, "b", pid, tid, e);
+                WriteMicros(out, e.start - S().qpcOrigin);
+                out << ",\"id\":" << id;
+                WriteArgs(out, e);
+                out << "}";
+                WriteEventHead(out, "e", pid, tid, e);
+                WriteMicros(out, e.end - S().qpcOrigin);
+                out << ",\"id\":" << id << "}";
+                return;
+            }
+            WriteEventHead(out, "X", pid, tid, e);
+            WriteMicros(out, e.start - S().qpcOrigin);
+            out << ",\"dur\":";
+            WriteMicros(out, e.end - e.start);
+            WriteArgs(out, e);
+            out << "}";
+        }
+
+        // Дописывает накопленное в trace.json и опустошает буферы. Буферы завершившихся
+        // потоков (ссылка осталась только здесь) после этого удаляются
+        void Flush() {
+            State& s = S();
+            std::lock_guard<std::mutex> wlk(s.writeMtx);
+            if (!s.out) return;
+
+            std::vector<std::shared_ptr<Buffer>> buffers;
+            {
+                std::lock_guard<std::mutex> lk(s.buffersMtx);
+                buffers = s.buffers;
+            }
+
+            const uint32_t pid = GetCurrentProcessId();
+            std::vector<Event> events;
+            for (const auto& b : buffers) {
+                std::string threadName;
+                {
+                    std::lock_guard<std::mutex> lk(b->mtx);
+                    events.swap(b->events);
+                    s.dropped += b->dropped;
+                    b->dropped = 0;
+                    if (!b->nameWritten && !b->threadName.empty()) {
+                        threadName = b->threadName;
+                        b->nameWritten = true;
+                    }
+                }
+                // Запись - без мьютекса буфера: поток продолжает писать интервалы в пустой вектор
+                if (!threadName.empty()) {
+                    *s.out << ",\n{\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << b->threadId
+                        << ",\"name\":\"thread_name\",\"args\":{\"name\":\"" << threadName << "\"}}";
+                }
+                for (const Event& e : events) WriteEvent(*s.out, pid, b->threadId, e, s.asyncId);
+                s.written += events.size();
+                s.buffered.fetch_sub(events.size(), std::memory_order_relaxed);
+                events.clear();
+            }
+            s.out->Flush();
+
+            buffers.clear();   // иначе use_count ниже не опустится до 1
+            std::lock_guard<std::mutex> lk(s.buffersMtx);
+            s.buffers.erase(std::remove_if(s.buffers.begin(), s.buffers.end(),
+                [](const std::shared_ptr<Buffer>& b) { return b.use_count() == 1 && b->events.empty(); }),
+                s.buffers.end());
+        }
+
+        void FlusherProc(std::chrono::seconds interval) {
+            State& s = S();
+            std::unique_lock<std::mutex> lk(s.flushMtx);
+            while (!s.flushCv.wait_for(lk, interval, [&s] { return s.stopping; })) {
+                lk.unlock();
+                Flush();
+                lk.lock();
+            }
+        }
+
+    } // namespace
+
+    void Span::Begin(const char* name, const char* category) {
+        name_ = name;
+        category_ = category;
+        start_ = Now();
+    }
+
+    void Span::End() {
+        const int64_t end = Now();
+        if (!Enabled()) return;   // Stop уже прошел - файл записан
+
+        State& s = S();
+        Buffer* b = ThisThreadBuffer();
+        std::lock_guard<std::mutex> lk(b->mtx);
+        if (s.buffered.fetch_add(1, std::memory_order_relaxed) >= s.maxBuffered) {
+            s.buffered.fetch_sub(1, std::memory_order_relaxed);
+            ++b->dropped;
+            return;
+        }
+        b->events.push_back(Event{ name_, category_, start_, end, std::wstring(arg_), async_ });
+    }
+
+    void NameThread(const char* name) {
+        if (!Enabled()) return;
+        Buffer* b = ThisThreadBuffer();
+        std::lock_guard<std::mutex> lk(b->mtx);
+        b->threadName = name;
+    }
+
+    // [Tracing] Enabled=1 - запись интервалов; FlushSeconds - период сброса в trace.json;
+    // MaxBufferedEvents - предел интервалов всех потоков между сбросами, сверх него интервалы
+    // отбрасываются и учитываются в логе при остановке
+    void Start() {
+        State& s = S();
+        std::wstring dir = util::GetAppDataDir();
+        std::wstring ini = dir + L"\\scheduler.ini";
+        if (!GetPrivateProfileIntW(L"Tracing", L"Enabled", 0, ini.c_str())) return;
+
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        s.qpcFrequency = freq.QuadPart;
+        s.qpcOrigin = Now();
+        s.maxBuffered = GetPrivateProfileIntW(L"Tracing", L"MaxBufferedEvents", 200000, ini.c_str());
+        UINT flushSeconds = GetPrivateProfileIntW(L"Tracing", L"FlushSeconds", 5, ini.c_str());
+        s.path = dir + L"\\trace.json";
+
+        // Формат-массив: закрывающая скобка необязательна, файл читается и после аварийного завершения
+        s.out = std::make_unique<util::Utf8Writer>(s.path);
+        if (!s.out->IsOpen()) {
+            s.out.reset();
+            g_Logger.Log(LogLevel::Error, L"Trace", L"Cannot open " + s.path + L" - tracing disabled");
+            return;
+        }
+        *s.out << "[\n{\"ph\":\"M\",\"pid\":" << (uint32_t)GetCurrentProcessId()
+            << ",\"name\":\"process_name\",\"args\":{\"name\":\"MiniTaskScheduler\"}}";
+
+        s.stopping = false;
+        detail::g_enabled.store(true);
+        s.flusher = std::thread(FlusherProc, std::chrono::seconds((std::max)(flushSeconds, 1u)));
+        NameThread("Main");
+        g_Logger.Log(LogLevel::Info, L"Trace", L"Tracing enabled, trace is written to " + s.path +
+            L" every " + std::to_wstring((std::max)(flushSeconds, 1u)) + L" s");
+    }
+
+    void Stop() {
+        State& s = S();
+        if (!detail::g_enabled.exchange(false)) return;
+
+        {
+            std::lock_guard<std::mutex> lk(s.flushMtx);
+            s.stopping = true;
+        }
+        s.flushCv.notify_all();
+        if (s.flusher.joinable()) s.flusher.join();
+        Flush();
+
+        std::lock_guard<std::mutex> wlk(s.writeMtx);
+        *s.out << "\n]\n";
+        if (!s.out->Close()) {
+            g_Logger.Log(LogLevel::Error, L"Trace", L"Cannot write " + s.path);
+        }
+        else {
+            g_Logger.Log(s.dropped ? LogLevel::Warn : LogLevel::Info, L"Trace",
+                L"Trace written: " + std::to_wstring(s.written) + L" span(s), " +
+                std::to_wstring(s.dropped) + L" dropped | " + s.path);
+        }
+        s.out.reset();
+    }
+
+} // namespace trace
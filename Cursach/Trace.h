@@ -0,0 +1,68 @@
+﻿#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+// Трассировка жизненного цикла планировщика и запусков в формате Chrome trace-event
+// (открывается в Perfetto / chrome://tracing). Интервалы копятся в буфере своего потока,
+// фоновый поток раз в FlushSeconds дописывает их в trace.json и опустошает буферы;
+// сверх MaxBufferedEvents на все потоки между сбросами интервалы отбрасываются.
+//
+//   TRACE_SPAN("DispatchPass", "scheduler");
+//   trace::Span span("spawn", "job"); span.Arg(task->id);
+//
+// Без [Tracing] Enabled=1 в scheduler.ini интервал стоит одной проверки флага.
+namespace trace {
+
+    namespace detail {
+        inline std::atomic<bool> g_enabled{ false };
+    }
+
+    inline bool Enabled() { return detail::g_enabled.load(std::memory_order_relaxed); }
+
+    void Start();   // читает [Tracing], засекает начало отсчета, открывает trace.json
+    void Stop();    // выключает запись, дописывает остаток и закрывает trace.json
+
+    // Имя потока на дорожке Perfetto (метаданные thread_name); без трассировки ничего не делает
+    void NameThread(const char* name);
+
+    // Метка интервала, переживающего co_await: он может закончиться в другом потоке пула,
+    // поэтому пишется парой асинхронных событий (ph "b"/"e") на своей дорожке, а не в стек потока
+    struct AsyncTag {};
+    inline constexpr AsyncTag kAsync{};
+
+    // Завершенный интервал (ph "X"). name и category - строковые литералы: хранятся указатели.
+    class Span {
+    public:
+        Span(const char* name, const char* category) {
+            if (Enabled()) Begin(name, category);
+        }
+        Span(const char* name, const char* category, AsyncTag) : async_(true) {
+            if (Enabled()) Begin(name, category);
+        }
+        ~Span() {
+            if (start_) End();
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        // Поле args.id события (обычно id задачи). Хранится только представление: строка должна
+        // жить до конца интервала, копируется она при записи события
+        void Arg(std::wstring_view value) { arg_ = value; }
+
+    private:
+        void Begin(const char* name, const char* category);
+        void End();
+
+        const char* name_ = nullptr;
+        const char* category_ = nullptr;
+        int64_t start_ = 0;   // QPC; 0 - интервал не пишется
+        bool async_ = false;
+        std::wstring_view arg_;
+    };
+
+} // namespace trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name, category) ::trace::Span TRACE_CONCAT(traceSpan_, __LINE__)(name, category)
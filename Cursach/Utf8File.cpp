@@ -0,0 +1,190 @@
+﻿#include "Utf8File.h"
+#include <algorithm>
+#include <cstdint>
+#include <Windows.h>
+
+namespace util {
+
+    std::string ToUtf8(std::wstring_view s) {
+        std::string out;
+        out.reserve(s.size());
+        for (size_t i = 0; i < s.size(); ++i) {
+            uint32_t c = (uint16_t)s[i];
+            if (c < 0x80) { out.push_back((char)c); continue; }
+
+            if (c >= 0xD800 && c <= 0xDBFF && i + 1 < s.size() &&
+                (uint16_t)s[i + 1] >= 0xDC00 && (uint16_t)s[i + 1] <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + ((uint16_t)s[++i] - 0xDC00);
+            }
+            else if (c >= 0xD800 && c <= 0xDFFF) {
+                c = 0xFFFD;   // непарный суррогат
+            }
+
+            if (c < 0x800) {
+                out.push_back((char)(0xC0 | (c >> 6)));
+            }
+            else if (c < 0x10000) {
+                out.push_back((char)(0xE0 | (c >> 12)));
+                out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+            }
+            else {
+                out.push_back((char)(0xF0 | (c >> 18)));
+                out.push_back((char)(0x80 | ((c >> 12) & 0x3F)));
+                out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+            }
+            out.push_back((char)(0x80 | (c & 0x3F)));
+        }
+        return out;
+    }
+
+    std::wstring FromUtf8(std::string_view s) {
+        std::wstring out;
+        out.reserve(s.size());
+        const unsigned char* p = (const unsigned char*)s.data();
+        const size_t n = s.size();
+
+        for (size_t i = 0; i < n;) {
+            unsigned char b = p[i];
+            if (b < 0x80) { out.push_back((wchar_t)b); ++i; continue; }
+
+            size_t len = (b >= 0xF0 && b <= 0xF4) ? 4 : (b >= 0xE0) ? 3 : (b >= 0xC2 && b <= 0xDF) ? 2 : 0;
+            if (b > 0xF4) len = 0;
+            uint32_t c = len == 4 ? (b & 0x07) : len == 3 ? (b & 0x0F) : (b & 0x1F);
+
+            bool ok = len != 0 && i + len <= n;
+            for (size_t k = 1; ok && k < len; ++k) {
+                ok = (p[i + k] & 0xC0) == 0x80;
+                c = (c << 6) | (p[i + k] & 0x3F);
+            }
+            // Отсекаем избыточные формы, суррогаты и значения за U+10FFFF
+            if (ok) {
+                ok = !(len == 3 && (c < 0x800 || (c >= 0xD800 && c <= 0xDFFF))) &&
+                     !(len == 4 && (c < 0x10000 || c > 0x10FFFF));
+            }
+            if (!ok) { out.push_back(L'\xFFFD'); ++i; continue; }
+
+            if (c >= 0x10000) {
+                c -= 0x10000;
+                out.push_back((wchar_t)(0xD800 + (c >> 10)));
+                out.push_back((wchar_t)(0xDC00 + (c & 0x3FF)));
+            }
+            else {
+                out.push_back((wchar_t)c);
+            }
+            i += len;
+        }
+        return out;
+    }
+
+    bool ReadFileUtf8(const std::wstring& path, std::string& out) {
+        out.clear();
+        HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (h == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER size{};
+        bool ok = GetFileSizeEx(h, &size) != 0;
+        if (ok) {
+            out.resize((size_t)size.QuadPart);
+            size_t done = 0;
+            while (ok && done < out.size()) {
+                DWORD chunk = (DWORD)((std::min)(out.size() - done, (size_t)(1u << 30)));
+                DWORD got = 0;
+                ok = ReadFile(h, &out[done], chunk, &got, NULL) != 0 && got != 0;
+                done += got;
+            }
+            out.resize(done);
+        }
+        CloseHandle(h);
+
+        if (out.size() >= 3 && (unsigned char)out[0] == 0xEF && (unsigned char)out[1] == 0xBB && (unsigned char)out[2] == 0xBF)
+            out.erase(0, 3);
+        return ok;
+    }
+
+    // ========================================================================
+    // Utf8Reader
+    // ========================================================================
+
+    Utf8Reader::Utf8Reader(const std::wstring& path) {
+        HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (h != INVALID_HANDLE_VALUE) file_ = h;
+    }
+
+    Utf8Reader::~Utf8Reader() {
+        if (file_) CloseHandle((HANDLE)file_);
+    }
+
+    size_t Utf8Reader::ReadChunk(std::string& out, size_t maxBytes) {
+        if (!file_ || failed_) return 0;
+        size_t base = out.size();
+        out.resize(base + maxBytes);
+        DWORD got = 0;
+        if (!ReadFile((HANDLE)file_, &out[base], (DWORD)maxBytes, &got, NULL)) {
+            failed_ = true;
+            got = 0;
+        }
+        out.resize(base + got);
+
+        if (!started_ && got >= 3 && (unsigned char)out[base] == 0xEF &&
+            (unsigned char)out[base + 1] == 0xBB && (unsigned char)out[base + 2] == 0xBF) {
+            out.erase(base, 3);
+            started_ = true;
+            return got - 3 ? got - 3 : ReadChunk(out, maxBytes);
+        }
+        started_ = true;
+        return got;
+    }
+
+    // ========================================================================
+    // Utf8Writer
+    // ========================================================================
+
+    Utf8Writer::Utf8Writer(const std::wstring& path, bool append) {
+        HANDLE h = CreateFileW(path.c_str(), append ? FILE_APPEND_DATA : GENERIC_WRITE,
+            FILE_SHARE_READ, NULL, append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (h != INVALID_HANDLE_VALUE) file_ = h;
+        buf_.reserve(kBufferSize);
+    }
+
+    Utf8Writer::~Utf8Writer() {
+        Close();
+    }
+
+    Utf8Writer& Utf8Writer::operator<<(std::string_view ascii) {
+        if (buf_.size() + ascii.size() > kBufferSize) Flush();
+        buf_.append(ascii.data(), ascii.size());
+        return *this;
+    }
+
+    Utf8Writer& Utf8Writer::operator<<(std::wstring_view s) {
+        // ASCII - основной случай (пути, ключи, числа): без промежуточной строки
+        size_t i = 0;
+        while (i < s.size() && (uint16_t)s[i] < 0x80) ++i;
+        if (buf_.size() + i > kBufferSize) Flush();
+        for (size_t k = 0; k < i; ++k) buf_.push_back((char)s[k]);
+        if (i < s.size()) *this << std::string_view(ToUtf8(s.substr(i)));
+        return *this;
+    }
+
+    bool Utf8Writer::Flush() {
+        if (!file_) { failed_ = true; buf_.clear(); return false; }
+        if (!buf_.empty()) {
+            DWORD written = 0;
+            if (!WriteFile((HANDLE)file_, buf_.data(), (DWORD)buf_.size(), &written, NULL) || written != buf_.size())
+                failed_ = true;
+            buf_.clear();
+        }
+        return !failed_;
+    }
+
+    bool Utf8Writer::Close() {
+        if (!file_) return !failed_ && buf_.empty();
+        Flush();
+        CloseHandle((HANDLE)file_);
+        file_ = nullptr;
+        return !failed_;
+    }
+
+} // namespace util
@@ -0,0 +1,72 @@
+﻿#pragma once
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <charconv>
+
+// Байтовый ввод-вывод в UTF-8. Модель и Win32 API работают с UTF-16 (wchar_t = 2 байта),
+// на диск уходит UTF-8: перекодирование - один проход по буферу, без wide-потоков и locale.
+namespace util {
+
+    std::string ToUtf8(std::wstring_view s);
+    std::wstring FromUtf8(std::string_view s);   // неверные последовательности -> U+FFFD
+
+    // Читает файл целиком одним ReadFile; BOM UTF-8 отбрасывается
+    bool ReadFileUtf8(const std::wstring& path, std::string& out);
+
+    // Последовательное чтение файла блоками (большие файлы - без загрузки целиком);
+    // BOM UTF-8 в начале отбрасывается
+    class Utf8Reader {
+    public:
+        explicit Utf8Reader(const std::wstring& path);
+        ~Utf8Reader();
+        Utf8Reader(const Utf8Reader&) = delete;
+        Utf8Reader& operator=(const Utf8Reader&) = delete;
+
+        bool IsOpen() const { return file_ != nullptr; }
+        bool Failed() const { return failed_; }
+
+        // Дописывает в out до maxBytes байт; 0 - конец файла или ошибка
+        size_t ReadChunk(std::string& out, size_t maxBytes);
+
+    private:
+        void* file_ = nullptr;
+        bool started_ = false;
+        bool failed_ = false;
+    };
+
+    // Буферизованная запись UTF-8 через WriteFile (буфер 64 КБ)
+    class Utf8Writer {
+    public:
+        explicit Utf8Writer(const std::wstring& path, bool append = false);
+        ~Utf8Writer();
+        Utf8Writer(const Utf8Writer&) = delete;
+        Utf8Writer& operator=(const Utf8Writer&) = delete;
+
+        bool IsOpen() const { return file_ != nullptr; }
+
+        Utf8Writer& operator<<(std::string_view ascii);   // литералы разметки
+        Utf8Writer& operator<<(const char* ascii) { return *this << std::string_view(ascii); }
+        Utf8Writer& operator<<(std::wstring_view s);
+        Utf8Writer& operator<<(const wchar_t* s) { return *this << std::wstring_view(s); }
+        Utf8Writer& operator<<(const std::wstring& s) { return *this << std::wstring_view(s); }
+
+        template <class T, class = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+        Utf8Writer& operator<<(T v) {
+            char tmp[24];
+            auto res = std::to_chars(tmp, tmp + sizeof(tmp), v);
+            return *this << std::string_view(tmp, res.ptr - tmp);
+        }
+
+        bool Flush();
+        bool Close();   // false, если любая запись не удалась
+
+    private:
+        static constexpr size_t kBufferSize = 64 * 1024;
+
+        void* file_ = nullptr;
+        std::string buf_;
+        bool failed_ = false;
+    };
+
+} // namespace util
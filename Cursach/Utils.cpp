@@ -1,4 +1,6 @@
 ﻿#include "Utils.h"
+#include "JsonSimd.h"
+#include "Utf8File.h"
 #include <Windows.h>
 #include <shlobj.h>
 #include <sstream>
@@ -7,6 +9,14 @@
 namespace util {
 
     std::wstring GetAppDataDir() {
+        // MTS_DATA_DIR - другой каталог данных (тесты, переносной запуск)
+        wchar_t custom[MAX_PATH] = {};
+        DWORD n = GetEnvironmentVariableW(L"MTS_DATA_DIR", custom, MAX_PATH);
+        if (n > 0 && n < MAX_PATH) {
+            CreateDirectoryW(custom, NULL);
+            return custom;
+        }
+
         wchar_t path[MAX_PATH] = {};
         if (SUCCEEDED(SHGetFolderPathW(NULL, CSIDL_LOCAL_APPDATA, NULL, 0, path))) {
             std::wstring dir = path;
@@ -46,65 +56,22 @@ namespace util {
         return std::wstring(buf);
     }
 
+    // Реализации - блочные ядра SSE2/AVX2 из JsonSimd.cpp (выбор по CPUID)
     bool IsValidJsonSimple(const std::wstring& s) {
-        int depth = 0;
-        bool inQuotes = false;
-        bool escape = false;
-        for (wchar_t c : s) {
-            if (escape) { escape = false; continue; }
-            if (c == L'\\') { escape = true; continue; }
-            if (c == L'"') inQuotes = !inQuotes;
-            if (!inQuotes) {
-                if (c == L'{') ++depth;
-                else if (c == L'}') --depth;
-                if (depth < 0) return false;
-            }
-        }
-        return !inQuotes && depth == 0;
+        return json::IsValid(s);
     }
 
     std::wstring EscapeJSON(const std::wstring& s) {
-        std::wstring out; out.reserve(s.size());
-        for (wchar_t c : s) {
-            switch (c) {
-            case L'\\': out += L"\\\\"; break;
-            case L'"':  out += L"\\\""; break;
-            case L'\n': out += L"\\n"; break;
-            case L'\r': out += L"\\r"; break;
-            case L'\t': out += L"\\t"; break;
-            default: out.push_back(c); break;
-            }
-        }
-        return out;
+        return json::Escape(s);
+    }
+
+    std::wstring EscapeJSON(std::wstring_view s) {
+        return json::Escape(s);
     }
 
     // ← ДОБАВЛЕНО: Обратная операция для EscapeJSON
     std::wstring UnescapeJSON(const std::wstring& s) {
-        std::wstring out;
-        out.reserve(s.size());
-
-        bool escape = false;
-        for (wchar_t c : s) {
-            if (escape) {
-                switch (c) {
-                case L'\\': out.push_back(L'\\'); break;
-                case L'"':  out.push_back(L'"'); break;
-                case L'n':  out.push_back(L'\n'); break;
-                case L'r':  out.push_back(L'\r'); break;
-                case L't':  out.push_back(L'\t'); break;
-                default:    out.push_back(c); break;  // Неизвестная escape-последовательность
-                }
-                escape = false;
-            }
-            else if (c == L'\\') {
-                escape = true;
-            }
-            else {
-                out.push_back(c);
-            }
-        }
-
-        return out;
+        return json::Unescape(s);
     }
 
     // ← ДОБАВЛЕНО: Извлечение имени файла из полного пути
@@ -121,4 +88,16 @@ namespace util {
         return path.substr(pos + 1);
     }
 
+    void PrintToConsole(const std::wstring& text) {
+        AttachConsole(ATTACH_PARENT_PROCESS);
+        HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+        if (!out || out == INVALID_HANDLE_VALUE) return;
+        DWORD written = 0;
+        if (!WriteConsoleW(out, text.c_str(), (DWORD)text.size(), &written, NULL)) {
+            // Вывод перенаправлен в файл
+            std::string utf8 = ToUtf8(text);
+            WriteFile(out, utf8.data(), (DWORD)utf8.size(), &written, NULL);
+        }
+    }
+
 } // namespace util
\ No newline at end of file
@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include <string>
+#include <string_view>
 #include <chrono>
 
 namespace util {
@@ -9,7 +10,10 @@ namespace util {
 	std::wstring TimePointToWString(const std::chrono::system_clock::time_point& tp);
 	bool IsValidJsonSimple(const std::wstring& s);
 	std::wstring EscapeJSON(const std::wstring& s);
+	std::wstring EscapeJSON(std::wstring_view s);      // строки задачи (std::pmr::wstring)
 	std::wstring UnescapeJSON(const std::wstring& s);  // ← ДОБАВЛЕНО
 	std::wstring GetFileName(const std::wstring& path);  // ← ДОБАВЛЕНО: извлечь имя файла из пути
+	// Вывод режимов командной строки в консоль, из которой запустили (своей консоли у оконного приложения нет)
+	void PrintToConsole(const std::wstring& text);
 
 } // namespace util
\ No newline at end of file
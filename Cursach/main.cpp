@@ -1,15 +1,44 @@
-#include <Windows.h>
+﻿#include <Windows.h>
 #include <commctrl.h>
 #include "TaskManager.h"
 #include "Scheduler.h"
 #include "MainWindow.h"
 #include "Logger.h"
+#include "StructuredLog.h"
+#include "Trace.h"
+#include "Simulator.h"
+#include "Launcher.h"
+#include "BulkIO.h"
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow) {
+    // Режимы командной строки - без окна и без настоящего планировщика
+    int argc = 0;
+    wchar_t** argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv && argc > 1) {
+        int (*command)(int, wchar_t**) =
+            wcscmp(argv[1], L"--simulate") == 0 ? RunSimulationCommand :
+            wcscmp(argv[1], L"--launcher") == 0 ? RunLauncherMain :
+            wcscmp(argv[1], L"--bench-spawn") == 0 ? RunSpawnBenchmark :
+            wcscmp(argv[1], L"--export") == 0 ? RunExportCommand :
+            wcscmp(argv[1], L"--import") == 0 ? RunImportCommand : nullptr;
+        if (command) {
+            int rc = command(argc, argv);
+            LocalFree(argv);
+            return rc;
+        }
+    }
+    if (argv) LocalFree(argv);
+
+    // Помощник запуска - до загрузки задач и окна, пока процесс маленький
+    g_Launcher.StartFromConfig();
+
     CoInitialize(NULL);
     InitCommonControls();
 
+    g_Logger.Start();
     g_Logger.Log(LogLevel::Info, L"Main", L"Starting MiniTaskScheduler");
+    slog::Start();
+    trace::Start();
 
     TaskManager tm;
     Scheduler sched(&tm);
@@ -23,6 +52,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow) {
 
     // start scheduler
     sched.Start();
+    tm.StartStoreWatch();   // tasks.json от внешних источников - без перезапуска
 
     // message loop
     MSG msg;
@@ -31,10 +61,15 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow) {
         DispatchMessage(&msg);
     }
 
+    tm.StopStoreWatch();
     sched.Stop();
     tm.Save();
+    g_Launcher.Stop();
 
+    trace::Stop();   // после последнего сохранения - оно тоже попадает в trace.json
     g_Logger.Log(LogLevel::Info, L"Main", L"Exiting MiniTaskScheduler");
+    slog::Stop();
+    g_Logger.Stop();
     CoUninitialize();
     return 0;
 }
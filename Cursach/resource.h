@@ -31,3 +31,23 @@
 #define IDC_TIMEOUT_MINUTES  531  // EditText для минут
 #define IDC_TIMEOUT_LABEL    532  // Статическая метка "minutes"
 
+// FILE_WATCH: каталог и маска файлов
+#define IDC_WATCH_PATH_LABEL    540
+#define IDC_WATCH_PATH          541
+#define IDC_WATCH_PATTERN_LABEL 542
+#define IDC_WATCH_PATTERN       543
+
+// Повторы неудачного запуска
+#define IDC_RETRY_ATTEMPTS      550
+#define IDC_RETRY_DELAY         551
+#define IDC_RETRY_MAX_DELAY     552
+#define IDC_RETRY_EXIT_CODES    553
+
+// Лимиты Job Object, перекрытие запусков, диспетчеризация
+#define IDC_LIMIT_CPU           560
+#define IDC_LIMIT_MEMORY        561
+#define IDC_LIMIT_PROCESSES     562
+#define IDC_OVERLAP_POLICY      563
+#define IDC_MAX_INSTANCES       564
+#define IDC_PRIORITY            565
+#define IDC_GROUP               566
@@ -0,0 +1,155 @@
+﻿// LogDecoder - перевод бинарного журнала scheduler.slog в текст или JSON Lines.
+//
+//   LogDecoder.exe <scheduler.slog> [--json]
+//   LogDecoder.exe --task <id> <папка журнала> [--from ...] [--to ...]   (см. LogQuery.h)
+//
+// Записи разных потоков внутри сессии упорядочиваются по QPC.
+#include "../Cursach/SlogFormat.h"
+#include "../Cursach/Utf8File.h"
+#include "../Cursach/JsonSimd.h"
+#include "LogQuery.h"
+#include <Windows.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+    struct Line {
+        int64_t qpc;
+        std::string text;   // готовая строка вывода (UTF-8)
+    };
+
+    struct Session {
+        slog::SessionInfo info{};
+        std::map<uint32_t, slog::SiteDesc> sites;
+        std::vector<Line> lines;
+    };
+
+    std::wstring FormatTime(const slog::SessionInfo& s, int64_t qpc, bool iso) {
+        uint64_t ft = s.fileTimeAnchor;
+        if (s.qpcFrequency > 0) {
+            int64_t delta = qpc - s.qpcAnchor;
+            ft += (uint64_t)((delta / s.qpcFrequency) * 10000000 + (delta % s.qpcFrequency) * 10000000 / s.qpcFrequency);
+        }
+        FILETIME utc{ (DWORD)ft, (DWORD)(ft >> 32) }, local;
+        SYSTEMTIME st{};
+        FileTimeToLocalFileTime(&utc, &local);
+        FileTimeToSystemTime(&local, &st);
+
+        wchar_t buf[64];
+        swprintf_s(buf, iso ? L"%04u-%02u-%02uT%02u:%02u:%02u.%06u" : L"%04u-%02u-%02u %02u:%02u:%02u.%06u",
+            st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, (unsigned)((ft / 10) % 1000000));
+        return buf;
+    }
+
+    std::string Quote(const std::wstring& s) {
+        return "\"" + util::ToUtf8(util::json::Escape(s)) + "\"";
+    }
+
+    std::string RenderArg(const slog::ArgValue& v) {
+        if (v.type == slog::ARG_WSTR) return Quote(v.s);
+        // В JSON нет NaN и бесконечностей: "nan"/"inf" из to_wstring сломали бы строку
+        if (v.type == slog::ARG_F64 && !std::isfinite(v.f)) return "null";
+        return util::ToUtf8(slog::ArgToString(v));
+    }
+
+    void Flush(Session& s) {
+        std::stable_sort(s.lines.begin(), s.lines.end(),
+            [](const Line& a, const Line& b) { return a.qpc < b.qpc; });
+        for (auto& l : s.lines) fwrite(l.text.data(), 1, l.text.size(), stdout);
+        s.lines.clear();
+    }
+
+} // namespace
+
+int wmain(int argc, wchar_t** argv) {
+    if (argc > 1 && wcscmp(argv[1], L"--task") == 0) return RunTaskQuery(argc, argv);
+    if (argc < 2) {
+        fwprintf(stderr, L"Usage: LogDecoder <scheduler.slog> [--json]\n"
+                         L"       LogDecoder --task <id> <log dir> [--from \"YYYY-MM-DD HH:MM[:SS]\"] [--to \"...\"]\n");
+        return 2;
+    }
+    bool json = argc > 2 && wcscmp(argv[2], L"--json") == 0;
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        fwprintf(stderr, L"Cannot open %ls\n", argv[1]);
+        return 1;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    Session session;
+    size_t records = 0, skipped = 0;
+
+    for (size_t off = 0; off + sizeof(slog::RecordHeader) <= data.size();) {
+        slog::RecordHeader h;
+        memcpy(&h, data.data() + off, sizeof(h));
+        if (h.size < sizeof(h) || (h.size & 7) || off + h.size > data.size()) {
+            fwprintf(stderr, L"Truncated or corrupt record at offset %zu, stopping\n", off);
+            break;
+        }
+        const uint8_t* p = (const uint8_t*)data.data() + off + sizeof(h);
+        size_t n = h.size - sizeof(h);
+        off += h.size;
+
+        if (h.siteId == slog::kSessionRecord) {
+            Flush(session);
+            session.sites.clear();
+            memcpy(&session.info, p, (std::min)(n, sizeof(session.info)));
+            continue;
+        }
+        if (h.siteId == slog::kSiteRecord) {
+            slog::SiteDesc d;
+            if (slog::DecodeSite(p, n, d)) session.sites[d.id] = std::move(d);
+            continue;
+        }
+
+        std::wstring ts = FormatTime(session.info, h.qpc, json);
+        std::string text;
+
+        if (h.siteId == slog::kDroppedRecord) {
+            uint64_t count = 0;
+            memcpy(&count, p, (std::min)(n, sizeof(count)));
+            text = json
+                ? "{\"ts\":\"" + util::ToUtf8(ts) + "\",\"level\":\"WARN\",\"tid\":" + std::to_string(h.threadId) +
+                  ",\"dropped\":" + std::to_string(count) + "}\n"
+                : util::ToUtf8(ts) + " [WARN] [Slog] thread " + std::to_string(h.threadId) +
+                  " dropped " + std::to_string(count) + " records\n";
+            session.lines.push_back({ h.qpc, std::move(text) });
+            continue;
+        }
+
+        auto it = session.sites.find(h.siteId);
+        std::vector<slog::ArgValue> args;
+        if (it == session.sites.end() || !slog::DecodeArgs(it->second, p, n, args)) {
+            ++skipped;
+            continue;
+        }
+        const slog::SiteDesc& d = it->second;
+        ++records;
+
+        if (json) {
+            text = "{\"ts\":\"" + util::ToUtf8(ts) + "\",\"level\":\"" + util::ToUtf8(slog::LevelName(d.level)) +
+                "\",\"tag\":" + Quote(d.tag) + ",\"tid\":" + std::to_string(h.threadId) +
+                ",\"msg\":" + Quote(slog::FormatText(d.format, args)) + ",\"args\":[";
+            for (size_t i = 0; i < args.size(); ++i) text += (i ? "," : "") + RenderArg(args[i]);
+            text += "],\"src\":" + Quote(d.file + L":" + std::to_wstring(d.line)) + "}\n";
+        }
+        else {
+            text = util::ToUtf8(ts + L" [" + slog::LevelName(d.level) + L"] [" + d.tag + L"] " +
+                slog::FormatText(d.format, args)) + "\n";
+        }
+        session.lines.push_back({ h.qpc, std::move(text) });
+    }
+    Flush(session);
+
+    fwprintf(stderr, L"%zu records decoded, %zu skipped\n", records, skipped);
+    return 0;
+}
@@ -0,0 +1,155 @@
+﻿#include "LogQuery.h"
+#include "../Cursach/LogIndex.h"
+#include "../Cursach/Utf8File.h"
+#include <Windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+    struct Bound {
+        bool set = false;
+        std::string text;      // "YYYY-MM-DD HH:MM:SS" в местном времени - как в начале строки журнала
+        uint64_t utc = 0;      // FILETIME для сравнения с индексом
+    };
+
+    // "YYYY-MM-DD HH:MM[:SS]" в местном времени; upper - без секунд берется конец минуты
+    bool ParseBound(const wchar_t* s, bool upper, Bound& out) {
+        SYSTEMTIME st{};
+        int y = 0, mo = 0, d = 0, h = 0, mi = 0, sec = upper ? 59 : 0;
+        int n = swscanf_s(s, L"%d-%d-%d %d:%d:%d", &y, &mo, &d, &h, &mi, &sec);
+        if (n == 3) { h = upper ? 23 : 0; mi = upper ? 59 : 0; }
+        else if (n < 5) return false;
+
+        st.wYear = (WORD)y; st.wMonth = (WORD)mo; st.wDay = (WORD)d;
+        st.wHour = (WORD)h; st.wMinute = (WORD)mi; st.wSecond = (WORD)sec;
+        SYSTEMTIME utcSt{};
+        FILETIME ft{};
+        if (!TzSpecificLocalTimeToSystemTime(NULL, &st, &utcSt) || !SystemTimeToFileTime(&utcSt, &ft)) return false;
+
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d", y, mo, d, h, mi, sec);
+        out.set = true;
+        out.text = buf;
+        out.utc = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+        if (upper) out.utc += 10000000 - 1;   // до конца указанной секунды
+        return true;
+    }
+
+    bool ReadAll(const std::wstring& path, std::string& out) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    uint64_t FileSize(const std::wstring& path) {
+        WIN32_FILE_ATTRIBUTE_DATA fa{};
+        if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &fa)) return 0;
+        return ((uint64_t)fa.nFileSizeHigh << 32) | fa.nFileSizeLow;
+    }
+
+    // Поле "[task=<id>]" строки; id сравнивается без учета регистра ASCII
+    bool HasTask(const std::string& line, const std::string& id) {
+        size_t pos = line.find("[task=");
+        if (pos == std::string::npos || pos + 6 + id.size() >= line.size()) return false;
+        if (line[pos + 6 + id.size()] != ']') return false;
+        for (size_t i = 0; i < id.size(); ++i) {
+            char a = line[pos + 6 + i], b = id[i];
+            if (a >= 'A' && a <= 'Z') a = a - 'A' + 'a';
+            if (b >= 'A' && b <= 'Z') b = b - 'A' + 'a';
+            if (a != b) return false;
+        }
+        return true;
+    }
+
+} // namespace
+
+int RunTaskQuery(int argc, wchar_t** argv) {
+    if (argc < 4) {
+        fwprintf(stderr, L"Usage: LogDecoder --task <id> <log dir> [--from \"YYYY-MM-DD HH:MM[:SS]\"] [--to \"...\"]\n");
+        return 2;
+    }
+    std::wstring taskId = argv[2];
+    std::wstring dir = argv[3];
+    Bound from, to;
+    for (int i = 4; i + 1 < argc; i += 2) {
+        bool ok = wcscmp(argv[i], L"--from") == 0 ? ParseBound(argv[i + 1], false, from)
+            : wcscmp(argv[i], L"--to") == 0 ? ParseBound(argv[i + 1], true, to) : false;
+        if (!ok) {
+            fwprintf(stderr, L"Bad argument: %ls %ls\n", argv[i], argv[i + 1]);
+            return 2;
+        }
+    }
+    uint64_t fromUtc = from.set ? from.utc : 0;
+    uint64_t toUtc = to.set ? to.utc : UINT64_MAX;
+
+    // Сегменты по имени (хронологически), активный - последним
+    std::vector<std::wstring> segments;
+    WIN32_FIND_DATAW fd;
+    HANDLE find = FindFirstFileW((dir + L"\\scheduler.*.log").c_str(), &fd);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) segments.push_back(dir + L"\\" + fd.cFileName);
+        } while (FindNextFileW(find, &fd));
+        FindClose(find);
+    }
+    std::sort(segments.begin(), segments.end());
+    segments.push_back(dir + L"\\scheduler.log");
+
+    const std::string id = util::ToUtf8(taskId);
+    size_t pruned = 0, scanned = 0, unindexed = 0, matched = 0;
+
+    for (size_t s = 0; s < segments.size(); ++s) {
+        const std::wstring& path = segments[s];
+        bool active = s + 1 == segments.size();
+        uint64_t size = FileSize(path);
+        if (size == 0) continue;
+
+        uint64_t offset = 0;
+        std::string raw;
+        logidx::SegmentIndex index;
+        if (ReadAll(logidx::IndexPathFor(path, active), raw) && index.Parse(raw) && index.Covers(size)) {
+            if (!index.Overlaps(fromUtc, toUtc) || !index.MayContain(taskId)) {
+                if (index.Usable(size)) {
+                    ++pruned;
+                    continue;
+                }
+                offset = index.Header().fileBytes;   // активный сегмент: только хвост после индекса
+            }
+            else if (from.set) {
+                offset = index.SeekOffset(fromUtc);
+            }
+        }
+        else {
+            ++unindexed;
+        }
+        ++scanned;
+
+        std::ifstream in(path, std::ios::binary);
+        if (!in) continue;
+        in.seekg((std::streamoff)offset);
+
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!HasTask(line, id)) continue;
+            if (line.size() >= 19) {
+                if (from.set && line.compare(0, 19, from.text) < 0) continue;
+                if (to.set && line.compare(0, 19, to.text) > 0) continue;
+            }
+            line += '\n';
+            fwrite(line.data(), 1, line.size(), stdout);
+            ++matched;
+        }
+    }
+
+    fwprintf(stderr, L"%zu lines | segments: %zu scanned (%zu without index), %zu skipped by index\n",
+        matched, scanned, unindexed, pruned);
+    return 0;
+}
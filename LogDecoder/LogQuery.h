@@ -0,0 +1,7 @@
+﻿#pragma once
+
+// LogDecoder --task: строки текстового журнала одной задачи за интервал времени.
+// Сегменты, которые по индексу (.idx) не пересекают интервал или не содержат задачу, не читаются.
+//
+//   LogDecoder.exe --task <id> <папка журнала> [--from "YYYY-MM-DD HH:MM[:SS]"] [--to "..."]
+int RunTaskQuery(int argc, wchar_t** argv);
@@ -0,0 +1,107 @@
+﻿#include "Tests.h"
+#include "../Cursach/Async.h"
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <Windows.h>
+
+namespace {
+    async::Future<int> AddOnPool(async::ThreadPool& pool, int a, int b, DWORD& thread) {
+        co_await pool.Schedule();
+        thread = GetCurrentThreadId();
+        co_return a + b;
+    }
+
+    async::Future<int> FailOnPool(async::ThreadPool& pool) {
+        co_await pool.Schedule();
+        throw std::runtime_error("job failed");
+    }
+
+    async::Future<void> FailVoid(async::ThreadPool& pool) {
+        co_await pool.Schedule();
+        throw std::logic_error("void job failed");
+    }
+
+    // Цепочка: результаты вложенных Future приходят по порядку, итог - в *sum
+    async::Future<void> SumTwice(async::ThreadPool& pool, int* sum, DWORD* thread, HANDLE done) {
+        int first = co_await AddOnPool(pool, 1, 2, *thread);
+        int second = co_await AddOnPool(pool, first, 10, *thread);
+        *sum = second;
+        SetEvent(done);
+    }
+
+    // Исключение из вложенной сопрограммы выходит из co_await у ожидающего
+    async::Future<void> CatchFailures(async::ThreadPool& pool, std::string* caught, HANDLE done) {
+        try {
+            co_await FailOnPool(pool);
+            *caught += "no exception;";
+        }
+        catch (const std::runtime_error& e) {
+            *caught += std::string(e.what()) + ";";
+        }
+        try {
+            co_await FailVoid(pool);
+            *caught += "no exception;";
+        }
+        catch (const std::logic_error& e) {
+            *caught += std::string(e.what()) + ";";
+        }
+        SetEvent(done);
+    }
+
+    async::Future<void> CountOne(async::ThreadPool& pool, std::atomic<int>* left, HANDLE done) {
+        DWORD thread = 0;
+        int v = co_await AddOnPool(pool, 1, 0, thread);
+        if (left->fetch_sub(v) == 1) SetEvent(done);
+    }
+
+    async::Future<void> SetFlag(bool* ran) {
+        *ran = true;
+        co_return;
+    }
+}
+
+// Результат co_return доходит до ожидающего через пул, продолжение - не в вызывающем потоке
+TEST(AsyncFutureCompletesOnPool) {
+    async::ThreadPool pool(1, 4);
+    HANDLE done = CreateEventW(NULL, TRUE, FALSE, NULL);
+    int sum = 0;
+    DWORD thread = 0;
+    async::Spawn(SumTwice(pool, &sum, &thread, done));
+    CHECK(WaitForSingleObject(done, 5000) == WAIT_OBJECT_0);
+    CHECK(sum == 13);
+    CHECK(thread != 0 && thread != GetCurrentThreadId());
+    CloseHandle(done);
+}
+
+// Исключения Future<T> и Future<void> перебрасываются в co_await
+TEST(AsyncFuturePropagatesExceptions) {
+    async::ThreadPool pool(1, 4);
+    HANDLE done = CreateEventW(NULL, TRUE, FALSE, NULL);
+    std::string caught;
+    async::Spawn(CatchFailures(pool, &caught, done));
+    CHECK(WaitForSingleObject(done, 5000) == WAIT_OBJECT_0);
+    CHECK(caught == "job failed;void job failed;");
+    CloseHandle(done);
+}
+
+// Много одновременных сопрограмм на малом пуле: каждая завершается ровно один раз.
+// Future, который не ожидали, тело не выполняет и освобождает кадр
+TEST(AsyncPoolCompletesEverySpawn) {
+    const int kJobs = 2000;
+    HANDLE done = CreateEventW(NULL, TRUE, FALSE, NULL);
+    std::atomic<int> left{ kJobs };
+    {
+        async::ThreadPool pool(1, 4);
+        for (int i = 0; i < kJobs; ++i) async::Spawn(CountOne(pool, &left, done));
+        CHECK(WaitForSingleObject(done, 10000) == WAIT_OBJECT_0);
+    }
+    CHECK(left.load() == 0);
+    CloseHandle(done);
+
+    bool ran = false;
+    {
+        async::Future<void> lazy = SetFlag(&ran);
+    }
+    CHECK(!ran);
+}
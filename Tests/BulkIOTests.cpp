@@ -0,0 +1,126 @@
+﻿#include "Tests.h"
+#include "../Cursach/BulkIO.h"
+#include "../Cursach/Persistence.h"
+#include "../Cursach/TaskManager.h"
+#include "../Cursach/Utf8File.h"
+#include <Windows.h>
+#include <map>
+
+namespace {
+
+    // Строки с разделителями CSV, кавычками, переводами строк и не-ASCII
+    std::vector<TaskPtr> SampleTasks() {
+        std::vector<TaskPtr> tasks;
+        for (int i = 0; i < 50; ++i) {
+            auto t = std::make_shared<Task>();
+            t->id = L"bulk-" + std::to_wstring(i);
+            t->name = L"task \"" + std::to_wstring(i) + L"\", line\r\nnext";
+            t->description = i % 2 ? L"Отчет, этап " + std::to_wstring(i) : L"";
+            t->exePath = std::wstring(L"C:\\Tools\\job ") + std::to_wstring(i % 3) + L".exe";
+            t->arguments = L"--in \"a,b\" --out c:\\tmp\\";
+            t->group = i % 4 ? L"group " + std::to_wstring(i % 4) : L"";
+            t->enabled = i % 5 != 0;
+            t->triggerType = i % 2 ? TriggerType::INTERVAL : TriggerType::WEEKLY;
+            t->intervalMinutes = 1 + i;
+            t->weeklyDays = std::bitset<7>(1 + i % 127);
+            t->weeklyHour = i % 24;
+            t->retryMaxAttempts = i % 3;
+            t->retryExitCodes = i % 3 ? L"1,2" : L"";
+            tasks.push_back(t);
+        }
+        return tasks;
+    }
+
+    std::map<std::wstring, TaskPtr> LoadById(const std::wstring& dir) {
+        test::ScopedDataDir data(dir);
+        Persistence store;
+        std::map<std::wstring, TaskPtr> byId;
+        for (auto& t : store.Load()) byId[std::wstring(t->id)] = t;
+        return byId;
+    }
+
+    void CheckSameDefinition(const Task& a, const Task& b) {
+        CHECK(a.name == b.name);
+        CHECK(a.description == b.description);
+        CHECK((const std::wstring&)a.exePath == (const std::wstring&)b.exePath);
+        CHECK((const std::wstring&)a.arguments == (const std::wstring&)b.arguments);
+        CHECK(a.group == b.group);
+        CHECK(a.enabled == b.enabled);
+        CHECK(a.triggerType == b.triggerType);
+        CHECK(a.intervalMinutes == b.intervalMinutes);
+        CHECK(a.weeklyDays == b.weeklyDays);
+        CHECK(a.weeklyHour == b.weeklyHour);
+        CHECK(a.retryMaxAttempts == b.retryMaxAttempts);
+        CHECK(a.retryExitCodes == b.retryExitCodes);
+    }
+
+    std::string ReadAll(const std::wstring& path) {
+        std::string bytes;
+        util::ReadFileUtf8(path, bytes);
+        return bytes;
+    }
+
+} // namespace
+
+// tasks.json -> --export -> --import в пустой каталог -> те же определения задач
+TEST(BulkExportImportRoundTrip) {
+    std::wstring src = test::TempDir(L"bulk-src");
+    std::vector<TaskPtr> original = SampleTasks();
+    {
+        test::ScopedDataDir data(src);
+        TaskManager tm;
+        for (auto& t : original) tm.AddTask(t);
+    }
+
+    for (const wchar_t* ext : { L".ndjson", L".csv" }) {
+        std::wstring file = src + L"\\export" + ext;
+        {
+            test::ScopedDataDir data(src);
+            CHECK(test::RunCommand(RunExportCommand, { L"--export", file }) == 0);
+        }
+
+        std::wstring dst = test::TempDir(std::wstring(L"bulk-dst") + ext);
+        {
+            test::ScopedDataDir data(dst);
+            CHECK(test::RunCommand(RunImportCommand, { L"--import", file, L"--batch", L"7" }) == 0);
+        }
+
+        auto imported = LoadById(dst);
+        CHECK(imported.size() == original.size());
+        for (auto& t : original) {
+            auto it = imported.find(std::wstring(t->id));
+            CHECK(it != imported.end());
+            CheckSameDefinition(*t, *it->second);
+        }
+
+        // Повторный экспорт импортированного - тот же файл
+        std::wstring again = dst + L"\\again" + ext;
+        {
+            test::ScopedDataDir data(dst);
+            CHECK(test::RunCommand(RunExportCommand, { L"--export", again }) == 0);
+        }
+        CHECK(ReadAll(again) == ReadAll(file));
+    }
+}
+
+// Пока runtime.dat открыт планировщиком, импорт отказывается и хранилище не трогает
+TEST(BulkImportRefusesWhileStoreIsInUse) {
+    std::wstring dir = test::TempDir(L"bulk-busy");
+    test::ScopedDataDir data(dir);
+    {
+        TaskManager tm;
+        tm.AddTask(SampleTasks().front());
+    }
+    std::wstring file = dir + L"\\in.ndjson";
+    CHECK(test::RunCommand(RunExportCommand, { L"--export", file }) == 0);
+    std::string before = ReadAll(dir + L"\\tasks.json");
+
+    HANDLE held = CreateFileW((dir + L"\\runtime.dat").c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    CHECK(held != INVALID_HANDLE_VALUE);
+    int rc = test::RunCommand(RunImportCommand, { L"--import", file });
+    CloseHandle(held);
+
+    CHECK(rc == 1);
+    CHECK(ReadAll(dir + L"\\tasks.json") == before);
+}
@@ -0,0 +1,159 @@
+﻿#include "Tests.h"
+#include "../Cursach/JsonSimd.h"
+#include "../Cursach/Persistence.h"
+#include "../Cursach/Utf8File.h"
+#include <random>
+
+using namespace util::json;
+
+namespace {
+
+    // Строки с кавычками, обратными слешами, управляющими символами, обрывками \u
+    // и суррогатами - у границ 16/32-символьных блоков и внутри них
+    std::wstring RandomString(std::mt19937& rng) {
+        static const wchar_t alphabet[] = L"ab\"\\\n\r\t\b\f\x01\x1f u0123456789ABCDEF/\x7f\x0410\xd83d\xde00";
+        std::uniform_int_distribution<int> len(0, 80);
+        std::uniform_int_distribution<int> pick(0, (int)(sizeof(alphabet) / sizeof(wchar_t)) - 2);
+        std::uniform_int_distribution<int> clean(0, 3);
+        std::wstring s;
+        int n = len(rng);
+        for (int i = 0; i < n; ++i) s += clean(rng) ? L'x' : alphabet[pick(rng)];
+        return s;
+    }
+
+    std::vector<Isa> AvailableIsas() {
+        std::vector<Isa> isas{ Isa::Scalar };
+        if (DetectedIsa() >= Isa::SSE2) isas.push_back(Isa::SSE2);
+        if (DetectedIsa() >= Isa::AVX2) isas.push_back(Isa::AVX2);
+        return isas;
+    }
+
+    // util::EscapeJSON до перехода на ядра: только \\, \", \n, \r, \t, прочие управляющие
+    // символы - как есть. В таком виде лежат tasks.json, записанные прежними версиями
+    std::wstring LegacyEscape(const std::wstring& s) {
+        std::wstring out; out.reserve(s.size());
+        for (wchar_t c : s) {
+            switch (c) {
+            case L'\\': out += L"\\\\"; break;
+            case L'"':  out += L"\\\""; break;
+            case L'\n': out += L"\\n"; break;
+            case L'\r': out += L"\\r"; break;
+            case L'\t': out += L"\\t"; break;
+            default: out.push_back(c); break;
+            }
+        }
+        return out;
+    }
+
+    struct IsaRestore {
+        Isa saved = ActiveIsa();
+        ~IsaRestore() { ForceIsa(saved); }
+    };
+
+} // namespace
+
+// Каждое доступное ядро совпадает с посимвольными эталонами
+TEST(JsonKernelsMatchReference) {
+    IsaRestore restore;
+    for (Isa isa : AvailableIsas()) {
+        ForceIsa(isa);
+        std::mt19937 rng(12345);
+        for (int i = 0; i < 100000; ++i) {
+            std::wstring s = RandomString(rng);
+            std::wstring escaped = Escape(s);
+            CHECK(escaped == EscapeReference(s));
+            CHECK(Unescape(s) == UnescapeReference(s));
+            CHECK(IsValid(s) == IsValidReference(s));
+            CHECK(Unescape(escaped) == s);
+        }
+    }
+}
+
+TEST(JsonEscapeShortForms) {
+    CHECK(Escape(L"\b\f\n\r\t\"\\") == L"\\b\\f\\n\\r\\t\\\"\\\\");
+    CHECK(Escape(std::wstring(1, L'\x01')) == L"\\u0001");
+    CHECK(Unescape(L"\\u0041\\/\\ud83d\\ude00") == L"A/\xd83d\xde00");
+}
+
+// Строки в прежнем формате читаются так же, как их читал прежний UnescapeJSON:
+// сырые \b, \f, \x01 остаются символами, текст вида "\u0041" был записан как "\\u0041"
+// и остается текстом, а не кодовой единицей
+TEST(JsonUnescapeReadsLegacyEscapes) {
+    IsaRestore restore;
+    const std::wstring fixed[] = {
+        L"C:\\Program Files\\Tool\\run.exe",
+        L"say \"hi\"\r\n\tnext line",
+        L"raw \b\f\x01\x1f controls",
+        L"literal \\u0041 and \\n stay text",
+        L"trailing backslash \\",
+    };
+    for (Isa isa : AvailableIsas()) {
+        ForceIsa(isa);
+        for (const std::wstring& s : fixed) {
+            std::wstring legacy = LegacyEscape(s);
+            CHECK(Unescape(legacy) == s);
+            CHECK(IsValid(L"{\"v\": \"" + legacy + L"\"}"));
+        }
+        std::mt19937 rng(777);
+        for (int i = 0; i < 20000; ++i) {
+            std::wstring s = RandomString(rng);
+            CHECK(Unescape(LegacyEscape(s)) == s);
+        }
+    }
+    CHECK(Unescape(LegacyEscape(L"literal \\u0041")) == L"literal \\u0041");
+}
+
+// tasks.json, записанный прежней версией: загружается с теми же строками, после
+// пересохранения в новом формате (\b, \f, \u00XX) читается обратно без изменений
+TEST(PersistenceLoadsLegacyTasksFile) {
+    std::wstring dir = test::TempDir(L"json-legacy");
+    {
+        util::Utf8Writer out(dir + L"\\tasks.json");
+        out << "{\n  \"tasks\": [\n    {\n"
+               "      \"id\": \"{legacy-1}\",\n"
+               "      \"name\": \"Backup \\\"daily\\\"\",\n"
+               "      \"description\": \"line one\\nline two\\tcol \x01\x1f\\\\u0041\",\n"
+               "      \"exePath\": \"C:\\\\Tools\\\\backup.exe\",\n"
+               "      \"arguments\": \"--dest \\\"D:\\\\Archive\\\\\\\"\",\n"
+               "      \"workingDirectory\": \"C:\\\\Tools\",\n"
+               "      \"enabled\": true,\n"
+               "      \"triggerType\": 1,\n"
+               "      \"runOnceTime\": 0,\n"
+               "      \"intervalMinutes\": 15,\n"
+               "      \"dailyHour\": 0,\n"
+               "      \"dailyMinute\": 0,\n"
+               "      \"dailySecond\": 0,\n"
+               "      \"weeklyDays\": 0,\n"
+               "      \"weeklyHour\": 0,\n"
+               "      \"weeklyMinute\": 0,\n"
+               "      \"weeklySecond\": 0,\n"
+               "      \"runIfMissed\": false,\n"
+               "      \"hasExecutionTimeout\": false,\n"
+               "      \"executionTimeoutMinutes\": 0\n"
+               "    }\n  ]\n}\n";
+        CHECK(out.Close());
+    }
+
+    auto check = [](const std::vector<TaskPtr>& tasks) {
+        CHECK(tasks.size() == 1);
+        const Task& t = *tasks[0];
+        CHECK(t.id == L"{legacy-1}");
+        CHECK(t.name == L"Backup \"daily\"");
+        CHECK(t.description == L"line one\nline two\tcol \x01\x1f\\u0041");
+        CHECK(t.exePath == L"C:\\Tools\\backup.exe");
+        CHECK(t.arguments == L"--dest \"D:\\Archive\\\"");
+        CHECK(t.workingDirectory == L"C:\\Tools");
+        CHECK(t.triggerType == TriggerType::INTERVAL && t.intervalMinutes == 15);
+    };
+
+    test::ScopedDataDir data(dir);
+    Persistence store;
+    std::vector<TaskPtr> tasks = store.Load(false);
+    check(tasks);
+
+    CHECK(store.Save(tasks));
+    std::string text;
+    CHECK(util::ReadFileUtf8(dir + L"\\tasks.json", text));
+    CHECK(text.find("\\u0001\\u001f") != std::string::npos);   // сырые управляющие больше не пишутся
+    check(store.Load(false));
+}
@@ -0,0 +1,58 @@
+﻿#include "Tests.h"
+#include "../Cursach/Launcher.h"
+#include <Windows.h>
+
+namespace {
+    const DWORD kHelperDelayMs = 6500;   // дольше таймаута ответа (5 с)
+
+    std::wstring TestsExe() {
+        wchar_t exe[MAX_PATH] = {};
+        GetModuleFileNameW(NULL, exe, MAX_PATH);
+        return exe;
+    }
+}
+
+// Помощник, который просыпается с опозданием: запросы ждут в канале, затем он работает
+// как обычный. args: задержка (мс), канал, родитель
+CHILD(SlowLauncherChild) {
+    Sleep((DWORD)_wtoi(args[0].c_str()));
+    std::wstring exe = TestsExe(), flag = L"--launcher", pipe = args[1], parent = args[2];
+    wchar_t* argv[] = { &exe[0], &flag[0], &pipe[0], &parent[0] };
+    return RunLauncherMain(4, argv);
+}
+
+// Помощник молчит дольше 5 с: Spawn отказывает по таймауту (задача запускается напрямую),
+// повторно помощник в пределах минуты не запускается. Когда он все же отвечает,
+// созданный им процесс завершается, не начав работу
+TEST(LauncherTimeoutAndLateReply) {
+    std::wstring dir = test::TempDir(L"launcher-late");
+    std::wstring marker = dir + L"\\late-started.txt";
+
+    Launcher launcher;
+    launcher.SetHelperCommand(L"\"" + TestsExe() + L"\" --child SlowLauncherChild " + std::to_wstring(kHelperDelayMs));
+    CHECK(launcher.Start());
+
+    // Как в JobExecutor: процесс создается приостановленным; выжить он может, только если
+    // его кто-то возобновит - тогда появится файл
+    std::wstring command = L"cmd.exe /c echo started> \"" + marker + L"\"";
+    PROCESS_INFORMATION pi{};
+    DWORD error = 0;
+    ULONGLONG t0 = GetTickCount64();
+    bool viaLauncher = launcher.Spawn(command, NULL, CREATE_NO_WINDOW | CREATE_SUSPENDED, nullptr, pi, error);
+    ULONGLONG waited = GetTickCount64() - t0;
+    CHECK(!viaLauncher);
+    CHECK(waited >= 4900 && waited < kHelperDelayMs);
+    CHECK(!launcher.IsRunning());
+
+    // Повторный запуск помощника - не раньше чем через минуту: сейчас сразу отказ
+    t0 = GetTickCount64();
+    CHECK(!launcher.Spawn(command, NULL, CREATE_NO_WINDOW | CREATE_SUSPENDED, nullptr, pi, error));
+    CHECK(GetTickCount64() - t0 < 1000);
+
+    for (int i = 0; i < 500 && launcher.LateReplies() == 0; ++i) Sleep(10);
+    CHECK(launcher.LateReplies() == 1);
+
+    Sleep(500);
+    CHECK(GetFileAttributesW(marker.c_str()) == INVALID_FILE_ATTRIBUTES);
+    launcher.Stop();
+}
@@ -0,0 +1,287 @@
+﻿#include "Tests.h"
+#include "../Cursach/Persistence.h"
+#include "../Cursach/Task.h"
+#include "../Cursach/TaskManager.h"
+#include <Windows.h>
+#include <cstdlib>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+
+// Счетчик глобальных выделений текущего потока: писатель журнала и прочие потоки не мешают
+namespace {
+    thread_local size_t t_allocations = 0;
+}
+
+void* operator new(size_t n) {
+    ++t_allocations;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+    // id, name и description длиннее буфера короткой строки: в куче каждая - отдельное выделение
+    void WriteStore(const std::wstring& dir, int count) {
+        std::vector<TaskPtr> tasks;
+        for (int i = 0; i < count; ++i) {
+            auto t = std::make_shared<Task>();
+            t->id = L"{persistence-test-" + std::to_wstring(i) + L"}";
+            t->name = L"Nightly export " + std::to_wstring(i);
+            t->description = L"Exports table " + std::to_wstring(i) + L" to the \"archive\" share";
+            t->exePath = L"C:\\Tools\\export.exe";
+            t->arguments = L"--table " + std::to_wstring(i % 4);
+            t->triggerType = TriggerType::INTERVAL;
+            t->intervalMinutes = 5 + i % 60;
+            tasks.push_back(t);
+        }
+        test::ScopedDataDir data(dir);
+        Persistence store;
+        CHECK(store.Save(tasks));
+    }
+
+    bool InHeap(const std::pmr::wstring& s) {
+        return s.get_allocator().resource() == std::pmr::get_default_resource();
+    }
+
+    // Задачи WriteStore делятся между двумя экземплярами по четности номера
+    bool MergeOwner(std::wstring_view id, int parity) {
+        return (id[id.size() - 2] - L'0') % 2 == parity;
+    }
+
+    std::wstring StoreTaskId(int i) { return L"{persistence-test-" + std::to_wstring(i) + L"}"; }
+
+    // События TaskManager из потока наблюдателя (Reset уплотнения снимка не считается)
+    class EventLog {
+    public:
+        explicit EventLog(TaskManager& tm) {
+            tm.SetOnTaskEvent([this](const TaskEvent& e) {
+                if (e.kind == TaskEvent::Kind::Reset) return;
+                std::lock_guard<std::mutex> lk(mtx_);
+                events_.push_back(e);
+            });
+        }
+
+        std::vector<TaskEvent> WaitFor(size_t count, DWORD timeoutMs) {
+            for (DWORD waited = 0; waited < timeoutMs; waited += 10) {
+                {
+                    std::lock_guard<std::mutex> lk(mtx_);
+                    if (events_.size() >= count) break;
+                }
+                Sleep(10);
+            }
+            std::lock_guard<std::mutex> lk(mtx_);
+            return events_;
+        }
+
+    private:
+        std::mutex mtx_;
+        std::vector<TaskEvent> events_;
+    };
+}
+
+// Экземпляр, который читает tasks.json один раз и дальше только сохраняет свои задачи.
+// args: четность своих задач, число сохранений
+CHILD(MergedSaveChild) {
+    int parity = _wtoi(args[0].c_str());
+    int rounds = _wtoi(args[1].c_str());
+    Persistence store;
+    std::vector<TaskPtr> tasks = store.Load(false);
+    if (tasks.empty()) return 2;
+
+    auto mine = [parity](std::wstring_view id) { return MergeOwner(id, parity); };
+    for (int r = 1; r <= rounds; ++r) {
+        for (auto& t : tasks) {
+            if (mine(t->id)) t->retryRuns = r;
+        }
+        if (!store.SaveMerged(tasks, mine)) return 3;
+    }
+    return 0;
+}
+
+// Load обращается к куче по числу чанков арены, а не по числу записей и строк
+TEST(PersistenceLoadAllocatesPerChunk) {
+    const int kTasks = 2000;
+    std::wstring dir = test::TempDir(L"persistence-alloc");
+    WriteStore(dir, kTasks);
+
+    test::ScopedDataDir data(dir);
+    Persistence store;
+    size_t before = t_allocations;
+    std::vector<TaskPtr> tasks = store.Load();
+    size_t allocations = t_allocations - before;
+
+    CHECK(tasks.size() == kTasks);
+    CHECK(store.GetLastLoadStats().valid);
+    CHECK(allocations < kTasks / 10);
+    CHECK(tasks[7]->name == L"Nightly export 7");
+    CHECK(tasks[7]->description == L"Exports table 7 to the \"archive\" share");
+}
+
+// Строки задач снимка - в арене; копия задачи и строки, измененные после загрузки, - в куче
+TEST(PersistenceSnapshotStrings) {
+    std::wstring dir = test::TempDir(L"persistence-strings");
+    WriteStore(dir, 10);
+
+    test::ScopedDataDir data(dir);
+    Persistence store;
+    std::vector<TaskPtr> tasks = store.Load();
+    CHECK(tasks.size() == 10);
+    CHECK(SnapshotOf(tasks[0]).records == 10);
+    CHECK(!InHeap(tasks[0]->id) && !InHeap(tasks[0]->name) && !InHeap(tasks[0]->description));
+
+    Task copy(*tasks[0]);
+    CHECK(InHeap(copy.id) && InHeap(copy.name) && InHeap(copy.description));
+    CHECK(copy.name == tasks[0]->name);
+    CHECK(SnapshotOf(std::make_shared<Task>(copy)).records == 0);
+
+    // Как правка в диалоге: строка растет уже после загрузки
+    tasks[0]->name = L"Renamed after load, long enough to need a new buffer";
+    tasks[0]->name += L" and then some";
+    CHECK(tasks[0]->name == L"Renamed after load, long enough to need a new buffer and then some");
+}
+
+// Перечитывание грузит без арены: принятая задача не держит записи, которые отброшены
+TEST(PersistenceLoadWithoutArena) {
+    std::wstring dir = test::TempDir(L"persistence-individual");
+    WriteStore(dir, 10);
+
+    test::ScopedDataDir data(dir);
+    Persistence store;
+    std::vector<TaskPtr> tasks = store.Load(false);
+    CHECK(tasks.size() == 10);
+    CHECK(store.GetLastLoadStats().valid);
+    CHECK(store.GetLastLoadStats().arenaChunks == 0);
+    for (auto& t : tasks) CHECK(SnapshotOf(t).records == 0 && InHeap(t->name));
+
+    std::weak_ptr<Task> probe = tasks[3];
+    TaskPtr kept = tasks[4];
+    tasks.clear();
+    CHECK(probe.expired());
+    CHECK(kept->name == L"Nightly export 4");
+}
+
+// Два процесса сохраняют каждый свои задачи поверх общего tasks.json: при записи всего списка
+// выиграл бы последний, со слиянием сохраняются изменения обоих
+TEST(PersistenceMergedSaveAcrossProcesses) {
+    const int kRounds = 40;
+    std::wstring dir = test::TempDir(L"persistence-merge");
+    WriteStore(dir, 30);
+
+    test::ScopedDataDir data(dir);
+    void* even = test::StartChild("MergedSaveChild", { L"0", std::to_wstring(kRounds) });
+    void* odd = test::StartChild("MergedSaveChild", { L"1", std::to_wstring(kRounds) });
+    CHECK(test::WaitChild(even) == 0);
+    CHECK(test::WaitChild(odd) == 0);
+
+    Persistence store;
+    std::vector<TaskPtr> tasks = store.Load();
+    CHECK(tasks.size() == 30);
+    for (auto& t : tasks) CHECK(t->retryRuns == kRounds);
+}
+
+// Одна оставшаяся задача не держит арену снимка: после удаления большинства задач
+// оставшиеся копируются в кучу, и снимок освобождается
+TEST(PersistenceSnapshotReleasedAfterRemovals) {
+    std::wstring dir = test::TempDir(L"persistence-compact");
+    WriteStore(dir, 20);
+
+    test::ScopedDataDir data(dir);
+    TaskManager tm;
+    std::weak_ptr<Task> probe;
+    {
+        std::vector<TaskPtr> all = tm.GetAllTasks();
+        CHECK(all.size() == 20);
+        CHECK(SnapshotOf(all.back()).records == 20);
+        probe = all.back();
+    }
+
+    for (int i = 0; i < 11; ++i) tm.RemoveTask(L"{persistence-test-" + std::to_wstring(i) + L"}");
+
+    std::vector<TaskPtr> left = tm.GetAllTasks();
+    CHECK(left.size() == 9);
+    for (auto& t : left) CHECK(SnapshotOf(t).records == 0);
+    CHECK(probe.expired());
+    CHECK(tm.GetTaskById(L"{persistence-test-19}")->name == L"Nightly export 19");
+}
+
+// Внешняя правка tasks.json: применяется только разница по id - удаленная, измененная
+// и новая задачи дают по одному событию, неизмененные остаются со своим состоянием
+TEST(StoreReloadAppliesExternalEdits) {
+    std::wstring dir = test::TempDir(L"store-reload");
+    WriteStore(dir, 5);
+
+    test::ScopedDataDir data(dir);
+    TaskManager tm;
+    tm.GetTaskById(StoreTaskId(1))->lastExitCode = 5;
+    tm.GetTaskById(StoreTaskId(2))->lastExitCode = 7;
+    EventLog log(tm);
+    tm.StartStoreWatch();
+
+    {
+        Persistence other;
+        std::vector<TaskPtr> edited = other.Load(false);
+        CHECK(edited.size() == 5);
+        edited.erase(edited.begin());                        // {persistence-test-0}
+        edited[1]->name = L"Edited by another writer";       // {persistence-test-2}
+        auto added = std::make_shared<Task>();
+        added->id = L"{persistence-test-new}";
+        added->name = L"Added by another writer";
+        added->exePath = L"C:\\Tools\\export.exe";
+        added->triggerType = TriggerType::INTERVAL;
+        added->intervalMinutes = 15;
+        edited.push_back(added);
+        CHECK(other.Save(edited));
+    }
+
+    std::vector<TaskEvent> events = log.WaitFor(3, 5000);
+    tm.StopStoreWatch();
+
+    CHECK(events.size() == 3);
+    size_t removed = 0, updated = 0, added = 0;
+    for (auto& e : events) {
+        if (e.kind == TaskEvent::Kind::Removed && e.id == StoreTaskId(0)) ++removed;
+        if (e.kind == TaskEvent::Kind::Updated && e.id == StoreTaskId(2)) ++updated;
+        if (e.kind == TaskEvent::Kind::Added && e.id == L"{persistence-test-new}") ++added;
+    }
+    CHECK(removed == 1 && updated == 1 && added == 1);
+
+    CHECK(tm.GetAllTasks().size() == 5);
+    CHECK(!tm.GetTaskById(StoreTaskId(0)));
+    TaskPtr changed = tm.GetTaskById(StoreTaskId(2));
+    CHECK(changed->name == L"Edited by another writer");
+    CHECK(changed->lastExitCode == 7);                       // история задачи - за id
+    CHECK(tm.GetTaskById(StoreTaskId(1))->lastExitCode == 5);
+    CHECK(tm.GetTaskById(L"{persistence-test-new}")->name == L"Added by another writer");
+}
+
+// Свое сохранение наблюдатель узнает по отпечатку и не перечитывает: задача, добавленная
+// после него без сохранения (импорт), не пропадает из списка
+TEST(StoreReloadIgnoresOwnSave) {
+    std::wstring dir = test::TempDir(L"store-own-save");
+    WriteStore(dir, 3);
+
+    test::ScopedDataDir data(dir);
+    TaskManager tm;
+    tm.StartStoreWatch();
+
+    auto saved = std::make_shared<Task>(*tm.GetTaskById(StoreTaskId(0)));
+    saved->id = L"{persistence-test-saved}";
+    tm.AddTask(saved);                                       // пишет tasks.json
+
+    auto imported = std::make_shared<Task>(*saved);
+    imported->id = L"{persistence-test-imported}";
+    size_t added = 0, updated = 0;
+    tm.ImportBatch({ imported }, added, updated);            // без сохранения
+    CHECK(added == 1);
+
+    EventLog log(tm);
+    std::vector<TaskEvent> events = log.WaitFor(1, 2000);   // больше паузы наблюдателя (500 мс)
+    tm.StopStoreWatch();
+
+    CHECK(events.empty());
+    CHECK(tm.GetTaskById(L"{persistence-test-imported}") != nullptr);
+    CHECK(tm.GetAllTasks().size() == 5);
+}
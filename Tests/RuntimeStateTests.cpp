@@ -0,0 +1,128 @@
+﻿#include "Tests.h"
+#include "../Cursach/RuntimeState.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <vector>
+#include <Windows.h>
+
+using namespace std::chrono;
+
+namespace {
+    const system_clock::time_point kBase = system_clock::from_time_t((time_t)1767571200);
+
+    std::wstring SlotTaskId(int i) { return L"{runtime-" + std::to_wstring(i) + L"}"; }
+
+    Task RecordTask(const std::wstring& id, int k) {
+        Task t;
+        t.id = id;
+        t.lastRunTime = kBase + seconds(k);
+        t.nextRunTime = kBase + seconds(2 * k);
+        t.lastExitCode = k;
+        return t;
+    }
+
+    bool HasRecord(const RuntimeState& rs, uint32_t slot, const std::wstring& id, int k) {
+        RuntimeState::Record r;
+        return rs.Read(slot, id, r) && r.lastRunTime == kBase + seconds(k) &&
+            r.nextRunTime == kBase + seconds(2 * k) && r.lastExitCode == k;
+    }
+}
+
+// Записи переживают рост файла (256 -> 512 -> 1024 слота, каждый раз новое отображение)
+// и повторное открытие; чужой id слот не читает, освобожденный слот выдается снова
+TEST(RuntimeStateSlotsSurviveGrowth) {
+    std::wstring path = test::TempDir(L"runtime-growth") + L"\\runtime.dat";
+    const int kTasks = 600;
+    std::vector<uint32_t> slots;
+    {
+        RuntimeState rs;
+        CHECK(rs.Open(path));
+        for (int i = 0; i < kTasks; ++i) {
+            uint32_t slot = rs.Allocate(SlotTaskId(i));
+            CHECK(slot != RuntimeState::kNoSlot);
+            rs.Store(slot, RecordTask(SlotTaskId(i), i));
+            slots.push_back(slot);
+        }
+        CHECK(std::set<uint32_t>(slots.begin(), slots.end()).size() == (size_t)kTasks);
+        for (int i = 0; i < kTasks; ++i) CHECK(HasRecord(rs, slots[i], SlotTaskId(i), i));
+
+        RuntimeState::Record r;
+        CHECK(!rs.Read(slots[3], SlotTaskId(4), r));
+        rs.Store(slots[3], RecordTask(SlotTaskId(4), 9999));   // чужой слот не меняется
+        CHECK(HasRecord(rs, slots[3], SlotTaskId(3), 3));
+
+        rs.Free(slots[10]);
+        CHECK(!rs.Read(slots[10], SlotTaskId(10), r));
+        CHECK(rs.Allocate(L"{runtime-new}") == slots[10]);
+        CHECK(rs.Read(slots[10], L"{runtime-new}", r) && r.lastExitCode == 0);
+        rs.Close();
+    }
+
+    WIN32_FILE_ATTRIBUTE_DATA info{};
+    CHECK(GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &info));
+    CHECK(info.nFileSizeLow == 128 + 1024 * 128);
+
+    RuntimeState reopened;
+    CHECK(reopened.Open(path));
+    for (int i = 0; i < kTasks; ++i) {
+        if (i != 10) CHECK(HasRecord(reopened, slots[i], SlotTaskId(i), i));
+    }
+    uint32_t fresh = reopened.Allocate(L"{runtime-after-reopen}");
+    CHECK(fresh != RuntimeState::kNoSlot);
+    CHECK(std::find(slots.begin(), slots.end(), fresh) == slots.end());
+}
+
+// Seqlock: два писателя одного слота и читатели, пока третий поток растит файл.
+// Читатель всегда видит запись одного Store целиком (nextRunTime = 2 * lastRunTime)
+TEST(RuntimeStateReadersSeeWholeRecords) {
+    std::wstring path = test::TempDir(L"runtime-seqlock") + L"\\runtime.dat";
+    RuntimeState rs;
+    CHECK(rs.Open(path));
+    const std::wstring id = L"{runtime-hot}";
+    uint32_t slot = rs.Allocate(id);
+    CHECK(slot != RuntimeState::kNoSlot);
+    rs.Store(slot, RecordTask(id, 0));
+
+    std::atomic<bool> done{ false };
+    std::atomic<uint64_t> reads{ 0 }, torn{ 0 };
+    std::vector<std::thread> threads;
+    for (int w = 0; w < 2; ++w) {
+        threads.emplace_back([&, w] {
+            for (int k = 1; k <= 200000; ++k) rs.Store(slot, RecordTask(id, 2 * k + w));
+        });
+    }
+    for (int r = 0; r < 2; ++r) {
+        threads.emplace_back([&] {
+            while (!done.load()) {
+                RuntimeState::Record rec;
+                if (!rs.Read(slot, id, rec)) {
+                    ++torn;
+                    continue;
+                }
+                int64_t last = duration_cast<seconds>(rec.lastRunTime - kBase).count();
+                int64_t next = duration_cast<seconds>(rec.nextRunTime - kBase).count();
+                if (next != 2 * last || rec.lastExitCode != (int)last) ++torn;
+                ++reads;
+            }
+        });
+    }
+    std::thread grow([&] {
+        for (int i = 0; i < 3000; ++i) rs.Allocate(SlotTaskId(i));
+    });
+
+    grow.join();
+    threads[0].join();
+    threads[1].join();
+    done = true;
+    threads[2].join();
+    threads[3].join();
+
+    CHECK(torn.load() == 0);
+    CHECK(reads.load() > 0);
+    RuntimeState::Record last;
+    CHECK(rs.Read(slot, id, last));
+    CHECK(last.lastExitCode == 400000 || last.lastExitCode == 400001);
+}
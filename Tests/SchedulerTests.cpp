@@ -0,0 +1,423 @@
+﻿#include "Tests.h"
+#include "../Cursach/Clock.h"
+#include "../Cursach/JobExecutor.h"
+#include "../Cursach/Scheduler.h"
+#include "../Cursach/TaskManager.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
+#include <Windows.h>
+
+using namespace std::chrono;
+
+namespace {
+    // Понедельник 2026-01-05 00:00 UTC: сроки INTERVAL от часового пояса не зависят
+    const Clock::time_point kStart = system_clock::from_time_t((time_t)1767571200);
+
+    // Хост RunSimulation с заданными длительностью и кодом выхода запусков (как Simulator,
+    // но без случайной модели): часы прыгают к сроку планировщика или к ближайшему завершению
+    class ScriptedHost : public SimulationHost {
+    public:
+        struct Started {
+            TaskPtr task;
+            Clock::time_point at;
+            bool queued;
+        };
+
+        std::function<milliseconds(const Task&)> duration = [](const Task&) { return minutes(1); };
+        std::function<int(const Task&)> exitCode = [](const Task&) { return 0; };
+        std::function<void(const TaskPtr&)> afterRun;   // после CompleteSimulatedRun, часы на сроке завершения
+
+        std::vector<Started> started;
+        std::vector<Clock::time_point> deadlines;     // сроки планировщика, кроме "сейчас" после запусков
+        uint32_t running = 0, peak = 0;
+        uint32_t runningOthers = 0, peakOthers = 0;   // без CRITICAL
+        uint32_t cancelled = 0;
+
+        ScriptedHost(VirtualClock& clock, Scheduler& sched, Clock::time_point end)
+            : clock_(clock), sched_(sched), end_(end) {}
+
+        void Launch(const TaskPtr& task, bool queuedRun) override {
+            Clock::time_point now = clock_.Now();
+            started.push_back(Started{ task, now, queuedRun });
+            live_.push_back(Live{ task, now + duration(*task), exitCode(*task), false });
+            peak = (std::max)(peak, ++running);
+            if (task->priority != TaskPriority::CRITICAL) peakOthers = (std::max)(peakOthers, ++runningOthers);
+        }
+
+        void Cancel(std::wstring_view taskId) override {
+            for (auto& run : live_) {
+                if (run.cancelled || std::wstring_view(run.task->id) != taskId) continue;
+                run.cancelled = true;
+                run.end = clock_.Now();
+                run.exitCode = JobExecutor::kCancelledExitCode;
+                ++cancelled;
+            }
+        }
+
+        bool WaitUntil(Clock::time_point deadline) override {
+            if (deadline != clock_.Now()) deadlines.push_back(deadline);
+            Clock::time_point target = end_;
+            if (deadline.time_since_epoch().count() != 0 && deadline < target) target = deadline;
+            for (auto& run : live_) target = (std::min)(target, run.end);
+
+            // Завершения до target - по порядку, часы стоят на сроке каждого
+            while (true) {
+                auto next = std::min_element(live_.begin(), live_.end(),
+                    [](const Live& a, const Live& b) { return a.end < b.end; });
+                if (next == live_.end() || next->end > target) break;
+                Live run = *next;
+                live_.erase(next);
+                if (run.end > clock_.Now()) clock_.AdvanceTo(run.end);
+                --running;
+                if (run.task->priority != TaskPriority::CRITICAL) --runningOthers;
+                run.task->lastExitCode = run.exitCode;
+                sched_.CompleteSimulatedRun(run.task, run.exitCode, run.cancelled);
+                if (afterRun) afterRun(run.task);
+            }
+            if (target > clock_.Now()) clock_.AdvanceTo(target);
+            return target < end_;
+        }
+
+        size_t StartsOf(const std::wstring& id) const {
+            return (size_t)std::count_if(started.begin(), started.end(),
+                [&id](const Started& s) { return std::wstring_view(s.task->id) == id; });
+        }
+
+    private:
+        struct Live {
+            TaskPtr task;
+            Clock::time_point end;
+            int exitCode;
+            bool cancelled;
+        };
+
+        VirtualClock& clock_;
+        Scheduler& sched_;
+        Clock::time_point end_;
+        std::vector<Live> live_;
+    };
+
+    TaskPtr IntervalTask(const std::wstring& id, uint32_t minutes, const std::wstring& group,
+        TaskPriority priority = TaskPriority::NORMAL) {
+        auto t = std::make_shared<Task>();
+        t->id = id;
+        t->name = id;
+        t->exePath = util::InternedWString(L"C:\\Windows\\System32\\cmd.exe");
+        t->triggerType = TriggerType::INTERVAL;
+        t->intervalMinutes = minutes;
+        t->group = group;
+        t->priority = priority;
+        return t;
+    }
+
+    const Scheduler::GroupStats* FindGroup(const std::vector<std::pair<std::wstring, Scheduler::GroupStats>>& stats,
+        const std::wstring& group) {
+        for (auto& [name, gs] : stats)
+            if (name == group) return &gs;
+        return nullptr;
+    }
+
+    // 8 задач "bulk" раз в минуту по 5 минут держат исполнитель насыщенным; CRITICAL "ops" -
+    // раз в 10 минут по минуте. Статистика ожидания по группам после двух часов
+    std::vector<std::pair<std::wstring, Scheduler::GroupStats>> RunReserveScenario(uint32_t reserved,
+        uint32_t& peak, uint32_t& peakOthers) {
+        VirtualClock clock(kStart);
+        TaskManager tm(clock, false);
+        for (int i = 0; i < 8; ++i) tm.AddTask(IntervalTask(L"bulk-" + std::to_wstring(i), 1, L"bulk"));
+        tm.AddTask(IntervalTask(L"ops", 10, L"ops", TaskPriority::CRITICAL));
+
+        Scheduler sched(&tm, clock);
+        sched.SetCapacity(3, reserved);
+        ScriptedHost host(clock, sched, kStart + hours(2));
+        host.duration = [](const Task& t) {
+            return t.priority == TaskPriority::CRITICAL ? milliseconds(minutes(1)) : milliseconds(minutes(5));
+        };
+        sched.RunSimulation(&host);
+
+        peak = host.peak;
+        peakOthers = host.peakOthers;
+        return sched.GetGroupStats();
+    }
+}
+
+// Резерв емкости: обычные задачи не занимают последний слот, CRITICAL запускается точно
+// в срок, хотя обычные ждут. Без резерва CRITICAL ждет освобождения слота
+TEST(SchedulerReservesCapacityForCritical) {
+    uint32_t peak = 0, peakOthers = 0;
+    auto stats = RunReserveScenario(1, peak, peakOthers);
+    CHECK(peak <= 3);
+    CHECK(peakOthers <= 2);
+
+    const Scheduler::GroupStats* ops = FindGroup(stats, L"ops");
+    const Scheduler::GroupStats* bulk = FindGroup(stats, L"bulk");
+    CHECK(ops && bulk);
+    CHECK(ops->dispatched >= 11);
+    CHECK(ops->maxWaitMs == 0);
+    CHECK(bulk->maxWaitMs > 0);
+
+    stats = RunReserveScenario(0, peak, peakOthers);
+    CHECK(peakOthers == 3);
+    ops = FindGroup(stats, L"ops");
+    CHECK(ops && ops->maxWaitMs > 0);
+}
+
+// DRR: при насыщении группы с весами 3 и 1 получают слоты примерно 3:1,
+// группа с меньшим весом не голодает
+TEST(SchedulerSharesCapacityByGroupWeight) {
+    VirtualClock clock(kStart);
+    TaskManager tm(clock, false);
+    for (int i = 0; i < 10; ++i) {
+        tm.AddTask(IntervalTask(L"a-" + std::to_wstring(i), 1, L"a"));
+        tm.AddTask(IntervalTask(L"b-" + std::to_wstring(i), 1, L"b"));
+    }
+
+    Scheduler sched(&tm, clock);
+    sched.SetCapacity(4, 0);
+    sched.SetGroupWeight(L"a", 3);
+    sched.SetGroupWeight(L"b", 1);
+    ScriptedHost host(clock, sched, kStart + hours(3));
+    host.duration = [](const Task&) { return minutes(2); };
+    sched.RunSimulation(&host);
+
+    CHECK(host.peak == 4);
+    auto stats = sched.GetGroupStats();
+    const Scheduler::GroupStats* a = FindGroup(stats, L"a");
+    const Scheduler::GroupStats* b = FindGroup(stats, L"b");
+    CHECK(a && b);
+    CHECK(b->dispatched >= 60);
+    double ratio = (double)a->dispatched / (double)b->dispatched;
+    CHECK(ratio > 2.7 && ratio < 3.3);
+
+    // Ожидание видно и в отчете (меню Help, лог)
+    std::wstring report = sched.GroupStatsReport();
+    CHECK(report.find(L"maxConcurrentJobs=4") != std::wstring::npos);
+    CHECK(report.find(L"  a ") != std::wstring::npos);
+}
+
+namespace {
+    struct OverlapRun {
+        std::vector<ScriptedHost::Started> started;
+        uint32_t peak = 0;
+        uint32_t cancelled = 0;
+        uint64_t skipped = 0;
+        uint64_t queued = 0;
+    };
+
+    // INTERVAL раз в минуту, запуск идет 2.5 минуты: каждое срабатывание попадает на живой запуск
+    OverlapRun RunOverlapScenario(OverlapPolicy policy) {
+        VirtualClock clock(kStart);
+        TaskManager tm(clock, false);
+        TaskPtr task = IntervalTask(L"overlap", 1, L"");
+        task->overlapPolicy = policy;
+        tm.AddTask(task);
+
+        Scheduler sched(&tm, clock);
+        ScriptedHost host(clock, sched, kStart + minutes(10) + seconds(30));
+        host.duration = [](const Task&) { return seconds(150); };
+        sched.RunSimulation(&host);
+
+        OverlapRun r;
+        r.started = host.started;
+        r.peak = host.peak;
+        r.cancelled = host.cancelled;
+        TaskPtr cur = tm.GetTaskById(L"overlap");
+        r.skipped = cur->overlapSkipped;
+        r.queued = cur->overlapQueued;
+        return r;
+    }
+}
+
+// ALLOW: запуски идут параллельно, ничего не пропускается
+TEST(OverlapAllowRunsInParallel) {
+    OverlapRun r = RunOverlapScenario(OverlapPolicy::ALLOW);
+    CHECK(r.started.size() == 10);
+    CHECK(r.peak == 3);
+    CHECK(r.skipped == 0 && r.queued == 0 && r.cancelled == 0);
+}
+
+// SKIP_IF_RUNNING: не больше одного запуска, срабатывания на живой запуск пропускаются
+TEST(OverlapSkipIfRunningDropsFires) {
+    OverlapRun r = RunOverlapScenario(OverlapPolicy::SKIP_IF_RUNNING);
+    CHECK(r.peak == 1);
+    CHECK(r.queued == 0 && r.cancelled == 0);
+    CHECK(r.skipped > 0);
+    CHECK(r.started.size() + r.skipped == 10);   // каждое срабатывание - либо запуск, либо пропуск
+    for (auto& s : r.started) CHECK(!s.queued);
+}
+
+// QUEUE_ONE: одно срабатывание ждет и стартует ровно в момент завершения текущего
+// запуска; следующие, пока оно ждет, пропускаются
+TEST(OverlapQueueOneStartsAtPreviousEnd) {
+    OverlapRun r = RunOverlapScenario(OverlapPolicy::QUEUE_ONE);
+    CHECK(r.peak == 1);
+    CHECK(r.cancelled == 0);
+    CHECK(r.queued > 0 && r.skipped > 0);
+
+    size_t queuedStarts = 0;
+    for (size_t i = 1; i < r.started.size(); ++i) {
+        if (!r.started[i].queued) continue;
+        ++queuedStarts;
+        CHECK(r.started[i].at == r.started[i - 1].at + seconds(150));
+    }
+    CHECK(queuedStarts > 0);
+    CHECK(queuedStarts + 1 >= r.queued);   // последнее отложенное может еще ждать
+}
+
+// CANCEL_PREVIOUS: каждое срабатывание останавливает прежний запуск и стартует заново
+TEST(OverlapCancelPreviousRestarts) {
+    OverlapRun r = RunOverlapScenario(OverlapPolicy::CANCEL_PREVIOUS);
+    CHECK(r.started.size() == 10);
+    CHECK(r.cancelled == r.started.size() - 1);
+    CHECK(r.skipped == 0 && r.queued == 0);
+}
+
+// Абсолютный срок таймера: FILETIME совпадает с тем, что дает Windows для той же даты,
+// доли меньше 100 нс отбрасываются
+TEST(DeadlineFileTimeMatchesSystemTime) {
+    CHECK(ToFileTime(system_clock::from_time_t(0)) == 116444736000000000LL);
+
+    SYSTEMTIME st{};
+    st.wYear = 2026;
+    st.wMonth = 1;
+    st.wDay = 5;
+    st.wMilliseconds = 123;
+    FILETIME ft;
+    CHECK(SystemTimeToFileTime(&st, &ft));
+    int64_t expected = (int64_t)(((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime);
+    CHECK(ToFileTime(kStart + milliseconds(123)) == expected);
+    CHECK(ToFileTime(kStart + milliseconds(123) + nanoseconds(99)) == expected);
+    CHECK(ToFileTime(kStart + minutes(7)) - ToFileTime(kStart) == 7LL * 60 * 10000000);
+}
+
+// Поток планировщика ждет ровно ближайший nextRunTime - без промежуточных опросов;
+// без задач срок нулевой (только Notify)
+TEST(SchedulerWaitsForExactNextRun) {
+    VirtualClock clock(kStart);
+    TaskManager tm(clock, false);
+    tm.AddTask(IntervalTask(L"seven", 7, L""));
+    tm.AddTask(IntervalTask(L"eleven", 11, L""));
+
+    Scheduler sched(&tm, clock);
+    ScriptedHost host(clock, sched, kStart + minutes(60));
+    host.duration = [](const Task&) { return seconds(10); };
+    sched.RunSimulation(&host);
+
+    std::set<Clock::time_point> expected;
+    for (int m = 7; m <= 63; m += 7) expected.insert(kStart + minutes(m));   // 63 - срок после последнего запуска
+    for (int m = 11; m < 60; m += 11) expected.insert(kStart + minutes(m));
+    CHECK(std::set<Clock::time_point>(host.deadlines.begin(), host.deadlines.end()) == expected);
+    CHECK(host.StartsOf(L"seven") == 8 && host.StartsOf(L"eleven") == 5);
+
+    VirtualClock idleClock(kStart);
+    TaskManager idle(idleClock, false);
+    Scheduler idleSched(&idle, idleClock);
+    ScriptedHost idleHost(idleClock, idleSched, kStart + minutes(60));
+    idleSched.RunSimulation(&idleHost);
+    CHECK(idleHost.deadlines.size() == 1);
+    CHECK(idleHost.deadlines[0].time_since_epoch().count() == 0);
+}
+
+namespace {
+    // Задача раз в час (первый запуск - kStart + 60 мин), повторы через 10 с с потолком 40 с:
+    // вся серия проходит до следующего запуска по расписанию
+    TaskPtr RetryTask(uint32_t maxAttempts, const std::wstring& exitCodes = L"") {
+        TaskPtr t = IntervalTask(L"flaky", 60, L"");
+        t->retryMaxAttempts = maxAttempts;
+        t->retryDelaySeconds = 10;
+        t->retryMaxDelaySeconds = 40;
+        t->retryExitCodes = exitCodes;
+        return t;
+    }
+}
+
+// Пауза перед попыткой n - 10 * 2^(n-1) с, не больше 40 с, со случайным разбросом
+// в [пауза/2, пауза]; после последней попытки серия - отказ
+TEST(RetryBacksOffExponentially) {
+    VirtualClock clock(kStart);
+    TaskManager tm(clock, false);
+    tm.AddTask(RetryTask(4));
+
+    Scheduler sched(&tm, clock);
+    ScriptedHost host(clock, sched, kStart + minutes(70));
+    host.duration = [](const Task&) { return seconds(1); };
+    host.exitCode = [](const Task&) { return 1; };
+    sched.RunSimulation(&host);
+
+    CHECK(host.started.size() == 5);
+    CHECK(host.started[0].at == kStart + minutes(60));
+    const int64_t delays[] = { 10, 20, 40, 40 };
+    for (size_t i = 1; i < host.started.size() && i <= 4; ++i) {
+        auto gap = host.started[i].at - (host.started[i - 1].at + seconds(1));
+        CHECK(gap >= milliseconds(delays[i - 1] * 500) && gap <= seconds(delays[i - 1]));
+    }
+
+    TaskPtr task = tm.GetTaskById(L"flaky");
+    CHECK(task->retryRuns == 4);
+    CHECK(task->retryGaveUp == 1 && task->retryRecovered == 0);
+    CHECK(task->retryAttempt == 0);
+    CHECK(task->retryAt.time_since_epoch().count() == 0);
+}
+
+// retryExitCodes: повторяются только перечисленные коды; другой код - отказ без попыток,
+// успех на повторе закрывает серию как восстановленную
+TEST(RetryOnlyListedExitCodes) {
+    for (int round = 0; round < 2; ++round) {
+        VirtualClock clock(kStart);
+        TaskManager tm(clock, false);
+        tm.AddTask(RetryTask(5, L"2, 999"));
+
+        Scheduler sched(&tm, clock);
+        ScriptedHost host(clock, sched, kStart + minutes(70));
+        // round 0: 2, 999, 0 - восстановлена; round 1: 2, 1 - код 1 не повторяется
+        const std::vector<int> codes = round == 0 ? std::vector<int>{ 2, 999, 0 } : std::vector<int>{ 2, 1 };
+        size_t next = 0;
+        host.duration = [](const Task&) { return seconds(1); };
+        host.exitCode = [&](const Task&) { return next < codes.size() ? codes[next++] : 0; };
+        sched.RunSimulation(&host);
+
+        TaskPtr task = tm.GetTaskById(L"flaky");
+        CHECK(host.started.size() == codes.size());
+        CHECK(task->retryRuns == codes.size() - 1);
+        CHECK(task->retryRecovered == (round == 0 ? 1u : 0u));
+        CHECK(task->retryGaveUp == (round == 0 ? 0u : 1u));
+        CHECK(task->retryAttempt == 0);
+    }
+}
+
+// Правка задачи в диалоге, пока ждет повтор: копия из диалога взята до неудачи, но
+// UpdateTask переносит серию по id - повтор приходит на новый объект, счет попыток продолжается
+TEST(RetryStateSurvivesUpdateTask) {
+    VirtualClock clock(kStart);
+    TaskManager tm(clock, false);
+    tm.AddTask(RetryTask(3));
+    auto edited = std::make_shared<Task>(*tm.GetTaskById(L"flaky"));
+    edited->name = L"flaky (edited)";
+
+    Scheduler sched(&tm, clock);
+    ScriptedHost host(clock, sched, kStart + minutes(70));
+    host.duration = [](const Task&) { return seconds(1); };
+    host.exitCode = [](const Task&) { return 1; };
+    bool updated = false;
+    host.afterRun = [&](const TaskPtr& ran) {
+        if (updated) return;
+        updated = true;
+        CHECK(ran->retryAttempt == 1 && ran->retryAt.time_since_epoch().count() != 0);
+        CHECK(edited->retryAttempt == 0);
+        tm.UpdateTask(edited);
+        CHECK(edited->retryAttempt == 1 && edited->retryAt == ran->retryAt);
+    };
+    sched.RunSimulation(&host);
+
+    CHECK(updated);
+    CHECK(host.started.size() == 4);
+    for (size_t i = 1; i < host.started.size(); ++i) CHECK(host.started[i].task == edited);
+    CHECK(tm.GetTaskById(L"flaky") == edited);
+    CHECK(edited->retryRuns == 3);
+    CHECK(edited->retryGaveUp == 1);
+    CHECK(edited->retryAttempt == 0);
+}
@@ -0,0 +1,193 @@
+﻿#include "Tests.h"
+#include "../Cursach/Persistence.h"
+#include "../Cursach/ShardLease.h"
+#include "../Cursach/TaskManager.h"
+#include "../Cursach/Utf8File.h"
+#include <Windows.h>
+#include <set>
+
+namespace {
+    const int kClaimTasks = 64;
+    const int kClaimRounds = 150;
+    const int kSaveTasks = 10;
+
+    // Шард задачи "{ui-save-N}" в тестах сохранения - четность N
+    bool SaveOwner(std::wstring_view id, int parity) {
+        return (id[id.size() - 2] - L'0') % 2 == parity;
+    }
+
+    std::wstring SaveTaskId(int i) { return L"{ui-save-" + std::to_wstring(i) + L"}"; }
+
+    void Touch(const std::wstring& path) {
+        util::Utf8Writer out(path);
+        out.Close();
+    }
+
+    bool WaitForFile(const std::wstring& path) {
+        std::string text;
+        for (int i = 0; i < 1000; ++i) {
+            if (util::ReadFileUtf8(path, text)) return true;
+            Sleep(10);
+        }
+        return false;
+    }
+}
+
+// Экземпляр планировщика: продлевает аренду и забирает срабатывания своих шардов.
+// args: каталог аренд, файл с выигранными срабатываниями, задержка старта (мс)
+CHILD(ShardClaimChild) {
+    Sleep((DWORD)_wtoi(args[2].c_str()));
+    ShardCoordinator shards(args[0], 8, 4);
+    if (!shards.Start()) return 2;
+
+    util::Utf8Writer out(args[1]);
+    if (!out.IsOpen()) return 3;
+    for (int occ = 1; occ <= kClaimRounds; ++occ) {
+        shards.Rebalance();
+        for (int i = 0; i < kClaimTasks; ++i) {
+            std::wstring id = L"claim-" + std::to_wstring(i);
+            if (shards.ClaimOccurrence(id, occ) == ShardCoordinator::Claim::Claimed)
+                out << id << " " << occ << "\n";
+        }
+        Sleep(2);
+    }
+    return out.Close() ? 0 : 4;
+}
+
+// Экземпляр A со списком, прочитанным до сохранения B: правит задачи так, как это делает окно.
+// args: файл "список загружен", файл "можно править"
+CHILD(UiSaveChild) {
+    TaskManager tm;
+    tm.SetSaveFilter([](std::wstring_view id) { return SaveOwner(id, 0); });
+    Touch(args[0]);
+    if (!WaitForFile(args[1])) return 2;
+
+    TaskPtr edited = tm.GetTaskById(SaveTaskId(2));
+    if (!edited) return 3;
+    auto copy = std::make_shared<Task>(*edited);
+    copy->name = L"Edited in the dialog";
+    tm.UpdateTask(copy);
+    tm.RemoveTask(SaveTaskId(4));
+
+    // Новая задача может попасть в чужой шард - она все равно должна дойти до файла
+    auto added = std::make_shared<Task>();
+    added->id = L"{ui-save-new-1}";
+    added->name = L"Added in the dialog";
+    added->exePath = L"C:\\Tools\\added.exe";
+    tm.AddTask(added);
+    return 0;
+}
+
+// Экземпляр B: сохраняет серию повторов своих задач, как проход планировщика
+CHILD(RetrySaveChild) {
+    TaskManager tm;
+    tm.SetSaveFilter([](std::wstring_view id) { return SaveOwner(id, 1); });
+    std::vector<TaskPtr> tasks = tm.GetAllTasks();
+    if (tasks.size() != kSaveTasks) return 2;
+    for (auto& t : tasks) {
+        if (!SaveOwner(t->id, 1)) continue;
+        t->retryAttempt = 2;
+        t->retryRuns = 7;
+    }
+    tm.Save();
+    return 0;
+}
+
+// Сохранение из окна экземпляра A (добавление, правка, удаление и выход) не затирает записи
+// шардов B: серия повторов, которую B записал после загрузки списка в A, остается в файле
+TEST(ShardedUiSaveKeepsPeerRetryState) {
+    std::wstring dir = test::TempDir(L"shard-ui-save");
+    {
+        std::vector<TaskPtr> tasks;
+        for (int i = 0; i < kSaveTasks; ++i) {
+            auto t = std::make_shared<Task>();
+            t->id = SaveTaskId(i);
+            t->name = L"Shard task " + std::to_wstring(i);
+            t->exePath = L"C:\\Tools\\job.exe";
+            t->triggerType = TriggerType::INTERVAL;
+            t->intervalMinutes = 10;
+            tasks.push_back(t);
+        }
+        test::ScopedDataDir data(dir);
+        Persistence store;
+        CHECK(store.Save(tasks));
+    }
+
+    test::ScopedDataDir data(dir);
+    std::wstring loaded = dir + L"\\a-loaded", go = dir + L"\\a-go";
+    void* a = test::StartChild("UiSaveChild", { loaded, go });
+    CHECK(WaitForFile(loaded));
+    void* b = test::StartChild("RetrySaveChild", {});
+    CHECK(test::WaitChild(b) == 0);
+    Touch(go);
+    CHECK(test::WaitChild(a) == 0);
+
+    Persistence store;
+    std::vector<TaskPtr> tasks = store.Load();
+    CHECK(tasks.size() == kSaveTasks);
+    bool added = false;
+    for (auto& t : tasks) {
+        CHECK(std::wstring_view(t->id) != SaveTaskId(4));
+        if (t->id == L"{ui-save-new-1}") { added = true; continue; }
+        if (SaveOwner(t->id, 1)) CHECK(t->retryAttempt == 2 && t->retryRuns == 7);
+        if (std::wstring_view(t->id) == SaveTaskId(2)) CHECK(t->name == L"Edited in the dialog");
+    }
+    CHECK(added);
+}
+
+// Несколько процессов с одним каталогом аренд: шарды переезжают по мере входа экземпляров,
+// но каждое срабатывание выигрывает не больше одного процесса
+TEST(ShardClaimsAreExactlyOnceAcrossProcesses) {
+    std::wstring dir = test::TempDir(L"shard-claims");
+    std::vector<void*> children;
+    for (int k = 0; k < 3; ++k) {
+        children.push_back(test::StartChild("ShardClaimChild",
+            { dir + L"\\leases", dir + L"\\claims-" + std::to_wstring(k) + L".txt", std::to_wstring(k * 60) }));
+    }
+    for (void* c : children) CHECK(test::WaitChild(c) == 0);
+
+    std::set<std::string> seen;
+    for (int k = 0; k < 3; ++k) {
+        std::string text;
+        CHECK(util::ReadFileUtf8(dir + L"\\claims-" + std::to_wstring(k) + L".txt", text));
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t eol = text.find('\n', pos);
+            if (eol == std::string::npos) eol = text.size();
+            CHECK(seen.insert(text.substr(pos, eol - pos)).second);
+            pos = eol + 1;
+        }
+    }
+    // Аренда вообще выдается: выигранных срабатываний не меньше, чем задач в одном раунде
+    CHECK(seen.size() >= (size_t)kClaimTasks);
+}
+
+// Журнал растет на одну запись за срабатывание и уплотняется; следующий владелец шарда
+// (здесь - новый координатор того же процесса) видит последнее срабатывание каждой задачи
+TEST(ShardJournalCompactsAndSurvivesReacquire) {
+    const int kTasks = 10;
+    const int kRounds = 1000;
+    std::wstring dir = test::TempDir(L"shard-journal");
+    {
+        ShardCoordinator shards(dir, 1, 1);
+        CHECK(shards.Start());
+        for (int occ = 1; occ <= kRounds; ++occ) {
+            for (int i = 0; i < kTasks; ++i)
+                CHECK(shards.ClaimOccurrence(L"journal-" + std::to_wstring(i), occ) == ShardCoordinator::Claim::Claimed);
+        }
+        CHECK(shards.ClaimOccurrence(L"journal-0", kRounds) == ShardCoordinator::Claim::AlreadyFired);
+    }
+
+    // kTasks * kRounds записей без уплотнения заняли бы больше 160 КБ
+    std::string journal;
+    CHECK(util::ReadFileUtf8(dir + L"\\shard-0.lease", journal));
+    CHECK(journal.size() < 64 * 1024);
+
+    ShardCoordinator shards(dir, 1, 1);
+    CHECK(shards.Start());
+    for (int i = 0; i < kTasks; ++i) {
+        std::wstring id = L"journal-" + std::to_wstring(i);
+        CHECK(shards.ClaimOccurrence(id, kRounds) == ShardCoordinator::Claim::AlreadyFired);
+        CHECK(shards.ClaimOccurrence(id, kRounds + 1) == ShardCoordinator::Claim::Claimed);
+    }
+}
@@ -0,0 +1,40 @@
+﻿#include "Tests.h"
+#include "../Cursach/StringPool.h"
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// Строка уходит из пула вместе с последней ссылкой; копия держит запись
+TEST(StringPoolReleasesUnreferencedStrings) {
+    size_t before = util::GetStringPoolStats().strings;
+    {
+        std::vector<util::InternedWString> args;
+        for (int i = 0; i < 1000; ++i) args.emplace_back(L"--unique-argument " + std::to_wstring(i));
+        util::InternedWString copy = args[5];
+        CHECK(copy == util::InternedWString(L"--unique-argument 5"));
+        CHECK(util::GetStringPoolStats().strings == before + 1000);
+
+        args.clear();
+        CHECK(copy.str() == L"--unique-argument 5");
+        CHECK(util::GetStringPoolStats().strings == before + 1);
+    }
+    CHECK(util::GetStringPoolStats().strings == before);
+}
+
+// Потоки одновременно берут и отпускают одни и те же строки: запись не удаляется,
+// пока ее держат, и не остается в пуле после последней ссылки
+TEST(StringPoolConcurrentInternAndRelease) {
+    size_t before = util::GetStringPoolStats().strings;
+    std::vector<std::thread> threads;
+    for (int k = 0; k < 4; ++k) {
+        threads.emplace_back([] {
+            for (int i = 0; i < 20000; ++i) {
+                util::InternedWString a(L"shared " + std::to_wstring(i % 7));
+                util::InternedWString b = a;
+                if (b.str() != L"shared " + std::to_wstring(i % 7)) std::abort();
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    CHECK(util::GetStringPoolStats().strings == before);
+}
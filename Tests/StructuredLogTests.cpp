@@ -0,0 +1,156 @@
+﻿#include "Tests.h"
+#include "../Cursach/StructuredLog.h"
+#include "../Cursach/Utf8File.h"
+#include <Windows.h>
+#include <atomic>
+#include <map>
+#include <thread>
+
+namespace {
+    const int kThreads = 4;
+    const int kRecordsPerThread = 3500;   // ~120 байт на запись: больше 1 МБ, но меньше двух
+    const wchar_t kFiller[] = L"0123456789012345678901234567890123456789";
+
+    struct SlogContents {
+        std::map<int32_t, std::vector<int32_t>> seqByThread;   // номера записей по потокам, в порядке файла
+        uint64_t dropped = 0;
+        bool debugSite = false;   // описана точка ниже порога уровня
+    };
+
+    // Проходит записи одного файла: первая - сессия, все выровнены и в пределах файла,
+    // у каждой записи точки описание - раньше нее в этом же файле
+    void ReadSlog(const std::wstring& path, SlogContents& out) {
+        std::string bytes;
+        CHECK(util::ReadFileUtf8(path, bytes));
+        std::map<uint32_t, slog::SiteDesc> sites;
+        size_t pos = 0;
+        bool first = true;
+        while (pos < bytes.size()) {
+            CHECK(pos + sizeof(slog::RecordHeader) <= bytes.size());
+            slog::RecordHeader h;
+            memcpy(&h, bytes.data() + pos, sizeof(h));
+            CHECK(h.size >= sizeof(h) && h.size % 8 == 0 && pos + h.size <= bytes.size());
+            const uint8_t* payload = (const uint8_t*)bytes.data() + pos + sizeof(h);
+            const size_t n = h.size - sizeof(h);
+            CHECK(!first || h.siteId == slog::kSessionRecord);
+            first = false;
+
+            if (h.siteId == slog::kSiteRecord) {
+                slog::SiteDesc d;
+                CHECK(slog::DecodeSite(payload, n, d));
+                if (d.level == (uint32_t)LogLevel::Debug) out.debugSite = true;
+                sites[d.id] = d;
+            }
+            else if (h.siteId == slog::kDroppedRecord) {
+                uint64_t delta;
+                memcpy(&delta, payload, sizeof(delta));
+                out.dropped += delta;
+            }
+            else if (h.siteId != slog::kSessionRecord) {
+                auto site = sites.find(h.siteId);
+                CHECK(site != sites.end());
+                std::vector<slog::ArgValue> args;
+                CHECK(slog::DecodeArgs(site->second, payload, n, args));
+                CHECK(args.size() == 3 && args[2].s == kFiller);
+                out.seqByThread[(int32_t)args[0].i].push_back((int32_t)args[1].i);
+            }
+            pos += h.size;
+        }
+    }
+}
+
+// Несколько потоков пишут больше StructuredMaxMB: файл ротируется по ходу записи, оба файла
+// декодируются сами по себе, каждая запись - либо в файле, либо в счетчике отброшенных.
+// Записи ниже Logger::minLevel_ не пишутся вовсе
+TEST(StructuredLogRotatesUnderLoad) {
+    std::wstring dir = test::TempDir(L"slog-stress");
+    test::ScopedDataDir data(dir);
+    std::wstring ini = dir + L"\\scheduler.ini";
+    WritePrivateProfileStringW(L"Logging", L"Structured", L"1", ini.c_str());
+    WritePrivateProfileStringW(L"Logging", L"StructuredMaxMB", L"1", ini.c_str());
+
+    LogLevel level = g_Logger.GetMinLevel();
+    g_Logger.SetMinLevel(LogLevel::Info);
+    slog::Start();
+    CHECK(slog::Enabled());
+
+    std::vector<std::thread> threads;
+    for (int k = 0; k < kThreads; ++k) {
+        threads.emplace_back([k] {
+            for (int i = 0; i < kRecordsPerThread; ++i) {
+                SLOG(LogLevel::Info, L"Stress", L"thread {} record {} {}", k, i, kFiller);
+                SLOG(LogLevel::Debug, L"Stress", L"below min level {}", i);
+                if (i % 20 == 19) Sleep(1);   // кольцо потока успевает сливаться
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    slog::Stop();
+    g_Logger.SetMinLevel(level);
+
+    WIN32_FILE_ATTRIBUTE_DATA fa;
+    CHECK(GetFileAttributesExW((dir + L"\\scheduler.slog.old").c_str(), GetFileExInfoStandard, &fa));
+    CHECK(fa.nFileSizeLow >= 1024 * 1024 || fa.nFileSizeHigh != 0);
+
+    SlogContents contents;
+    ReadSlog(dir + L"\\scheduler.slog.old", contents);
+    ReadSlog(dir + L"\\scheduler.slog", contents);
+    CHECK(!contents.debugSite);
+
+    uint64_t records = 0;
+    for (auto& [thread, seqs] : contents.seqByThread) {
+        for (size_t i = 1; i < seqs.size(); ++i) CHECK(seqs[i - 1] < seqs[i]);
+        records += seqs.size();
+    }
+    CHECK(records + contents.dropped == (uint64_t)kThreads * kRecordsPerThread);
+    CHECK(records > contents.dropped);
+}
+
+// Stop посреди записи: каждая запись, сделанная в бинарном режиме, - либо в файле, либо
+// в счетчике отброшенных. Поток пишет, пока Enabled(); запись, проскочившая между его
+// проверкой и проверкой в Emit, уходит в текстовый журнал - не больше одной на поток
+TEST(StructuredLogStopAccountsForInFlightRecords) {
+    std::wstring dir = test::TempDir(L"slog-stop");
+    test::ScopedDataDir data(dir);
+    std::wstring ini = dir + L"\\scheduler.ini";
+    WritePrivateProfileStringW(L"Logging", L"Structured", L"1", ini.c_str());
+
+    LogLevel level = g_Logger.GetMinLevel();
+    g_Logger.SetMinLevel(LogLevel::Info);
+    slog::Start();
+    CHECK(slog::Enabled());
+
+    std::atomic<uint64_t> emitted{ 0 };
+    std::vector<std::thread> threads;
+    for (int k = 0; k < kThreads; ++k) {
+        threads.emplace_back([k, &emitted] {
+            int i = 0;
+            for (; slog::Enabled(); ++i) {
+                SLOG(LogLevel::Info, L"Stop", L"thread {} record {} {}", k, i, kFiller);
+                if (i % 20 == 19) Sleep(1);
+            }
+            emitted += (uint64_t)i;
+        });
+    }
+    Sleep(100);
+    slog::Stop();
+    for (auto& t : threads) t.join();
+    g_Logger.SetMinLevel(level);
+
+    SlogContents contents;
+    ReadSlog(dir + L"\\scheduler.slog", contents);
+    uint64_t records = 0;
+    for (auto& [thread, seqs] : contents.seqByThread) {
+        for (size_t i = 1; i < seqs.size(); ++i) CHECK(seqs[i - 1] < seqs[i]);
+        records += seqs.size();
+    }
+    CHECK(records > 0);
+    CHECK(records + contents.dropped <= emitted.load());
+    CHECK(records + contents.dropped + kThreads >= emitted.load());
+
+    // После Stop точки снова пишут в текстовый журнал, кольца не растут
+    SLOG(LogLevel::Info, L"Stop", L"thread {} record {} {}", -1, 0, kFiller);
+    SlogContents after;
+    ReadSlog(dir + L"\\scheduler.slog", after);
+    CHECK(after.seqByThread.count(-1) == 0);
+}
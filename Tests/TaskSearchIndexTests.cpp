@@ -0,0 +1,120 @@
+﻿#include "Tests.h"
+#include "../Cursach/TaskSearchIndex.h"
+#include <algorithm>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+    // Маленький алфавит с регистром и кириллицей: триграммы часто повторяются,
+    // списки длинные, пересечение и проверка кандидатов идут по обеим ветвям
+    const wchar_t kAlphabet[] = L"abcABC xy\x0430\x0431\x0410\x0401\x0451.";
+
+    std::wstring RandomText(std::mt19937& rng, size_t maxLen) {
+        std::uniform_int_distribution<size_t> len(0, maxLen);
+        std::uniform_int_distribution<size_t> pick(0, std::size(kAlphabet) - 2);
+        std::wstring s(len(rng), L'\0');
+        for (auto& c : s) c = kAlphabet[pick(rng)];
+        return s;
+    }
+
+    wchar_t Lower(wchar_t c) {
+        if (c >= L'A' && c <= L'Z') return c - L'A' + L'a';
+        if (c >= 0x0410 && c <= 0x042F) return c + 0x20;
+        if (c == 0x0401) return 0x0451;
+        return c;
+    }
+
+    std::wstring Lower(std::wstring_view text) {
+        std::wstring s(text);
+        for (auto& c : s) c = Lower(c);
+        return s;
+    }
+
+    bool ScanField(std::wstring_view text, std::wstring_view query, SearchMode mode) {
+        std::wstring t = Lower(text), q = Lower(query);
+        return mode == SearchMode::Prefix ? t.compare(0, q.size(), q) == 0 && t.size() >= q.size()
+                                          : t.find(q) != std::wstring::npos;
+    }
+
+    // Эталон: перебор задач в порядке последнего добавления
+    std::vector<TaskPtr> Scan(const std::vector<TaskPtr>& order, const std::wstring& query,
+        SearchMode mode, uint32_t fields, size_t limit) {
+        std::vector<TaskPtr> out;
+        for (const auto& t : order) {
+            bool hit = ((fields & SEARCH_NAME) && ScanField(t->name, query, mode)) ||
+                ((fields & SEARCH_DESCRIPTION) && ScanField(t->description, query, mode)) ||
+                ((fields & SEARCH_EXE) && ScanField(t->exePath.str(), query, mode));
+            if (!hit) continue;
+            out.push_back(t);
+            if (limit && out.size() == limit) break;
+        }
+        return out;
+    }
+
+    TaskPtr RandomTask(std::mt19937& rng, std::wstring_view id) {
+        auto t = std::make_shared<Task>();
+        t->id = id;
+        t->name = RandomText(rng, 12);
+        t->description = RandomText(rng, 20);
+        t->exePath = RandomText(rng, 10);
+        return t;
+    }
+}
+
+// Индекс выдает ровно то же, что и перебор, в том же порядке: запросы 0-6 символов,
+// оба режима, все наборы полей и лимиты, между сериями запросов - добавления, правки
+// и удаления (их хватает, чтобы индекс несколько раз пересобрался)
+TEST(SearchIndexMatchesLinearScan) {
+    std::mt19937 rng(20261019);
+    TaskSearchIndex index;
+    std::vector<TaskPtr> order;
+    int nextId = 0;
+
+    for (int i = 0; i < 300; ++i) order.push_back(RandomTask(rng, L"{t" + std::to_wstring(nextId++) + L"}"));
+    index.Rebuild(order);
+
+    size_t queries = 0, mismatches = 0, hits = 0;
+    for (int round = 0; round < 40; ++round) {
+        for (int op = 0; op < 100; ++op) {
+            int kind = (int)(rng() % 3);
+            if (kind == 0 || order.empty()) {
+                order.push_back(RandomTask(rng, L"{t" + std::to_wstring(nextId++) + L"}"));
+                index.Add(order.back());
+            } else {
+                size_t at = rng() % order.size();
+                TaskPtr old = order[at];
+                order.erase(order.begin() + at);
+                if (kind == 1) {
+                    order.push_back(RandomTask(rng, old->id));   // правка - новый номер, конец выдачи
+                    index.Add(order.back());
+                } else {
+                    index.Remove(old->id);
+                }
+            }
+        }
+
+        for (int q = 0; q < 60; ++q) {
+            std::wstring query = RandomText(rng, 6);
+            SearchMode mode = rng() % 2 ? SearchMode::Prefix : SearchMode::Substring;
+            uint32_t fields = 1 + rng() % SEARCH_ALL;
+            size_t limit = rng() % 4 == 0 ? 1 + rng() % 5 : 0;
+
+            auto expected = Scan(order, query, mode, fields, limit);
+            auto got = index.Search(query, mode, fields, limit);
+            ++queries;
+            hits += expected.size();
+            if (got != expected) ++mismatches;
+            for (const auto& t : got) {
+                if (!TaskSearchIndex::Matches(*t, query, mode, fields)) ++mismatches;
+            }
+        }
+    }
+
+    CHECK(mismatches == 0);
+    CHECK(hits > queries);   // запросы не вырождены в пустую выдачу
+    auto stats = index.GetStats();
+    CHECK(stats.liveDocs == order.size());
+    CHECK(stats.docs < 2048);   // удаленные номера не копятся без предела
+}
@@ -0,0 +1,122 @@
+﻿#include "Tests.h"
+#include "../Cursach/TaskManager.h"
+#include "../Cursach/TaskViewModel.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace {
+    TaskPtr MakeTask(const std::wstring& id, const std::wstring& name, bool enabled = true) {
+        auto t = std::make_shared<Task>();
+        t->id = id;
+        t->name = name;
+        t->enabled = enabled;
+        t->triggerType = TriggerType::ONCE;   // без nextRunTime: CalculateNextRun не трогает порядок
+        return t;
+    }
+
+    std::wstring ViewId(int i) { return L"{view-" + std::to_wstring(i) + L"}"; }
+
+    std::vector<std::wstring> VisibleNames(const TaskViewModel& vm) {
+        std::vector<std::wstring> names;
+        TaskViewModel::Row row;
+        for (size_t i = 0; vm.RowAt(i, row); ++i) names.push_back(row.name);
+        return names;
+    }
+
+    // Ожидаемый порядок по имени: полная сортировка текущего списка TaskManager
+    std::vector<std::wstring> SortedNames(TaskManager& tm) {
+        std::vector<std::wstring> names;
+        for (const auto& t : tm.GetAllTasks()) names.emplace_back(t->name);
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    void Rename(TaskManager& tm, const std::wstring& id, const std::wstring& name) {
+        auto copy = std::make_shared<Task>(*tm.GetTaskById(id));
+        copy->name = name;
+        tm.UpdateTask(copy);
+    }
+}
+
+// События копятся до TakeChanges; одиночные правки встают на место сдвигом,
+// и порядок совпадает с полной сортировкой после каждого шага
+TEST(ViewModelIndexOrderAfterAddUpdateRemove) {
+    TaskManager tm(Clock::System(), false);
+    for (int i = 0; i < 40; ++i) tm.AddTask(MakeTask(ViewId(i), L"task " + std::to_wstring(100 + (i * 37) % 40)));
+
+    TaskViewModel vm(&tm);
+    vm.SetSort(TaskViewModel::SortKey::Name, false);
+    CHECK(VisibleNames(vm) == SortedNames(tm));
+
+    tm.AddTask(MakeTask(ViewId(40), L"task 000"));
+    CHECK(vm.Count() == 40);   // еще не разобрано
+    TaskViewModel::Changes c = vm.TakeChanges();
+    CHECK(c.any && c.countChanged && c.first == 0);
+    CHECK(vm.Count() == 41);
+    CHECK(VisibleNames(vm) == SortedNames(tm));
+
+    Rename(tm, ViewId(40), L"task 999");
+    c = vm.TakeChanges();
+    CHECK(c.any && vm.Count() == 41);
+    CHECK(VisibleNames(vm) == SortedNames(tm));
+    CHECK(VisibleNames(vm).back() == L"task 999");
+
+    tm.RemoveTask(ViewId(3));
+    tm.RemoveTask(ViewId(17));
+    c = vm.TakeChanges();
+    CHECK(c.any && c.countChanged);
+    CHECK(vm.Count() == 39);
+    CHECK(VisibleNames(vm) == SortedNames(tm));
+
+    // Большая пачка - пересортировка индексов целиком; результат тот же
+    for (int i = 0; i < 41; i += 2) {
+        if (i == 3 || i == 17) continue;
+        Rename(tm, ViewId(i), L"renamed " + std::to_wstring(1000 - i));
+    }
+    vm.TakeChanges();
+    CHECK(VisibleNames(vm) == SortedNames(tm));
+
+    // Группировка по статусу: выключенные - после включенных, внутри - по имени
+    auto off = std::make_shared<Task>(*tm.GetTaskById(ViewId(0)));
+    off->enabled = false;
+    tm.UpdateTask(off);
+    vm.TakeChanges();
+    vm.SetSort(TaskViewModel::SortKey::Name, true);
+    TaskViewModel::Row row;
+    CHECK(vm.RowAt(vm.Count() - 1, row) && std::wstring_view(row.task->id) == ViewId(0));
+    CHECK(vm.GetCounters().disabled == 1);
+}
+
+// Несколько событий одной задачи до разбора - одна строка; добавленная и сразу
+// удаленная задача не появляется вовсе
+TEST(ViewModelCoalescesQueuedEvents) {
+    TaskManager tm(Clock::System(), false);
+    for (int i = 0; i < 20; ++i) tm.AddTask(MakeTask(ViewId(i), L"task " + std::to_wstring(100 + i)));
+
+    TaskViewModel vm(&tm);
+    int wakeups = 0;
+    vm.SetOnChanged([&wakeups] { ++wakeups; });
+    vm.SetSort(TaskViewModel::SortKey::Name, false);
+    vm.TakeChanges();
+    wakeups = 0;
+
+    tm.AddTask(MakeTask(ViewId(20), L"task 050"));
+    Rename(tm, ViewId(20), L"task 060");
+    Rename(tm, ViewId(20), L"task 070");
+    Rename(tm, ViewId(5), L"task 200");
+    Rename(tm, ViewId(5), L"task 201");
+    tm.AddTask(MakeTask(ViewId(21), L"task 080"));
+    tm.RemoveTask(ViewId(21));
+    CHECK(wakeups == 1);   // окно будится один раз на пачку
+
+    vm.TakeChanges();
+    std::vector<std::wstring> names = VisibleNames(vm);
+    CHECK(names.size() == 21);
+    CHECK(names.front() == L"task 070");
+    CHECK(names.back() == L"task 201");
+    CHECK(names == SortedNames(tm));
+
+    Rename(tm, ViewId(1), L"task 300");
+    CHECK(wakeups == 2);
+}
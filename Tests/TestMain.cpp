@@ -0,0 +1,132 @@
+﻿#include "Tests.h"
+#include <Windows.h>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+namespace test {
+
+    namespace {
+        struct Failure : std::runtime_error {
+            using std::runtime_error::runtime_error;
+        };
+
+        void RemoveTree(const std::wstring& dir) {
+            WIN32_FIND_DATAW fd;
+            HANDLE h = FindFirstFileW((dir + L"\\*").c_str(), &fd);
+            if (h != INVALID_HANDLE_VALUE) {
+                do {
+                    std::wstring name = fd.cFileName;
+                    if (name == L"." || name == L"..") continue;
+                    std::wstring path = dir + L"\\" + name;
+                    if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) RemoveTree(path);
+                    else DeleteFileW(path.c_str());
+                } while (FindNextFileW(h, &fd));
+                FindClose(h);
+            }
+            RemoveDirectoryW(dir.c_str());
+        }
+    }
+
+    std::vector<Case>& Registry() {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    void Fail(const char* file, int line, const std::string& what) {
+        throw Failure(std::string(file) + ":" + std::to_string(line) + ": " + what);
+    }
+
+    std::wstring TempDir(const std::wstring& name) {
+        wchar_t tmp[MAX_PATH] = {};
+        GetTempPathW(MAX_PATH, tmp);
+        std::wstring dir = std::wstring(tmp) + L"MiniTaskSchedulerTests";
+        CreateDirectoryW(dir.c_str(), NULL);
+        dir += L"\\" + name;
+        RemoveTree(dir);
+        CreateDirectoryW(dir.c_str(), NULL);
+        return dir;
+    }
+
+    ScopedDataDir::ScopedDataDir(const std::wstring& dir) {
+        SetEnvironmentVariableW(L"MTS_DATA_DIR", dir.c_str());
+    }
+
+    ScopedDataDir::~ScopedDataDir() {
+        SetEnvironmentVariableW(L"MTS_DATA_DIR", NULL);
+    }
+
+    int RunCommand(int (*command)(int, wchar_t**), std::vector<std::wstring> args) {
+        args.insert(args.begin(), L"Tests.exe");
+        std::vector<wchar_t*> argv;
+        for (auto& a : args) argv.push_back(&a[0]);
+        return command((int)argv.size(), argv.data());
+    }
+
+    std::vector<ChildCase>& Children() {
+        static std::vector<ChildCase> children;
+        return children;
+    }
+
+    void* StartChild(const char* name, const std::vector<std::wstring>& args) {
+        wchar_t exe[MAX_PATH] = {};
+        GetModuleFileNameW(NULL, exe, MAX_PATH);
+        std::wstring cmd = L"\"" + std::wstring(exe) + L"\" --child " + std::wstring(name, name + strlen(name));
+        for (auto& a : args) cmd += L" \"" + a + L"\"";
+
+        STARTUPINFOW si{};
+        si.cb = sizeof(si);
+        PROCESS_INFORMATION pi{};
+        if (!CreateProcessW(NULL, &cmd[0], NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi)) return nullptr;
+        CloseHandle(pi.hThread);
+        return pi.hProcess;
+    }
+
+    int WaitChild(void* process) {
+        if (!process) return -1;
+        WaitForSingleObject(process, INFINITE);
+        DWORD code = (DWORD)-1;
+        GetExitCodeProcess(process, &code);
+        CloseHandle(process);
+        return (int)code;
+    }
+
+} // namespace test
+
+static int RunChild(int argc, wchar_t** argv) {
+    std::wstring wanted = argv[2];
+    for (const test::ChildCase& c : test::Children()) {
+        if (std::wstring(c.name, c.name + strlen(c.name)) != wanted) continue;
+        try {
+            return c.fn(std::vector<std::wstring>(argv + 3, argv + argc));
+        }
+        catch (const std::exception& e) {
+            printf("[ FAIL ] child %s\n         %s\n", c.name, e.what());
+            return 1;
+        }
+    }
+    printf("Unknown child: %ls\n", argv[2]);
+    return 1;
+}
+
+int wmain(int argc, wchar_t** argv) {
+    if (argc > 2 && wcscmp(argv[1], L"--child") == 0) return RunChild(argc, argv);
+    std::wstring filter = argc > 1 ? argv[1] : L"";
+    int failed = 0, run = 0;
+    for (const test::Case& c : test::Registry()) {
+        std::wstring name(c.name, c.name + strlen(c.name));
+        if (!filter.empty() && name.find(filter) == std::wstring::npos) continue;
+        ++run;
+        try {
+            c.fn();
+            printf("[  OK  ] %s\n", c.name);
+        }
+        catch (const std::exception& e) {
+            ++failed;
+            printf("[ FAIL ] %s\n         %s\n", c.name, e.what());
+        }
+    }
+    printf("%d test(s), %d failed\n", run, failed);
+    return failed;
+}
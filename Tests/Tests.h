@@ -0,0 +1,79 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+
+// Минимальный раннер без внешних зависимостей:
+//
+//   TEST(EscapeRoundTrip) {
+//       CHECK(util::json::Unescape(util::json::Escape(s)) == s);
+//   }
+//
+// Tests.exe [подстрока имени] - запускает все тесты или только совпавшие; код выхода - число упавших.
+// Tests.exe --child <имя> [аргументы] - тело CHILD(имя) для многопроцессных тестов (StartChild).
+namespace test {
+
+    struct Case {
+        const char* name;
+        void (*fn)();
+    };
+
+    std::vector<Case>& Registry();
+
+    struct Register {
+        Register(const char* name, void (*fn)()) { Registry().push_back(Case{ name, fn }); }
+    };
+
+    // Бросает исключение, которое раннер засчитывает как провал текущего теста
+    [[noreturn]] void Fail(const char* file, int line, const std::string& what);
+
+    // Пустой каталог под %TEMP% для теста (содержимое прошлого запуска удаляется)
+    std::wstring TempDir(const std::wstring& name);
+
+    // Каталог данных (MTS_DATA_DIR) на время теста: tasks.json, runtime.dat и т.п. - в dir
+    class ScopedDataDir {
+    public:
+        explicit ScopedDataDir(const std::wstring& dir);
+        ~ScopedDataDir();
+        ScopedDataDir(const ScopedDataDir&) = delete;
+        ScopedDataDir& operator=(const ScopedDataDir&) = delete;
+    };
+
+    // Режим командной строки (RunImportCommand и т.п.) с аргументами после имени программы
+    int RunCommand(int (*command)(int, wchar_t**), std::vector<std::wstring> args);
+
+    // Тело дочернего процесса: код выхода 0 - успех (CHECK в нем - код 1)
+    struct ChildCase {
+        const char* name;
+        int (*fn)(const std::vector<std::wstring>& args);
+    };
+
+    std::vector<ChildCase>& Children();
+
+    struct RegisterChild {
+        RegisterChild(const char* name, int (*fn)(const std::vector<std::wstring>&)) {
+            Children().push_back(ChildCase{ name, fn });
+        }
+    };
+
+    // Запускает CHILD(name) отдельным процессом Tests.exe (окружение, в т.ч. MTS_DATA_DIR, наследуется)
+    // и не ждет его. Возвращает дескриптор процесса, nullptr - не запустился
+    void* StartChild(const char* name, const std::vector<std::wstring>& args);
+    // Дожидается процесса StartChild и закрывает дескриптор; код выхода, -1 - процесса нет
+    int WaitChild(void* process);
+
+} // namespace test
+
+#define TEST(name)                                                   \
+    static void name();                                              \
+    static ::test::Register name##_registration(#name, name);        \
+    static void name()
+
+#define CHILD(name)                                                              \
+    static int name(const std::vector<std::wstring>& args);                      \
+    static ::test::RegisterChild name##_registration(#name, name);               \
+    static int name(const std::vector<std::wstring>& args)
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) ::test::Fail(__FILE__, __LINE__, #cond);                \
+    } while (0)